@@ -7,4 +7,6 @@
 #include <quic/network.hpp>
 #include <quic/opt.hpp>
 #include <quic/stream.hpp>
+#include <quic/stripe.hpp>
+#include <quic/tunnel.hpp>
 #include <quic/utils.hpp>
@@ -2,6 +2,7 @@
 
 #include <ngtcp2/ngtcp2.h>
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
@@ -17,6 +18,8 @@
 
 namespace oxen::quic
 {
+    class datagram_fec;
+
     /*
         TODO:
         - tls creds and session?
@@ -29,7 +32,9 @@ namespace oxen::quic
             - fail cases
     */
 
-    class connection_interface
+    // Connections carry a user data slot (see user_data_slot) for associating application state
+    // with the connection.
+    class connection_interface : public user_data_slot
     {
       public:
         virtual std::shared_ptr<Stream> get_new_stream(
@@ -37,6 +42,15 @@ namespace oxen::quic
 
         virtual const ConnectionID& scid() const = 0;
 
+        // Queues an unreliable datagram to the remote (see opt::enable_datagrams).  The data is
+        // copied.  Throws std::logic_error if datagrams are not enabled on this connection.
+        virtual void send_datagram(bstring_view data) = 0;
+
+        // Returns the largest datagram send_datagram() can currently send: what fits in a packet on
+        // the connection's path, less the FEC header and parity overhead if FEC is enabled.  This
+        // can grow as path MTU discovery raises the packet size.  Larger datagrams are dropped.
+        virtual size_t max_datagram_size() const = 0;
+
         virtual ~connection_interface() = default;
     };
 
@@ -67,6 +81,8 @@ namespace oxen::quic
                 Direction dir,
                 ngtcp2_pkt_hd* hdr = nullptr);
 
+        ~Connection() override;
+
         void io_ready();
 
         const TLSSession* get_session() const { return tls_session.get(); };
@@ -74,6 +90,15 @@ namespace oxen::quic
         std::shared_ptr<Stream> get_new_stream(
                 stream_data_callback_t data_cb = nullptr, stream_close_callback_t close_cb = nullptr) override;
 
+        void send_datagram(bstring_view data) override;
+        size_t max_datagram_size() const override { return max_datagram; }
+
+        // Test hook: outgoing datagrams (as framed for the wire, i.e. with any FEC header) for which
+        // `drop` returns true are discarded instead of being sent, as if lost in transit (though
+        // without ngtcp2 seeing them, so they don't count towards FEC's loss rate).  Pass nullptr
+        // to stop dropping.
+        void simulate_datagram_loss(std::function<bool(bstring_view dgram)> drop);
+
         Direction direction() const { return dir; }
         bool is_inbound() const { return dir == Direction::INBOUND; }
         bool is_outbound() const { return dir == Direction::OUTBOUND; }
@@ -94,6 +119,12 @@ namespace oxen::quic
         const Endpoint& endpoint() const { return _endpoint; }
 
       private:
+        friend class Endpoint;
+
+        // Returns the full traffic class (TOS) byte for an outgoing packet: our DSCP (see
+        // opt::dscp) combined with the packet's ECN bits.
+        uint8_t traffic_class(uint8_t ecn) const { return static_cast<uint8_t>(user_config.dscp << 2) | ecn; }
+
         std::shared_ptr<ContextBase> context;
         config_t user_config;
         Direction dir;
@@ -126,6 +157,13 @@ namespace oxen::quic
 
         void setup_tls_session(bool is_client);
 
+        // Stream compression (see opt::stream_compression) is negotiated in the handshake, so a
+        // stream's codec is created with the stream but only kept, once the stream opens, if the
+        // peer agreed to it; data sent before then is held back unencoded and encoded at that
+        // point.  The ALPN is settled by the time any stream can open.
+        void add_stream_codec(Stream& s);
+        void settle_stream_codec(Stream& s);
+
         std::shared_ptr<TLSCreds> tls_creds;
         std::unique_ptr<TLSSession> tls_session;
 
@@ -139,13 +177,66 @@ namespace oxen::quic
 
         void flush_streams(std::chrono::steady_clock::time_point tp);
 
-        std::array<std::byte, NGTCP2_MAX_PMTUD_UDP_PAYLOAD_SIZE * DATAGRAM_BATCH_SIZE> send_buffer;
+        // Sized to hold DATAGRAM_BATCH_SIZE packets of the endpoint's max UDP payload size.  With
+        // zero-copy sends (opt::zerocopy_send) the socket can keep the buffer pinned after sending
+        // until the kernel is done with it, so we then swap it for one of the spare buffers.
+        std::shared_ptr<std::vector<std::byte>> send_buffer;
+        std::vector<std::shared_ptr<std::vector<std::byte>>> spare_send_buffers;
+
+        // Returns a spare send buffer not currently pinned by the socket, allocating one if needed
+        // (up to a limit); returns nullptr if all are pinned.
+        std::shared_ptr<std::vector<std::byte>> spare_send_buffer();
         std::array<size_t, DATAGRAM_BATCH_SIZE> send_buffer_size;
         uint8_t send_ecn = 0;
         size_t n_packets = 0;
 
         void schedule_retransmit(std::chrono::steady_clock::time_point ts);
 
+        // Per-connection egress rate limit (see opt::rate_limit); if we or the endpoint are
+        // currently rate limited with stream data waiting, `throttled_until` is when we can resume
+        // (which schedule_retransmit wakes us up for).
+        std::optional<token_bucket> rate_limiter;
+        std::optional<std::chrono::steady_clock::time_point> throttled_until;
+        throttle_timer throttled;
+
+        // Refills the connection and endpoint rate limit buckets and returns true if neither (where
+        // present) is dry.
+        bool rate_limit_ready(std::chrono::steady_clock::time_point now);
+
+        // Consumes tokens for a sent packet from the connection and endpoint buckets.
+        void rate_limit_consume(size_t bytes);
+
+        // Records that the given rate limit state held back (or did not hold back) pending stream
+        // data, updating throttled time accounting and `throttled_until`.
+        void update_throttled(bool held_back, std::chrono::steady_clock::time_point now);
+
+        // Outgoing datagrams (already FEC-framed, if enabled) waiting to be written, and the FEC
+        // codec if enabled (see opt::enable_datagrams).
+        std::deque<bstring> pending_datagrams;
+        std::unique_ptr<datagram_fec> fec;
+        // ID given to ngtcp2 for the next datagram, for its ack/loss notifications
+        uint64_t next_datagram_id{0};
+        // Cached max_datagram_size(), updated on the event loop thread whenever we send
+        std::atomic<size_t> max_datagram{0};
+        std::function<bool(bstring_view)> datagram_drop;
+
+        // Updates `max_datagram` for the path's current max packet size, returning the largest
+        // datagram (as framed for the wire) that fits in a packet.
+        size_t update_max_datagram();
+
+        // Writes pending datagrams into packets in the send buffer (ahead of stream data), sending
+        // full batches as we go.  Returns false if the caller should return immediately (as for
+        // send()).
+        bool flush_datagrams(
+                uint8_t*& buf_pos,
+                size_t max_packet_size,
+                std::chrono::steady_clock::time_point tp,
+                pkt_tx_timer_updater& pkt_updater);
+
+        // PMTUD probe sizes given to ngtcp2 (settings.pmtud_probes only takes a pointer, so we keep
+        // the storage alive alongside the connection).
+        std::vector<uint16_t> pmtud_probes;
+
         const std::shared_ptr<Stream>& get_stream(int64_t ID) const;
 
         int get_streams_available();
@@ -153,12 +244,32 @@ namespace oxen::quic
         bool draining = false;
         bool closing = false;
 
+        // Additional (non-primary) connection IDs registered for this connection in the endpoint
+        std::vector<ConnectionID> cid_aliases;
+
+        // Stateless reset tokens of the peer's connection IDs, registered in the endpoint
+        std::vector<reset_token> peer_reset_tokens;
+
         // holds a mapping of active streams
         std::map<int64_t, std::shared_ptr<Stream>> streams;
         // holds queue of pending streams not yet ready to broadcast
         // streams are added to the back and popped from the front (FIFO)
         std::deque<std::shared_ptr<Stream>> pending_streams;
 
+        // IDs of streams with buffered received data awaiting delivery (batched delivery mode)
+        std::vector<int64_t> pending_recv_streams;
+
+        // Invokes the stream's data callback, closing the stream if it throws.  Returns false if
+        // the callback threw.
+        bool deliver_stream_data(Stream& str, bstring_view data);
+
+        // Delivers and clears the stream's buffered received data; returns false if the callback
+        // threw.
+        bool deliver_buffered_stream_data(Stream& str);
+
+        // Delivers buffered received data for all streams; called at the end of each receive batch.
+        void flush_received_stream_data();
+
       public:
         // Buffer used to store non-stream connection data
         //  ex: initial transport params
@@ -169,6 +280,11 @@ namespace oxen::quic
         int stream_receive(int64_t id, bstring_view data, bool fin);
         void stream_closed(int64_t id, uint64_t app_code);
         void check_pending_streams(int available);
+        int new_connection_id(ngtcp2_cid* cid, uint8_t* token, size_t cidlen);
+        void remove_connection_id(const ngtcp2_cid* cid);
+        void peer_reset_token(bool active, const uint8_t* token);
+        int datagram_received(bstring_view data);
+        void datagram_feedback(bool lost);
 
         // Implicit conversion of Connection to the underlying ngtcp2_conn* (so that you can pass a
         // Connection directly to ngtcp2 functions taking a ngtcp2_conn* argument).
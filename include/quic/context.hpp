@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <unordered_map>
 
 #include "crypto.hpp"
@@ -17,6 +18,24 @@ namespace oxen::quic
         // max streams
         int max_streams = 0;
 
+        // aggregated stream data delivery threshold (see opt::batch_stream_data); 0 to disable
+        size_t batch_stream_data = 0;
+
+        // ACK tuning (see opt::ack_frequency); unset to use the ngtcp2 defaults
+        std::optional<opt::ack_frequency> ack_frequency;
+
+        // Per-connection egress rate limit (see opt::rate_limit)
+        std::optional<opt::rate_limit> rate_limit;
+
+        // DSCP to mark outgoing packets with (see opt::dscp)
+        uint8_t dscp = 0;
+
+        // Per-stream compression settings (see opt::stream_compression); unset if disabled
+        std::optional<opt::stream_compression> stream_compression;
+
+        // DATAGRAM frame settings (see opt::enable_datagrams); unset if disabled
+        std::optional<opt::enable_datagrams> datagrams;
+
         config_t() = default;
     };
 
@@ -27,6 +46,8 @@ namespace oxen::quic
         stream_data_callback_t stream_data_cb;
         stream_open_callback_t stream_open_cb;
         stream_close_callback_t stream_close_cb;
+        std::shared_ptr<stream_handler> stream_data_handler;
+        datagram_data_callback_t datagram_data_cb;
         config_t config{};
 
         // TODO: I think we can move the handle_opt calls here
@@ -49,9 +70,17 @@ namespace oxen::quic
       private:
         void handle_outbound_opt(std::shared_ptr<TLSCreds> tls);
         void handle_outbound_opt(opt::max_streams ms);
+        void handle_outbound_opt(opt::batch_stream_data bsd);
+        void handle_outbound_opt(opt::ack_frequency af);
+        void handle_outbound_opt(opt::stream_compression sc);
+        void handle_outbound_opt(opt::enable_datagrams ed);
+        void handle_outbound_opt(opt::dscp d);
+        void handle_outbound_opt(opt::rate_limit rl);
         void handle_outbound_opt(stream_data_callback_t func);
         void handle_outbound_opt(stream_open_callback_t func);
         void handle_outbound_opt(stream_close_callback_t func);
+        void handle_outbound_opt(std::shared_ptr<stream_handler> handler);
+        void handle_outbound_opt(datagram_data_callback_t func);
     };
 
     struct InboundContext : public ContextBase
@@ -69,9 +98,17 @@ namespace oxen::quic
       private:
         void handle_inbound_opt(std::shared_ptr<TLSCreds> tls);
         void handle_inbound_opt(opt::max_streams ms);
+        void handle_inbound_opt(opt::batch_stream_data bsd);
+        void handle_inbound_opt(opt::ack_frequency af);
+        void handle_inbound_opt(opt::stream_compression sc);
+        void handle_inbound_opt(opt::enable_datagrams ed);
+        void handle_inbound_opt(opt::dscp d);
+        void handle_inbound_opt(opt::rate_limit rl);
         void handle_inbound_opt(stream_data_callback_t func);
         void handle_inbound_opt(stream_open_callback_t func);
         void handle_inbound_opt(stream_close_callback_t func);
+        void handle_inbound_opt(std::shared_ptr<stream_handler> handler);
+        void handle_inbound_opt(datagram_data_callback_t func);
     };
 
     /*
@@ -6,6 +6,9 @@ extern "C"
 }
 
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "utils.hpp"
 
@@ -28,6 +31,15 @@ namespace oxen::quic
 
       public:
         virtual void* get_session() = 0;
+
+        // Sets the application protocols (ALPN) to offer, for a client, or to accept, for a server.
+        // Must be called before the handshake starts.
+        virtual void set_alpns(const std::vector<std::string>& protocols) = 0;
+
+        // Returns the application protocol agreed in the handshake, or an empty string if none was
+        // (or the handshake hasn't got that far yet).
+        virtual std::string_view selected_alpn() const = 0;
+
         virtual ~TLSSession() { log::trace(log_cat, "{} called", __PRETTY_FUNCTION__); }
     };
 
@@ -17,6 +17,7 @@ extern "C"
 #include <event2/event.h>
 
 #include <cstddef>
+#include <atomic>
 #include <list>
 #include <memory>
 #include <numeric>
@@ -34,6 +35,41 @@ extern "C"
 
 namespace oxen::quic
 {
+    class handoff_channel;
+
+    // Read-only summary of a connection's state at the time an endpoint's connection snapshot was
+    // taken.  These are plain copies, so they can be read from any thread without touching (or
+    // keeping alive) the Connection itself.
+    struct connection_summary
+    {
+        ConnectionID scid;
+        ConnectionID dcid;
+        Path path;
+        Direction direction;
+        bool closing;
+        bool draining;
+        size_t streams;          // Open streams
+        size_t pending_streams;  // Streams waiting for the remote to allow more streams
+        std::chrono::nanoseconds throttled;  // Total time held back by rate limits (opt::rate_limit)
+        std::chrono::nanoseconds smoothed_rtt;
+        std::chrono::nanoseconds min_rtt;
+        uint64_t cwnd;
+        uint64_t bytes_in_flight;
+    };
+
+    // Immutable snapshot of an endpoint's connections, published periodically by the event loop.
+    // A snapshot is never modified once published (a newer snapshot replaces it instead), so any
+    // number of threads can hold and iterate one without locking or blocking the event loop.
+    struct connection_snapshot
+    {
+        // Incremented each time the endpoint publishes a new snapshot
+        uint64_t epoch{0};
+        std::chrono::steady_clock::time_point taken;
+        // Total time the endpoint-wide rate limit (if any) has held back sending
+        std::chrono::nanoseconds throttled{0};
+        std::vector<connection_summary> connections;
+    };
+
     class Endpoint : std::enable_shared_from_this<Endpoint>
     {
         friend class Network;
@@ -44,8 +80,72 @@ namespace oxen::quic
         event_ptr expiry_timer;
         std::unique_ptr<UDPSocket> socket;
         bool accepting_inbound{false};
+        bool use_connected_socket{false};
+        size_t max_udp_payload{max_payload_size};
         Network& net;
 
+        void handle_ep_opt(opt::connected_socket);
+        void handle_ep_opt(opt::max_udp_payload mup);
+        void handle_ep_opt(opt::static_secret ss);
+        void handle_ep_opt(opt::socket_buffers sb);
+        void handle_ep_opt(opt::socket_buffer_autotune at);
+        void handle_ep_opt(opt::unix_transport ut);
+        void handle_ep_opt(opt::rate_limit rl);
+        void handle_ep_opt(opt::zerocopy_send zc);
+        void handle_ep_opt(opt::xdp x);
+        void handle_ep_opt(opt::dual_stack);
+        void handle_ep_opt(opt::inherit_socket is);
+
+        std::optional<std::string> unix_dir;
+        std::optional<opt::zerocopy_send> zerocopy;
+        std::optional<opt::xdp> xdp;
+        bool dual_stack{false};
+        std::optional<opt::inherit_socket> inherit;
+
+        // Channel to the other process of a zero-downtime restart, if there is one: in the new
+        // process (opt::inherit_socket) we forward packets for the old process's connections
+        // through it; in the old process (hand_off()) it delivers those packets to us.
+        std::shared_ptr<handoff_channel> handoff;
+        std::function<void()> handoff_drained;
+
+        // Called from check_timeouts while there is a handoff channel.  In the old process, once
+        // the new process has taken the socket and our last connection has gone, this closes the
+        // channel and invokes the `drained` callback given to hand_off(); in the new process it
+        // drops the channel once the old process has closed it.
+        void check_handoff_drained();
+
+        // Endpoint-wide egress rate limit shared by all connections (see opt::rate_limit), and the
+        // time it has spent holding back connections.
+        std::optional<token_bucket> rate_limiter;
+        throttle_timer throttled;
+
+        opt::socket_buffers socket_buffers;
+        std::optional<opt::socket_buffer_autotune> buffer_autotune;
+
+        // Socket counters as of the last autotune check, and the current (requested) buffer sizes
+        uint32_t last_rx_drops{0};
+        uint64_t last_send_blocks{0};
+        size_t recv_buffer_size{0};
+        size_t send_buffer_size{0};
+
+        // Called periodically (from check_timeouts) to grow the socket buffers, if autotuning is
+        // enabled, in response to receive drops or blocked sends since the last call.
+        void autotune_socket_buffers();
+
+        // Secret used to derive stateless reset tokens for the connection IDs we issue
+        std::vector<uint8_t> static_secret;
+
+        // Maximum number of stateless resets we send per check_timeouts() interval (250ms)
+        static constexpr size_t STATELESS_RESET_BURST = 100;
+        size_t stateless_reset_budget{STATELESS_RESET_BURST};
+
+        // Creates the socket and timers; called from the constructor after options are applied.
+        void _init_internals();
+
+        // Connects or disconnects the socket (if using opt::connected_socket) as appropriate for
+        // the current set of connections and listening state.
+        void update_socket_connection(const Address* new_remote = nullptr);
+
       public:
         // Non-movable/non-copyable; you must always hold a Endpoint in a shared_ptr
         Endpoint(const Endpoint&) = delete;
@@ -53,7 +153,12 @@ namespace oxen::quic
         Endpoint(Endpoint&&) = delete;
         Endpoint& operator=(Endpoint&&) = delete;
 
-        explicit Endpoint(Network& n, const Address& listen_addr);
+        template <typename... Opt>
+        explicit Endpoint(Network& n, const Address& listen_addr, Opt&&... opts) : local{listen_addr}, net{n}
+        {
+            ((void)handle_ep_opt(std::forward<Opt>(opts)), ...);
+            _init_internals();
+        }
 
         template <typename... Opt>
         bool listen(Opt&&... opts)
@@ -67,6 +172,7 @@ namespace oxen::quic
                     // initialize client context and client tls context simultaneously
                     inbound_ctx = std::make_shared<InboundContext>(std::forward<Opt>(opts)...);
                     accepting_inbound = true;
+                    update_socket_connection();
 
                     log::debug(log_cat, "Inbound context ready for incoming connections");
 
@@ -94,10 +200,13 @@ namespace oxen::quic
                     // initialize client context and client tls context simultaneously
                     outbound_ctx = std::make_shared<OutboundContext>(std::forward<Opt>(opts)...);
 
+                    update_socket_connection(&path.remote);
+
                     for (;;)
                     {
                         if (auto [itr, success] = conns.emplace(ConnectionID::random(), nullptr); success)
                         {
+                            snapshot_dirty = true;
                             itr->second = Connection::make_conn(
                                     *this,
                                     itr->first,
@@ -120,17 +229,38 @@ namespace oxen::quic
             return f.get();
         }
 
+        // Hands this endpoint's UDP socket over to a new process for a zero-downtime restart: we
+        // listen on the unix socket `path` for the new process (constructing its endpoint with
+        // opt::inherit_socket and the same path) and, once it has connected and taken the socket,
+        // stop reading from the socket and accepting new connections.  Our existing connections
+        // carry on, with their packets forwarded to us by the new process, and once the last of
+        // them is gone `drained` (if given) is invoked from the event loop, after which this
+        // endpoint (and process) can be shut down.  Throws on failure to listen on `path`.  Not
+        // supported on Windows, or with AF_XDP, unix socket transport, opt::zerocopy_send or
+        // opt::connected_socket.
+        void hand_off(std::string path, std::function<void()> drained = nullptr);
+
         const std::shared_ptr<event_base>& get_loop() { return net.loop(); }
 
         const std::unique_ptr<UDPSocket>& get_socket() { return socket; }
 
-        // query a list of all active inbound and outbound connections paired with a conn_interface
+        // query a list of all active inbound and outbound connections paired with a conn_interface.
+        // When called from outside the event loop this blocks until the event loop can service it;
+        // monitoring threads should generally use `snapshot()` instead.
         std::list<std::shared_ptr<connection_interface>> get_all_conns(std::optional<Direction> d = std::nullopt);
 
         void handle_packet(const Packet& pkt);
 
-        // Query by connection id; returns nullptr if not found.
-        Connection* get_conn(const ConnectionID& ID);
+        // Query by connection id; returns nullptr if not found.  As with get_all_conns(), calls
+        // from outside the event loop are forwarded to (and block on) the event loop; both return
+        // nothing once the Network has been closed.
+        std::shared_ptr<Connection> get_conn(const ConnectionID& ID);
+
+        // Returns the most recently published snapshot of this endpoint's connections.  This is
+        // lock-free with respect to the event loop and safe to call from any thread; the snapshot
+        // is refreshed every 250ms if anything has happened since the last one (so may lag behind
+        // connections opened or closed since then).  Never returns nullptr.
+        std::shared_ptr<const connection_snapshot> snapshot() const { return std::atomic_load(&current_snapshot); }
 
       private:
         std::shared_ptr<ContextBase> outbound_ctx;
@@ -138,7 +268,36 @@ namespace oxen::quic
 
         void close_connection(Connection& conn, int code = NGTCP2_NO_ERROR, std::string_view msg = "NO_ERROR"sv);
 
-        void close_conns(std::optional<Direction> d = std::nullopt);
+        // Closes all connections (or just those in direction `d`).  Rather than sending each
+        // connection's close packet individually, they are all written into one buffer and sent
+        // in batches with as few syscalls as possible, which makes closing large numbers of
+        // connections (e.g. on shutdown) much faster and less lossy.  If given, `flushed` is
+        // invoked once all of the close packets have been sent (or have failed); this may be
+        // immediately, or later from the event loop if the socket blocks.
+        void close_conns(std::optional<Direction> d = std::nullopt, std::function<void()> flushed = nullptr);
+
+        // Close packets written for sending together (see close_conns): the packets, packed into
+        // `buf`, with their sizes, paths, traffic classes and connection IDs; and how far through
+        // them we have got sending.
+        struct close_batch
+        {
+            std::vector<std::byte> buf;
+            std::vector<size_t> sizes;
+            std::vector<Path> paths;
+            std::vector<uint8_t> tos;
+            std::vector<ConnectionID> cids;
+            size_t sent{0};
+            size_t sent_bytes{0};
+            std::function<void()> flushed;
+        };
+
+        // Writes the close packet for `conn` into `batch`.  Returns false (having deleted the
+        // connection) if no close packet is needed or it couldn't be written.
+        bool write_close_packet(Connection& conn, int code, std::string_view msg, close_batch& batch);
+
+        // Sends as much of the batch as we can, waiting for the socket to be writeable (and then
+        // continuing) if it blocks; invokes the batch's `flushed` callback when done.
+        void send_close_batch(std::shared_ptr<close_batch> batch);
 
         void delete_connection(const ConnectionID& cid);
 
@@ -175,13 +334,54 @@ namespace oxen::quic
 
         std::map<std::chrono::steady_clock::time_point, ConnectionID> draining;
 
+        // Maps additional connection IDs of our connections (issued via NEW_CONNECTION_ID frames,
+        // and the client-chosen initial DCID for inbound connections) to the connection's primary
+        // CID (i.e. the key in `conns`).
+        std::unordered_map<ConnectionID, ConnectionID> conn_aliases;
+
+        void add_connection_alias(Connection& conn, const ConnectionID& alias);
+        void remove_connection_alias(Connection& conn, const ConnectionID& alias);
+        void erase_connection_aliases(Connection& conn);
+
+        // Maps the stateless reset tokens of our connections' active peer connection IDs (from
+        // the server's transport parameters and NEW_CONNECTION_ID frames) to the connection's
+        // primary CID, so that we can recognize a stateless reset by its trailing token.
+        std::unordered_map<reset_token, ConnectionID, reset_token_hash> peer_reset_tokens;
+
+        void add_peer_reset_token(Connection& conn, const reset_token& token);
+        void remove_peer_reset_token(Connection& conn, const reset_token& token);
+        void erase_peer_reset_tokens(Connection& conn);
+
+        // Handles a short header packet for a connection ID that we don't know: this is either a
+        // stateless reset from the remote of one of our connections (which we recognize by its
+        // trailing reset token), or a packet for a connection that we no longer have (e.g. from
+        // before a restart) in which case we reply with a stateless reset.
+        void handle_unknown_short_packet(const Packet& pkt, const ConnectionID& dcid);
+
+        void send_stateless_reset(const Packet& pkt, const ConnectionID& dcid);
+
+        // Packets of the current receive batch that have been demuxed (by handle_packet) but not yet
+        // read, along with the source CID of the connection they belong to.  The packet data
+        // points into the UDPSocket's receive buffers, and so is only valid until the end of the
+        // batch.
+        std::vector<std::pair<ConnectionID, Packet>> rx_batch;
+
+        // Called by the socket at the end of each receive batch to feed the queued packets in
+        // `rx_batch` to their connections, grouped by connection, and then flush each touched
+        // connection once.
+        void process_received_batch();
+
         std::optional<ConnectionID> handle_packet_connid(const Packet& pkt);
 
-        void handle_conn_packet(Connection& conn, const Packet& pkt);
+        // Returns true if the packet was successfully read and the connection needs to be flushed
+        bool handle_conn_packet(Connection& conn, const Packet& pkt);
 
         io_result read_packet(Connection& conn, const Packet& pkt);
 
-        /// Attempts to send up to `n_pkts` packets to an address over this endpoint's socket.
+        /// Attempts to send up to `n_pkts` packets to the remote of `path` over this endpoint's
+        /// socket (from the path's local address, if the socket is bound to a wildcard address).
+        /// `tos` is the traffic class byte for the packets: DSCP in the upper 6 bits, ECN in the
+        /// lower 2.
         ///
         /// Upon success, updates n_pkts to 0 and returns an io_result with `.success()` true.
         ///
@@ -197,7 +397,20 @@ namespace oxen::quic
         /// If a more serious error occurs (other than a blocked socket) then `n_pkts` is set to 0
         /// (effectively dropping all packets) and a result is returned with `.failure()` true (and
         /// `.blocked()` false).
-        io_result send_packets(const Address& dest, std::byte* buf, size_t* bufsize, uint8_t ecn, size_t& n_pkts);
+        ///
+        /// If `pin` is given then the packets may be sent zero-copy (see opt::zerocopy_send and
+        /// UDPSocket::send), leaving `buf` pinned after the call.  In that case the sent packets'
+        /// data must not be overwritten, so unsent packets are moved to the beginning of
+        /// `unsent_buf` (which must then be given, and be large enough) rather than of `buf`; this
+        /// happens whenever not everything was sent, even if nothing was.
+        io_result send_packets(
+                const Path& path,
+                std::byte* buf,
+                size_t* bufsize,
+                uint8_t tos,
+                size_t& n_pkts,
+                const std::shared_ptr<void>& pin = nullptr,
+                std::byte* unsent_buf = nullptr);
 
         // Less efficient wrapper around send_packets that takes care of queuing the packet if the
         // socket is blocked.  This is for rare, one-shot packets only (regular data packets go via
@@ -207,13 +420,52 @@ namespace oxen::quic
         // fails).  It can be called immediately, if the packet sends right away, but can be delayed
         // if the socket would block.
         void send_or_queue_packet(
-                const Path& p, std::vector<std::byte> buf, uint8_t ecn, std::function<void(io_result)> callback = nullptr);
+                const Path& p, std::vector<std::byte> buf, uint8_t tos, std::function<void(io_result)> callback = nullptr);
 
         void send_version_negotiation(const ngtcp2_version_cid& vid, const Path& p);
 
         void check_timeouts();
 
+        // Published connection snapshot; accessed only via std::atomic_load/atomic_store.
+        std::shared_ptr<const connection_snapshot> current_snapshot = std::make_shared<connection_snapshot>();
+        uint64_t snapshot_epoch{0};
+        // Set whenever connections are added or removed, change state, or send or receive
+        // packets; publish_snapshot() does nothing when it is clear.
+        bool snapshot_dirty{true};
+
+        // Builds and publishes a new connection snapshot if anything changed since the last one;
+        // called from the event loop.
+        void publish_snapshot();
+
+        // get_conn() for use in the event loop: returns a non-owning pointer, or nullptr if not found
+        Connection* find_conn(const ConnectionID& id);
+
         Connection* accept_initial_connection(const Packet& pkt);
     };
 
+    template <typename... Opt>
+    std::shared_ptr<Endpoint> Network::endpoint(const Address& local_addr, Opt&&... opts)
+    {
+        if (auto [it, added] = endpoint_map.emplace(local_addr, nullptr); !added)
+        {
+            log::info(log_cat, "Endpoint already exists for listening address {}", local_addr);
+            return it->second;
+        }
+        else
+        {
+            try
+            {
+                it->second = std::make_shared<Endpoint>(*this, local_addr, std::forward<Opt>(opts)...);
+            }
+            catch (...)
+            {
+                // Don't leave a null placeholder behind if endpoint setup fails (e.g. opt::xdp without
+                // the required privileges)
+                endpoint_map.erase(it);
+                throw;
+            }
+            return it->second;
+        }
+    }
+
 }  // namespace oxen::quic
@@ -9,6 +9,9 @@ extern "C"
 #include <ngtcp2/ngtcp2_crypto_gnutls.h>
 }
 
+#include <chrono>
+#include <string_view>
+
 #include "crypto.hpp"
 
 namespace fs = std::filesystem;
@@ -75,11 +78,26 @@ namespace oxen::quic
         }
     };
 
+    // Counters of the peer verification cache (see GNUTLSCreds::enable_peer_verification)
+    struct verify_cache_stats
+    {
+        uint64_t hits = 0;    // Handshakes whose peer certificate was accepted from the cache
+        uint64_t misses = 0;  // Handshakes that needed a full chain verification
+        size_t cached = 0;    // Current number of cached certificates
+
+        double hit_rate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+    };
+
     class GNUTLSCreds : public TLSCreds
     {
       private:
         GNUTLSCreds(std::string local_key, std::string local_cert, std::string remote_cert, std::string ca_arg);
 
+        // Verified peer certificates; see enable_peer_verification()
+        struct verify_cache;
+        std::unique_ptr<verify_cache> vcache;
+        bool verify_peers{false};
+
       public:
         ~GNUTLSCreds();
 
@@ -88,10 +106,52 @@ namespace oxen::quic
         gnutls_callback client_tls_policy{nullptr};
         gnutls_callback server_tls_policy{nullptr};
 
+        // GnuTLS priority string applied to sessions created from these credentials; the GnuTLS
+        // default priorities are used if empty.
+        std::string priority;
+
+        // Priority string restricting sessions to TLS 1.3 with AES-128-GCM, the cheapest QUIC
+        // packet protection on hardware with AES acceleration.  This is intended for co-located
+        // peers (e.g. using opt::unix_transport) that both opt into it: a peer that does not offer
+        // AES-128-GCM will fail the handshake.
+        static constexpr auto FAST_CIPHER_PRIORITY = "NORMAL:-VERS-ALL:+VERS-TLS1.3:-CIPHER-ALL:+AES-128-GCM";
+
         static std::shared_ptr<GNUTLSCreds> make(
                 std::string remote_key, std::string remote_cert, std::string local_cert = "", std::string ca_arg = "");
 
         std::unique_ptr<TLSSession> make_session(const ngtcp2_crypto_conn_ref& conn_ref, bool is_client = false) override;
+
+        // Enables verification of the peer's X.509 certificate chain against the trust store (the
+        // `ca_arg` given to make(), plus anything added with add_trust()) during the handshake;
+        // servers using these credentials then also require a client certificate.  Hostnames are
+        // not checked.  Must be called before the credentials are used.
+        //
+        // Successful verifications are cached, keyed by the SHA-256 fingerprint of the peer's
+        // certificate, so that peers that reconnect skip the chain's signature checks.  An entry
+        // lasts for `cache_ttl` (or until the certificate expires, if sooner), and all entries are
+        // invalidated when the trust store changes or a certificate is revoked.  At most
+        // `cache_size` certificates are cached; a `cache_ttl` of 0 disables the cache.
+        void enable_peer_verification(std::chrono::seconds cache_ttl = 1h, size_t cache_size = 1000);
+
+        // Adds trusted CA certificate(s) (a file path, or PEM/DER data), or a certificate
+        // revocation list, to the trust store.  GnuTLS doesn't synchronize changes to credentials
+        // with handshakes that are using them, so these should only be called while no handshakes
+        // are in progress.  Throws std::invalid_argument if GnuTLS can't load them.
+        void add_trust(std::string ca);
+        void add_crl(std::string crl);
+
+        // Rejects any peer whose certificate chain includes the certificate with the given
+        // (hex) SHA-256 fingerprint.  Safe to call at any time.  Throws std::invalid_argument if
+        // `fingerprint` isn't 64 hex digits.
+        void revoke(std::string_view fingerprint);
+
+        verify_cache_stats verify_stats() const;
+
+        // Certificate verification hook called during the handshake; returns 0 to accept the
+        // peer, or a GnuTLS error code to abort the handshake.
+        int verify_peer(gnutls_session_t session) const;
+
+        bool verifying_peers() const { return verify_peers; }
     };
 
     class GNUTLSSession : public TLSSession
@@ -109,6 +169,11 @@ namespace oxen::quic
 
         void* get_session() override { return session; };
 
+        void set_alpns(const std::vector<std::string>& protocols) override;
+        std::string_view selected_alpn() const override;
+
+        int verify_peer(gnutls_session_t session) const { return creds.verify_peer(session); }
+
         int do_tls_callback(
                 gnutls_session_t session,
                 unsigned int htype,
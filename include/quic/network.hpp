@@ -46,21 +46,37 @@ namespace oxen::quic
       public:
         Network(std::shared_ptr<::event_base> loop_ptr, std::thread::id loop_thread_id);
         Network();
+        // Constructs a Network with its own event loop thread running in busy-poll mode (see
+        // opt::busy_poll).
+        explicit Network(opt::busy_poll bp);
         ~Network();
 
-        std::shared_ptr<Endpoint> endpoint(const Address& local_addr);
+        // Returns the Endpoint bound to the given local address, creating it (with the given
+        // endpoint options, such as opt::connected_socket) if it does not exist yet.  Options are
+        // ignored when returning an existing Endpoint.
+        template <typename... Opt>
+        std::shared_ptr<Endpoint> endpoint(const Address& local_addr, Opt&&... opts);
 
         /// Initiates shutdown the network, closing all endpoint connections and stopping the event
         /// loop (if Network-managed).  If graceful is true (the default) this call initiates a
         /// graceful shutdown (sending connection close packets, etc.).
         ///
         /// Returns a future that can be waited on to block until a graceful shutdown complete (for
-        /// ungraceful, the promise will be available immediately).
-        std::future<void> close(bool graceful = true);
+        /// ungraceful, the promise will be available immediately).  A graceful shutdown completes
+        /// once every connection's close packet has been sent, or once `timeout` has passed
+        /// (e.g. if the sockets stay blocked), whichever comes first.
+        std::future<void> close(bool graceful = true, std::chrono::milliseconds timeout = 1s);
 
       private:
         std::atomic<bool> running{false};
         std::shared_ptr<::event_base> ev_loop;
+        opt::busy_poll busy_poll;
+        // Incremented (in the loop thread) whenever the loop does useful work; used by the
+        // busy-poll loop to decide whether to keep spinning.
+        uint64_t loop_activity{0};
+        // Set by close_final() to stop the busy-poll loop; checked on every iteration because a
+        // loopexit issued between two non-blocking passes is cleared by the start of the next one.
+        std::atomic<bool> loop_stop{false};
         std::optional<std::thread> loop_thread;
         std::thread::id loop_thread_id;
 
@@ -69,15 +85,21 @@ namespace oxen::quic
         event_ptr job_waker;
         std::queue<Job> job_queue;
         std::mutex job_queue_mutex;
+        // Set (under job_queue_mutex) once our loop thread has finished: jobs queued after that
+        // could never run, so they are dropped instead (which breaks any promise they hold).
+        bool loop_done{false};
 
         friend class Endpoint;
         friend class Connection;
         friend class Stream;
+        friend class TCPTunnel;
 
         const std::shared_ptr<::event_base>& loop() const { return ev_loop; }
 
         void setup_job_waker();
 
+        void run_busy_poll_loop();
+
         bool in_event_loop() const;
 
         void call_soon(std::function<void(void)> f, source_location src = source_location::current());
@@ -99,11 +121,46 @@ namespace oxen::quic
         void process_job_queue();
 
         // Asynchronously begins closing (e.g. sending close packets) for all endpoints.  Triggers a
-        // call to `close_ungraceful` when all connections have had their close packet written.  If
-        // the promise is given, it will be passed on to `close_final()` to be fulfilled once
-        // closing is complete.
-        void close_all(std::shared_ptr<std::promise<void>> done = nullptr);
+        // call to `close_final()` once all connections have had their close packet sent, or once
+        // `timeout` passes.  If the promise is given, it will be passed on to `close_final()` to be
+        // fulfilled once closing is complete.
+        void close_all(std::shared_ptr<std::promise<void>> done = nullptr, std::chrono::milliseconds timeout = 1s);
 
         void close_final(std::shared_ptr<std::promise<void>> done = nullptr);
+
+        // Worker threads of send_chunks_async() producers, by ID: each runs its `work` function,
+        // after which the thread removes its own entry and detaches itself.  Threads still running
+        // at shutdown are stopped (via their `stop` function) and joined by join_async_workers(),
+        // so stopping a producer never has to wait for its thread.
+        struct async_worker
+        {
+            std::thread thread;
+            std::function<void()> stop;
+        };
+        std::mutex async_workers_mutex;
+        std::unordered_map<uint64_t, async_worker> async_workers;
+        uint64_t next_async_worker{0};
+
+        // Starts a worker thread running `work`.
+        void start_async_worker(std::function<void()> work, std::function<void()> stop);
+
+        // Called by a worker thread once its work is done: removes and detaches it, unless
+        // join_async_workers() has already taken it (and is about to join it).
+        void finish_async_worker(uint64_t id);
+
+        // Stops and joins all remaining worker threads.
+        void join_async_workers();
+
+        // Graceful shutdown state: the number of endpoints still sending close packets, the promise
+        // to pass to close_final() once they are done, and the timer enforcing the deadline.
+        size_t closing_endpoints{0};
+        std::shared_ptr<std::promise<void>> close_done;
+        bool close_pending{false};
+        event_ptr close_timer;
+
+        // Called (from close_all) as each endpoint finishes sending its close packets, and when
+        // the deadline passes.
+        void endpoint_close_flushed();
+        void close_deadline();
     };
 }  // namespace oxen::quic
@@ -24,4 +24,355 @@ namespace oxen::quic::opt
         max_streams() = default;
         explicit max_streams(int s) : stream_count(s) {}
     };
+
+    // Endpoint option for outbound-only endpoints that talk to a single remote: when the endpoint
+    // makes its first outbound connection the UDP socket is connect()ed to the remote so that sends
+    // can omit per-message destination addresses and use the kernel's cached route.  The socket is
+    // automatically disconnected again (falling back to regular unconnected sends) if the
+    // endpoint connects to a different remote or starts listening for inbound connections.
+    //
+    // Note that a connected UDP socket only receives packets from the connected address, so this
+    // should not be used where the remote address may change (e.g. across NAT rebinding).
+    struct connected_socket
+    {};
+
+    // Endpoint option for an endpoint bound to the IPv6 any address (`[::]`) to serve both IPv6 and
+    // IPv4 peers from a single socket (IPV6_V6ONLY off), rather than needing a separate endpoint for
+    // each address family.  IPv4 peers are reported (e.g. in Connection::remote()) as plain IPv4
+    // addresses.  Throws std::invalid_argument if the endpoint's local address is anything else.
+    //
+    // (Independently of this option, an endpoint bound to a wildcard address learns the local
+    // address of each received packet via IP_PKTINFO/IPV6_PKTINFO and replies from that address,
+    // so that multihomed hosts answer from the address their peers expect).
+    struct dual_stack
+    {};
+
+    // Endpoint option for a zero-downtime restart: rather than binding a new UDP socket, the
+    // endpoint connects to the unix socket `path` on which the previous process (having called
+    // Endpoint::hand_off with the same path) is waiting, and takes over its bound UDP socket.
+    // Packets for connections that the previous process still holds are forwarded back to it
+    // until those connections have finished; everything else (including new connections) is
+    // handled by this endpoint.  A `path` beginning with `@` names a socket in the (Linux)
+    // abstract namespace.  Endpoint construction throws if the socket can't be obtained within
+    // `timeout`.  Not supported on Windows, or together with AF_XDP, unix socket transport,
+    // opt::zerocopy_send or opt::connected_socket (on either side of the handoff).
+    struct inherit_socket
+    {
+        std::string path;
+        std::chrono::milliseconds timeout = 5s;
+
+        explicit inherit_socket(std::string path, std::chrono::milliseconds timeout = 5s) :
+                path{std::move(path)}, timeout{timeout}
+        {}
+    };
+
+    // Endpoint option setting the largest UDP payload the endpoint will send (via path MTU
+    // discovery probing) and receive.  The default, `max_payload_size`, is suitable for standard
+    // 1500-byte MTU paths; on jumbo-frame networks this can be raised (e.g. to 8952 for a 9000 MTU
+    // with IPv6) to substantially reduce per-byte overhead.  Packets larger than 1200 bytes are only
+    // sent once path MTU discovery has confirmed that the path supports them.
+    struct max_udp_payload
+    {
+        size_t size = max_payload_size;
+        max_udp_payload() = default;
+        explicit max_udp_payload(size_t s) : size{s} {}
+    };
+
+    // Endpoint option providing the secret from which the endpoint derives its stateless reset
+    // tokens.  This should be unique to the endpoint, kept private, and persist across restarts:
+    // that allows a restarted endpoint to reset connections established by its previous
+    // incarnation so that the remote side drops them immediately rather than waiting for an idle
+    // timeout.  Must be at least 16 bytes.  If not given, a random secret is generated (and so
+    // resets only work for as long as the endpoint lives).
+    struct static_secret
+    {
+        bstring secret;
+        explicit static_secret(bstring s) : secret{std::move(s)} {}
+    };
+
+    // Endpoint option for communication between endpoints on the same host: packets are carried over
+    // Unix datagram sockets instead of UDP, bypassing the IP/UDP stack (and checksumming) entirely
+    // while keeping the same Connection/Stream API.  Endpoint addresses are still given as regular
+    // IP:port addresses, but are only used to name the unix sockets: the endpoint listening on
+    // 127.0.0.1:5500 binds a socket named `libquic-4-7f000001-5500`, and connecting to
+    // 127.0.0.1:5500 sends to that socket.  Both sides of a connection must use this option (with
+    // the same `dir`).
+    //
+    // - dir -- the directory in which socket files are created.  If empty (the default) sockets are
+    //   created in the Linux abstract socket namespace, which requires no filesystem access.
+    //
+    // Unix datagrams are not subject to an MTU, so it is worth also raising opt::max_udp_payload.
+    // To further reduce per-packet crypto cost both sides can restrict their TLS credentials to a
+    // cheaper cipher suite (see GNUTLSCreds::FAST_CIPHER_PRIORITY).  Not supported on Windows.
+    struct unix_transport
+    {
+        std::string dir;
+        unix_transport() = default;
+        explicit unix_transport(std::string dir) : dir{std::move(dir)} {}
+    };
+
+    // Endpoint option setting the kernel receive and send buffer sizes (SO_RCVBUF/SO_SNDBUF) of the
+    // endpoint's UDP socket.  The system defaults (typically around 200kB on Linux) are easily
+    // overrun by bursts of incoming packets on busy endpoints, and make blocked sends common at
+    // high send rates.  If the process has CAP_NET_ADMIN the sizes are applied with
+    // SO_RCVBUFFORCE/SO_SNDBUFFORCE, allowing them to exceed the net.core.rmem_max/wmem_max
+    // sysctls; otherwise the kernel silently caps them at those limits.  A size of 0 leaves the
+    // corresponding buffer at the system default.
+    struct socket_buffers
+    {
+        size_t recv_size = 0;
+        size_t send_size = 0;
+
+        socket_buffers() = default;
+        explicit socket_buffers(size_t recv, size_t send) : recv_size{recv}, send_size{send} {}
+    };
+
+    // Endpoint option enabling socket buffer autotuning: the endpoint periodically (every 250ms)
+    // checks for packets dropped by the kernel because the receive buffer was full (via
+    // SO_RXQ_OVFL, where supported) and for sends that blocked because the send buffer was full,
+    // and doubles the corresponding buffer size in response, up to the given maximums.  This can be
+    // combined with `socket_buffers` to set the starting sizes.
+    //
+    // - max_recv_size/max_send_size -- the sizes above which buffers will not be grown.
+    // - send_block_threshold -- the number of blocked sends within one interval that triggers
+    //   growing the send buffer (occasional blocking is normal and handled by retrying).
+    struct socket_buffer_autotune
+    {
+        size_t max_recv_size = 16_Mi;
+        size_t max_send_size = 16_Mi;
+        size_t send_block_threshold = 4;
+
+        socket_buffer_autotune() = default;
+        explicit socket_buffer_autotune(size_t max_recv, size_t max_send, size_t block_threshold = 4) :
+                max_recv_size{max_recv}, max_send_size{max_send}, send_block_threshold{block_threshold}
+        {}
+    };
+
+    // Endpoint option enabling zero-copy sends (SO_ZEROCOPY/MSG_ZEROCOPY) for large GSO batches:
+    // rather than copying a batch of outgoing packets into kernel buffers, the kernel sends straight
+    // from the connection's send buffer, which then stays pinned (and is swapped for a spare) until
+    // the kernel reports completion via the socket error queue.  Only batches of at least
+    // `min_bytes` are sent this way, as for small sends the page pinning and completion handling
+    // costs more than the copy saves.  This mainly pays off on fast (10Gbps+) links; on loopback the
+    // kernel has to copy the data anyway.  Requires Linux (4.14+) and a GSO build (LIBQUIC_SEND=gso);
+    // if unavailable, a warning is logged and sends are copied as usual.
+    struct zerocopy_send
+    {
+        size_t min_bytes = 32_ki;
+
+        zerocopy_send() = default;
+        explicit zerocopy_send(size_t min) : min_bytes{min} {}
+    };
+
+    // Endpoint option switching the endpoint's packet I/O to an AF_XDP socket on queue `queue` of
+    // network interface `ifname`, for relays whose packet rates exceed what even batched
+    // recvmmsg/sendmmsg can handle.  A small XDP program attached to the interface redirects UDP
+    // packets for the endpoint's port to the AF_XDP socket, where they are read straight out of
+    // the shared packet memory (UMEM); all other traffic passes on to the kernel as usual.  The
+    // endpoint's regular UDP socket stays bound: it reserves the port, receives packets arriving
+    // on other queues, and is used to send to remotes we haven't yet received from over XDP (we
+    // learn the MAC addresses for replies from received packets).
+    //
+    // - `native` -- attach the program in native (driver) mode, which requires driver support;
+    //   the default uses generic (SKB) mode, which works on any interface (including veth pairs,
+    //   for testing) at the cost of a copy in the kernel.
+    // - `frames` -- number of UMEM frames (4kB each), split evenly between receiving and sending;
+    //   must be a power of 2.
+    //
+    // Requires a build with LIBQUIC_XDP (libxdp and libbpf), Linux 5.3+, and CAP_NET_ADMIN and
+    // CAP_BPF (or root).  Only one endpoint per interface can use XDP, packets are limited to a
+    // frame (so no jumbo frames), and IPv4 packets with IP options are left to the kernel.
+    struct xdp
+    {
+        std::string ifname;
+        uint32_t queue = 0;
+        bool native = false;
+        uint32_t frames = 4096;
+
+        explicit xdp(std::string ifname, uint32_t queue = 0, bool native = false, uint32_t frames = 4096) :
+                ifname{std::move(ifname)}, queue{queue}, native{native}, frames{frames}
+        {
+            if (this->ifname.empty())
+                throw std::invalid_argument{"xdp: interface name is required"};
+            if (frames < 2 * DATAGRAM_BATCH_SIZE || (frames & (frames - 1)) != 0)
+                throw std::invalid_argument{"xdp: frames must be a power of 2, and at least {}"_format(
+                        2 * DATAGRAM_BATCH_SIZE)};
+        }
+    };
+
+    // Connection option tuning how often we acknowledge received packets.  By default ngtcp2 sends
+    // an ACK after every 2nd ack-eliciting packet (or after at most 25ms); on bulk transfers
+    // raising the threshold substantially reduces the number of ACK packets the receiver has to
+    // build, encrypt, and send (and that the sender has to process), at the cost of slightly
+    // slower loss detection and congestion window growth.
+    //
+    // - ack_thresh -- the number of received ack-eliciting packets that triggers an immediate ACK.
+    // - max_ack_delay -- the maximum time we delay an ACK; this is also advertised to the peer (via
+    //   the max_ack_delay transport parameter) so that it accounts for it in loss detection.
+    //
+    // (This is a local, receiver-side setting: ngtcp2 does not implement the ACK_FREQUENCY
+    // extension frame, so it cannot be requested of the peer; pass this option on both sides to
+    // reduce ACKs in both directions).
+    struct ack_frequency
+    {
+        size_t ack_thresh = 2;
+        std::chrono::microseconds max_ack_delay = 25ms;
+
+        ack_frequency() = default;
+        explicit ack_frequency(size_t thresh, std::chrono::microseconds max_delay = 25ms) :
+                ack_thresh{thresh}, max_ack_delay{max_delay}
+        {
+            if (ack_thresh < 1)
+                throw std::invalid_argument{"ack_frequency: ack_thresh must be at least 1"};
+            // max_ack_delay transport parameter values of 2^14ms or more are invalid (RFC 9000 §18.2)
+            if (max_ack_delay >= 16384ms)
+                throw std::invalid_argument{"ack_frequency: max_ack_delay must be less than 16384ms"};
+        }
+    };
+
+    // Enables aggregated delivery of received stream data: rather than invoking the stream data
+    // callback once per received STREAM frame (typically ~1.2kB each), data received for a stream
+    // during one receive batch is copied into a reusable per-stream buffer and delivered in a
+    // single callback at the end of the batch.  Buffered data is delivered early if it reaches
+    // `max_size` bytes or if the stream is finished or closed.  A `max_size` of 0 disables batching.
+    struct batch_stream_data
+    {
+        size_t max_size = 256_ki;
+        batch_stream_data() = default;
+        explicit batch_stream_data(size_t max) : max_size{max} {}
+    };
+
+    // Endpoint or connection option limiting the egress rate with a token bucket: `rate` bytes per
+    // second (of UDP payload) on average, with bursts of up to `burst` bytes (the default, 0, uses
+    // 20ms worth of `rate`, but at least 16kB).  Given to Network::endpoint() it caps the total send
+    // rate of all of the endpoint's connections; given to listen() or connect() it caps each
+    // resulting connection individually.  The two can be combined.
+    //
+    // Limits are enforced where the connection writes packets rather than by dropping them: when a
+    // bucket runs dry the connection stops writing new stream data (as it does when congestion
+    // limited) and is woken up again, alongside ngtcp2's own pacing timer, once tokens become
+    // available.  ACKs and other control frames are still written while throttled (and consume
+    // tokens).  Time spent throttled is reported in the endpoint's connection snapshots.
+    struct rate_limit
+    {
+        uint64_t rate;
+        uint64_t burst = 0;
+
+        explicit rate_limit(uint64_t rate, uint64_t burst = 0) : rate{rate}, burst{burst}
+        {
+            if (rate == 0)
+                throw std::invalid_argument{"rate_limit: rate must be non-zero"};
+            if (this->burst == 0)
+                this->burst = std::max<uint64_t>(rate / 50, 16_ki);
+        }
+    };
+
+    // Connection option marking the connection's outgoing packets with a DSCP (Differentiated
+    // Services Code Point) so that routers applying QoS can treat connections differently, e.g.
+    // marking latency-sensitive connections with EF and bulk transfers with LE so that the former
+    // don't queue behind the latter on congested links.  Because all connections of an endpoint
+    // share one socket the marking is applied per message, via an IP_TOS (or IPV6_TCLASS) control
+    // message that carries the DSCP together with the packet's ECN bits.  The default, 0, sends
+    // unmarked (best-effort) packets.  Marking is not supported on Windows (where it is ignored).
+    struct dscp
+    {
+        // Some common code points (RFC 4594, RFC 8622)
+        static constexpr uint8_t BEST_EFFORT = 0;
+        static constexpr uint8_t LOWER_EFFORT = 1;
+        static constexpr uint8_t CS1 = 8;
+        static constexpr uint8_t AF21 = 18;
+        static constexpr uint8_t AF41 = 34;
+        static constexpr uint8_t EF = 46;
+
+        uint8_t value = BEST_EFFORT;
+
+        dscp() = default;
+        explicit dscp(uint8_t v) : value{v}
+        {
+            if (value > 63)
+                throw std::invalid_argument{"dscp: value must be between 0 and 63"};
+        }
+    };
+
+    // Connection option enabling per-stream zstd compression.  When enabled, each direction of
+    // every stream of the connection starts with a single stream-open header byte announcing how
+    // the data that follows is encoded (uncompressed, or a zstd stream); the sender chooses per
+    // stream (see Stream::set_compression) and the receiver decodes accordingly, so the stream
+    // data callback always sees the original data.  Outgoing data is compressed (and flushed) per
+    // Stream::send() call.  Because it changes the stream data framing the two sides agree on it
+    // during the handshake (via ALPN): if the peer did not enable this option too, the connection's
+    // streams carry plain, unframed data instead.  Requires libquic to be built with LIBQUIC_ZSTD;
+    // throws otherwise.
+    //
+    // - level -- zstd compression level; 0 (the default) adapts the level to the connection by
+    //   comparing the rate at which data is being compressed with the rate at which the peer is
+    //   acknowledging it: the level is raised while the link is the bottleneck and lowered when
+    //   compression is.
+    // - compress -- whether streams send compressed data by default; if false, streams send
+    //   uncompressed data unless compression is explicitly enabled on them.
+    struct stream_compression
+    {
+        int level = 0;
+        bool compress = true;
+
+        stream_compression() = default;
+        explicit stream_compression(int level, bool compress = true) : level{level}, compress{compress} {}
+    };
+
+    // Connection option enabling unreliable QUIC DATAGRAM frames (RFC 9221), sent with
+    // connection_interface::send_datagram and delivered to the datagram_data_callback_t passed
+    // with the connection's other options.  Datagrams are never retransmitted, and are dropped if
+    // too large for a packet or if the peer didn't enable datagrams.
+    //
+    // - fec -- enables XOR forward error correction: datagrams are sent in groups, each followed
+    //   by a parity datagram from which the receiver can rebuild any one datagram of the group
+    //   that was lost.  Every datagram then carries a 4-byte header, so both sides must enable
+    //   this (and the usable payload shrinks accordingly).
+    // - fec_group -- number of datagrams per group; 0 (the default) adapts the group size (and so
+    //   the redundancy) to the datagram loss rate seen by ngtcp2, from 2 (50% redundancy) on very
+    //   lossy links up to no parity at all when there is next to no loss.  Must otherwise be
+    //   between 2 and 32.
+    // - fec_delay -- how long a partial group may wait for more datagrams before its parity is
+    //   sent anyway, bounding the delay before a loss can be repaired.
+    struct enable_datagrams
+    {
+        bool fec = false;
+        int fec_group = 0;
+        std::chrono::milliseconds fec_delay = 20ms;
+
+        enable_datagrams() = default;
+        explicit enable_datagrams(bool fec, int fec_group = 0, std::chrono::milliseconds fec_delay = 20ms) :
+                fec{fec}, fec_group{fec_group}, fec_delay{fec_delay}
+        {
+            if (fec_group != 0 && (fec_group < 2 || fec_group > 32))
+                throw std::invalid_argument{"opt::enable_datagrams: FEC group size must be 0 or 2-32"};
+        }
+    };
+
+    // Network option enabling busy-poll mode for the Network's event loop: after any activity
+    // (received packets or queued jobs) the loop keeps spinning on non-blocking polls of the
+    // sockets and job queue for up to `budget` before falling back to blocking in epoll.  This
+    // trades CPU (one core spins while traffic is flowing) for lower wake-up latency.
+    //
+    // socket_poll, if non-zero, is also applied as SO_BUSY_POLL (in microseconds) to the UDP
+    // sockets of the Network's endpoints so that the kernel polls the device queue directly on
+    // receive; `prefer` additionally sets SO_PREFER_BUSY_POLL where supported.  Raising
+    // SO_BUSY_POLL above the net.core.busy_read sysctl requires CAP_NET_ADMIN; failure to set these
+    // is logged but not fatal.
+    //
+    // Has no effect on a Network constructed around an existing, externally managed event loop.
+    struct busy_poll
+    {
+        std::chrono::microseconds budget{0};
+        std::chrono::microseconds socket_poll{0};
+        bool prefer = true;
+
+        busy_poll() = default;
+        explicit busy_poll(
+                std::chrono::microseconds budget, std::chrono::microseconds socket_poll = 50us, bool prefer = true) :
+                budget{budget}, socket_poll{socket_poll}, prefer{prefer}
+        {}
+
+        explicit operator bool() const { return budget > 0us; }
+    };
 }  // namespace oxen::quic::opt
@@ -5,13 +5,17 @@ extern "C"
 #include <ngtcp2/ngtcp2.h>
 }
 
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <variant>
 #include <vector>
 
@@ -21,8 +25,31 @@ namespace oxen::quic
 {
     class Connection;
     class Endpoint;
+    class stream_codec;
+
+    // Interface-based alternative to the stream data/close callbacks: implementations receive
+    // stream events through virtual calls rather than through type-erased std::function wrappers,
+    // which (particularly with a `final` implementation) keeps the per-chunk data path down to a
+    // single indirect call.  Pass a std::shared_ptr to an implementation to listen()/connect() to
+    // use it for all streams of the resulting connections that are not given an explicit data
+    // callback.
+    struct stream_handler
+    {
+        virtual ~stream_handler() = default;
+
+        // Called with newly received stream data (see stream_data_callback_t).
+        virtual void on_data(Stream& s, bstring_view data) = 0;
+
+        // Called when the remote has finished its side of the stream (i.e. sent a FIN), after the
+        // last of its data has been passed to on_data().  The stream stays open (and we can keep
+        // sending) until our side is finished too; see Stream::send_fin().
+        virtual void on_fin(Stream&) {}
+
+        // Called when the stream is closed; invoked before the stream's close callback, if any.
+        virtual void on_close(Stream&, uint64_t /*error_code*/) {}
+    };
 
-    class Stream : public std::enable_shared_from_this<Stream>
+    class Stream : public std::enable_shared_from_this<Stream>, public user_data_slot
     {
         friend class Connection;
 
@@ -43,6 +70,8 @@ namespace oxen::quic
 
         stream_data_callback_t data_callback;
         stream_close_callback_t close_callback;
+        // If set, this is used instead of data_callback to deliver received data
+        std::shared_ptr<stream_handler> handler;
         Connection& conn;
 
         int64_t stream_id;
@@ -56,13 +85,23 @@ namespace oxen::quic
 
         void close(uint64_t error_code = 0);
 
+        // Finishes our side of the stream: a FIN is sent once everything already queued has been
+        // sent, and nothing more may be sent after this call.  Unlike close(), data from the remote
+        // keeps arriving until it finishes its side too, at which point the stream closes with
+        // error code 0.
+        void send_fin();
+
         void wrote(size_t bytes);
 
         void append_buffer(bstring_view buffer, std::shared_ptr<void> keep_alive);
 
         void acknowledge(size_t bytes);
 
-        inline bool available() const { return !(is_closing || is_shutdown || sent_fin); }
+        // Returns true if this stream has a handler or callback to receive data.  (The handler is
+        // kept after shutdown, for the close notification, but no longer receives data).
+        inline bool has_data_handler() const { return (handler && !is_shutdown) || data_callback; }
+
+        inline bool available() const { return !(is_closing || is_shutdown || finishing || sent_fin); }
 
         inline size_t size() const
         {
@@ -109,6 +148,36 @@ namespace oxen::quic
       private:
         // Implementations classes for send_chunks()
 
+        // True if a chunk Container is a (raw or smart) pointer to the actual container
+        template <typename Container>
+        static constexpr bool is_chunk_pointer = std::is_pointer_v<Container> ||
+                                                 is_instantiation<std::unique_ptr, Container> ||
+                                                 is_instantiation<std::shared_ptr, Container>;
+
+        template <typename Container>
+        static bstring_view chunk_view(const Container& data)
+        {
+            if constexpr (is_chunk_pointer<Container>)
+            {
+                static_assert(sizeof(*data->data()) == 1, "chunk_sender requires bytes data");
+                return {reinterpret_cast<const std::byte*>(data->data()), data->size()};
+            }
+            else
+            {
+                static_assert(sizeof(*data.data()) == 1, "chunk_sender requires bytes data");
+                return {reinterpret_cast<const std::byte*>(data.data()), data.size()};
+            }
+        }
+
+        template <typename Container>
+        static bool chunk_empty(const Container& data)
+        {
+            if constexpr (is_chunk_pointer<Container>)
+                return !data || data->size() == 0;
+            else
+                return data.size() == 0;
+        }
+
         // chunk_sender: When sending chunks we construct *one* of these, then share its ownership
         // across all the chunks in flight.  When each individual chunk gets destroyed, it called
         // back into this to queue the next chunk, which this class then sends into the stream.
@@ -119,10 +188,6 @@ namespace oxen::quic
         {
             static_assert(!std::is_reference_v<Container>, "chunk_sender requires a value or pointer, not a reference");
 
-            static constexpr bool is_pointer = std::is_pointer_v<Container> ||
-                                               is_instantiation<std::unique_ptr, Container> ||
-                                               is_instantiation<std::shared_ptr, Container>;
-
             using chunk_callback_t = std::function<Container(const Stream&)>;
             using done_callback_t = std::function<void(Stream&)>;
 
@@ -147,19 +212,7 @@ namespace oxen::quic
                 single_chunk(chunk_sender& cs, Container&& d) : _chunks{cs.shared_from_this()}, _data{std::move(d)} {}
                 ~single_chunk() { _chunks->queue_next_chunk(); }
 
-                bstring_view view() const
-                {
-                    if constexpr (is_pointer)
-                    {
-                        static_assert(sizeof(*_data->data()) == 1, "chunk_sender requires bytes data");
-                        return {reinterpret_cast<const std::byte*>(_data->data()), _data->size()};
-                    }
-                    else
-                    {
-                        static_assert(sizeof(*_data.data()) == 1, "chunk_sender requires bytes data");
-                        return {reinterpret_cast<const std::byte*>(_data.data()), _data.size()};
-                    }
-                }
+                bstring_view view() const { return chunk_view(_data); }
             };
 
             chunk_sender(Stream& s, chunk_callback_t next, done_callback_t done) :
@@ -180,13 +233,8 @@ namespace oxen::quic
                     return;
 
                 auto data = next_chunk(const_cast<const Stream&>(str));
-                bool no_data = false;
-                if constexpr (is_pointer)
-                    no_data = !data || data->size() == 0;
-                else
-                    no_data = data.size() == 0;
 
-                if (no_data)
+                if (chunk_empty(data))
                 {
                     log::trace(log_cat, "send_chunks finished");
                     // We're finishing
@@ -203,6 +251,233 @@ namespace oxen::quic
             }
         };
 
+        // Type-erased base of async_chunk_sender, through which the stream starts the producer and
+        // stops it if the stream is closed or destroyed first.  The producer's worker thread is
+        // owned by the Network, which joins it on shutdown if it is still running then.
+        struct async_chunk_base
+        {
+            virtual ~async_chunk_base() = default;
+
+            // Sets up the producer before its worker thread starts; `loop_call` queues a job on the
+            // stream's event loop.
+            virtual void start(std::function<void(std::function<void()>)> loop_call) = 0;
+
+            // The worker thread: produces chunks until out of data or stopped.
+            virtual void produce() = 0;
+
+            // Stops producing and sending chunks: the worker thread returns once any chunk callback
+            // in progress does, but we don't wait for it (so this is safe to call from the event
+            // loop).  Also called from Network shutdown.
+            virtual void stop() = 0;
+        };
+
+        // async_chunk_sender: the send_chunks_async() counterpart of chunk_sender.  The chunk
+        // callback runs on a worker thread, which keeps up to `prefetch` chunks waiting in a
+        // lock-free queue; as earlier chunks are acknowledged the event loop pops ready chunks
+        // off the queue and appends them to the stream, so the loop never waits on the producer
+        // (and the producer only waits when it is `prefetch` chunks ahead).
+        template <typename Container>
+        struct async_chunk_sender final : async_chunk_base, std::enable_shared_from_this<async_chunk_sender<Container>>
+        {
+            static_assert(
+                    !std::is_reference_v<Container>, "async_chunk_sender requires a value or pointer, not a reference");
+
+            using chunk_callback_t = std::function<Container()>;
+            using done_callback_t = std::function<void(Stream&)>;
+
+            static void make(Stream& s, chunk_callback_t next, done_callback_t done, int simultaneous, int prefetch)
+            {
+                s.start_async_sender(std::shared_ptr<async_chunk_sender<Container>>{
+                        new async_chunk_sender<Container>(s, std::move(next), std::move(done), simultaneous, prefetch)});
+            }
+
+            void start(std::function<void(std::function<void()>)> call) override
+            {
+                std::lock_guard lock{loop_mutex};
+                loop_call = std::move(call);
+            }
+
+            void produce() override
+            {
+                while (!stopped)
+                {
+                    {
+                        std::unique_lock lock{space_mutex};
+                        space_cv.wait(lock, [this] { return stopped || !ready.full(); });
+                    }
+                    if (stopped)
+                        break;
+
+                    std::optional<Container> data;
+                    try
+                    {
+                        data.emplace(next_chunk());
+                    }
+                    catch (const std::exception& e)
+                    {
+                        log::warning(log_cat, "send_chunks_async chunk callback raised exception: {}", e.what());
+                        failed = true;
+                    }
+                    catch (...)
+                    {
+                        log::warning(log_cat, "send_chunks_async chunk callback raised an unknown exception");
+                        failed = true;
+                    }
+
+                    if (!data || chunk_empty(*data))
+                    {
+                        finished = true;
+                        wake_loop();
+                        break;
+                    }
+
+                    // Can't fail: we're the only producer, and there was space above
+                    ready.push(std::move(*data));
+                    wake_loop();
+                }
+            }
+
+            void stop() override
+            {
+                stopped = true;
+                {
+                    std::lock_guard lock{loop_mutex};
+                    loop_call = nullptr;
+                }
+                wake_producer();
+            }
+
+          private:
+            // Holds a sent chunk until the stream is done with it, then lets us send another.
+            struct single_chunk
+            {
+              private:
+                std::shared_ptr<async_chunk_sender> _chunks;
+                Container _data;
+
+              public:
+                single_chunk(async_chunk_sender& cs, Container&& d) : _chunks{cs.shared_from_this()}, _data{std::move(d)}
+                {}
+                ~single_chunk() { _chunks->chunk_done(); }
+
+                bstring_view view() const { return chunk_view(_data); }
+            };
+
+            async_chunk_sender(Stream& s, chunk_callback_t next, done_callback_t done, int simultaneous, int prefetch) :
+                    str{s.weak_from_this()},
+                    next_chunk{std::move(next)},
+                    done{std::move(done)},
+                    simultaneous{static_cast<size_t>(simultaneous)},
+                    ready{static_cast<size_t>(prefetch)}
+            {
+                assert(next_chunk);
+            }
+
+            std::weak_ptr<Stream> str;
+            chunk_callback_t next_chunk;
+            done_callback_t done;
+            const size_t simultaneous;
+
+            // Chunks produced by the worker, waiting to be sent by the loop
+            spsc_queue<Container> ready;
+
+            std::atomic<bool> stopped{false};
+            // Set by the worker when next_chunk() signals the end of the data (or throws)
+            std::atomic<bool> finished{false};
+            std::atomic<bool> failed{false};
+            // Set while a drain() job is queued on the loop, so that we only ever queue one
+            std::atomic<bool> drain_queued{false};
+
+            // Event loop only: chunks handed to the stream and not yet released by it
+            size_t in_flight{0};
+
+            // Queues jobs on the event loop; cleared (under the mutex) when stopped so that the
+            // worker never touches the loop after that.
+            std::mutex loop_mutex;
+            std::function<void(std::function<void()>)> loop_call;
+
+            // The worker sleeps on this while the ready queue is full
+            std::mutex space_mutex;
+            std::condition_variable space_cv;
+
+            void wake_loop()
+            {
+                if (drain_queued.exchange(true))
+                    return;
+                std::lock_guard lock{loop_mutex};
+                if (loop_call)
+                    loop_call([self = this->shared_from_this()] { self->drain(); });
+            }
+
+            void wake_producer()
+            {
+                // Taking the mutex ensures the worker is either waiting or hasn't yet checked for
+                // space, so it can't miss the notification.
+                {
+                    std::lock_guard lock{space_mutex};
+                }
+                space_cv.notify_one();
+            }
+
+            // Event loop
+            void chunk_done()
+            {
+                in_flight--;
+                drain();
+            }
+
+            // Event loop: sends ready chunks for as long as we're under `simultaneous` in flight
+            void drain()
+            {
+                drain_queued = false;
+                if (stopped)
+                    return;
+                auto s = str.lock();
+                if (!s || s->is_closing)
+                {
+                    stop();
+                    return;
+                }
+
+                bool popped = false;
+                while (in_flight < simultaneous)
+                {
+                    auto data = ready.pop();
+                    if (!data)
+                        break;
+                    popped = true;
+                    in_flight++;
+                    auto chunk = std::make_shared<single_chunk>(*this, std::move(*data));
+                    auto bsv = chunk->view();
+                    log::trace(log_cat, "sending prefetched chunk of size {}", bsv.size());
+                    s->send(bsv, std::move(chunk));
+                }
+                if (popped)
+                    wake_producer();
+
+                // `finished` is set after the final push, so once we see it an empty queue means
+                // everything has been sent.
+                if (finished && ready.empty())
+                {
+                    log::trace(log_cat, "send_chunks_async finished");
+                    stop();
+                    if (failed)
+                        s->close(STREAM_ERROR_EXCEPTION);
+                    else if (done)
+                        done(*s);
+                }
+            }
+        };
+
+        // Registers and starts an async chunk sender on the event loop (unless the stream is
+        // already closing).
+        void start_async_sender(std::shared_ptr<async_chunk_base> sender);
+
+        // Stops any running async chunk senders; called when the stream is closed or destroyed.
+        void stop_async_senders();
+
+        std::vector<std::weak_ptr<async_chunk_base>> async_senders;
+
       public:
         /// Sends data in chunks: `next_chunk` is some callable (e.g. lambda) that will be called
         /// with a const reference to the stream instance as needed to obtain the next chunk of data
@@ -237,6 +512,71 @@ namespace oxen::quic
             chunk_sender<T>::make(simultaneous, *this, std::move(next_chunk), std::move(done));
         }
 
+        /// Like send_chunks(), except that `next_chunk` is called on a dedicated worker thread
+        /// rather than on the event loop thread, so that expensive chunk generation (reading from
+        /// disk, compressing, hashing, etc.) doesn't hold up packet processing.  The worker keeps
+        /// up to `prefetch` chunks ready ahead of when the stream needs them, and the event loop
+        /// only appends ready chunks to the stream as earlier ones are acknowledged.
+        ///
+        /// Because it runs off the event loop, `next_chunk` takes no arguments: it must not touch
+        /// the stream (or anything else owned by the event loop).  It returns the same types as
+        /// for send_chunks(), with an empty container or nullptr signalling the end of the data, at
+        /// which point `done(stream)` is called from the event loop once all chunks are queued.  If
+        /// `next_chunk` throws, the stream is closed with STREAM_ERROR_EXCEPTION.
+        ///
+        /// The worker thread belongs to the stream's Network.  If the stream is closed (or
+        /// destroyed) the producer is stopped: `next_chunk` is not called again, though a call
+        /// already in progress finishes (and its chunk is discarded) on the worker thread.  Network
+        /// shutdown stops any producers still running and waits for their `next_chunk` calls to
+        /// return, so `next_chunk` must not block on the event loop.
+        ///
+        /// Up to `simultaneous + prefetch + 1` chunks can be alive at once (in flight, waiting to
+        /// be sent, and being produced), so a circular buffer of pointed-to containers needs to be
+        /// at least that large.
+        template <typename NextChunk>
+        void send_chunks_async(
+                NextChunk next_chunk, std::function<void(Stream&)> done = nullptr, int simultaneous = 2, int prefetch = 4)
+        {
+            if (simultaneous < 1)
+                throw std::logic_error{"Stream::send_chunks_async simultaneous must be >= 1"};
+            if (prefetch < 1)
+                throw std::logic_error{"Stream::send_chunks_async prefetch must be >= 1"};
+
+            using T = decltype(next_chunk());
+            async_chunk_sender<T>::make(*this, std::move(next_chunk), std::move(done), simultaneous, prefetch);
+        }
+
+        /// When the connection uses opt::stream_compression, sets whether data sent on this stream
+        /// is compressed (overriding the option's default).  This must be called before any data
+        /// is sent on the stream (later calls are ignored); throws if the connection does not use
+        /// stream compression.  Has no effect if the peer did not also enable stream compression.
+        void set_compression(bool compress);
+
+        /// Returns true if data sent on this stream is being compressed.  Until the stream has
+        /// opened this reflects our own setting, as the peer's agreement isn't known yet.
+        bool compressed() const;
+
+        /// The current compression level of data sent on this stream (see
+        /// opt::stream_compression), or 0 if it is not being compressed.
+        int compression_level() const;
+
+        /// Total bytes of stream data (after any compression) sent to the remote so far.
+        uint64_t bytes_sent() const;
+
+        /// Test hook: queues `raw` to be sent on the stream as-is, bypassing stream compression
+        /// (e.g. to send the remote something it can't decode).
+        void simulate_raw_send(bstring_view raw);
+
+        /// Stops extending the remote's flow control window for this stream as data arrives, so
+        /// that once it has sent everything it is already allowed to it must wait for us, rather
+        /// than us having to buffer whatever it sends.  The credit for data received while paused
+        /// is granted all at once by resume_receiving().  Intended for data handlers that pass the
+        /// data on to something slower (e.g. a socket) and would otherwise queue it without limit.
+        void pause_receiving();
+
+        /// Resumes extending the stream's flow control window after pause_receiving().
+        void resume_receiving();
+
         inline void set_ready()
         {
             log::trace(log_cat, "Setting stream ready");
@@ -256,9 +596,34 @@ namespace oxen::quic
 
         bool is_closing{false};
         bool is_shutdown{false};
+        bool finishing{false};  // send_fin() called: FIN goes out once all data is sent
         bool sent_fin{false};
         bool ready{false};
 
+        // Received data awaiting aggregated delivery to data_callback (only used when the
+        // connection has batched stream data delivery enabled).  The buffer is cleared, but not
+        // deallocated, after each delivery so that it gets reused.
+        std::vector<std::byte> recv_buffer;
+        bool recv_pending{false};
+
+        // Set by pause_receiving(): flow control credit for received data is held back (and
+        // accumulated in recv_withheld) instead of being granted as the data arrives.
+        bool recv_paused{false};
+        uint64_t recv_withheld{0};
+
+        // Set if the connection uses stream compression (see opt::stream_compression); the codec
+        // is dropped when the stream opens if the peer turns out not to use it.
+        std::unique_ptr<stream_codec> codec;
+        bool compression_enabled{false};
+
+        // Copies of the codec state (and of the bytes sent) for the thread-safe accessors above;
+        // updated on the event loop thread whenever they may have changed.
+        std::atomic<bool> compressing{false};
+        std::atomic<int> compress_level{0};
+        std::atomic<uint64_t> sent_bytes{0};
+
+        void update_compression_state();
+
         Endpoint& endpoint;
     };
 }  // namespace oxen::quic
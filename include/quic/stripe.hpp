@@ -0,0 +1,220 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "connection.hpp"
+#include "stream.hpp"
+#include "utils.hpp"
+
+namespace oxen::quic
+{
+    // Striped bulk transfer: one logical byte stream split across streams on several connections
+    // (typically each on its own Network, and so its own event loop thread, and/or its own local
+    // endpoint so that the flows spread across NIC receive queues), so that a single transfer is
+    // limited neither by one event loop's crypto throughput nor by a single flow's congestion
+    // window.
+    //
+    // The sender opens one stream on each connection, starting each with the transfer's 64-bit ID
+    // (STRIPE_ID_SIZE bytes, little endian), and cuts the data into chunks, each sent on a stripe
+    // as a STRIPE_HEADER_SIZE-byte header (the chunk's 64-bit offset in the logical stream and
+    // its 32-bit length, little endian) followed by the chunk data.  Chunks go to
+    // whichever stripe has room for them (each stripe has at most `simultaneous` unacknowledged
+    // chunks), so faster connections naturally carry more of the data.  Once the data is
+    // exhausted the sender sends a zero-length chunk with the total length as its offset.
+    //
+    // The receiver is a stream_handler for all of the stripe streams, keeping separate state for
+    // each transfer ID, so that one receiver (e.g. an endpoint's listen() handler) can take
+    // several transfers at once, and a failed transfer only closes its own stripes.  Data that
+    // continues a transfer's logical stream is delivered straight from the stream's receive
+    // buffer, while data arriving ahead of a gap is copied and held until the gap is filled.
+    // Buffering (per transfer) is bounded by the
+    // sender: it never starts a chunk more than `window` bytes beyond the start of the oldest
+    // chunk that is not yet acknowledged, so (since an acknowledged chunk has already been
+    // delivered to the receiver, as have the chunks before it on the same stripe) the receiver
+    // never holds more than `window` bytes plus one chunk.  A receiver whose `max_buffer` is
+    // smaller than that closes the stripe that overflows it with ERROR_STRIPE_OVERFLOW.
+    //
+    // Once the receiver has delivered everything it closes the stripes with error code 0, which
+    // the sender also takes as completion; the sender in turn sends a FIN on every stripe once it
+    // is done.  A stripe whose ID only arrives after its transfer has finished (e.g. one that
+    // carried no chunks) is closed with 0 as well, as is any stripe that is FINned without its
+    // transfer being in progress.  If a stripe fails, the other stripes of its transfer are closed
+    // with ERROR_STRIPE_ABORTED and both sides report failure.
+    //
+    // NB: the receiver treats *every* stream it handles as a stripe.  Connections using it as
+    // their stream handler therefore can't carry any other streams (unless those are given their
+    // own data callbacks): an unrelated stream would be taken as a stripe of some bogus transfer,
+    // which fails (closing that stream, but not affecting real transfers) as soon as its data
+    // doesn't parse as chunks, and otherwise just never completes.
+
+    // Size of the transfer ID at the start of each stripe
+    inline constexpr size_t STRIPE_ID_SIZE = 8;
+    // Size of the header preceding each chunk on a stripe
+    inline constexpr size_t STRIPE_HEADER_SIZE = 12;
+    // Default sender window (see StripedSender::make)
+    inline constexpr size_t STRIPE_DEFAULT_WINDOW = 16 * 1024 * 1024;
+    // Close error code of a stripe that delivers more out-of-order data than the receiver buffers
+    inline constexpr uint64_t ERROR_STRIPE_OVERFLOW{0x547190a};
+    // Close error code of a stripe with a malformed chunk (e.g. overlapping already received data)
+    inline constexpr uint64_t ERROR_STRIPE_BAD_CHUNK{0x547190b};
+    // Close error code of the remaining stripes when a transfer fails or is aborted
+    inline constexpr uint64_t ERROR_STRIPE_ABORTED{0x547190c};
+
+    class StripedSender : public std::enable_shared_from_this<StripedSender>
+    {
+      public:
+        // Returns the next chunk of data to send, or an empty chunk once all the data has been
+        // returned.  Called with the sender's lock held, from whichever stripe's event loop thread
+        // has room for another chunk.  Chunk sizes are up to the callback, but should be large
+        // enough to amortize the header and small enough to balance well across the stripes: 64kiB
+        // to 1MiB is a good range.
+        using source_t = std::function<bstring()>;
+
+        // Called once, from one of the stripes' event loop threads, with true when all of the data
+        // has been acknowledged (or the receiver has closed the stripes after receiving it all), or
+        // false if a stripe was closed before then or the source threw.
+        using done_callback_t = std::function<void(bool success)>;
+
+        // Starts sending the data produced by `source` striped across a new stream on each of
+        // `conns`, with at most `simultaneous` unacknowledged chunks per stripe.  The transfer is
+        // identified to the receiver by `transfer_id`, which is random if not given.  Throws
+        // std::invalid_argument if `conns` is empty, `window` is 0, or `simultaneous` is less than 1.
+        static std::shared_ptr<StripedSender> make(
+                const std::vector<std::shared_ptr<connection_interface>>& conns,
+                source_t source,
+                done_callback_t done = nullptr,
+                size_t window = STRIPE_DEFAULT_WINDOW,
+                int simultaneous = 2,
+                std::optional<uint64_t> transfer_id = std::nullopt);
+
+        StripedSender(const StripedSender&) = delete;
+        StripedSender& operator=(const StripedSender&) = delete;
+
+        // Aborts the transfer, closing all the stripes (the done callback is not called).
+        void close();
+
+        size_t stripes() const { return streams.size(); }
+
+        uint64_t transfer_id() const { return id; }
+
+        // Bytes of the logical stream acknowledged so far
+        uint64_t acked() const;
+
+      private:
+        struct sent_chunk;
+
+        StripedSender(source_t source, done_callback_t done, size_t window, int simultaneous, uint64_t id);
+
+        source_t source;
+        done_callback_t done;
+        const size_t window;
+        const size_t simultaneous;
+        const uint64_t id;
+        // The ID as sent at the start of each stripe
+        std::array<std::byte, STRIPE_ID_SIZE> id_bytes;
+
+        mutable std::mutex mutex;
+        std::vector<std::weak_ptr<Stream>> streams;
+        std::vector<size_t> in_flight;
+        // Offset => length of every chunk sent but not yet acknowledged
+        std::map<uint64_t, size_t> unacked;
+        uint64_t next_offset{0};
+        uint64_t acked_bytes{0};
+        bool exhausted{false};  // source returned empty; the end chunk is sent
+        bool finished{false};   // completed, failed, or closed: nothing more to do
+
+        // Pulls chunks from the source and sends them on every stripe with room for them (within
+        // the window), starting with stripe `first`.  The sent chunks and streams are also appended
+        // to `keep`, which the caller must only release after releasing the lock (as their
+        // destruction calls back into us).  Returns false if the source failed.  Requires the lock.
+        bool fill(std::vector<std::shared_ptr<void>>& keep, size_t first = 0);
+
+        // Marks the transfer finished and returns its stripes, which the caller (after releasing the
+        // lock) closes with ERROR_STRIPE_ABORTED on failure, or FINs on success.  Requires the lock.
+        std::vector<std::shared_ptr<Stream>> finish();
+
+        void chunk_acked(size_t stripe, uint64_t offset, size_t size);
+        void stripe_closed(uint64_t error_code);
+    };
+
+    class StripeReceiver : public stream_handler, public std::enable_shared_from_this<StripeReceiver>
+    {
+      public:
+        // Called with each successive piece of a transfer's logical stream, in order.  Invoked
+        // with the receiver's lock held from the thread of whichever stripe completed the piece;
+        // the data is only valid for the duration of the call.
+        using data_callback_t = std::function<void(uint64_t transfer_id, bstring_view data)>;
+
+        // Called once per transfer, with true when its entire logical stream has been delivered,
+        // or false if one of its stripes was closed or misbehaved before then.
+        using done_callback_t = std::function<void(uint64_t transfer_id, bool success)>;
+
+        // Creates a receiver to use as the stream handler for the stripes' incoming streams (e.g.
+        // by passing it to Endpoint::listen() of each receiving endpoint; see the note above about
+        // other streams).  `max_buffer`, which applies to each transfer, should be at least the
+        // sender's window plus its largest chunk.  The receiver uses each stripe stream's user data
+        // slot.
+        static std::shared_ptr<StripeReceiver> make(
+                data_callback_t on_data, done_callback_t done = nullptr, size_t max_buffer = 2 * STRIPE_DEFAULT_WINDOW);
+
+        StripeReceiver(const StripeReceiver&) = delete;
+        StripeReceiver& operator=(const StripeReceiver&) = delete;
+
+        void on_data(Stream& s, bstring_view data) override;
+        void on_fin(Stream& s) override;
+        void on_close(Stream& s, uint64_t error_code) override;
+
+        // Bytes of logical streams delivered so far, over all transfers
+        uint64_t delivered() const;
+
+        // Bytes currently held waiting for earlier data, over all transfers
+        size_t buffered() const;
+
+        // Number of transfers in progress
+        size_t transfers() const;
+
+      private:
+        // Per-transfer reassembly state
+        struct transfer;
+        // Per-stripe parser state, kept in the stream's user data slot
+        struct stripe_state;
+
+        StripeReceiver(data_callback_t on_data, done_callback_t done, size_t max_buffer);
+
+        data_callback_t data_cb;
+        done_callback_t done;
+        const size_t max_buffer;
+
+        mutable std::mutex mutex;
+        // Transfers in progress, by ID
+        std::unordered_map<uint64_t, std::shared_ptr<transfer>> active;
+        // IDs of the most recently finished transfers (oldest first), so that stripes arriving
+        // after their transfer has finished don't start it over again
+        std::unordered_set<uint64_t> recent;
+        std::deque<uint64_t> recent_order;
+        uint64_t delivered_bytes{0};
+        size_t pending_bytes{0};
+
+        // Handles a piece of chunk data at `offset` of transfer `t`: delivers it (along with any
+        // buffered data it makes contiguous) if it continues the logical stream, and otherwise
+        // buffers it.  Returns an error code to close the stripe with on overflow or overlap.
+        // Requires the lock.
+        std::optional<uint64_t> accept(transfer& t, uint64_t offset, bstring_view data);
+
+        // Marks the transfer finished (dropping it from `active`, and adding it to `recent`) and
+        // returns its stripes, which the caller closes after releasing the lock.  Requires the
+        // lock.
+        std::vector<std::shared_ptr<Stream>> finish(transfer& t);
+    };
+}  // namespace oxen::quic
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <event2/event.h>
+#include <event2/listener.h>
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "connection.hpp"
+#include "network.hpp"
+#include "stream.hpp"
+#include "utils.hpp"
+
+namespace oxen::quic
+{
+    // TCP-over-QUIC tunnel: each TCP connection is carried over its own bidirectional QUIC stream.
+    //
+    // The client side of a tunnel listens on a local TCP address; each accepted TCP connection
+    // opens a new stream on a QUIC connection and sends a single CONNECT_INIT byte to request the
+    // remote TCP connection.  The server side of a tunnel is used as the stream handler of a
+    // listening endpoint; when a new stream's CONNECT_INIT arrives it connects to its configured
+    // TCP target and replies with CONNECT_INIT once connected (or closes the stream with
+    // ERROR_CONNECT if the connection fails).  Only once the client receives CONNECT_INIT does it
+    // start reading from its TCP socket.
+    //
+    // Data read from TCP is read into pooled buffers that are passed to the stream as zero-copy
+    // keep-alives (and returned to the pool once acknowledged); reading from a TCP socket pauses
+    // while its stream has PAUSE_SIZE or more bytes of unacknowledged data.  Received stream data
+    // is written directly to the TCP socket from the stream's receive buffer, and is only copied
+    // when the socket cannot accept all of it immediately; once PENDING_HIGH_WATER bytes are queued
+    // that way we stop extending the stream's flow control window (see Stream::pause_receiving)
+    // until the socket has taken all of it, so a slow TCP reader pushes back on the QUIC sender.
+    //
+    // When one side's TCP connection reaches EOF we finish our side of the stream (sending a FIN
+    // after the data), and the other side shuts down the writing side of its TCP connection once
+    // it has written out all the data, so half-closed TCP connections work as expected.  Once both
+    // sides have finished, the stream closes and both TCP connections are closed.  TCP errors close
+    // the stream with ERROR_TCP.  If the QUIC connection goes away (the tunnel only holds a weak
+    // reference to it) its streams are destroyed, which closes their TCP connections.
+    //
+    // All tunnel activity happens in the Network's event loop thread.
+    class TCPTunnel : public stream_handler, public std::enable_shared_from_this<TCPTunnel>
+    {
+      public:
+        // Creates the client side of a tunnel that accepts TCP connections on `tcp_listen` (use
+        // port 0 to pick a random port, retrievable via `tcp_address()`) and tunnels them over
+        // new streams of `conn`.  The tunnel doesn't keep `conn` alive: once it is gone, new TCP
+        // connections are refused.  Throws if the TCP listener cannot be created.
+        static std::shared_ptr<TCPTunnel> client(
+                Network& net, std::shared_ptr<connection_interface> conn, const Address& tcp_listen);
+
+        // Creates the server side of a tunnel that connects tunnelled streams to `tcp_target`.  The
+        // returned tunnel should be passed to Endpoint::listen() so that it handles the endpoint's
+        // incoming streams.
+        static std::shared_ptr<TCPTunnel> server(Network& net, const Address& tcp_target);
+
+        TCPTunnel(const TCPTunnel&) = delete;
+        TCPTunnel& operator=(const TCPTunnel&) = delete;
+        TCPTunnel(TCPTunnel&&) = delete;
+        TCPTunnel& operator=(TCPTunnel&&) = delete;
+
+        ~TCPTunnel() override;
+
+        // For a client tunnel, returns the address the TCP listener is bound to.
+        const Address& tcp_address() const { return tcp_addr; }
+
+        // Returns the number of currently tunnelled TCP connections.
+        size_t active() const { return tcp_conns.size(); }
+
+        // Stops accepting new TCP connections (client side) and closes all tunnelled connections.
+        void close();
+
+        void on_data(Stream& s, bstring_view data) override;
+        void on_fin(Stream& s) override;
+        void on_close(Stream& s, uint64_t error_code) override;
+
+      private:
+        struct tcp_conn;
+
+        // Pool of fixed-size buffers that TCP data is read into; see buffer_pool in tunnel.cpp.
+        struct buffer_pool;
+
+        // Size of each pooled TCP read buffer
+        static constexpr size_t CHUNK_SIZE = 16_ki;
+
+        // Amount of received stream data waiting for a TCP socket above which we pause the stream
+        static constexpr size_t PENDING_HIGH_WATER = 256_ki;
+
+        TCPTunnel(Network& net, std::shared_ptr<connection_interface> conn, std::optional<Address> target);
+
+        Network& net;
+        event_base* ev_loop;
+        std::weak_ptr<connection_interface> conn;  // client side only
+        std::optional<Address> target;            // server side only
+        Address tcp_addr;
+
+        struct listener_deleter
+        {
+            void operator()(evconnlistener* l) const { evconnlistener_free(l); }
+        };
+        std::unique_ptr<evconnlistener, listener_deleter> listener;
+
+        std::shared_ptr<buffer_pool> pool;
+
+        std::unordered_map<tcp_conn*, std::shared_ptr<tcp_conn>> tcp_conns;
+
+        void listen_tcp(const Address& addr);
+        void init_events(tcp_conn& tc);
+        void accept_tcp(evutil_socket_t fd);
+        void start_tcp_connect(Stream& s);
+
+        // Closes the TCP socket and forgets the tcp_conn; if `stream_code` is given the stream is
+        // also closed with that code.
+        void drop(tcp_conn& tc, std::optional<uint64_t> stream_code = std::nullopt);
+
+        void on_tcp_connected(tcp_conn& tc);
+        void on_tcp_readable(tcp_conn& tc);
+        void on_tcp_writeable(tcp_conn& tc);
+        void on_check(tcp_conn& tc);
+        // Shuts down the writing side of the TCP socket once the remote has finished the stream
+        // and all of its data has been written.
+        void maybe_shutdown_tcp(tcp_conn& tc);
+        // Writes received stream data to the TCP socket, queuing whatever can't be written
+        // immediately.  Returns false if the write failed (and the tcp_conn was dropped).
+        bool write_tcp(tcp_conn& tc, bstring_view data);
+    };
+}  // namespace oxen::quic
@@ -13,32 +13,59 @@ extern "C"
 
 #include <event2/event.h>
 
+#include <array>
 #include <cstdint>
+#include <deque>
 
 #include "utils.hpp"
 
 namespace oxen::quic
 {
+    namespace opt
+    {
+        struct xdp;
+    }
+    class xdp_socket;
+
 #ifdef _WIN32
     using msghdr = WSAMSG;
 #else
     using msghdr = ::msghdr;
 #endif
 
-    // Simple struct wrapping a packet and its corresponding information
+    // Simple struct wrapping a packet and its corresponding information.  The local address is a
+    // reference to the receiving socket's bound address (rather than a copy) to keep per-packet
+    // copying to a minimum; a Packet must therefore not outlive the UDPSocket that produced it.
+    // (For a socket bound to a wildcard address it instead refers to the socket's record of the
+    // address the packet was actually sent to, which is only valid until the end of the receive
+    // batch, just like the packet data).
     struct Packet
     {
-        Path path;
+        const Address& local;
+        Address remote;
         bstring_view data;
         ngtcp2_pkt_info pkt_info{};
 
-        /// Constructs a packet from a path and data:
-        Packet(Path p, bstring_view d) : path{std::move(p)}, data{std::move(d)} {}
-
         /// Constructs a packet from a local address, data, and the IP header; remote addr and ECN
         /// data are extracted from the header.
-
         Packet(const Address& local, bstring_view data, msghdr& hdr);
+
+        /// Constructs a packet from already-parsed addressing and ECN information (as used by the
+        /// AF_XDP backend, which parses packet headers itself).
+        Packet(const Address& local, Address remote, bstring_view data, uint8_t ecn) :
+                local{local}, remote{std::move(remote)}, data{data}
+        {
+            pkt_info.ecn = ecn;
+        }
+
+        /// Returns an owning Path copy of the packet's local/remote addresses.  This copies both
+        /// addresses, so should only be used when the path needs to be stored (e.g. when creating a
+        /// new connection).
+        Path path() const { return Path{local, remote}; }
+
+        /// Returns a non-owning ngtcp2_path pointing into the packet's addresses for passing into
+        /// ngtcp2 functions; it is valid only as long as this Packet (and its socket) is.
+        ngtcp2_path path_view() const { return ngtcp2_path{local, remote, nullptr}; }
     };
 
     /// RAII class wrapping a UDP socket; the socket is bound at construction and closed during
@@ -55,6 +82,7 @@ namespace oxen::quic
                 ;
 
         using receive_callback_t = std::function<void(const Packet& pkt)>;
+        using batch_done_callback_t = std::function<void()>;
 
         UDPSocket() = delete;
 
@@ -62,10 +90,37 @@ namespace oxen::quic
         /// binding to an any address (or any port) you can retrieve the realized address via
         /// address() after construction.
         ///
-        /// When packets are received they will be fed into the given callback.
+        /// When packets are received they will be fed into the given callback.  If `batch_done` is
+        /// given then it is invoked after each batch of received packets has been fed into `cb`;
+        /// packet data passed to `cb` remains valid until `batch_done` returns, so the receiver
+        /// can defer processing of the batch's packets until then.  (Without recvmmsg support each
+        /// batch is a single packet).
+        ///
+        /// If `unix_dir` is given then the socket uses the Unix datagram transport (see
+        /// opt::unix_transport) instead of UDP: `addr` (and the remote addresses of sent and
+        /// received packets) are then names of unix sockets in that directory (or the abstract
+        /// namespace, if empty) rather than actual IP addresses.
+        ///
+        /// If `addr` is a wildcard address (0.0.0.0 or ::) then the local address of each received
+        /// packet is the address it was actually sent to (where the platform supports
+        /// IP_PKTINFO/IPV6_PKTINFO), and sends with a specific local address in their path go out
+        /// from that address.  If `dual_stack` is true then `addr` must be the IPv6 wildcard
+        /// address, and the socket also handles IPv4 (see opt::dual_stack).
         ///
         /// ev_loop must outlive this object.
-        UDPSocket(event_base* ev_loop, const Address& addr, receive_callback_t cb);
+        UDPSocket(
+                event_base* ev_loop,
+                const Address& addr,
+                receive_callback_t cb,
+                batch_done_callback_t batch_done = nullptr,
+                std::optional<std::string> unix_dir = std::nullopt,
+                bool dual_stack = false);
+
+        /// Constructs a UDPSocket around an existing, already-bound UDP socket (such as one
+        /// inherited from another process; see opt::inherit_socket), taking ownership of it.  The
+        /// socket's options are set up as for a newly bound socket (a dual-stack socket is
+        /// detected from its IPV6_V6ONLY setting).  Throws if `sock` is not a bound IP socket.
+        UDPSocket(event_base* ev_loop, socket_t sock, receive_callback_t cb, batch_done_callback_t batch_done = nullptr);
 
         /// Non-copyable and non-moveable
         UDPSocket(const UDPSocket& s) = delete;
@@ -79,14 +134,20 @@ namespace oxen::quic
             return bound_;
         }
 
-        /// Attempts to send one or more UDP payloads to a single destination.  Returns a pair: an
+        /// Attempts to send one or more UDP payloads to a single destination, `path.remote`.  If the
+        /// socket is bound to a wildcard address and `path.local` is a specific address then the
+        /// packets are sent from that address (so that replies come from the address the peer sent
+        /// to, on multihomed hosts).  Returns a pair: an
         /// io_result of either success (all packets were sent), `blocked()` if some or all of the
         /// packets could not be sent, or otherwise a `failure()` on more serious errors; and the
         /// number of packets that were actually sent (between 0 and n_pkts).
         ///
         /// Payloads should be packed sequentially starting at `bufs` with the length of each
-        /// payload given by the `bufsize` array.  The ecn flag on the socket will be updated to the
-        /// given ecn value (if not already set to it).
+        /// payload given by the `bufsize` array.  `tos` is the traffic class byte for the packets:
+        /// the ECN bits (the lower 2 bits) are applied to the socket itself (if not already set to
+        /// them), while a non-zero DSCP (the upper 6 bits) is applied to just these packets via an
+        /// IP_TOS/IPV6_TCLASS control message carrying the full byte (see opt::dscp).  DSCP marking
+        /// is not supported on Windows or with the unix transport.
         ///
         /// If not all packets could be sent because the socket would block it is up to the caller
         /// to deal with it: if such a block occurs it is always the first `n` packets that will
@@ -96,8 +157,138 @@ namespace oxen::quic
         /// Typically this is done by blocking creation of new packets and using `when_writeable` to
         /// retry however much of the send is remaining (via resend()) and, once the send is fully
         /// completed, resuming creation of new packets.
+        ///
+        /// If zero-copy sending is enabled (see `enable_zerocopy`) and `pin` is given, a batch
+        /// totalling at least the zero-copy threshold is sent with MSG_ZEROCOPY: the kernel then
+        /// keeps reading from `bufs` after this returns, so the socket holds a copy of `pin` until
+        /// the kernel reports that it is done, and the caller must not modify the buffer while it
+        /// is held (i.e. while `pin.use_count()` shows the extra reference).
         std::pair<io_result, size_t> send(
-                const Address& dest, const std::byte* bufs, const size_t* bufsize, uint8_t ecn, size_t n_pkts);
+                const Path& path,
+                const std::byte* bufs,
+                const size_t* bufsize,
+                uint8_t tos,
+                size_t n_pkts,
+                const std::shared_ptr<void>& pin = nullptr);
+
+        /// Sends `n_pkts` packets to (potentially) different destinations: packet `i` goes to
+        /// `paths[i].remote` with traffic class `tos[i]`, with payloads and sizes as in `send()`.
+        /// Where sendmmsg is available this sends up to MAX_BATCH packets with a single call, for
+        /// sending one-off packets to many remotes at once (such as close packets when shutting
+        /// down).  The packets are sent with the socket's current ECN setting, and never zero-copy.
+        /// Returns as `send()`, except that only a prefix of the packets may be attempted: callers
+        /// should send the remainder with further calls.
+        std::pair<io_result, size_t> send_multi(
+                const Path* paths, const std::byte* bufs, const size_t* bufsize, const uint8_t* tos, size_t n_pkts);
+
+        /// Sets the maximum UDP payload size that this socket can receive, resizing the receive
+        /// buffers accordingly.  Defaults to `max_payload_size`; this should be increased to match
+        /// the configured maximum when using path MTU discovery on jumbo-frame networks.
+        void set_max_payload_size(size_t size);
+
+        /// Returns the underlying socket, e.g. for handing it to another process (see
+        /// Endpoint::hand_off).  It remains owned (and is closed on destruction) by this object.
+        socket_t handle() const { return sock_; }
+
+        /// Stops reading packets from the socket (sending is unaffected), for when another process
+        /// has taken over receiving on it (see Endpoint::hand_off).
+        void stop_receiving();
+
+        /// Returns true if this socket handles both IPv4 and IPv6 (see opt::dual_stack).
+        bool is_dual_stack() const { return dual_stack_; }
+
+        /// Returns true if this socket uses the Unix datagram transport rather than UDP.
+        bool is_unix() const { return unix_dir_.has_value(); }
+
+        /// Returns the current maximum receivable UDP payload size.
+        size_t max_payload() const { return max_payload_; }
+
+        /// Connects the socket to the given remote address so that packets sent to that remote do
+        /// not need to carry a destination address (letting the kernel use its cached route).
+        /// Once connected, the socket only receives packets from `remote`.  Sending to other
+        /// addresses is still permitted (the destination is included explicitly in such cases).
+        /// Failure to connect is logged and leaves the socket unconnected.
+        void connect(const Address& remote);
+
+        /// Dissolves a connection established by `connect()`, returning the socket to a regular
+        /// unconnected socket that sends to and receives from anywhere.  Does nothing if not
+        /// connected.  The socket keeps its local port even if that was assigned by the kernel
+        /// (which, on Linux, releases such a port when a socket is disconnected): it is bound to
+        /// it again explicitly.
+        void disconnect();
+
+        /// Returns a pointer to the address this socket is connected to, or nullptr if not
+        /// connected.
+        const Address* connected_address() const { return connected_ ? &*connected_ : nullptr; }
+
+        /// Sets SO_BUSY_POLL (and, if `prefer` is true, SO_PREFER_BUSY_POLL) on the socket so that
+        /// blocking and non-blocking receives poll the device queue directly for up to `usec`.  This
+        /// requires kernel support (and CAP_NET_ADMIN to exceed the net.core.busy_read sysctl);
+        /// failures are logged but otherwise ignored.  Does nothing on platforms without
+        /// SO_BUSY_POLL.
+        void set_busy_poll(std::chrono::microseconds usec, bool prefer);
+
+        /// Sets the socket's kernel receive buffer size (SO_RCVBUF).  SO_RCVBUFFORCE is tried first
+        /// (where available) so that privileged processes may exceed the system maximum; otherwise
+        /// the size is capped by the kernel.  Returns the resulting buffer size as reported by the
+        /// kernel (note that Linux reports double the requested value, as it includes bookkeeping
+        /// overhead).  Failures are logged but otherwise ignored.
+        size_t set_receive_buffer_size(size_t size);
+
+        /// Sets the socket's kernel send buffer size (SO_SNDBUF); as `set_receive_buffer_size`.
+        size_t set_send_buffer_size(size_t size);
+
+        /// Returns the current kernel receive/send buffer sizes (as reported by getsockopt).
+        size_t receive_buffer_size() const;
+        size_t send_buffer_size() const;
+
+        /// Returns the number of received packets dropped by the kernel because the socket receive
+        /// buffer was full, as reported by SO_RXQ_OVFL.  This is only updated when packets are
+        /// received, and is always 0 on platforms without SO_RXQ_OVFL.
+        uint32_t receive_drops() const { return rx_drops_; }
+
+        /// Returns the number of sends (since construction) that could not be completed because the
+        /// socket would block.
+        uint64_t send_blocks() const { return send_blocks_; }
+
+#ifdef OXEN_LIBQUIC_TEST_HOOKS
+        /// For testing: makes the next `n` calls to send() send nothing and report the socket as
+        /// blocked (while it actually stays writeable, so that when_writeable() callbacks fire right
+        /// away).  The packets of each batch refused this way are recorded, and the next send() is
+        /// checked to start with the very same packets (as a retry of a blocked send must); the
+        /// results are counted in simulated_resends() and simulated_resend_mismatches().  May be
+        /// called from any thread.  Only available in builds with LIBQUIC_TEST_HOOKS.
+        void simulate_send_blocks(size_t n) { sim_block_sends_ += n; }
+        uint64_t simulated_resends() const { return sim_resends_; }
+        uint64_t simulated_resend_mismatches() const { return sim_resend_mismatches_; }
+#endif
+
+        /// Enables zero-copy sends (SO_ZEROCOPY) of batches of at least `min_bytes`; see
+        /// opt::zerocopy_send.  Returns false (and leaves regular sends in place) if not supported.
+        bool enable_zerocopy(size_t min_bytes);
+
+        /// Returns true if zero-copy sending is enabled.
+        bool zerocopy() const { return zerocopy_min_ > 0; }
+
+        /// Returns the number of sendmsg-level messages sent zero-copy, and how many of those the
+        /// kernel reported having had to copy anyway (e.g. on loopback, or with devices lacking
+        /// scatter-gather support).  Both are 0 if zero-copy is not enabled.
+        uint64_t zerocopy_sends() const { return zc_sends_; }
+        uint64_t zerocopy_copied() const { return zc_copied_; }
+
+        /// Switches packet I/O to AF_XDP as configured by `conf` (see opt::xdp), keeping this
+        /// socket for packets the XDP socket can't handle.  The max payload size (see
+        /// set_max_payload_size) is lowered, if need be, to what fits in an AF_XDP frame.  Throws
+        /// on failure, or if libquic was built without AF_XDP support.
+        void enable_xdp(const opt::xdp& conf);
+
+        /// Returns true if this socket uses AF_XDP for packet I/O.
+        bool is_xdp() const { return xdp_ != nullptr; }
+
+        /// Tells the socket that `pkt`, from the current receive batch, has been authenticated, and
+        /// so that its source can be trusted as a route for replies.  Only AF_XDP needs this (it
+        /// addresses outgoing frames using what it learned from received ones); otherwise a no-op.
+        void confirm_path(const Packet& pkt);
 
         /// Queues a callback to invoke when the UDP socket becomes writeable again.
         ///
@@ -111,20 +302,113 @@ namespace oxen::quic
         ~UDPSocket();
 
       private:
-        void process_packet(bstring_view payload, msghdr& hdr);
+        // Sets up socket options and events once the socket is bound; used by the constructors.
+        void init();
+
+        // Processes a received packet; `local` is where we store the packet's local address, if
+        // we get one from pktinfo (it must stay valid until the end of the receive batch).
+        void process_packet(bstring_view payload, msghdr& hdr, Address& local);
+
+        // Per-message control messages for sends: the traffic class, when it carries a DSCP
+        // marking, and the source address, when sending from a specific address on a wildcard-bound
+        // socket.
+        bool need_source_cmsg(const Path& path) const;
+        bool need_send_cmsgs(const Path& path, uint8_t tos) const;
+        void append_send_cmsgs(msghdr& hdr, const Path& path, uint8_t tos) const;
         io_result receive();
 
+        // AF_XDP backend (see opt::xdp), and its receive event
+        std::unique_ptr<xdp_socket> xdp_;
+        event_ptr xdp_ev_;
+        void receive_xdp();
+
+        // Set when the last send() blocked on the AF_XDP TX ring, in which case when_writeable()
+        // waits for the XDP socket (with xdp_wev_), as the regular socket is writeable regardless.
+        bool xdp_blocked_{false};
+        event_ptr xdp_wev_;
+
         socket_t sock_;
         Address bound_;
+
+        // Set in Unix transport mode: the socket directory (empty for the abstract namespace), and
+        // the path of our bound socket file (which we unlink on destruction).
+        std::optional<std::string> unix_dir_;
+        std::string unix_path_;
+        void bind_unix(const Address& addr);
+        std::pair<io_result, size_t> send_unix(
+                const Address& dest, const std::byte* bufs, const size_t* bufsize, size_t n_pkts);
+        std::optional<Address> connected_;
         uint8_t ecn_{0};
+
+        // Set for a dual-stack socket, which sends to IPv4 remotes via IPv4-mapped addresses (and
+        // reports IPv4 remotes as plain IPv4 addresses); and when bound to a wildcard address, in
+        // which case we request pktinfo to learn the local address of each received packet.
+        bool dual_stack_{false};
+        bool pktinfo_{false};
+
+        // Local addresses of the packets in the current receive batch, when using pktinfo
+        std::array<Address, DATAGRAM_BATCH_SIZE> recv_local_;
         void set_ecn();
 
+        // Cumulative kernel receive drop count (from the most recent SO_RXQ_OVFL control message)
+        // and count of blocked sends.
+        uint32_t rx_drops_{0};
+        uint64_t send_blocks_{0};
+
+#ifdef OXEN_LIBQUIC_TEST_HOOKS
+        // simulate_send_blocks() state: sends still to refuse, the packets of the last refused
+        // batch (empty if the following send has been checked), and the check counts.
+        std::atomic<size_t> sim_block_sends_{0};
+        std::vector<bstring> sim_refused_;
+        std::atomic<uint64_t> sim_resends_{0};
+        std::atomic<uint64_t> sim_resend_mismatches_{0};
+
+        // Checks a send against the last refused batch, and refuses it if more blocks are due.
+        // Returns true if the send is refused.
+        bool simulated_block(const std::byte* buf, const size_t* bufsize, size_t n_pkts);
+#endif
+
+        // Zero-copy state: the minimum batch size to send zero-copy (0 if disabled), the id the
+        // kernel will assign to our next zero-copy message, and the pins of sends that the kernel
+        // has not yet reported complete, with the id range of their messages and the number of
+        // those still outstanding.
+        struct zerocopy_pending
+        {
+            uint32_t first_id;
+            uint32_t count;
+            uint32_t remaining;
+            std::shared_ptr<void> pin;
+        };
+        size_t zerocopy_min_{0};
+        uint32_t zc_next_id_{0};
+        std::deque<zerocopy_pending> zc_pending_;
+        uint64_t zc_sends_{0};
+        uint64_t zc_copied_{0};
+
+        // Reads zero-copy completion notifications from the socket error queue, releasing the pins
+        // of completed sends.
+        void process_zerocopy_completions();
+
+        size_t set_buffer_size(int opt, int force_opt, size_t size);
+        size_t get_buffer_size(int opt) const;
+
+        // Sets the don't-fragment bit on outgoing packets (needed for path MTU discovery).
+        void set_dont_fragment();
+
+        // Receive buffers, `max_payload_` bytes for each of the (up to) DATAGRAM_BATCH_SIZE
+        // packets we read at once.
+        size_t max_payload_{max_payload_size};
+        std::vector<std::byte> recv_buf_;
+
         event_base* ev_ = nullptr;
 
         event_ptr rev_ = nullptr;
         receive_callback_t receive_callback_;
+        batch_done_callback_t batch_done_callback_;
         event_ptr wev_ = nullptr;
         std::vector<std::function<void()>> writeable_callbacks_;
+        // Invokes (and clears) the when_writeable callbacks
+        void on_writeable();
     };
 
 }  // namespace oxen::quic
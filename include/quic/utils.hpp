@@ -22,6 +22,8 @@ extern "C"
 #include <oxenc/hex.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstdint>
@@ -30,12 +32,15 @@ extern "C"
 #include <future>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <optional>
 #include <oxen/log.hpp>
 #include <oxen/log/format.hpp>
 #include <random>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <vector>
 
 /*
  * Example 1: Handshake with www.google.com
@@ -54,6 +59,7 @@ namespace oxen::quic
     inline auto log_cat = oxen::log::Cat("quic");
 
     class Stream;
+    class connection_interface;
 
     using namespace std::literals;
     using namespace oxen::log::literals;
@@ -122,6 +128,131 @@ namespace oxen::quic
     using stream_open_callback_t = std::function<uint64_t(Stream&)>;
     using unblocked_callback_t = std::function<bool(Stream&)>;
 
+    // Datagram callback (see opt::enable_datagrams); the data is only valid for the duration of
+    // the call.
+    using datagram_data_callback_t = std::function<void(connection_interface&, bstring_view)>;
+
+    // Slot for attaching application state to a library object (Connection, Stream) so that
+    // callbacks can get back to it directly rather than looking it up by connection/stream ID.
+    // The slot holds either a non-owning pointer (set_user_data) or an object that it owns and
+    // destroys along with the library object (emplace_user_data).  Retrieval via user_data<T>() is
+    // an unchecked cast: the caller must ask for the type that was stored.
+    class user_data_slot
+    {
+        void* ptr_ = nullptr;
+        std::unique_ptr<void, void (*)(void*)> owned_{nullptr, [](void*) {}};
+
+      public:
+        void set_user_data(void* ptr)
+        {
+            owned_.reset();
+            ptr_ = ptr;
+        }
+
+        template <typename T, typename... Args>
+        T& emplace_user_data(Args&&... args)
+        {
+            auto* p = new T(std::forward<Args>(args)...);
+            owned_ = {p, [](void* x) { delete static_cast<T*>(x); }};
+            ptr_ = p;
+            return *p;
+        }
+
+        template <typename T = void>
+        T* user_data() const
+        {
+            return static_cast<T*>(ptr_);
+        }
+    };
+
+    // Byte-counting token bucket used for egress rate limiting (see opt::rate_limit).  The bucket
+    // refills at `rate` bytes per second up to `burst` bytes, and is allowed to go into deficit: a
+    // packet may be sent whenever there are any tokens at all, and its full size is then consumed,
+    // so that packet sizes never need to be known in advance.
+    class token_bucket
+    {
+        double rate_per_ns;
+        int64_t burst;
+        int64_t tokens;
+        std::chrono::steady_clock::time_point last_refill;
+
+      public:
+        token_bucket(uint64_t rate, uint64_t burst, std::chrono::steady_clock::time_point now);
+
+        // Adds the tokens accumulated since the last refill.
+        void refill(std::chrono::steady_clock::time_point now);
+
+        // True if there are tokens available (i.e. at least one more packet may be sent).
+        bool ready() const { return tokens > 0; }
+
+        void consume(size_t bytes) { tokens -= static_cast<int64_t>(bytes); }
+
+        // Returns the time at which the bucket will be ready again (`now` if already ready).
+        std::chrono::steady_clock::time_point ready_at(std::chrono::steady_clock::time_point now) const;
+    };
+
+    // Accumulates the time spent in throttled periods (i.e. while rate limiting held back sending).
+    class throttle_timer
+    {
+        std::optional<std::chrono::steady_clock::time_point> since;
+        std::chrono::nanoseconds total{0};
+
+      public:
+        // Records the start (if not already started) or end of a throttled period.
+        void set(bool throttled, std::chrono::steady_clock::time_point now);
+
+        // Total time spent throttled, including any current throttled period.
+        std::chrono::nanoseconds elapsed(std::chrono::steady_clock::time_point now) const;
+    };
+
+    // Bounded single-producer, single-consumer queue: one thread may push() while another
+    // pop()s, without locks (each side only writes its own index, publishing slots to the other
+    // side with release/acquire ordering).  Used to hand work between a worker thread and the event
+    // loop without the loop ever blocking on the worker.
+    template <typename T>
+    class spsc_queue
+    {
+        std::vector<std::optional<T>> slots;
+        // Separate cache lines so that the producer and consumer don't contend on them
+        alignas(64) std::atomic<size_t> head{0};  // Next slot to pop (written by the consumer)
+        alignas(64) std::atomic<size_t> tail{0};  // Next slot to push into (written by the producer)
+
+        size_t next(size_t i) const { return i + 1 == slots.size() ? 0 : i + 1; }
+
+      public:
+        explicit spsc_queue(size_t capacity) : slots(capacity + 1) {}
+
+        // Producer: appends `value`, returning false (and leaving `value` alone) if the queue is full.
+        bool push(T&& value)
+        {
+            auto t = tail.load(std::memory_order_relaxed);
+            auto n = next(t);
+            if (n == head.load(std::memory_order_acquire))
+                return false;
+            slots[t].emplace(std::move(value));
+            tail.store(n, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer: removes the oldest value, or returns nullopt if the queue is empty.
+        std::optional<T> pop()
+        {
+            auto h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+                return std::nullopt;
+            std::optional<T> value{std::move(slots[h])};
+            slots[h].reset();
+            head.store(next(h), std::memory_order_release);
+            return value;
+        }
+
+        // Producer: true if a push() would currently fail.
+        bool full() const { return next(tail.load(std::memory_order_relaxed)) == head.load(std::memory_order_acquire); }
+
+        // Consumer: true if a pop() would currently fail.
+        bool empty() const { return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire); }
+    };
+
     inline constexpr uint64_t DEFAULT_MAX_BIDI_STREAMS = 32;
 
     // Maximum number of packets we can send in one batch when using sendmmsg/GSO, and maximum we
@@ -166,6 +297,9 @@ namespace oxen::quic
     inline constexpr uint64_t STREAM_ERROR_EXCEPTION = (1ULL << 62) - 2;
     // Error code we send to a stream close callback if the stream's connection expires
     inline constexpr uint64_t STREAM_ERROR_CONNECTION_EXPIRED = (1ULL << 62) + 1;
+    // Application error code we close with if a compressed stream's data cannot be decoded (see
+    // opt::stream_compression)
+    inline constexpr uint64_t STREAM_ERROR_BAD_ENCODING = (1ULL << 62) - 3;
 
     // bstring_view literals baby
     inline std::basic_string_view<std::byte> operator""_bsv(const char* __str, size_t __len) noexcept
@@ -242,16 +376,37 @@ namespace oxen::quic
     template <>
     constexpr inline bool IsToStringFormattable<ConnectionID> = true;
 
-    // Holds an address, with a ngtcp2_addr held for easier passing into ngtcp2 functions.
+    // A stateless reset token (RFC 9000 §10.3), as found in the last bytes of a stateless reset
+    using reset_token = std::array<uint8_t, NGTCP2_STATELESS_RESET_TOKENLEN>;
+
+    // Tokens are random (or HMAC output), so any slice of them makes a fine hash
+    struct reset_token_hash
+    {
+        size_t operator()(const reset_token& token) const
+        {
+            size_t h;
+            std::memcpy(&h, token.data(), sizeof(h));
+            return h;
+        }
+    };
+
+    // Holds an IPv4 or IPv6 address, with a ngtcp2_addr held for easier passing into ngtcp2
+    // functions.  The storage is only as large as a sockaddr_in6 (rather than a full 128-byte
+    // sockaddr_storage) because addresses get copied around on the packet path.
     struct Address
     {
       private:
-        sockaddr_storage _sock_addr{};
-        ngtcp2_addr _addr{reinterpret_cast<sockaddr*>(&_sock_addr), 0};
+        union
+        {
+            sockaddr _sa;
+            sockaddr_in _sin;
+            sockaddr_in6 _sin6{};
+        };
+        ngtcp2_addr _addr{&_sa, 0};
 
         void _copy_internals(const Address& obj)
         {
-            std::memmove(&_sock_addr, &obj._sock_addr, sizeof(_sock_addr));
+            std::memcpy(&_sin6, &obj._sin6, sizeof(_sin6));
             _addr.addrlen = obj._addr.addrlen;
         }
 
@@ -259,13 +414,14 @@ namespace oxen::quic
         // Default constructor yields [::]:0
         Address()
         {
-            _sock_addr.ss_family = AF_INET6;
+            _sin6.sin6_family = AF_INET6;
             _addr.addrlen = sizeof(sockaddr_in6);
         }
 
         Address(const sockaddr* s, socklen_t n)
         {
-            std::memmove(&_sock_addr, s, n);
+            assert(n <= sizeof(_sin6));
+            std::memcpy(&_sin6, s, n);
             _addr.addrlen = n;
         }
         explicit Address(const sockaddr* s) :
@@ -286,7 +442,7 @@ namespace oxen::quic
             _addr.addrlen = std::is_same_v<T, sockaddr>
                                   ? s->sa_family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6)
                                   : sizeof(T);
-            std::memmove(&_sock_addr, s, _addr.addrlen);
+            std::memcpy(&_sin6, s, _addr.addrlen);
             return *this;
         }
 
@@ -299,38 +455,49 @@ namespace oxen::quic
 
         inline bool is_ipv4() const
         {
-            return _addr.addrlen == sizeof(sockaddr_in) &&
-                   reinterpret_cast<const sockaddr_in&>(_sock_addr).sin_family == AF_INET;
+            return _addr.addrlen == sizeof(sockaddr_in) && _sin.sin_family == AF_INET;
         }
         inline bool is_ipv6() const
         {
-            return _addr.addrlen == sizeof(sockaddr_in6) &&
-                   reinterpret_cast<const sockaddr_in6&>(_sock_addr).sin6_family == AF_INET6;
+            return _addr.addrlen == sizeof(sockaddr_in6) && _sin6.sin6_family == AF_INET6;
         }
 
         // Accesses the sockaddr_in for this address.  Precondition: `is_ipv4()`
         inline const sockaddr_in& in4() const
         {
             assert(is_ipv4());
-            return reinterpret_cast<const sockaddr_in&>(_sock_addr);
+            return _sin;
         }
 
         // Accesses the sockaddr_in6 for this address.  Precondition: `is_ipv6()`
         inline const sockaddr_in6& in6() const
         {
             assert(is_ipv6());
-            return reinterpret_cast<const sockaddr_in6&>(_sock_addr);
+            return _sin6;
         }
 
         inline uint16_t port() const
         {
             assert(is_ipv4() || is_ipv6());
 
-            return oxenc::big_to_host(
-                    is_ipv4() ? reinterpret_cast<const sockaddr_in&>(_sock_addr).sin_port
-                              : reinterpret_cast<const sockaddr_in6&>(_sock_addr).sin6_port);
+            return oxenc::big_to_host(is_ipv4() ? _sin.sin_port : _sin6.sin6_port);
         }
 
+        // Returns true if this is the IPv4 or IPv6 any address (0.0.0.0 or ::), with any port.
+        bool is_any_addr() const;
+
+        // Returns true if this is an IPv4-mapped IPv6 address (::ffff:a.b.c.d), as used for IPv4
+        // peers of a dual-stack socket.
+        bool is_ipv4_mapped() const;
+
+        // Returns the IPv4 address (and port) of an IPv4-mapped IPv6 address; any other address is
+        // returned unchanged.
+        Address unmapped() const;
+
+        // Returns the IPv4-mapped IPv6 equivalent of an IPv4 address; any other address is
+        // returned unchanged.
+        Address mapped() const;
+
         // template code to implicitly convert to sockaddr*, sockaddr_in*, sockaddr_in6* so that
         // this can be passed into C functions taking such a pointer (for the first you also want
         // `socklen()`).
@@ -346,7 +513,7 @@ namespace oxen::quic
                         int> = 0>
         operator T*()
         {
-            return reinterpret_cast<T*>(&_sock_addr);
+            return reinterpret_cast<T*>(&_sin6);
         }
         template <
                 typename T,
@@ -355,7 +522,7 @@ namespace oxen::quic
                         int> = 0>
         operator const T*() const
         {
-            return reinterpret_cast<const T*>(&_sock_addr);
+            return reinterpret_cast<const T*>(&_sin6);
         }
 
         // Conversion to a const ngtcp2_addr reference and pointer.  We don't provide non-const
@@ -389,7 +556,8 @@ namespace oxen::quic
         socklen_t socklen() const { return _addr.addrlen; }
 
         // Returns a pointer to the sockaddr size; typically you want this when updating the address
-        // via a function like `getsockname`.
+        // via a function like `getsockname`.  Note that the available storage is only
+        // sizeof(sockaddr_in6) bytes.
         socklen_t* socklen_ptr() { return &_addr.addrlen; }
 
         // Updates the socklen of the sockaddr; this must be called if directly modifying the
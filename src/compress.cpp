@@ -0,0 +1,257 @@
+#include "compress.hpp"
+
+#include <array>
+
+#include "stream.hpp"
+
+namespace oxen::quic
+{
+    // Adaptive compression level bounds and starting point.  Levels above ~12 cost far more CPU
+    // for little extra gain on typical structured data, so we don't adapt beyond that.
+    static constexpr int ADAPTIVE_MIN_LEVEL = 1;
+    static constexpr int ADAPTIVE_MAX_LEVEL = 12;
+    static constexpr int ADAPTIVE_START_LEVEL = 3;
+
+    // How often we reconsider the adaptive compression level
+    static constexpr auto ADAPT_INTERVAL = 100ms;
+
+    // Unsent compressed data above which we consider the link (rather than compression) to be the
+    // bottleneck.
+    static constexpr size_t ADAPT_BACKLOG = 64_ki;
+
+    // Compressed output is written into pooled buffers of this size; a buffer is shared by the
+    // output of consecutive sends until it has less than MIN_OUTPUT_SPACE left.
+    static constexpr size_t OUTPUT_BUFFER_SIZE = 128_ki;
+    static constexpr size_t MIN_OUTPUT_SPACE = 1_ki;
+
+    static constexpr std::array<std::byte, 1> PLAIN_HEADER{STREAM_ENCODING_PLAIN};
+    static constexpr std::array<std::byte, 1> ZSTD_HEADER{STREAM_ENCODING_ZSTD};
+
+    struct stream_codec::out_buffer
+    {
+        std::unique_ptr<std::byte[]> data{new std::byte[OUTPUT_BUFFER_SIZE]};
+        size_t used = 0;
+
+        size_t space() const { return OUTPUT_BUFFER_SIZE - used; }
+    };
+
+    // Pool of output buffers.  Buffers are handed to the stream (via keep-alives) and return here
+    // once all the data written into them has been acknowledged; the keep-alives only hold a weak
+    // reference, so buffers released after the codec is gone are simply freed.
+    struct stream_codec::buffer_pool : std::enable_shared_from_this<buffer_pool>
+    {
+        // Maximum number of idle buffers we hold onto
+        static constexpr size_t MAX_FREE = 4;
+
+        std::vector<std::unique_ptr<out_buffer>> free;
+
+        std::shared_ptr<out_buffer> get()
+        {
+            std::unique_ptr<out_buffer> buf;
+            if (free.empty())
+                buf = std::make_unique<out_buffer>();
+            else
+            {
+                buf = std::move(free.back());
+                free.pop_back();
+                buf->used = 0;
+            }
+            return {buf.release(), [weak = weak_from_this()](out_buffer* b) {
+                        std::unique_ptr<out_buffer> ptr{b};
+                        if (auto pool = weak.lock(); pool && pool->free.size() < MAX_FREE)
+                            pool->free.push_back(std::move(ptr));
+                    }};
+        }
+    };
+
+    stream_codec::stream_codec(const opt::stream_compression& conf) :
+            adaptive{conf.level == 0},
+            compress{conf.compress},
+            current_level{conf.level ? conf.level : ADAPTIVE_START_LEVEL},
+            pool{std::make_shared<buffer_pool>()},
+            window_start{std::chrono::steady_clock::now()}
+    {}
+
+    stream_codec::~stream_codec()
+    {
+#ifdef OXEN_LIBQUIC_ZSTD
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+#endif
+    }
+
+    bool stream_codec::set_compress(bool c)
+    {
+        if (header_sent)
+            return false;
+        compress = c;
+        return true;
+    }
+
+    std::optional<int> stream_codec::adapt(const Stream& s)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = now - window_start;
+        if (!adaptive || elapsed < ADAPT_INTERVAL)
+            return std::nullopt;
+
+        std::optional<int> new_level;
+        if (window_in > 0 && window_out > 0 && window_cpu.count() > 0)
+        {
+            using secs = std::chrono::duration<double>;
+            // The uncompressed data rate compression can sustain (per CPU second) vs. the rate at
+            // which (the uncompressed equivalent of) data is getting through to the peer.
+            double cpu_rate = window_in / secs{window_cpu}.count();
+            double link_rate = window_acked * (double(window_in) / window_out) / secs{elapsed}.count();
+
+            if (cpu_rate < 2 * link_rate && current_level > ADAPTIVE_MIN_LEVEL)
+                // Compression is using more than half of the wall time: it is (or is close to
+                // being) the bottleneck, so back off.
+                new_level = current_level - 1;
+            else if (s.unsent() >= ADAPT_BACKLOG && cpu_rate > 4 * link_rate && current_level < ADAPTIVE_MAX_LEVEL)
+                // Data is piling up waiting for the link and we have CPU to spare: spend it on
+                // making the data smaller.
+                new_level = current_level + 1;
+
+            log::trace(
+                    log_cat,
+                    "Stream {} compression: cpu rate {:.0f}B/s, link rate {:.0f}B/s, ratio {:.2f}, level {} -> {}",
+                    s.stream_id,
+                    cpu_rate,
+                    link_rate,
+                    double(window_in) / window_out,
+                    current_level,
+                    new_level.value_or(current_level));
+        }
+
+        window_start = now;
+        window_in = window_out = window_acked = 0;
+        window_cpu = 0ns;
+        return new_level;
+    }
+
+    void stream_codec::send(Stream& s, bstring_view data, std::shared_ptr<void> keep_alive)
+    {
+        if (!header_sent)
+        {
+            header_sent = true;
+            auto& header = compress ? ZSTD_HEADER : PLAIN_HEADER;
+            s.append_buffer(bstring_view{header.data(), header.size()}, nullptr);
+        }
+
+        if (!compress)
+            return s.append_buffer(data, std::move(keep_alive));
+
+#ifdef OXEN_LIBQUIC_ZSTD
+        if (!cctx)
+        {
+            cctx = ZSTD_createCCtx();
+            if (!cctx)
+                throw std::bad_alloc{};
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, current_level);
+        }
+
+        // Changing the level requires starting a new zstd frame, so if we're changing it we end
+        // the current frame with this data (rather than just flushing it).
+        auto new_level = adapt(s);
+        auto mode = new_level ? ZSTD_e_end : ZSTD_e_flush;
+
+        auto started = std::chrono::steady_clock::now();
+
+        // Output pieces to append; the final one also carries the input's keep-alive.
+        std::vector<std::pair<bstring_view, std::shared_ptr<out_buffer>>> pieces;
+        ZSTD_inBuffer in{data.data(), data.size(), 0};
+        for (;;)
+        {
+            if (!current || current->space() < MIN_OUTPUT_SPACE)
+                current = pool->get();
+
+            ZSTD_outBuffer out{current->data.get(), OUTPUT_BUFFER_SIZE, current->used};
+            auto remaining = ZSTD_compressStream2(cctx, &out, &in, mode);
+            if (ZSTD_isError(remaining))
+                throw std::runtime_error{"zstd compression failed: {}"_format(ZSTD_getErrorName(remaining))};
+
+            if (out.pos > current->used)
+            {
+                pieces.emplace_back(bstring_view{current->data.get() + current->used, out.pos - current->used}, current);
+                window_out += out.pos - current->used;
+                current->used = out.pos;
+            }
+            if (remaining == 0)
+                break;
+        }
+
+        window_cpu += std::chrono::steady_clock::now() - started;
+        window_in += data.size();
+
+        if (new_level)
+        {
+            current_level = *new_level;
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, current_level);
+        }
+
+        for (size_t i = 0; i < pieces.size(); i++)
+        {
+            auto& [view, buf] = pieces[i];
+            if (i + 1 < pieces.size() || !keep_alive)
+                s.append_buffer(view, std::move(buf));
+            else
+                s.append_buffer(
+                        view,
+                        std::make_shared<std::pair<std::shared_ptr<out_buffer>, std::shared_ptr<void>>>(
+                                std::move(buf), std::move(keep_alive)));
+        }
+#else
+        (void)keep_alive;
+        throw std::logic_error{"libquic was built without stream compression support"};
+#endif
+    }
+
+    bool stream_codec::receive(bstring_view data, const std::function<bool(bstring_view)>& deliver)
+    {
+        if (!header_received)
+        {
+            if (data.empty())
+                return true;
+            auto encoding = data.front();
+            data.remove_prefix(1);
+            header_received = true;
+
+            if (encoding == STREAM_ENCODING_ZSTD)
+            {
+#ifdef OXEN_LIBQUIC_ZSTD
+                dctx = ZSTD_createDCtx();
+                if (!dctx)
+                    throw std::bad_alloc{};
+                decode_buf.resize(ZSTD_DStreamOutSize());
+#else
+                throw std::runtime_error{"received zstd-compressed stream, but zstd support is not available"};
+#endif
+            }
+            else if (encoding != STREAM_ENCODING_PLAIN)
+                throw std::runtime_error{"invalid stream encoding header {}"_format(static_cast<int>(encoding))};
+        }
+
+#ifdef OXEN_LIBQUIC_ZSTD
+        if (dctx)
+        {
+            ZSTD_inBuffer in{data.data(), data.size(), 0};
+            ZSTD_outBuffer out{decode_buf.data(), decode_buf.size(), 0};
+            // Keep going until all input is consumed *and* the output buffer wasn't filled (a full
+            // output buffer means there may be more decompressed data waiting to come out).
+            while (in.pos < in.size || out.pos == out.size)
+            {
+                out.pos = 0;
+                auto rv = ZSTD_decompressStream(dctx, &out, &in);
+                if (ZSTD_isError(rv))
+                    throw std::runtime_error{"zstd decompression failed: {}"_format(ZSTD_getErrorName(rv))};
+                if (out.pos > 0 && !deliver(bstring_view{decode_buf.data(), out.pos}))
+                    return false;
+            }
+            return true;
+        }
+#endif
+
+        return data.empty() || deliver(data);
+    }
+}  // namespace oxen::quic
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "opt.hpp"
+#include "utils.hpp"
+
+#ifdef OXEN_LIBQUIC_ZSTD
+#include <zstd.h>
+#endif
+
+namespace oxen::quic
+{
+    class Stream;
+
+    // Stream-open header values sent as the first byte of each stream direction when stream
+    // compression is enabled on a connection.
+    inline constexpr std::byte STREAM_ENCODING_PLAIN{0x00};
+    inline constexpr std::byte STREAM_ENCODING_ZSTD{0x01};
+
+    // ALPN protocol through which both sides of a connection agree to use stream compression
+    inline constexpr auto STREAM_COMPRESSION_ALPN = "libquic-zstd";
+
+    // Per-stream encoder/decoder implementing opt::stream_compression: writes the stream-open
+    // header and (optionally) zstd-compresses outgoing data into pooled buffers before it is handed
+    // to Stream::append_buffer, and parses the peer's header and decompresses incoming data before
+    // it is passed to the stream's data callback.  Only used from the event loop thread.
+    class stream_codec
+    {
+      public:
+        explicit stream_codec(const opt::stream_compression& conf);
+        ~stream_codec();
+
+        stream_codec(const stream_codec&) = delete;
+        stream_codec& operator=(const stream_codec&) = delete;
+
+        // Sets whether this side compresses its outgoing data.  Returns false (and does nothing) if
+        // data has already been sent, as the header announcing the encoding has then gone out.
+        bool set_compress(bool compress);
+
+        bool compressing() const { return compress; }
+
+        // The current compression level (which changes over time when adaptive).
+        int level() const { return current_level; }
+
+        // Encodes `data` and appends it (preceded by the header, on the first call) to the stream's
+        // outgoing buffers.  The keep-alive is held until all of the output it contributed to has
+        // been acknowledged.
+        void send(Stream& s, bstring_view data, std::shared_ptr<void> keep_alive);
+
+        // Called with the size of each acknowledgement of the stream's outgoing data.
+        void acked(size_t bytes) { window_acked += bytes; }
+
+        // Decodes received stream data, passing decoded data to `deliver` (possibly in several
+        // pieces, each valid only for the duration of the call).  Returns false if `deliver` did;
+        // throws on an invalid header or corrupt compressed data.
+        bool receive(bstring_view data, const std::function<bool(bstring_view)>& deliver);
+
+      private:
+        struct out_buffer;
+        struct buffer_pool;
+
+        const bool adaptive;
+        bool compress;
+        int current_level;
+        bool header_sent{false};
+        bool header_received{false};
+
+        std::shared_ptr<buffer_pool> pool;
+        std::shared_ptr<out_buffer> current;
+
+        // Measurement window for adaptive levels: uncompressed input and compressed output bytes,
+        // time spent compressing, and compressed bytes acknowledged by the peer.
+        std::chrono::steady_clock::time_point window_start;
+        size_t window_in{0};
+        size_t window_out{0};
+        size_t window_acked{0};
+        std::chrono::nanoseconds window_cpu{0};
+
+        // Returns a new compression level if the measurement window is complete and the level
+        // should change.
+        std::optional<int> adapt(const Stream& s);
+
+#ifdef OXEN_LIBQUIC_ZSTD
+        ZSTD_CCtx* cctx{nullptr};
+        ZSTD_DCtx* dctx{nullptr};
+        std::vector<std::byte> decode_buf;
+#endif
+    };
+}  // namespace oxen::quic
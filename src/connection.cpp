@@ -24,6 +24,8 @@ extern "C"
 #include <random>
 #include <stdexcept>
 
+#include "compress.hpp"
+#include "datagram_fec.hpp"
 #include "endpoint.hpp"
 #include "internal.hpp"
 #include "stream.hpp"
@@ -130,20 +132,58 @@ namespace oxen::quic
         (void)gnutls_rnd(GNUTLS_RND_RANDOM, dest, destlen);
     }
 
-    int get_new_connection_id_cb(ngtcp2_conn* conn, ngtcp2_cid* cid, uint8_t* token, size_t cidlen, void* user_data)
+    int get_new_connection_id_cb(ngtcp2_conn* /*conn*/, ngtcp2_cid* cid, uint8_t* token, size_t cidlen, void* user_data)
     {
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
-        (void)conn;
-        (void)user_data;
+        return static_cast<Connection*>(user_data)->new_connection_id(cid, token, cidlen);
+    }
 
-        if (gnutls_rnd(GNUTLS_RND_RANDOM, cid->data, cidlen) != 0)
-            return NGTCP2_ERR_CALLBACK_FAILURE;
+    int remove_connection_id_cb(ngtcp2_conn* /*conn*/, const ngtcp2_cid* cid, void* user_data)
+    {
+        log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
+        static_cast<Connection*>(user_data)->remove_connection_id(cid);
+        return 0;
+    }
 
-        cid->datalen = cidlen;
+    int dcid_status_cb(
+            ngtcp2_conn* /*conn*/,
+            ngtcp2_connection_id_status_type type,
+            uint64_t /*seq*/,
+            const ngtcp2_cid* /*cid*/,
+            const uint8_t* token,
+            void* user_data)
+    {
+        log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
+        if (token)
+            static_cast<Connection*>(user_data)->peer_reset_token(
+                    type == NGTCP2_CONNECTION_ID_STATUS_TYPE_ACTIVATE, token);
+        return 0;
+    }
 
-        if (gnutls_rnd(GNUTLS_RND_RANDOM, token, NGTCP2_STATELESS_RESET_TOKENLEN) != 0)
-            return NGTCP2_ERR_CALLBACK_FAILURE;
+    int recv_stateless_reset_cb(ngtcp2_conn* /*conn*/, const ngtcp2_pkt_stateless_reset* /*sr*/, void* user_data)
+    {
+        log::info(
+                log_cat,
+                "Received stateless reset for connection {}; remote has lost connection state",
+                static_cast<Connection*>(user_data)->scid());
+        return 0;
+    }
+
+    int recv_datagram(ngtcp2_conn* /*conn*/, uint32_t /*flags*/, const uint8_t* data, size_t datalen, void* user_data)
+    {
+        log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
+        return static_cast<Connection*>(user_data)->datagram_received({reinterpret_cast<const std::byte*>(data), datalen});
+    }
 
+    int ack_datagram(ngtcp2_conn* /*conn*/, uint64_t /*dgram_id*/, void* user_data)
+    {
+        static_cast<Connection*>(user_data)->datagram_feedback(false);
+        return 0;
+    }
+
+    int lost_datagram(ngtcp2_conn* /*conn*/, uint64_t /*dgram_id*/, void* user_data)
+    {
+        static_cast<Connection*>(user_data)->datagram_feedback(true);
         return 0;
     }
 
@@ -194,6 +234,7 @@ namespace oxen::quic
             if (int rv = ngtcp2_conn_open_bidi_stream(conn.get(), &str->stream_id, str.get()); rv == 0)
             {
                 log::debug(log_cat, "Stream [ID:{}] ready for broadcast, moving out of pending streams", str->stream_id);
+                settle_stream_codec(*str);
                 str->set_ready();
                 popped += 1;
                 streams[str->stream_id] = std::move(str);
@@ -206,10 +247,14 @@ namespace oxen::quic
 
     std::shared_ptr<Stream> Connection::get_new_stream(stream_data_callback_t data_cb, stream_close_callback_t close_cb)
     {
-        if (!data_cb)
+        const bool use_handler = !data_cb && context->stream_data_handler;
+        if (!data_cb && !use_handler)
             data_cb = context->stream_data_cb;
 
         auto stream = std::make_shared<Stream>(*this, _endpoint, std::move(data_cb), std::move(close_cb));
+        if (use_handler)
+            stream->handler = context->stream_data_handler;
+        add_stream_codec(*stream);
 
         if (int rv = ngtcp2_conn_open_bidi_stream(conn.get(), &stream->stream_id, stream.get()); rv != 0)
         {
@@ -221,6 +266,7 @@ namespace oxen::quic
         else
         {
             log::debug(log_cat, "Stream {} successfully created; ready to broadcast", stream->stream_id);
+            settle_stream_codec(*stream);
             stream->set_ready();
             auto& strm = streams[stream->stream_id];
             strm = std::move(stream);
@@ -228,6 +274,91 @@ namespace oxen::quic
         }
     }
 
+    // Maximum number of datagrams we queue for sending; beyond this the oldest are dropped (they
+    // would likely be stale by the time they went out anyway).
+    static constexpr size_t MAX_PENDING_DATAGRAMS = 256;
+
+    void Connection::send_datagram(bstring_view data)
+    {
+        if (!user_config.datagrams)
+            throw std::logic_error{"Datagrams are not enabled on this connection"};
+
+        _endpoint.net.call([this, data = bstring{data}]() mutable {
+            // An oversized datagram would be dropped when we come to send it anyway, but with FEC
+            // we must drop it now, as otherwise the group's parity datagram would be too big too.
+            if (fec && data.size() > max_datagram)
+            {
+                log::warning(
+                        log_cat,
+                        "Dropping {}B datagram: larger than the {}B that fit in a packet with FEC",
+                        data.size(),
+                        max_datagram.load());
+                return;
+            }
+
+            if (fec)
+                fec->encode(data, get_time(), pending_datagrams);
+            else
+                pending_datagrams.push_back(std::move(data));
+
+            while (pending_datagrams.size() > MAX_PENDING_DATAGRAMS)
+            {
+                log::debug(log_cat, "Datagram send queue full; dropping oldest datagram");
+                pending_datagrams.pop_front();
+            }
+            io_ready();
+        });
+    }
+
+    void Connection::simulate_datagram_loss(std::function<bool(bstring_view dgram)> drop)
+    {
+        _endpoint.net.call([this, drop = std::move(drop)]() mutable { datagram_drop = std::move(drop); });
+    }
+
+    int Connection::datagram_received(bstring_view data)
+    {
+        auto deliver = [this](bstring_view d) {
+            if (!context->datagram_data_cb)
+                return;
+            try
+            {
+                context->datagram_data_cb(*this, d);
+            }
+            catch (const std::exception& e)
+            {
+                log::warning(log_cat, "Datagram data callback raised exception: {}", e.what());
+            }
+            catch (...)
+            {
+                log::warning(log_cat, "Datagram data callback raised an unknown exception");
+            }
+        };
+
+        if (!fec)
+            deliver(data);
+        else if (!fec->decode(data, deliver))
+            log::debug(log_cat, "Dropping malformed FEC datagram ({}B)", data.size());
+        return 0;
+    }
+
+    void Connection::datagram_feedback(bool lost)
+    {
+        if (!fec)
+            return;
+        auto before = fec->group_size();
+        if (lost)
+            fec->lost();
+        else
+            fec->acked();
+        if (auto after = fec->group_size(); after != before)
+            log::debug(
+                    log_cat,
+                    "Datagram loss rate now {:.2f}%; FEC group size {} -> {}",
+                    fec->loss_rate() * 100,
+                    before,
+                    after);
+    }
+
     void Connection::call_closing()
     {
         if (!on_closing)
@@ -289,7 +420,31 @@ namespace oxen::quic
 
         sent_counter += n_packets;
 
-        auto rv = endpoint().send_packets(remote(), send_buffer.data(), send_buffer_size.data(), send_ecn, n_packets);
+        // If the socket might send zero-copy we offer it the buffer to pin, provided that we have
+        // a spare to carry on with (otherwise the send just gets copied).
+        std::shared_ptr<std::vector<std::byte>> next;
+        if (auto& sock = endpoint().get_socket(); sock && sock->zerocopy())
+            next = spare_send_buffer();
+        std::shared_ptr<void> pin = next ? send_buffer : nullptr;
+
+        auto rv = endpoint().send_packets(
+                path(),
+                send_buffer->data(),
+                send_buffer_size.data(),
+                traffic_class(send_ecn),
+                n_packets,
+                pin,
+                next ? next->data() : nullptr);
+
+        pin.reset();
+        // Any unsent packets have been moved into `next`; otherwise we only need to switch buffers
+        // if the socket kept hold of the current one.
+        if (next && (n_packets > 0 || send_buffer.use_count() > 1))
+        {
+            log::trace(log_cat, "Send buffer pinned by zero-copy send; switching to a spare");
+            *std::find(spare_send_buffers.begin(), spare_send_buffers.end(), next) = std::move(send_buffer);
+            send_buffer = std::move(next);
+        }
 
         if (rv.blocked())
         {
@@ -317,6 +472,20 @@ namespace oxen::quic
         return true;
     }
 
+    // Maximum number of send buffers (including the current one) a connection rotates through
+    // while zero-copy sends keep them pinned.
+    static constexpr size_t MAX_SEND_BUFFERS = 8;
+
+    std::shared_ptr<std::vector<std::byte>> Connection::spare_send_buffer()
+    {
+        for (auto& buf : spare_send_buffers)
+            if (buf.use_count() == 1)
+                return buf;
+        if (spare_send_buffers.size() + 1 >= MAX_SEND_BUFFERS)
+            return nullptr;
+        return spare_send_buffers.emplace_back(std::make_shared<std::vector<std::byte>>(send_buffer->size()));
+    }
+
     // Don't worry about seeding this because it doesn't matter at all if the stream selection below
     // is predictable, we just want to shuffle it.
     thread_local std::mt19937 stream_start_rng{};
@@ -339,8 +508,27 @@ namespace oxen::quic
             return;
         }
 
+        // If a rate limit bucket is dry we don't write any stream data right now, but still go
+        // through the -1 pseudo-stream below so that ACKs and other control frames go out.
+        bool rate_limited = !rate_limit_ready(tp);
+
+        // Records whether the rate limits are holding anything back.  This has to happen on every
+        // way out (including the early returns when a send blocks or fails), as the throttled
+        // accounting, our resume timer, and the endpoint-wide throttled period all depend on it.
+        auto finish_throttling = [&] {
+            bool held_back = rate_limited && !pending_datagrams.empty();
+            if (rate_limited && !held_back)
+                for (const auto& [id, str] : streams)
+                    if (str && (str->unsent() > 0 || ((str->is_closing || str->finishing) && !str->sent_fin)))
+                    {
+                        held_back = true;
+                        break;
+                    }
+            update_throttled(held_back, tp);
+        };
+
         std::list<Stream*> strs;
-        if (!streams.empty())
+        if (!rate_limited && !streams.empty())
         {
             // Start from a random stream so that we aren't favouring early streams by potentially
             // giving them more opportunities to send packets.
@@ -369,10 +557,18 @@ namespace oxen::quic
         strs.push_back(nullptr);
         auto streams_end_it = std::prev(strs.end());
 
+        // This can exceed the current path max while ngtcp2 is sending a PMTUD probe
+        const auto max_packet_size = ngtcp2_conn_get_max_tx_udp_payload_size(conn.get());
+        assert(max_packet_size * MAX_BATCH <= send_buffer->size());
+
         ngtcp2_pkt_info pkt_info{};
-        auto* buf_pos = reinterpret_cast<uint8_t*>(send_buffer.data());
+        auto* buf_pos = reinterpret_cast<uint8_t*>(send_buffer->data());
         pkt_tx_timer_updater pkt_updater{*this, ts};
         size_t stream_packets = 0;
+
+        if (!rate_limited && !flush_datagrams(buf_pos, max_packet_size, tp, pkt_updater))
+            return finish_throttling();
+
         while (!strs.empty())
         {
 
@@ -392,7 +588,7 @@ namespace oxen::quic
             {
                 bufs = stream->pending();
 
-                if (stream->is_closing && !stream->sent_fin && stream->unsent() == 0)
+                if ((stream->is_closing || stream->finishing) && !stream->sent_fin && stream->unsent() == 0)
                 {
                     log::trace(log_cat, "Sending FIN");
                     flags |= NGTCP2_WRITE_STREAM_FLAG_FIN;
@@ -411,7 +607,7 @@ namespace oxen::quic
                     _path,
                     &pkt_info,
                     buf_pos,
-                    NGTCP2_MAX_PMTUD_UDP_PAYLOAD_SIZE,
+                    max_packet_size,
                     &ndatalen,
                     flags,
                     stream_id,
@@ -469,14 +665,23 @@ namespace oxen::quic
             send_ecn = pkt_info.ecn;
             stream_packets++;
 
+            rate_limit_consume(nwrite);
+            if (stream && !rate_limited && !rate_limit_ready(tp))
+            {
+                // Out of tokens: stop writing stream data, as if congested
+                log::trace(log_cat, "Rate limit reached; deferring further stream data");
+                rate_limited = true;
+                strs.erase(strs.begin(), streams_end_it);
+            }
+
             if (n_packets == MAX_BATCH)
             {
                 log::trace(log_cat, "Sending stream data packet batch");
                 if (!send(&pkt_updater))
-                    return;
+                    return finish_throttling();
 
                 assert(n_packets == 0);
-                buf_pos = reinterpret_cast<uint8_t*>(send_buffer.data());
+                buf_pos = reinterpret_cast<uint8_t*>(send_buffer->data());
             }
 
             if (stream_packets == max_stream_packets)
@@ -492,7 +697,7 @@ namespace oxen::quic
                 assert(strs.empty());
                 strs.push_back(stream);
             }
-            else if (stream->unsent() > 0)
+            else if (stream->unsent() > 0 && !rate_limited)
             {
                 // For an actual stream with more data we want to let it be checked again, so
                 // insert it just before the final -1 fake stream for potential reconsideration.
@@ -506,13 +711,170 @@ namespace oxen::quic
             log::trace(log_cat, "Sending final packet batch of {} packets", n_packets);
             send(&pkt_updater);
         }
+
+        finish_throttling();
+
         log::debug(log_cat, "Exiting flush_streams()");
     }
 
+    // Upper bound on the bytes a short header packet carrying just a DATAGRAM frame adds to the
+    // datagram: the first byte, DCID (up to 20 bytes), packet number (up to 4), AEAD tag (16),
+    // and frame type and length (up to 3).
+    static constexpr size_t DATAGRAM_PACKET_OVERHEAD = 1 + 20 + 4 + 16 + 3;
+
+    size_t Connection::update_max_datagram()
+    {
+        const size_t limit = ngtcp2_conn_get_path_max_tx_udp_payload_size(conn.get()) - DATAGRAM_PACKET_OVERHEAD;
+        // With FEC, a parity datagram is the size of the largest datagram of its group plus the
+        // length prefix (and both carry the FEC header), so the parity is what has to fit.
+        max_datagram = fec ? limit - datagram_fec::HEADER_SIZE - datagram_fec::PARITY_OVERHEAD : limit;
+        return limit;
+    }
+
+    bool Connection::flush_datagrams(
+            uint8_t*& buf_pos,
+            size_t max_packet_size,
+            std::chrono::steady_clock::time_point tp,
+            pkt_tx_timer_updater& pkt_updater)
+    {
+        if (fec)
+            fec->flush(tp, pending_datagrams);
+
+        auto ts = static_cast<uint64_t>(std::chrono::nanoseconds{tp.time_since_epoch()}.count());
+        const size_t max_wire_datagram = update_max_datagram();
+
+        while (!pending_datagrams.empty())
+        {
+            auto& dgram = pending_datagrams.front();
+            if (datagram_drop && datagram_drop(dgram))
+            {
+                log::trace(log_cat, "Dropping {}B datagram (simulated loss)", dgram.size());
+                pending_datagrams.pop_front();
+                continue;
+            }
+            if (dgram.size() > max_wire_datagram)
+            {
+                // It would never fit in a packet, and would block everything behind it
+                log::warning(
+                        log_cat,
+                        "Dropping {}B datagram: larger than the {}B that fit in a packet",
+                        dgram.size(),
+                        max_wire_datagram);
+                pending_datagrams.pop_front();
+                continue;
+            }
+
+            ngtcp2_vec vec{u8data(dgram), dgram.size()};
+            ngtcp2_pkt_info pkt_info{};
+            int accepted = 0;
+            auto nwrite = ngtcp2_conn_writev_datagram(
+                    conn.get(), _path, &pkt_info, buf_pos, max_packet_size, &accepted, 0, next_datagram_id, &vec, 1, ts);
+
+            if (nwrite < 0)
+            {
+                if (nwrite == NGTCP2_ERR_INVALID_ARGUMENT)
+                {
+                    log::warning(log_cat, "Dropping datagram: the remote does not accept datagrams (of this size)");
+                    pending_datagrams.pop_front();
+                    continue;
+                }
+                if (nwrite == NGTCP2_ERR_CLOSING)
+                    log::debug(log_cat, "Cannot write datagram: connection is closing");
+                else
+                    log::error(log_cat, "Error writing datagram: {}", ngtcp2_strerror(nwrite));
+                break;
+            }
+
+            if (accepted)
+            {
+                pending_datagrams.pop_front();
+                next_datagram_id++;
+            }
+
+            if (nwrite == 0)  // Congested, or can't send datagrams yet (i.e. still handshaking)
+                break;
+
+            buf_pos += nwrite;
+            send_buffer_size[n_packets++] = nwrite;
+            send_ecn = pkt_info.ecn;
+            rate_limit_consume(nwrite);
+
+            if (n_packets == MAX_BATCH)
+            {
+                log::trace(log_cat, "Sending datagram packet batch");
+                if (!send(&pkt_updater))
+                    return false;
+                buf_pos = reinterpret_cast<uint8_t*>(send_buffer->data());
+            }
+
+            if (!rate_limit_ready(tp))
+                break;
+        }
+
+        return true;
+    }
+
+    bool Connection::rate_limit_ready(std::chrono::steady_clock::time_point now)
+    {
+        bool ready = true;
+        if (rate_limiter)
+        {
+            rate_limiter->refill(now);
+            ready = rate_limiter->ready();
+        }
+        if (auto& ep_limiter = _endpoint.rate_limiter)
+        {
+            ep_limiter->refill(now);
+            ready = ready && ep_limiter->ready();
+        }
+        return ready;
+    }
+
+    void Connection::rate_limit_consume(size_t bytes)
+    {
+        if (rate_limiter)
+            rate_limiter->consume(bytes);
+        if (auto& ep_limiter = _endpoint.rate_limiter)
+            ep_limiter->consume(bytes);
+    }
+
+    void Connection::update_throttled(bool held_back, std::chrono::steady_clock::time_point now)
+    {
+        throttled.set(held_back, now);
+        if (held_back)
+        {
+            auto until = now;
+            if (rate_limiter)
+                until = std::max(until, rate_limiter->ready_at(now));
+            if (auto& ep_limiter = _endpoint.rate_limiter)
+                until = std::max(until, ep_limiter->ready_at(now));
+            log::trace(log_cat, "Rate limited; resuming in {}", until - now);
+            throttled_until = until;
+        }
+        else
+            throttled_until.reset();
+
+        // The endpoint's throttled period lasts for as long as its bucket is dry while some
+        // connection has data waiting.
+        if (auto& ep_limiter = _endpoint.rate_limiter)
+        {
+            if (ep_limiter->ready())
+                _endpoint.throttled.set(false, now);
+            else if (held_back)
+                _endpoint.throttled.set(true, now);
+        }
+    }
+
     void Connection::schedule_retransmit(std::chrono::steady_clock::time_point ts)
     {
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
         ngtcp2_tstamp exp_ns = ngtcp2_conn_get_expiry(conn.get());
+        // If rate limited then we also need to wake up when we can send again
+        if (throttled_until)
+            exp_ns = std::min<ngtcp2_tstamp>(exp_ns, std::chrono::nanoseconds{throttled_until->time_since_epoch()}.count());
+        // ...and to send the parity of a partial datagram FEC group on time
+        if (auto deadline = fec ? fec->deadline() : std::nullopt)
+            exp_ns = std::min<ngtcp2_tstamp>(exp_ns, std::chrono::nanoseconds{deadline->time_since_epoch()}.count());
 
         if (exp_ns == std::numeric_limits<ngtcp2_tstamp>::max())
         {
@@ -546,7 +908,15 @@ namespace oxen::quic
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
         log::info(log_cat, "New stream ID:{}", id);
 
-        auto stream = std::make_shared<Stream>(*this, _endpoint, context->stream_data_cb, context->stream_close_cb, id);
+        auto stream = std::make_shared<Stream>(
+                *this,
+                _endpoint,
+                context->stream_data_handler ? nullptr : context->stream_data_cb,
+                context->stream_close_cb,
+                id);
+        stream->handler = context->stream_data_handler;
+        add_stream_codec(*stream);
+        settle_stream_codec(*stream);
         stream->set_ready();
 
         log::debug(log_cat, "Local endpoint creating stream to match remote");
@@ -576,13 +946,26 @@ namespace oxen::quic
             return;
 
         auto& stream = *it->second;
+
+        // Don't lose any data still waiting for batched delivery
+        if (stream.recv_pending && !stream.is_closing)
+            deliver_buffered_stream_data(stream);
+
         const bool was_closing = stream.is_closing;
         stream.is_closing = stream.is_shutdown = true;
 
-        if (!was_closing && stream.close_callback)
+        if (!was_closing)
         {
-            log::trace(log_cat, "Invoking stream close callback");
-            stream.close_callback(stream, app_code);
+            if (stream.handler)
+            {
+                log::trace(log_cat, "Invoking stream handler close");
+                stream.handler->on_close(stream, app_code);
+            }
+            if (stream.close_callback)
+            {
+                log::trace(log_cat, "Invoking stream close callback");
+                stream.close_callback(stream, app_code);
+            }
         }
 
         log::info(log_cat, "Erasing stream {}", id);
@@ -604,64 +987,176 @@ namespace oxen::quic
         return NGTCP2_ERR_CALLBACK_FAILURE;
     }
 
+    bool Connection::deliver_stream_data(Stream& str, bstring_view data)
+    {
+        bool good = false;
+
+        try
+        {
+            if (str.handler && !str.is_shutdown)
+                str.handler->on_data(str, data);
+            else
+                str.data_callback(str, data);
+            good = true;
+        }
+        catch (const std::exception& e)
+        {
+            log::warning(
+                    log_cat,
+                    "Stream {} data callback raised exception ({}); closing stream with app "
+                    "code "
+                    "{}",
+                    str.stream_id,
+                    e.what(),
+                    STREAM_ERROR_EXCEPTION);
+        }
+        catch (...)
+        {
+            log::warning(
+                    log_cat,
+                    "Stream {} data callback raised an unknown exception; closing stream with "
+                    "app "
+                    "code {}",
+                    str.stream_id,
+                    STREAM_ERROR_EXCEPTION);
+        }
+        if (!good)
+            str.close(STREAM_ERROR_EXCEPTION);
+
+        return good;
+    }
+
+    bool Connection::deliver_buffered_stream_data(Stream& str)
+    {
+        str.recv_pending = false;
+        if (str.recv_buffer.empty() || !str.has_data_handler())
+        {
+            str.recv_buffer.clear();
+            return true;
+        }
+
+        log::trace(log_cat, "Delivering {}B of buffered data for stream {}", str.recv_buffer.size(), str.stream_id);
+        bool good = deliver_stream_data(str, bstring_view{str.recv_buffer.data(), str.recv_buffer.size()});
+        str.recv_buffer.clear();
+        return good;
+    }
+
+    void Connection::flush_received_stream_data()
+    {
+        if (pending_recv_streams.empty())
+            return;
+
+        for (auto id : pending_recv_streams)
+        {
+            auto it = streams.find(id);
+            if (it == streams.end())
+                continue;
+            // Hold a reference in case the callback does something that removes the stream
+            auto str = it->second;
+            if (str->recv_pending)
+                deliver_buffered_stream_data(*str);
+        }
+
+        pending_recv_streams.clear();
+    }
+
     int Connection::stream_receive(int64_t id, bstring_view data, bool fin)
     {
         log::trace(log_cat, "Stream (ID: {}) received data: {}", id, buffer_printer{data});
         auto str = get_stream(id);
 
-        if (!str->data_callback)
+        auto deliver = [&](bstring_view data) {
+            if (!user_config.batch_stream_data)
+                return deliver_stream_data(*str, data);
+
+            // Batched mode: accumulate the data and deliver it at the end of the receive batch, unless
+            // we hit the buffering limit (or the stream is finished; see below).
+            auto& buf = str->recv_buffer;
+            buf.insert(buf.end(), data.begin(), data.end());
+
+            if (buf.size() >= user_config.batch_stream_data)
+                return deliver_buffered_stream_data(*str);
+            if (!str->recv_pending)
+            {
+                str->recv_pending = true;
+                pending_recv_streams.push_back(id);
+            }
+            return true;
+        };
+
+        if (!str->has_data_handler())
             log::debug(log_cat, "Stream (ID: {}) has no user-supplied data callback", str->stream_id);
-        else
+        else if (str->codec)
         {
-            bool good = false;
-
+            // Compressed stream framing: decode before delivery
             try
             {
-                str->data_callback(*str, data);
-                good = true;
+                if (!str->codec->receive(data, deliver))
+                    return NGTCP2_ERR_CALLBACK_FAILURE;
             }
             catch (const std::exception& e)
             {
-                log::warning(
-                        log_cat,
-                        "Stream {} data callback raised exception ({}); closing stream with app "
-                        "code "
-                        "{}",
-                        str->stream_id,
-                        e.what(),
-                        STREAM_ERROR_EXCEPTION);
-            }
-            catch (...)
-            {
-                log::warning(
-                        log_cat,
-                        "Stream {} data callback raised an unknown exception; closing stream with "
-                        "app "
-                        "code {}",
-                        str->stream_id,
-                        STREAM_ERROR_EXCEPTION);
-            }
-            if (!good)
-            {
-                str->close(STREAM_ERROR_EXCEPTION);
-                return NGTCP2_ERR_CALLBACK_FAILURE;
+                log::warning(log_cat, "Stream {} received undecodable data ({}); closing stream", id, e.what());
+                str->close(STREAM_ERROR_BAD_ENCODING);
             }
         }
+        else if (!deliver(data))
+            return NGTCP2_ERR_CALLBACK_FAILURE;
+
+        if (fin && str->recv_pending && !deliver_buffered_stream_data(*str))
+            return NGTCP2_ERR_CALLBACK_FAILURE;
 
         if (fin)
         {
-            log::info(log_cat, "Stream {} closed by remote", str->stream_id);
-            // no clean up, close_cb called after this
+            log::info(log_cat, "Stream {} finished by remote", str->stream_id);
+            // no clean up, close_cb called once our side is finished too
+            if (str->handler && !str->is_shutdown)
+                str->handler->on_fin(*str);
         }
         else
         {
-            ngtcp2_conn_extend_max_stream_offset(conn.get(), id, data.size());
+            // A paused stream (see Stream::pause_receiving) gets its credit when it resumes; the
+            // connection-level window still grows so that other streams aren't held up by it.
+            if (str->recv_paused)
+                str->recv_withheld += data.size();
+            else
+                ngtcp2_conn_extend_max_stream_offset(conn.get(), id, data.size());
             ngtcp2_conn_extend_max_offset(conn.get(), data.size());
         }
 
         return 0;
     }
 
+    int Connection::new_connection_id(ngtcp2_cid* cid, uint8_t* token, size_t cidlen)
+    {
+        if (gnutls_rnd(GNUTLS_RND_RANDOM, cid->data, cidlen) != 0)
+            return NGTCP2_ERR_CALLBACK_FAILURE;
+
+        cid->datalen = cidlen;
+
+        auto& secret = _endpoint.static_secret;
+        if (ngtcp2_crypto_generate_stateless_reset_token(token, secret.data(), secret.size(), cid) != 0)
+            return NGTCP2_ERR_CALLBACK_FAILURE;
+
+        _endpoint.add_connection_alias(*this, ConnectionID{*cid});
+        return 0;
+    }
+
+    void Connection::remove_connection_id(const ngtcp2_cid* cid)
+    {
+        _endpoint.remove_connection_alias(*this, ConnectionID{*cid});
+    }
+
+    void Connection::peer_reset_token(bool active, const uint8_t* token)
+    {
+        reset_token t;
+        std::memcpy(t.data(), token, t.size());
+        if (active)
+            _endpoint.add_peer_reset_token(*this, t);
+        else
+            _endpoint.remove_peer_reset_token(*this, t);
+    }
+
     int Connection::get_streams_available()
     {
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
@@ -708,6 +1203,9 @@ namespace oxen::quic
         callbacks.extend_max_local_streams_bidi = extend_max_local_streams_bidi;
         callbacks.rand = rand_cb;
         callbacks.get_new_connection_id = get_new_connection_id_cb;
+        callbacks.remove_connection_id = remove_connection_id_cb;
+        callbacks.recv_stateless_reset = recv_stateless_reset_cb;
+        callbacks.dcid_status = dcid_status_cb;
         callbacks.update_key = ngtcp2_crypto_update_key_cb;
         callbacks.stream_reset = on_stream_reset;
         callbacks.delete_crypto_aead_ctx = ngtcp2_crypto_delete_crypto_aead_ctx_cb;
@@ -715,6 +1213,12 @@ namespace oxen::quic
         callbacks.get_path_challenge_data = ngtcp2_crypto_get_path_challenge_data_cb;
         callbacks.version_negotiation = ngtcp2_crypto_version_negotiation_cb;
         callbacks.stream_open = on_stream_open;
+        if (user_config.datagrams)
+        {
+            callbacks.recv_datagram = recv_datagram;
+            callbacks.ack_datagram = ack_datagram;
+            callbacks.lost_datagram = lost_datagram;
+        }
 
         ngtcp2_settings_default(&settings);
 
@@ -722,11 +1226,23 @@ namespace oxen::quic
 #ifndef NDEBUG
         settings.log_printf = log_printer;
 #endif
-        settings.max_tx_udp_payload_size = NGTCP2_MAX_PMTUD_UDP_PAYLOAD_SIZE;
+        settings.max_tx_udp_payload_size = _endpoint.max_udp_payload;
+#if NGTCP2_VERSION_NUM >= 0x010400
+        // Probe the common MTU sizes (IPv6/IPv4 over 1500 and 9000 byte links) up to our configured
+        // max, plus the max itself, to quickly find the largest usable size.
+        for (size_t probe : {1452, 1472, 4052, 8952, 8972})
+            if (probe < _endpoint.max_udp_payload)
+                pmtud_probes.push_back(static_cast<uint16_t>(probe));
+        pmtud_probes.push_back(static_cast<uint16_t>(_endpoint.max_udp_payload));
+        settings.pmtud_probes = pmtud_probes.data();
+        settings.pmtud_probeslen = pmtud_probes.size();
+#endif
         settings.cc_algo = NGTCP2_CC_ALGO_CUBIC;
         settings.initial_rtt = NGTCP2_DEFAULT_INITIAL_RTT;
         settings.max_window = 24_Mi;
         settings.max_stream_window = 16_Mi;
+        if (user_config.ack_frequency)
+            settings.ack_thresh = user_config.ack_frequency->ack_thresh;
 
         ngtcp2_transport_params_default(&params);
 
@@ -741,6 +1257,12 @@ namespace oxen::quic
         params.initial_max_stream_data_uni = 6_Mi;
         params.max_idle_timeout = std::chrono::nanoseconds(5min).count();
         params.active_connection_id_limit = 8;
+        params.max_udp_payload_size = _endpoint.max_udp_payload;
+        if (user_config.ack_frequency)
+            params.max_ack_delay = std::chrono::nanoseconds{user_config.ack_frequency->max_ack_delay}.count();
+
+        if (user_config.datagrams)
+            params.max_datagram_frame_size = 65535;
 
         // config values
         params.initial_max_streams_bidi = (user_config.max_streams) ? user_config.max_streams : DEFAULT_MAX_BIDI_STREAMS;
@@ -770,6 +1292,14 @@ namespace oxen::quic
         const auto d_str = outbound ? "outbound"s : "inbound"s;
         log::trace(log_cat, "Creating new {} connection object", d_str);
 
+        send_buffer = std::make_shared<std::vector<std::byte>>(_endpoint.max_udp_payload * DATAGRAM_BATCH_SIZE);
+
+        if (user_config.rate_limit)
+            rate_limiter.emplace(user_config.rate_limit->rate, user_config.rate_limit->burst, get_time());
+
+        if (user_config.datagrams && user_config.datagrams->fec)
+            fec = std::make_unique<datagram_fec>(*user_config.datagrams);
+
         ngtcp2_settings settings;
         ngtcp2_transport_params params;
         ngtcp2_callbacks callbacks{};
@@ -803,6 +1333,15 @@ namespace oxen::quic
             params.original_dcid_present = 1;
             settings.token = hdr->token;
 
+            // The stateless reset token for our initial CID goes into the transport params (ones for
+            // later CIDs are sent with the NEW_CONNECTION_ID frames).
+            auto& secret = _endpoint.static_secret;
+            if (ngtcp2_crypto_generate_stateless_reset_token(
+                        params.stateless_reset_token, secret.data(), secret.size(), &_source_cid) == 0)
+                params.stateless_reset_token_present = 1;
+            else
+                log::warning(log_cat, "Failed to generate stateless reset token for {}", _source_cid);
+
             rv = ngtcp2_conn_server_new(
                     &connptr,
                     &_dest_cid,
@@ -825,9 +1364,13 @@ namespace oxen::quic
             throw std::runtime_error{"Failed to initialize connection object: "s + ngtcp2_strerror(rv)};
         }
 
+        update_max_datagram();
+
         log::info(log_cat, "Successfully created new {} connection object", d_str);
     }
 
+    Connection::~Connection() = default;
+
     void Connection::setup_tls_session(bool is_client)
     {
         ngtcp2_crypto_conn_ref conn_ref;
@@ -837,10 +1380,42 @@ namespace oxen::quic
         conn_ref.user_data = this;
 
         tls_session = tls_creds->make_session(conn_ref, is_client);
+        if (user_config.stream_compression)
+            tls_session->set_alpns({STREAM_COMPRESSION_ALPN});
 
         ngtcp2_conn_set_tls_native_handle(conn.get(), tls_session->get_session());
     }
 
+    void Connection::add_stream_codec(Stream& s)
+    {
+        if (!user_config.stream_compression)
+            return;
+        s.codec = std::make_unique<stream_codec>(*user_config.stream_compression);
+        s.compression_enabled = true;
+        s.update_compression_state();
+    }
+
+    void Connection::settle_stream_codec(Stream& s)
+    {
+        if (!s.codec)
+            return;
+
+        if (tls_session->selected_alpn() != STREAM_COMPRESSION_ALPN)
+        {
+            log::debug(log_cat, "Peer did not enable stream compression; stream {} is unencoded", s.stream_id);
+            s.codec.reset();
+            s.update_compression_state();
+            return;
+        }
+
+        // Nothing has been sent yet, so the stream's buffers are all data held back until now
+        auto held = std::move(s.user_buffers);
+        s.user_buffers.clear();
+        for (auto& [data, keep_alive] : held)
+            s.codec->send(s, data, std::move(keep_alive));
+        s.update_compression_state();
+    }
+
     std::shared_ptr<Connection> Connection::make_conn(
             Endpoint& ep,
             const ConnectionID& scid,
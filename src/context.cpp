@@ -2,8 +2,29 @@
 
 #include "connection.hpp"
 
+#ifdef OXEN_LIBQUIC_ZSTD
+#include <zstd.h>
+#endif
+
 namespace oxen::quic
 {
+    static void check_stream_compression(const opt::stream_compression& sc)
+    {
+#ifndef OXEN_LIBQUIC_ZSTD
+        (void)sc;
+        throw std::invalid_argument{"opt::stream_compression requires libquic to be built with LIBQUIC_ZSTD"};
+#else
+        if (sc.level < 0 || sc.level > ZSTD_maxCLevel())
+            throw std::invalid_argument{
+                    "opt::stream_compression: invalid compression level {}"_format(sc.level)};
+        log::trace(
+                log_cat,
+                "User enabled stream compression (level {}, compress by default: {})",
+                sc.level ? std::to_string(sc.level) : "adaptive"s,
+                sc.compress);
+#endif
+    }
+
     void OutboundContext::handle_outbound_opt(std::shared_ptr<TLSCreds> tls)
     {
         tls_creds = std::move(tls);
@@ -15,6 +36,46 @@ namespace oxen::quic
         log::trace(log_cat, "User passed max_streams_bidi config value: {}", config.max_streams);
     }
 
+    void OutboundContext::handle_outbound_opt(opt::batch_stream_data bsd)
+    {
+        config.batch_stream_data = bsd.max_size;
+        log::trace(log_cat, "User enabled batched stream data delivery (max {}B)", config.batch_stream_data);
+    }
+
+    void OutboundContext::handle_outbound_opt(opt::ack_frequency af)
+    {
+        config.ack_frequency = af;
+        log::trace(
+                log_cat,
+                "User passed ack_thresh={}, max_ack_delay={}us",
+                af.ack_thresh,
+                af.max_ack_delay.count());
+    }
+
+    void OutboundContext::handle_outbound_opt(opt::stream_compression sc)
+    {
+        check_stream_compression(sc);
+        config.stream_compression = sc;
+    }
+
+    void OutboundContext::handle_outbound_opt(opt::enable_datagrams ed)
+    {
+        config.datagrams = ed;
+        log::trace(log_cat, "User enabled datagrams (FEC: {}, group size: {})", ed.fec, ed.fec_group);
+    }
+
+    void OutboundContext::handle_outbound_opt(opt::dscp d)
+    {
+        config.dscp = d.value;
+        log::trace(log_cat, "User passed DSCP {}", config.dscp);
+    }
+
+    void OutboundContext::handle_outbound_opt(opt::rate_limit rl)
+    {
+        config.rate_limit = rl;
+        log::trace(log_cat, "User passed connection rate limit of {}B/s (burst {}B)", rl.rate, rl.burst);
+    }
+
     void OutboundContext::handle_outbound_opt(stream_close_callback_t func)
     {
         log::trace(log_cat, "Inbound context stored stream close callback");
@@ -33,6 +94,18 @@ namespace oxen::quic
         stream_open_cb = std::move(func);
     }
 
+    void OutboundContext::handle_outbound_opt(std::shared_ptr<stream_handler> handler)
+    {
+        log::trace(log_cat, "Outbound context stored stream handler");
+        stream_data_handler = std::move(handler);
+    }
+
+    void OutboundContext::handle_outbound_opt(datagram_data_callback_t func)
+    {
+        log::trace(log_cat, "Outbound context stored datagram data callback");
+        datagram_data_cb = std::move(func);
+    }
+
     void InboundContext::handle_inbound_opt(std::shared_ptr<TLSCreds> tls)
     {
         tls_creds = std::move(tls);
@@ -57,10 +130,62 @@ namespace oxen::quic
         stream_close_cb = std::move(func);
     }
 
+    void InboundContext::handle_inbound_opt(std::shared_ptr<stream_handler> handler)
+    {
+        log::trace(log_cat, "Inbound context stored stream handler");
+        stream_data_handler = std::move(handler);
+    }
+
+    void InboundContext::handle_inbound_opt(datagram_data_callback_t func)
+    {
+        log::trace(log_cat, "Inbound context stored datagram data callback");
+        datagram_data_cb = std::move(func);
+    }
+
     void InboundContext::handle_inbound_opt(opt::max_streams ms)
     {
         config.max_streams = ms.stream_count;
         log::trace(log_cat, "User passed max_streams_bidi config value: {}", config.max_streams);
     }
 
+    void InboundContext::handle_inbound_opt(opt::ack_frequency af)
+    {
+        config.ack_frequency = af;
+        log::trace(
+                log_cat,
+                "User passed ack_thresh={}, max_ack_delay={}us",
+                af.ack_thresh,
+                af.max_ack_delay.count());
+    }
+
+    void InboundContext::handle_inbound_opt(opt::stream_compression sc)
+    {
+        check_stream_compression(sc);
+        config.stream_compression = sc;
+    }
+
+    void InboundContext::handle_inbound_opt(opt::enable_datagrams ed)
+    {
+        config.datagrams = ed;
+        log::trace(log_cat, "User enabled datagrams (FEC: {}, group size: {})", ed.fec, ed.fec_group);
+    }
+
+    void InboundContext::handle_inbound_opt(opt::dscp d)
+    {
+        config.dscp = d.value;
+        log::trace(log_cat, "User passed DSCP {}", config.dscp);
+    }
+
+    void InboundContext::handle_inbound_opt(opt::rate_limit rl)
+    {
+        config.rate_limit = rl;
+        log::trace(log_cat, "User passed connection rate limit of {}B/s (burst {}B)", rl.rate, rl.burst);
+    }
+
+    void InboundContext::handle_inbound_opt(opt::batch_stream_data bsd)
+    {
+        config.batch_stream_data = bsd.max_size;
+        log::trace(log_cat, "User enabled batched stream data delivery (max {}B)", config.batch_stream_data);
+    }
+
 }  // namespace oxen::quic
@@ -0,0 +1,233 @@
+#include "datagram_fec.hpp"
+
+#include <cstring>
+
+#include "internal.hpp"
+
+namespace oxen::quic
+{
+    // Datagram header kinds
+    static constexpr std::byte KIND_PLAIN{0x00};   // Not part of a group (sent while no parity is needed)
+    static constexpr std::byte KIND_DATA{0x01};    // Data datagram of a group
+    static constexpr std::byte KIND_PARITY{0x02};  // Parity datagram of a group
+
+    // Adaptive group sizes by (maximum) datagram loss rate: the worse the loss, the smaller the
+    // groups and so the more parity we send.  Below the first threshold we send no parity.
+    static constexpr std::array<std::pair<double, size_t>, 4> ADAPTIVE_GROUPS{{
+            {0.002, 0},
+            {0.01, 16},
+            {0.03, 8},
+            {0.08, 4},
+    }};
+
+    // Loss rate assumed before we have any feedback
+    static constexpr double INITIAL_LOSS = 0.02;
+
+    // Weight of each new ack/loss sample in the loss rate average
+    static constexpr double LOSS_EWMA_WEIGHT = 1.0 / 64;
+
+    // XORs `len` bytes of `src` into `dst`.  This works a machine word at a time (through memcpy,
+    // so alignment doesn't matter), which compilers vectorize into SIMD loads and stores where the
+    // target has them; parity blocks are at most a packet in size, so that's all we need.
+    static void xor_into(std::byte* dst, const std::byte* src, size_t len)
+    {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+        {
+            uint64_t a, b;
+            std::memcpy(&a, dst + i, sizeof(a));
+            std::memcpy(&b, src + i, sizeof(b));
+            a ^= b;
+            std::memcpy(dst + i, &a, sizeof(a));
+        }
+        for (; i < len; i++)
+            dst[i] ^= src[i];
+    }
+
+    // XORs a datagram, as its 2-byte length followed by its payload, into `acc` (growing it, with
+    // zero padding, if needed).
+    static void xor_block(std::vector<std::byte>& acc, bstring_view data)
+    {
+        if (acc.size() < data.size() + 2)
+            acc.resize(data.size() + 2);
+        acc[0] ^= static_cast<std::byte>(data.size() >> 8);
+        acc[1] ^= static_cast<std::byte>(data.size() & 0xff);
+        xor_into(acc.data() + 2, data.data(), data.size());
+    }
+
+    static bstring make_header(std::byte kind, uint16_t group, uint8_t n)
+    {
+        return bstring{
+                {kind,
+                 static_cast<std::byte>(group >> 8),
+                 static_cast<std::byte>(group & 0xff),
+                 static_cast<std::byte>(n)}};
+    }
+
+    datagram_fec::datagram_fec(const opt::enable_datagrams& conf) :
+            fixed_group{conf.fec_group}, max_delay{conf.fec_delay}, loss{INITIAL_LOSS}
+    {}
+
+    size_t datagram_fec::group_size() const
+    {
+        if (fixed_group)
+            return static_cast<size_t>(fixed_group);
+        for (const auto& [max_loss, size] : ADAPTIVE_GROUPS)
+            if (loss < max_loss)
+                return size;
+        return 2;
+    }
+
+    void datagram_fec::update_loss(double sample)
+    {
+        loss += (sample - loss) * LOSS_EWMA_WEIGHT;
+    }
+
+    void datagram_fec::encode(bstring_view data, std::chrono::steady_clock::time_point now, std::deque<bstring>& out)
+    {
+        if (tx_count == 0)
+        {
+            tx_target = group_size();
+            tx_opened = now;
+        }
+
+        if (tx_target == 0)
+        {
+            auto& d = out.emplace_back(make_header(KIND_PLAIN, 0, 0));
+            d += data;
+            return;
+        }
+
+        auto& d = out.emplace_back(make_header(KIND_DATA, tx_group, static_cast<uint8_t>(tx_count)));
+        d += data;
+        xor_block(tx_parity, data);
+
+        if (++tx_count == tx_target)
+            close_group(out);
+    }
+
+    void datagram_fec::flush(std::chrono::steady_clock::time_point now, std::deque<bstring>& out)
+    {
+        if (tx_count > 0 && now - tx_opened >= max_delay)
+        {
+            log::trace(log_cat, "Closing partial datagram FEC group {} of {}/{}", tx_group, tx_count, tx_target);
+            close_group(out);
+        }
+    }
+
+    std::optional<std::chrono::steady_clock::time_point> datagram_fec::deadline() const
+    {
+        if (tx_count == 0)
+            return std::nullopt;
+        return tx_opened + max_delay;
+    }
+
+    void datagram_fec::close_group(std::deque<bstring>& out)
+    {
+        auto& p = out.emplace_back(make_header(KIND_PARITY, tx_group, static_cast<uint8_t>(tx_count)));
+        p.append(tx_parity.data(), tx_parity.size());
+        n_parity_sent++;
+
+        tx_group++;
+        tx_count = 0;
+        tx_parity.clear();
+    }
+
+    datagram_fec::rx_group* datagram_fec::rx_state(uint16_t id)
+    {
+        auto& g = rx_groups[id % rx_groups.size()];
+        if (g.used && g.id == id)
+            return &g;
+        if (g.used && static_cast<int16_t>(static_cast<uint16_t>(id - g.id)) < 0)
+            return nullptr;
+
+        g.used = true;
+        g.id = id;
+        g.size = 0;
+        g.have_parity = false;
+        g.have = 0;
+        g.acc.clear();
+        return &g;
+    }
+
+    void datagram_fec::try_recover(rx_group& g, const std::function<void(bstring_view)>& deliver)
+    {
+        if (!g.have_parity)
+            return;
+
+        const uint64_t all = (uint64_t{1} << g.size) - 1;
+        const uint64_t missing = all & ~g.have;
+        // Nothing to do if we have everything, or are missing more than one datagram
+        if (missing == 0 || (missing & (missing - 1)) || (g.have & ~all))
+            return;
+
+        // Everything else has been XORed out of the accumulator, leaving the missing datagram
+        g.have |= missing;
+        size_t len = static_cast<size_t>(g.acc[0]) << 8 | static_cast<size_t>(g.acc[1]);
+        if (len + 2 > g.acc.size())
+        {
+            log::debug(log_cat, "Invalid recovered datagram length {} in FEC group {}", len, g.id);
+            return;
+        }
+
+        n_recovered++;
+        log::trace(log_cat, "Recovered lost datagram of {}B from FEC group {}", len, g.id);
+        deliver(bstring_view{g.acc.data() + 2, len});
+    }
+
+    bool datagram_fec::decode(bstring_view dgram, const std::function<void(bstring_view)>& deliver)
+    {
+        if (dgram.size() < HEADER_SIZE)
+            return false;
+
+        const auto kind = dgram[0];
+        const auto id = static_cast<uint16_t>(static_cast<uint16_t>(dgram[1]) << 8 | static_cast<uint16_t>(dgram[2]));
+        const auto n = static_cast<uint8_t>(dgram[3]);
+        const auto payload = dgram.substr(HEADER_SIZE);
+
+        if (kind == KIND_PLAIN)
+        {
+            deliver(payload);
+            return true;
+        }
+
+        if (kind == KIND_DATA)
+        {
+            if (n >= MAX_GROUP)
+                return false;
+            auto* g = rx_state(id);
+            if (!g)
+            {
+                // Too old to help with recovery any more, but still perfectly good data
+                deliver(payload);
+                return true;
+            }
+            const uint64_t bit = uint64_t{1} << n;
+            if (g->have & bit)
+                return true;  // We already recovered it from the parity
+            g->have |= bit;
+            xor_block(g->acc, payload);
+            deliver(payload);
+            try_recover(*g, deliver);
+            return true;
+        }
+
+        if (kind == KIND_PARITY)
+        {
+            if (n == 0 || n > MAX_GROUP || payload.size() < 2)
+                return false;
+            auto* g = rx_state(id);
+            if (!g || g->have_parity)
+                return true;
+            g->have_parity = true;
+            g->size = n;
+            if (g->acc.size() < payload.size())
+                g->acc.resize(payload.size());
+            xor_into(g->acc.data(), payload.data(), payload.size());
+            try_recover(*g, deliver);
+            return true;
+        }
+
+        return false;
+    }
+}  // namespace oxen::quic
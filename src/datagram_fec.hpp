@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "opt.hpp"
+#include "utils.hpp"
+
+namespace oxen::quic
+{
+    // XOR forward error correction for a connection's datagrams (see opt::enable_datagrams).
+    //
+    // Each outgoing datagram is prefixed with a 4-byte header: a kind byte, the 16-bit (big
+    // endian) group ID, and the datagram's index within the group.  After the last datagram of a
+    // group we send a parity datagram whose header carries the group size instead of an index,
+    // followed by the XOR of the group's datagrams, each taken as a 2-byte length followed by its
+    // payload (zero-padded to the longest).  Received data datagrams are delivered immediately;
+    // once a group's parity and all but one of its datagrams have arrived, XORing them together
+    // yields the missing datagram, which is then delivered too.
+    //
+    // With an adaptive group size, the group size used for each new group is picked from the
+    // datagram loss rate (an EWMA over the ngtcp2 ack/loss notifications of our datagrams), down
+    // to sending no parity at all ("unprotected" datagrams) when there is next to no loss.
+    //
+    // Only used from the event loop thread.
+    class datagram_fec
+    {
+      public:
+        explicit datagram_fec(const opt::enable_datagrams& conf);
+
+        // Header prepended to every datagram
+        static constexpr size_t HEADER_SIZE = 4;
+        // Bytes a parity datagram adds over the largest datagram in its group (the length prefix)
+        static constexpr size_t PARITY_OVERHEAD = 2;
+        // Largest allowed group size (and so the number of datagrams a parity datagram covers)
+        static constexpr size_t MAX_GROUP = 32;
+
+        // Frames `data` as the next datagram of the current group and appends it to `out`; if this
+        // completes the group, its parity datagram is appended as well.
+        void encode(bstring_view data, std::chrono::steady_clock::time_point now, std::deque<bstring>& out);
+
+        // Closes the current group (appending its parity datagram to `out`) if it has been open
+        // for at least the configured fec_delay.
+        void flush(std::chrono::steady_clock::time_point now, std::deque<bstring>& out);
+
+        // When the current partial group has to be closed by, if there is one.
+        std::optional<std::chrono::steady_clock::time_point> deadline() const;
+
+        // Loss feedback for our sent datagrams (both data and parity)
+        void acked() { update_loss(0.0); }
+        void lost() { update_loss(1.0); }
+
+        // The group size used for new groups; 0 if currently sending without parity.
+        size_t group_size() const;
+
+        // Current estimated datagram loss rate
+        double loss_rate() const { return loss; }
+
+        // Decodes a received datagram, passing its payload (if a data datagram) and any datagram
+        // recovered with its help to `deliver`.  Returns false if the datagram is malformed.
+        bool decode(bstring_view dgram, const std::function<void(bstring_view)>& deliver);
+
+        // Statistics: parity datagrams sent, and datagrams recovered from received parity
+        uint64_t parity_sent() const { return n_parity_sent; }
+        uint64_t recovered() const { return n_recovered; }
+
+      private:
+        const int fixed_group;
+        const std::chrono::milliseconds max_delay;
+
+        double loss;
+
+        // Encoder state: the current group's ID, target size, number of datagrams sent so far,
+        // when it was opened, and the running XOR of its (length-prefixed) datagrams.
+        uint16_t tx_group{0};
+        size_t tx_target{0};
+        size_t tx_count{0};
+        std::chrono::steady_clock::time_point tx_opened;
+        std::vector<std::byte> tx_parity;
+
+        // Appends the current group's parity datagram to `out` and starts a new group.
+        void close_group(std::deque<bstring>& out);
+
+        void update_loss(double sample);
+
+        // Decoder state for a recently seen group: which datagrams of it we have (received or
+        // recovered), the XOR of everything received for it (including the parity), and the
+        // group size (known once the parity has arrived).
+        struct rx_group
+        {
+            bool used{false};
+            uint16_t id{0};
+            uint8_t size{0};
+            bool have_parity{false};
+            uint64_t have{0};
+            std::vector<std::byte> acc;
+        };
+        // Recent groups, indexed by group ID modulo the array size
+        std::array<rx_group, 64> rx_groups;
+
+        uint64_t n_parity_sent{0};
+        uint64_t n_recovered{0};
+
+        // Returns the state for group `id`, resetting its slot if that holds an older group, or
+        // nullptr if the slot holds a newer group (i.e. `id` is too old to still be recovered).
+        rx_group* rx_state(uint16_t id);
+
+        // Recovers (and delivers) the group's missing datagram if that has become possible.
+        void try_recover(rx_group& g, const std::function<void(bstring_view)>& deliver);
+    };
+}  // namespace oxen::quic
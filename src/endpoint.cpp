@@ -14,15 +14,170 @@ extern "C"
 #include <optional>
 
 #include "connection.hpp"
+#include "handoff.hpp"
 #include "internal.hpp"
 #include "utils.hpp"
 
 namespace oxen::quic
 {
-    Endpoint::Endpoint(Network& n, const Address& listen_addr) : local{listen_addr}, net{n}
+    void Endpoint::handle_ep_opt(opt::connected_socket)
     {
-        log::debug(log_cat, "Starting new UDP socket on {}", local);
-        socket = std::make_unique<UDPSocket>(get_loop().get(), local, [this](const auto& packet) { handle_packet(packet); });
+        log::trace(log_cat, "Endpoint will use a connected UDP socket for single-remote outbound use");
+        use_connected_socket = true;
+    }
+
+    void Endpoint::handle_ep_opt(opt::max_udp_payload mup)
+    {
+        // 65527 is the largest value permitted for the max_udp_payload_size transport parameter
+        if (mup.size < NGTCP2_MAX_UDP_PAYLOAD_SIZE || mup.size > 65527)
+            throw std::invalid_argument{"Invalid max UDP payload size {}: must be in [{}, 65527]"_format(
+                    mup.size, NGTCP2_MAX_UDP_PAYLOAD_SIZE)};
+        max_udp_payload = mup.size;
+        log::trace(log_cat, "Endpoint max UDP payload size set to {}", max_udp_payload);
+    }
+
+    void Endpoint::handle_ep_opt(opt::static_secret ss)
+    {
+        if (ss.secret.size() < 16)
+            throw std::invalid_argument{"Invalid static secret: must be at least 16 bytes"};
+        static_secret.resize(ss.secret.size());
+        std::memcpy(static_secret.data(), ss.secret.data(), ss.secret.size());
+        log::trace(log_cat, "Endpoint stored {}-byte static secret", static_secret.size());
+    }
+
+    void Endpoint::handle_ep_opt(opt::socket_buffers sb)
+    {
+        socket_buffers = sb;
+        log::trace(
+                log_cat, "Endpoint socket buffer sizes set to {} (recv), {} (send)", sb.recv_size, sb.send_size);
+    }
+
+    void Endpoint::handle_ep_opt(opt::socket_buffer_autotune at)
+    {
+        if (at.send_block_threshold < 1)
+            throw std::invalid_argument{"Invalid socket buffer autotune send block threshold: must be at least 1"};
+        buffer_autotune = at;
+        log::trace(
+                log_cat,
+                "Endpoint socket buffer autotuning enabled (max {} recv, {} send)",
+                at.max_recv_size,
+                at.max_send_size);
+    }
+
+    void Endpoint::handle_ep_opt(opt::unix_transport ut)
+    {
+#ifdef _WIN32
+        throw std::invalid_argument{"opt::unix_transport is not supported on Windows"};
+#endif
+        log::trace(
+                log_cat,
+                "Endpoint will use unix datagram transport in {}",
+                ut.dir.empty() ? "the abstract namespace"s : ut.dir);
+        unix_dir = std::move(ut.dir);
+    }
+
+    void Endpoint::handle_ep_opt(opt::rate_limit rl)
+    {
+        log::trace(log_cat, "Endpoint egress rate limited to {}B/s (burst {}B)", rl.rate, rl.burst);
+        rate_limiter.emplace(rl.rate, rl.burst, get_time());
+    }
+
+    void Endpoint::handle_ep_opt(opt::zerocopy_send zc)
+    {
+        log::trace(log_cat, "Endpoint will use zero-copy sends for batches of {}B or more", zc.min_bytes);
+        zerocopy = zc;
+    }
+
+    void Endpoint::handle_ep_opt(opt::xdp x)
+    {
+        log::trace(log_cat, "Endpoint will use AF_XDP on {} queue {}", x.ifname, x.queue);
+        xdp = std::move(x);
+    }
+
+    void Endpoint::handle_ep_opt(opt::dual_stack)
+    {
+        if (!local.is_ipv6() || !local.is_any_addr())
+            throw std::invalid_argument{"opt::dual_stack requires the endpoint to be bound to [::] (not {})"_format(local)};
+        log::trace(log_cat, "Endpoint will use a dual-stack IPv4/IPv6 socket");
+        dual_stack = true;
+    }
+
+    void Endpoint::handle_ep_opt(opt::inherit_socket is)
+    {
+#ifdef _WIN32
+        (void)is;
+        throw std::invalid_argument{"opt::inherit_socket is not supported on Windows"};
+#else
+        log::trace(log_cat, "Endpoint will take over its UDP socket from the process listening on {}", is.path);
+        inherit = std::move(is);
+#endif
+    }
+
+    void Endpoint::_init_internals()
+    {
+        if (static_secret.empty())
+        {
+            static_secret.resize(32);
+            if (gnutls_rnd(GNUTLS_RND_KEY, static_secret.data(), static_secret.size()) != 0)
+                throw std::runtime_error{"Failed to generate endpoint static secret"};
+        }
+
+        if (inherit)
+        {
+            // Zero-copy sends leave completions (and pinned buffers) on the socket's error queue, and
+            // a connected socket only receives from one remote, neither of which survives the
+            // socket changing hands.
+            if (unix_dir || xdp || zerocopy || use_connected_socket)
+                throw std::invalid_argument{
+                        "opt::inherit_socket cannot be combined with unix transport, AF_XDP, opt::zerocopy_send or "
+                        "opt::connected_socket"};
+            handoff = std::make_shared<handoff_channel>(get_loop().get(), inherit->path, inherit->timeout);
+            socket = std::make_unique<UDPSocket>(
+                    get_loop().get(),
+                    handoff->take_socket(),
+                    [this](const auto& packet) { handle_packet(packet); },
+                    [this] { process_received_batch(); });
+            if (!(socket->address() == local))
+                log::warning(log_cat, "Inherited UDP socket is bound to {}, not {}", socket->address(), local);
+        }
+        else
+        {
+            log::debug(log_cat, "Starting new UDP socket on {}", local);
+            socket = std::make_unique<UDPSocket>(
+                    get_loop().get(),
+                    local,
+                    [this](const auto& packet) { handle_packet(packet); },
+                    [this] { process_received_batch(); },
+                    unix_dir,
+                    dual_stack);
+        }
+        rx_batch.reserve(DATAGRAM_BATCH_SIZE);
+
+        if (max_udp_payload != socket->max_payload())
+            socket->set_max_payload_size(max_udp_payload);
+
+        if (net.busy_poll && net.busy_poll.socket_poll > 0us)
+            socket->set_busy_poll(net.busy_poll.socket_poll, net.busy_poll.prefer);
+
+        if (xdp)
+        {
+            socket->enable_xdp(*xdp);
+            // (AF_XDP frames may be too small for the configured payload size, lowering the socket's)
+            max_udp_payload = std::min(max_udp_payload, socket->max_payload());
+        }
+
+        if (zerocopy && !socket->enable_zerocopy(zerocopy->min_bytes))
+            log::warning(log_cat, "Zero-copy sends unavailable; endpoint will use regular sends");
+
+        if (socket_buffers.recv_size)
+            socket->set_receive_buffer_size(socket_buffers.recv_size);
+        if (socket_buffers.send_size)
+            socket->set_send_buffer_size(socket_buffers.send_size);
+
+        // The kernel reports (on Linux) double the requested size, so halve it to get the baseline
+        // that autotuning grows from when no explicit size was given.
+        recv_buffer_size = socket_buffers.recv_size ? socket_buffers.recv_size : socket->receive_buffer_size() / 2;
+        send_buffer_size = socket_buffers.send_size ? socket_buffers.send_size : socket->send_buffer_size() / 2;
 
         expiry_timer.reset(event_new(
                 get_loop().get(),
@@ -38,8 +193,63 @@ namespace oxen::quic
         log::info(log_cat, "Created QUIC endpoint listening on {}", local);
     }
 
+    void Endpoint::update_socket_connection(const Address* new_remote)
+    {
+        if (!use_connected_socket || !socket)
+            return;
+
+        // We can only use a connected socket when we aren't accepting inbound connections and all of
+        // our connections (including the new one about to be made, if any) go to the same remote.
+        // This is re-evaluated as connections are made and deleted, so that we go back to a
+        // connected socket once other remotes' connections are gone.
+        std::optional<Address> remote;
+        bool single_remote = !accepting_inbound;
+        if (new_remote)
+            remote = *new_remote;
+        for (auto it = conns.begin(); single_remote && it != conns.end(); ++it)
+        {
+            if (!it->second)
+                continue;
+            if (!remote)
+                remote = it->second->remote();
+            else if (!(*remote == it->second->remote()))
+                single_remote = false;
+        }
+
+        if (single_remote)
+        {
+            // (With no connections at all we just stay as we are until the next one)
+            if (auto* current = socket->connected_address(); remote && (!current || !(*current == *remote)))
+                socket->connect(*remote);
+        }
+        else if (socket->connected_address())
+        {
+            log::debug(log_cat, "Endpoint no longer serves a single remote; disconnecting UDP socket");
+            socket->disconnect();
+        }
+    }
+
     std::list<std::shared_ptr<connection_interface>> Endpoint::get_all_conns(std::optional<Direction> d)
     {
+        if (!net.in_event_loop())
+        {
+            // The promise is owned by the job so that, if the loop stops before getting to it, the
+            // dropped job breaks it rather than leaving us waiting forever.
+            if (!net.running)
+                return {};
+            auto p = std::make_shared<std::promise<std::list<std::shared_ptr<connection_interface>>>>();
+            auto f = p->get_future();
+            net.call([p, d, this] { p->set_value(get_all_conns(d)); });
+            try
+            {
+                return f.get();
+            }
+            catch (const std::future_error&)
+            {
+                return {};
+            }
+        }
+
         std::list<std::shared_ptr<connection_interface>> ret{};
 
         for (const auto& c : conns)
@@ -56,24 +266,33 @@ namespace oxen::quic
         return ret;
     }
 
-    void Endpoint::close_conns(std::optional<Direction> d)
+    void Endpoint::close_conns(std::optional<Direction> d, std::function<void()> flushed)
     {
-        for (const auto& c : conns)
-        {
-            if (d)
-            {
-                if (c.second->direction() == d)
-                    close_connection(*c.second.get());
-            }
-            else
-                close_connection(*c.second.get());
-        }
+        // (Collected first, as writing a close packet can delete the connection from `conns`)
+        std::vector<std::shared_ptr<Connection>> closing;
+        closing.reserve(conns.size());
+        for (const auto& [cid, conn] : conns)
+            if (conn && (!d || conn->direction() == *d))
+                closing.push_back(conn);
+
+        auto batch = std::make_shared<close_batch>();
+        batch->flushed = std::move(flushed);
+        batch->sizes.reserve(closing.size());
+        batch->paths.reserve(closing.size());
+        batch->tos.reserve(closing.size());
+        batch->cids.reserve(closing.size());
+        for (auto& conn : closing)
+            write_close_packet(*conn, NGTCP2_NO_ERROR, "NO_ERROR"sv, *batch);
+
+        log::debug(log_cat, "Closing {} connection(s) with {} close packet(s)", closing.size(), batch->sizes.size());
+        send_close_batch(std::move(batch));
     }
 
     void Endpoint::drain_connection(Connection& conn)
     {
         if (conn.is_draining())
             return;
+        snapshot_dirty = true;
         conn.call_closing();
 
         log::debug(log_cat, "Putting CID: {} into draining state", conn.scid());
@@ -83,6 +302,9 @@ namespace oxen::quic
 
     void Endpoint::handle_packet(const Packet& pkt)
     {
+        net.loop_activity++;
+        snapshot_dirty = true;
+
         auto dcid_opt = handle_packet_connid(pkt);
 
         if (!dcid_opt)
@@ -95,10 +317,32 @@ namespace oxen::quic
 
         // check existing conns
         log::trace(log_cat, "Incoming connection ID: {}", dcid);
-        auto cptr = get_conn(dcid);
+        auto cptr = find_conn(dcid);
+
+        if (!cptr && handoff && handoff->forwarding())
+        {
+            // After a socket handoff, packets for connections we don't know belong (or at least
+            // may belong) to the previous process: short header and Handshake packets (the
+            // long-header type bits 0x30 being 0x20 in QUIC v1) can't start a new connection, so
+            // pass those back to it.  Initial (and 0-RTT) packets are new connections for us.
+            auto b0 = static_cast<uint8_t>(pkt.data[0]);
+            if (!(b0 & 0x80) || (b0 & 0x30) == 0x20)
+            {
+                handoff->forward(pkt);
+                return;
+            }
+        }
 
         if (!cptr)
         {
+            // Short header (i.e. 1-RTT) packets are never the start of a new connection.  (The
+            // header form bit is the most significant bit of the first byte).
+            if (!(static_cast<uint8_t>(pkt.data[0]) & 0x80))
+            {
+                handle_unknown_short_packet(pkt, dcid);
+                return;
+            }
+
             if (accepting_inbound)
             {
                 cptr = accept_initial_connection(pkt);
@@ -116,16 +360,214 @@ namespace oxen::quic
             }
         }
 
-        handle_conn_packet(*cptr, pkt);
-        return;
+        // We don't process the packet yet: instead we collect the whole receive batch so that we
+        // can feed each connection its packets back-to-back and then flush it just once (see
+        // process_received_batch()).
+        rx_batch.emplace_back(cptr->scid(), pkt);
+    }
+
+    // Returns the ngtcp2 path for feeding `pkt` to `conn`.  This is normally just the packet's
+    // path, but an outbound connection from a wildcard-bound socket only knows its local address as
+    // the wildcard, so we keep using that (rather than the real, pktinfo-supplied local address of
+    // the packet) to stop ngtcp2 from seeing it as a path change.
+    static ngtcp2_path conn_path(const Connection& conn, const Packet& pkt)
+    {
+        auto path = pkt.path_view();
+        if (conn.local().is_any_addr())
+            path.local = conn.local();
+        return path;
+    }
+
+    void Endpoint::handle_unknown_short_packet(const Packet& pkt, const ConnectionID& dcid)
+    {
+        // A stateless reset looks just like a short header packet with an unknown (random) CID,
+        // but ends with one of the reset tokens the peer gave us for its connection IDs (RFC 9000
+        // §10.3.1), in which case we can drop the connection right away.
+        constexpr size_t min_reset_size = 1 + NGTCP2_MIN_STATELESS_RESET_RANDLEN + NGTCP2_STATELESS_RESET_TOKENLEN;
+        if (pkt.data.size() >= min_reset_size && !peer_reset_tokens.empty())
+        {
+            reset_token token;
+            std::memcpy(token.data(), pkt.data.data() + pkt.data.size() - token.size(), token.size());
+            if (auto it = peer_reset_tokens.find(token); it != peer_reset_tokens.end())
+            {
+                if (auto c = conns.find(it->second); c != conns.end() && c->second && !c->second->is_draining())
+                {
+                    log::info(log_cat, "Connection {} received stateless reset from {}; draining", it->second, pkt.remote);
+                    drain_connection(*c->second);
+                }
+                return;
+            }
+        }
+
+        log::debug(log_cat, "Received packet for unknown connection ID {} from {}", dcid, pkt.remote);
+        send_stateless_reset(pkt, dcid);
+    }
+
+    void Endpoint::send_stateless_reset(const Packet& pkt, const ConnectionID& dcid)
+    {
+        // Per RFC 9000 §10.3 a reset must be smaller than the packet that triggered it (so that two
+        // endpoints can't get into an infinite reset loop), but needs at least
+        // NGTCP2_MIN_STATELESS_RESET_RANDLEN random bytes to be indistinguishable from a real packet.
+        constexpr size_t min_reset_size = 1 + NGTCP2_MIN_STATELESS_RESET_RANDLEN + NGTCP2_STATELESS_RESET_TOKENLEN;
+        if (pkt.data.size() <= min_reset_size)
+        {
+            log::trace(log_cat, "Packet too small to reply with a stateless reset");
+            return;
+        }
+
+        if (stateless_reset_budget == 0)
+        {
+            log::debug(log_cat, "Not sending stateless reset to {}: rate limit reached", pkt.remote);
+            return;
+        }
+        --stateless_reset_budget;
+
+        std::array<uint8_t, NGTCP2_STATELESS_RESET_TOKENLEN> token;
+        if (ngtcp2_crypto_generate_stateless_reset_token(token.data(), static_secret.data(), static_secret.size(), &dcid) !=
+            0)
+        {
+            log::warning(log_cat, "Failed to generate stateless reset token");
+            return;
+        }
+
+        // Like ngtcp2's example server, we make the reset as large as a short header packet with a
+        // max-length CID plus minimum payload (so that it can't be distinguished from one), unless
+        // that would make it too big.
+        constexpr size_t max_randlen = NGTCP2_MAX_CIDLEN + 22 - NGTCP2_STATELESS_RESET_TOKENLEN;
+        const size_t randlen = std::min(max_randlen, pkt.data.size() - 1 - NGTCP2_STATELESS_RESET_TOKENLEN - 1);
+
+        std::array<uint8_t, max_randlen> rand;
+        if (gnutls_rnd(GNUTLS_RND_NONCE, rand.data(), randlen) != 0)
+            return;
+
+        std::vector<std::byte> buf;
+        buf.resize(1 + max_randlen + NGTCP2_STATELESS_RESET_TOKENLEN);
+        auto nwrite = ngtcp2_pkt_write_stateless_reset(u8data(buf), buf.size(), token.data(), rand.data(), randlen);
+        if (nwrite <= 0)
+        {
+            log::warning(log_cat, "Failed to write stateless reset: {}", ngtcp2_strerror(nwrite));
+            return;
+        }
+        buf.resize(nwrite);
+
+        log::debug(log_cat, "Sending stateless reset for unknown connection ID {} to {}", dcid, pkt.remote);
+        send_or_queue_packet(pkt.path(), std::move(buf), /*tos=*/0);
+    }
+
+    void Endpoint::add_connection_alias(Connection& conn, const ConnectionID& alias)
+    {
+        if (auto [it, ins] = conn_aliases.emplace(alias, conn.scid()); ins)
+        {
+            conn.cid_aliases.push_back(alias);
+            log::trace(log_cat, "Registered CID {} for connection {}", alias, conn.scid());
+        }
+        else
+            log::warning(log_cat, "Connection ID {} collision; ignoring", alias);
+    }
+
+    void Endpoint::remove_connection_alias(Connection& conn, const ConnectionID& alias)
+    {
+        if (auto it = conn_aliases.find(alias); it != conn_aliases.end() && it->second == conn.scid())
+        {
+            conn_aliases.erase(it);
+            auto& aliases = conn.cid_aliases;
+            aliases.erase(std::remove(aliases.begin(), aliases.end(), alias), aliases.end());
+            log::trace(log_cat, "Retired CID {} of connection {}", alias, conn.scid());
+        }
+    }
+
+    void Endpoint::erase_connection_aliases(Connection& conn)
+    {
+        for (const auto& alias : conn.cid_aliases)
+            conn_aliases.erase(alias);
+        conn.cid_aliases.clear();
+    }
+
+    void Endpoint::add_peer_reset_token(Connection& conn, const reset_token& token)
+    {
+        if (auto [it, ins] = peer_reset_tokens.emplace(token, conn.scid()); ins)
+            conn.peer_reset_tokens.push_back(token);
+        else if (!(it->second == conn.scid()))
+            log::warning(log_cat, "Stateless reset token collision for connection {}; ignoring", conn.scid());
+    }
+
+    void Endpoint::remove_peer_reset_token(Connection& conn, const reset_token& token)
+    {
+        if (auto it = peer_reset_tokens.find(token); it != peer_reset_tokens.end() && it->second == conn.scid())
+        {
+            peer_reset_tokens.erase(it);
+            auto& tokens = conn.peer_reset_tokens;
+            tokens.erase(std::remove(tokens.begin(), tokens.end(), token), tokens.end());
+        }
+    }
+
+    void Endpoint::erase_peer_reset_tokens(Connection& conn)
+    {
+        for (const auto& token : conn.peer_reset_tokens)
+            peer_reset_tokens.erase(token);
+        conn.peer_reset_tokens.clear();
+    }
+
+    void Endpoint::process_received_batch()
+    {
+        const size_t n = rx_batch.size();
+        if (n == 0)
+            return;
+
+        // The batch is small (at most DATAGRAM_BATCH_SIZE) so we just do a simple quadratic scan
+        // to group packets by connection, preserving each connection's arrival order.
+        std::array<bool, DATAGRAM_BATCH_SIZE> done{};
+        assert(n <= done.size());
+
+        for (size_t i = 0; i < n; i++)
+        {
+            if (done[i])
+                continue;
+
+            const auto& cid = rx_batch[i].first;
+            bool need_flush = false;
+            for (size_t j = i; j < n; j++)
+            {
+                if (done[j] || rx_batch[j].first != cid)
+                    continue;
+                done[j] = true;
+
+                // Look the connection up each time, as a previous packet could have closed it
+                auto* conn = find_conn(cid);
+                if (!conn)
+                {
+                    log::debug(log_cat, "Connection {} went away; dropping remaining packets in batch", cid);
+                    break;
+                }
+                if (handle_conn_packet(*conn, rx_batch[j].second))
+                    need_flush = true;
+            }
+
+            if (auto* conn = find_conn(cid))
+            {
+                conn->flush_received_stream_data();
+                if (need_flush)
+                    conn->on_io_ready();
+            }
+        }
+
+        rx_batch.clear();
     }
 
     void Endpoint::close_connection(Connection& conn, int code, std::string_view msg)
+    {
+        auto batch = std::make_shared<close_batch>();
+        if (write_close_packet(conn, code, msg, *batch))
+            send_close_batch(std::move(batch));
+    }
+
+    bool Endpoint::write_close_packet(Connection& conn, int code, std::string_view msg, close_batch& batch)
     {
         log::debug(log_cat, "Closing connection (CID: {})", *conn.scid().data);
 
         if (conn.is_closing() || conn.is_draining())
-            return;
+            return false;
+        snapshot_dirty = true;
 
         if (code == NGTCP2_ERR_IDLE_CLOSE)
         {
@@ -135,7 +577,7 @@ namespace oxen::quic
                     "packet",
                     *conn.scid().data);
             delete_connection(conn.scid());
-            return;
+            return false;
         }
 
         //  "The error not specifically mentioned, including NGTCP2_ERR_HANDSHAKE_TIMEOUT,
@@ -152,34 +594,74 @@ namespace oxen::quic
         ngtcp2_ccerr err;
         ngtcp2_ccerr_set_liberr(&err, code, reinterpret_cast<uint8_t*>(const_cast<char*>(msg.data())), msg.size());
 
-        std::vector<std::byte> buf;
-        buf.resize(max_payload_size);
+        const size_t offset = batch.buf.size();
+        batch.buf.resize(offset + max_payload_size);
         ngtcp2_pkt_info pkt_info{};
 
         auto written = ngtcp2_conn_write_connection_close(
-                conn, nullptr, &pkt_info, u8data(buf), buf.size(), &err, get_timestamp().count());
+                conn, nullptr, &pkt_info, u8data(batch.buf) + offset, max_payload_size, &err, get_timestamp().count());
 
         if (written <= 0)
         {
             log::warning(
                     log_cat,
                     "Error: Failed to write connection close packet: {}",
-                    (written < 0) ? strerror(written) : "[Error Unknown: closing pkt is 0 bytes?]"s);
+                    (written < 0) ? ngtcp2_strerror(written) : "[Error Unknown: closing pkt is 0 bytes?]"s);
 
+            batch.buf.resize(offset);
             delete_connection(conn.scid());
-            return;
+            return false;
         }
         // ensure we had enough write space
-        assert(static_cast<size_t>(written) <= buf.size());
+        assert(static_cast<size_t>(written) <= max_payload_size);
+
+        batch.buf.resize(offset + written);
+        batch.sizes.push_back(written);
+        batch.paths.push_back(conn.path());
+        batch.tos.push_back(conn.traffic_class(0));
+        batch.cids.push_back(conn.scid());
+        return true;
+    }
 
-        send_or_queue_packet(conn.path(), std::move(buf), /*ecn=*/0, [this, cid = conn.scid()](io_result rv) {
-            if (rv.failure())
+    void Endpoint::send_close_batch(std::shared_ptr<close_batch> batch)
+    {
+        auto& b = *batch;
+        const size_t n = b.sizes.size();
+        while (socket && b.sent < n)
+        {
+            auto [res, sent] = socket->send_multi(
+                    &b.paths[b.sent], b.buf.data() + b.sent_bytes, &b.sizes[b.sent], &b.tos[b.sent], n - b.sent);
+            b.sent_bytes += std::accumulate(b.sizes.begin() + b.sent, b.sizes.begin() + b.sent + sent, size_t{0});
+            b.sent += sent;
+
+            if (res.blocked())
+            {
+                log::debug(
+                        log_cat, "Socket blocked after sending {}/{} close packet(s); resuming when writeable", b.sent, n);
+                socket->when_writeable([this, batch = std::move(batch)]() mutable { send_close_batch(std::move(batch)); });
+                return;
+            }
+            if (res.failure())
             {
+                // Give up on (the connection of) the packet that failed, and carry on with the rest
                 log::warning(
-                        log_cat, "Error: failed to send close packet [{}]; removing connection [CID: {}]", rv.str(), cid);
-                delete_connection(cid);
+                        log_cat,
+                        "Error: failed to send close packet [{}]; removing connection [CID: {}]",
+                        res.str(),
+                        b.cids[b.sent]);
+                delete_connection(b.cids[b.sent]);
+                b.sent_bytes += b.sizes[b.sent];
+                b.sent++;
             }
-        });
+        }
+
+        if (b.sent < n)
+            log::warning(log_cat, "Socket closed with {} close packet(s) unsent", n - b.sent);
+        else if (n > 1)
+            log::debug(log_cat, "Sent {} close packets", n);
+
+        if (b.flushed)
+            b.flushed();
     }
 
     void Endpoint::delete_connection(const ConnectionID& cid)
@@ -188,7 +670,11 @@ namespace oxen::quic
         {
             itr->second->call_closing();
 
+            erase_connection_aliases(*itr->second);
+            erase_peer_reset_tokens(*itr->second);
             conns.erase(itr);
+            snapshot_dirty = true;
+            update_socket_connection();
             log::debug(log_cat, "Successfully deleted connection [ID: {}]", *cid.data);
         }
         else
@@ -202,7 +688,7 @@ namespace oxen::quic
 
         if (rv == NGTCP2_ERR_VERSION_NEGOTIATION)
         {  // version negotiation has not been sent yet, ignore packet
-            send_version_negotiation(vid, pkt.path);
+            send_version_negotiation(vid, pkt.path());
             return std::nullopt;
         }
         if (rv != 0)
@@ -257,20 +743,24 @@ namespace oxen::quic
         {
             if (auto [itr, success] = conns.emplace(ConnectionID::random(), nullptr); success)
             {
-                itr->second =
-                        Connection::make_conn(*this, itr->first, hdr.scid, pkt.path, inbound_ctx, Direction::INBOUND, &hdr);
+                snapshot_dirty = true;
+                itr->second = Connection::make_conn(
+                        *this, itr->first, hdr.scid, pkt.path(), inbound_ctx, Direction::INBOUND, &hdr);
+                // The client keeps using its randomly chosen initial DCID until it hears back from
+                // us, so make sure any further packets it sends with it find this connection.
+                add_connection_alias(*itr->second, ConnectionID{hdr.dcid});
                 return itr->second.get();
             }
         }
     }
 
-    void Endpoint::handle_conn_packet(Connection& conn, const Packet& pkt)
+    bool Endpoint::handle_conn_packet(Connection& conn, const Packet& pkt)
     {
         if (auto rv = ngtcp2_conn_in_closing_period(conn); rv != 0)
         {
             log::debug(log_cat, "Error: connection (CID: {}) is in closing period; dropping connection", *conn.scid().data);
             delete_connection(conn.scid());
-            return;
+            return false;
         }
 
         if (conn.is_draining())
@@ -280,20 +770,29 @@ namespace oxen::quic
 
         // TODO: if read packet gives us failure, should we close?
         if (read_packet(conn, pkt).success())
+        {
             log::trace(log_cat, "done with incoming packet");
-        else
-            log::trace(log_cat, "read packet failed");  // error will be already logged
+            // Only a short header packet proves the sender is the peer: Initial packets' keys are
+            // derivable by anyone who sees (or makes up) the connection ID.
+            if (!(static_cast<uint8_t>(pkt.data[0]) & 0x80))
+                socket->confirm_path(pkt);
+            return true;
+        }
+
+        log::trace(log_cat, "read packet failed");  // error will be already logged
+        return false;
     }
 
     io_result Endpoint::read_packet(Connection& conn, const Packet& pkt)
     {
         auto ts = get_timestamp().count();
-        auto rv = ngtcp2_conn_read_pkt(conn, pkt.path, &pkt.pkt_info, u8data(pkt.data), pkt.data.size(), ts);
+        auto path = conn_path(conn, pkt);
+        auto rv = ngtcp2_conn_read_pkt(conn, &path, &pkt.pkt_info, u8data(pkt.data), pkt.data.size(), ts);
 
         switch (rv)
         {
             case 0:
-                conn.io_ready();
+                // Flushing is deferred to the end of the receive batch (see process_received_batch)
                 break;
             case NGTCP2_ERR_DRAINING:
                 log::debug(log_cat, "Draining connection {}", *conn.scid().data);
@@ -327,20 +826,29 @@ namespace oxen::quic
         return io_result::ngtcp2(rv);
     }
 
-    io_result Endpoint::send_packets(const Address& dest, std::byte* buf, size_t* bufsize, uint8_t ecn, size_t& n_pkts)
+    io_result Endpoint::send_packets(
+            const Path& path,
+            std::byte* buf,
+            size_t* bufsize,
+            uint8_t tos,
+            size_t& n_pkts,
+            const std::shared_ptr<void>& pin,
+            std::byte* unsent_buf)
     {
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
 
+        const auto& dest = path.remote;
         if (!socket)
         {
             log::warning(log_cat, "Cannot send packets on closed socket (to reach {})", dest);
             return io_result{EBADF};
         }
         assert(n_pkts >= 1 && n_pkts <= MAX_BATCH);
+        snapshot_dirty = true;
 
         log::trace(log_cat, "Sending {} UDP packet(s) to {}...", n_pkts, dest);
 
-        auto [ret, sent] = socket->send(dest, buf, bufsize, ecn, n_pkts);
+        auto [ret, sent] = socket->send(path, buf, bufsize, tos, n_pkts, pin);
 
         if (ret.failure() && !ret.blocked())
         {
@@ -353,14 +861,18 @@ namespace oxen::quic
         {
             if (sent == 0)  // Didn't send *any* packets, i.e. we got entirely blocked
                 log::debug(log_cat, "UDP sent none of {}", n_pkts);
-
             else
-            {
-                // We sent some but not all, so shift the unsent packets back to the beginning of buf/bufsize
                 log::debug(log_cat, "UDP undersent {}/{}", sent, n_pkts);
+
+            // Shift the unsent packets back to the beginning of buf/bufsize, or of unsent_buf if we
+            // were given a pin.  In the latter case the caller continues with unsent_buf, so the
+            // packets have to go there even if none were sent.
+            if (sent > 0 || pin)
+            {
                 size_t offset = std::accumulate(bufsize, bufsize + sent, size_t{0});
                 size_t len = std::accumulate(bufsize + sent, bufsize + n_pkts, size_t{0});
-                std::memmove(buf, buf + offset, len);
+                assert(!pin || unsent_buf);
+                std::memmove(pin ? unsent_buf : buf, buf + offset, len);
                 std::copy(bufsize + sent, bufsize + n_pkts, bufsize);
                 n_pkts -= sent;
             }
@@ -377,7 +889,7 @@ namespace oxen::quic
     }
 
     void Endpoint::send_or_queue_packet(
-            const Path& p, std::vector<std::byte> buf, uint8_t ecn, std::function<void(io_result)> callback)
+            const Path& p, std::vector<std::byte> buf, uint8_t tos, std::function<void(io_result)> callback)
     {
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
 
@@ -391,12 +903,12 @@ namespace oxen::quic
 
         size_t n_pkts = 1;
         size_t bufsize = buf.size();
-        auto res = send_packets(p.remote, buf.data(), &bufsize, ecn, n_pkts);
+        auto res = send_packets(p, buf.data(), &bufsize, tos, n_pkts);
 
         if (res.blocked())
         {
-            socket->when_writeable([this, p, buf = std::move(buf), ecn, cb = std::move(callback)]() mutable {
-                send_or_queue_packet(p, std::move(buf), ecn, std::move(cb));
+            socket->when_writeable([this, p, buf = std::move(buf), tos, cb = std::move(callback)]() mutable {
+                send_or_queue_packet(p, std::move(buf), tos, std::move(cb));
             });
         }
     }
@@ -427,13 +939,23 @@ namespace oxen::quic
             return;
         }
 
-        send_or_queue_packet(p, std::move(buf), /*ecn=*/0);
+        send_or_queue_packet(p, std::move(buf), /*tos=*/0);
     }
 
     void Endpoint::check_timeouts()
     {
         auto now = get_time();
 
+        stateless_reset_budget = STATELESS_RESET_BURST;
+
+        if (handoff)
+            check_handoff_drained();
+
+        if (buffer_autotune)
+            autotune_socket_buffers();
+
+        publish_snapshot();
+
         const auto& f = draining.begin();
 
         while (!draining.empty() && f->first < now)
@@ -441,16 +963,187 @@ namespace oxen::quic
             if (auto itr = conns.find(f->second); itr != conns.end())
             {
                 log::debug(log_cat, "Deleting connection {}", *itr->first.data);
+                erase_connection_aliases(*itr->second);
+                erase_peer_reset_tokens(*itr->second);
                 conns.erase(itr);
+                snapshot_dirty = true;
+                update_socket_connection();
             }
             draining.erase(f);
         }
     }
 
-    Connection* Endpoint::get_conn(const ConnectionID& id)
+    void Endpoint::hand_off(std::string path, std::function<void()> drained)
+    {
+        std::promise<void> p;
+        auto f = p.get_future();
+
+        net.call([&, this]() mutable {
+            try
+            {
+                if (unix_dir || xdp || zerocopy || use_connected_socket)
+                    throw std::invalid_argument{
+                            "Socket handoff is not supported with unix transport, AF_XDP, opt::zerocopy_send or "
+                            "opt::connected_socket"};
+                if (handoff)
+                    throw std::logic_error{"Endpoint socket handoff is already in progress"};
+
+                handoff = std::make_shared<handoff_channel>(
+                        get_loop().get(),
+                        std::move(path),
+                        socket->handle(),
+                        max_udp_payload,
+                        [this] {
+                            // The new process reads the socket from here on; we only get the
+                            // packets it forwards to us for our existing connections.
+                            socket->stop_receiving();
+                            accepting_inbound = false;
+                        },
+                        [this](const auto& packet) { handle_packet(packet); },
+                        [this] { process_received_batch(); });
+                handoff_drained = std::move(drained);
+
+                p.set_value();
+            }
+            catch (...)
+            {
+                p.set_exception(std::current_exception());
+            }
+        });
+
+        f.get();
+    }
+
+    void Endpoint::check_handoff_drained()
+    {
+        if (inherit)
+        {
+            // New process: once the old process has closed the channel there is nothing left to
+            // forward to.
+            if (!handoff->forwarding())
+                handoff.reset();
+            return;
+        }
+
+        if (!handoff->handed_off() || !conns.empty())
+            return;
+
+        log::info(log_cat, "All connections finished after socket handoff; closing handoff channel");
+        handoff->close();
+        handoff.reset();
+        if (auto drained = std::move(handoff_drained))
+            drained();
+    }
+
+    void Endpoint::publish_snapshot()
+    {
+        if (!snapshot_dirty)
+            return;
+        snapshot_dirty = false;
+
+        auto snap = std::make_shared<connection_snapshot>();
+        snap->epoch = ++snapshot_epoch;
+        snap->taken = get_time();
+        snap->throttled = throttled.elapsed(snap->taken);
+        snap->connections.reserve(conns.size());
+
+        for (const auto& [cid, conn] : conns)
+        {
+            if (!conn)
+                continue;
+            ngtcp2_conn_info info{};
+            if (ngtcp2_conn* c = *conn)
+                ngtcp2_conn_get_conn_info(c, &info);
+
+            auto& cs = snap->connections.emplace_back();
+            cs.scid = conn->scid();
+            cs.dcid = conn->dcid();
+            cs.path = conn->path();
+            cs.direction = conn->direction();
+            cs.closing = conn->is_closing();
+            cs.draining = conn->is_draining();
+            cs.streams = conn->streams.size();
+            cs.pending_streams = conn->pending_streams.size();
+            cs.throttled = conn->throttled.elapsed(snap->taken);
+            cs.smoothed_rtt = std::chrono::nanoseconds{info.smoothed_rtt};
+            cs.min_rtt = std::chrono::nanoseconds{info.min_rtt};
+            cs.cwnd = info.cwnd;
+            cs.bytes_in_flight = info.bytes_in_flight;
+        }
+
+        std::atomic_store(&current_snapshot, std::shared_ptr<const connection_snapshot>{std::move(snap)});
+    }
+
+    void Endpoint::autotune_socket_buffers()
+    {
+        if (!socket)
+            return;
+
+        auto drops = socket->receive_drops();
+        auto blocks = socket->send_blocks();
+        // The drop counter is a kernel uint32_t, and so can wrap; unsigned subtraction handles that.
+        uint32_t new_drops = drops - last_rx_drops;
+        uint64_t new_blocks = blocks - last_send_blocks;
+        last_rx_drops = drops;
+        last_send_blocks = blocks;
+
+        if (new_drops > 0 && recv_buffer_size < buffer_autotune->max_recv_size)
+        {
+            recv_buffer_size = std::min(std::max<size_t>(recv_buffer_size * 2, 64_ki), buffer_autotune->max_recv_size);
+            log::info(
+                    log_cat,
+                    "Kernel dropped {} received packets on {}; growing receive buffer to {}",
+                    new_drops,
+                    local,
+                    recv_buffer_size);
+            socket->set_receive_buffer_size(recv_buffer_size);
+        }
+
+        if (new_blocks >= buffer_autotune->send_block_threshold && send_buffer_size < buffer_autotune->max_send_size)
+        {
+            send_buffer_size = std::min(std::max<size_t>(send_buffer_size * 2, 64_ki), buffer_autotune->max_send_size);
+            log::info(
+                    log_cat,
+                    "{} blocked sends on {}; growing send buffer to {}",
+                    new_blocks,
+                    local,
+                    send_buffer_size);
+            socket->set_send_buffer_size(send_buffer_size);
+        }
+    }
+
+    std::shared_ptr<Connection> Endpoint::get_conn(const ConnectionID& id)
+    {
+        if (!net.in_event_loop())
+        {
+            // As in get_all_conns(), the job owns the promise so that a stopped loop can't hang us
+            if (!net.running)
+                return nullptr;
+            auto p = std::make_shared<std::promise<std::shared_ptr<Connection>>>();
+            auto f = p->get_future();
+            net.call([p, id, this] { p->set_value(get_conn(id)); });
+            try
+            {
+                return f.get();
+            }
+            catch (const std::future_error&)
+            {
+                return nullptr;
+            }
+        }
+
+        if (auto* conn = find_conn(id))
+            return conns.at(conn->scid());
+        return nullptr;
+    }
+
+    Connection* Endpoint::find_conn(const ConnectionID& id)
     {
         if (auto it = conns.find(id); it != conns.end())
             return it->second.get();
+        if (auto alias = conn_aliases.find(id); alias != conn_aliases.end())
+            if (auto it = conns.find(alias->second); it != conns.end())
+                return it->second.get();
         return nullptr;
     }
 
@@ -4,9 +4,16 @@ extern "C"
 {
 #include <gnutls/crypto.h>
 #include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
 }
 
+#include <oxenc/hex.h>
+
+#include <ctime>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "connection.hpp"
 #include "context.hpp"
@@ -30,6 +37,91 @@ namespace oxen::quic
 
             return tls_session->do_tls_callback(session, htype, when, incoming, msg);
         }
+
+        int gnutls_verify_wrapper(gnutls_session_t session)
+        {
+            const auto* conn_ref = static_cast<ngtcp2_crypto_conn_ref*>(gnutls_session_get_ptr(session));
+            const auto* conn = static_cast<Connection*>(conn_ref->user_data);
+            const GNUTLSSession* tls_session = dynamic_cast<const GNUTLSSession*>(conn->get_session());
+            assert(tls_session);
+
+            return tls_session->verify_peer(session);
+        }
+    }
+
+    struct GNUTLSCreds::verify_cache
+    {
+        struct entry
+        {
+            std::chrono::steady_clock::time_point expiry;
+            uint64_t generation;
+        };
+
+        std::chrono::seconds ttl;
+        size_t max_size;
+
+        std::mutex mutex;
+        // Bumped whenever the trust store changes or a certificate is revoked; entries from an older
+        // generation are stale.
+        uint64_t generation{0};
+        // Raw SHA-256 fingerprint => cache entry
+        std::unordered_map<std::string, entry> entries;
+        std::unordered_set<std::string> revoked;
+        uint64_t hits{0};
+        uint64_t misses{0};
+
+        verify_cache(std::chrono::seconds ttl, size_t max_size) : ttl{ttl}, max_size{max_size} {}
+
+        // Makes room for a new entry, dropping expired entries or (if none) the one expiring first
+        void evict(std::chrono::steady_clock::time_point now)
+        {
+            for (auto it = entries.begin(); it != entries.end();)
+            {
+                if (it->second.expiry <= now || it->second.generation != generation)
+                    it = entries.erase(it);
+                else
+                    ++it;
+            }
+            if (entries.size() >= max_size && !entries.empty())
+                entries.erase(std::min_element(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+                    return a.second.expiry < b.second.expiry;
+                }));
+        }
+    };
+
+    // Returns the raw SHA-256 fingerprint of a DER certificate (empty on failure)
+    static std::string cert_fingerprint(const gnutls_datum_t& cert)
+    {
+        std::string fp(32, '\0');
+        size_t size = fp.size();
+        if (gnutls_fingerprint(GNUTLS_DIG_SHA256, &cert, fp.data(), &size) < 0)
+            return {};
+        fp.resize(size);
+        return fp;
+    }
+
+    // Loads trust or CRL data (a file path, or PEM/DER data) into `cred`
+    template <typename FileLoader, typename MemLoader>
+    static void load_x509(std::string_view what, const std::string& input, FileLoader load_file, MemLoader load_mem)
+    {
+        int rv;
+        if (fs::path path{input}; fs::exists(path))
+        {
+            auto format = str_tolower(path.extension().u8string()) == ".pem" ? GNUTLS_X509_FMT_PEM : GNUTLS_X509_FMT_DER;
+            rv = load_file(path.u8string().c_str(), format);
+        }
+        else
+        {
+            auto format = input.compare(0, 5, "-----") == 0 ? GNUTLS_X509_FMT_PEM : GNUTLS_X509_FMT_DER;
+            gnutls_datum_t mem{reinterpret_cast<unsigned char*>(const_cast<char*>(input.data())),
+                               static_cast<unsigned int>(input.size())};
+            rv = load_mem(&mem, format);
+        }
+        if (rv < 0)
+        {
+            log::warning(log_cat, "Loading x509 {} failed: {}", what, gnutls_strerror(rv));
+            throw std::invalid_argument{"gnutls didn't like the specified {} file/memblock"_format(what)};
+        }
     }
 
     GNUTLSCreds::GNUTLSCreds(std::string local_key, std::string local_cert, std::string remote_cert, std::string ca_arg)
@@ -41,7 +133,7 @@ namespace oxen::quic
             rcert = datum{remote_cert};
         datum ca;
         if (not ca_arg.empty())
-            ca = datum{ca};
+            ca = datum{ca_arg};
 
         if (auto rv = gnutls_certificate_allocate_credentials(&cred); rv < 0)
         {
@@ -93,6 +185,167 @@ namespace oxen::quic
         return std::make_unique<GNUTLSSession>(*this, conn_ref, is_client);
     }
 
+    void GNUTLSCreds::enable_peer_verification(std::chrono::seconds cache_ttl, size_t cache_size)
+    {
+        vcache = std::make_unique<verify_cache>(cache_ttl, cache_size);
+        verify_peers = true;
+        gnutls_certificate_set_verify_function(cred, gnutls_verify_wrapper);
+    }
+
+    void GNUTLSCreds::add_trust(std::string ca)
+    {
+        load_x509(
+                "trust",
+                ca,
+                [this](const char* file, gnutls_x509_crt_fmt_t fmt) {
+                    return gnutls_certificate_set_x509_trust_file(cred, file, fmt);
+                },
+                [this](const gnutls_datum_t* mem, gnutls_x509_crt_fmt_t fmt) {
+                    return gnutls_certificate_set_x509_trust_mem(cred, mem, fmt);
+                });
+        if (vcache)
+        {
+            std::lock_guard lock{vcache->mutex};
+            vcache->generation++;
+        }
+    }
+
+    void GNUTLSCreds::add_crl(std::string crl)
+    {
+        load_x509(
+                "CRL",
+                crl,
+                [this](const char* file, gnutls_x509_crt_fmt_t fmt) {
+                    return gnutls_certificate_set_x509_crl_file(cred, file, fmt);
+                },
+                [this](const gnutls_datum_t* mem, gnutls_x509_crt_fmt_t fmt) {
+                    return gnutls_certificate_set_x509_crl_mem(cred, mem, fmt);
+                });
+        if (vcache)
+        {
+            std::lock_guard lock{vcache->mutex};
+            vcache->generation++;
+        }
+    }
+
+    void GNUTLSCreds::revoke(std::string_view fingerprint)
+    {
+        if (fingerprint.size() != 64 || !oxenc::is_hex(fingerprint))
+            throw std::invalid_argument{"Invalid certificate fingerprint: expected 64 hex digits"};
+        if (!vcache)
+            throw std::logic_error{"Cannot revoke certificates without peer verification enabled"};
+
+        std::lock_guard lock{vcache->mutex};
+        vcache->revoked.insert(oxenc::from_hex(fingerprint));
+        vcache->generation++;
+    }
+
+    verify_cache_stats GNUTLSCreds::verify_stats() const
+    {
+        verify_cache_stats stats;
+        if (vcache)
+        {
+            std::lock_guard lock{vcache->mutex};
+            stats.hits = vcache->hits;
+            stats.misses = vcache->misses;
+            stats.cached = vcache->entries.size();
+        }
+        return stats;
+    }
+
+    int GNUTLSCreds::verify_peer(gnutls_session_t session) const
+    {
+        assert(vcache);
+        auto& cache = *vcache;
+
+        unsigned int num_certs = 0;
+        const gnutls_datum_t* certs = gnutls_certificate_get_peers(session, &num_certs);
+        if (!certs || num_certs == 0)
+        {
+            log::warning(log_cat, "Peer did not present a certificate");
+            return GNUTLS_E_CERTIFICATE_ERROR;
+        }
+
+        auto fp = cert_fingerprint(certs[0]);
+        if (fp.empty())
+            return GNUTLS_E_CERTIFICATE_ERROR;
+
+        const auto now = std::chrono::steady_clock::now();
+        uint64_t generation;
+        {
+            std::lock_guard lock{cache.mutex};
+            if (!cache.revoked.empty())
+            {
+                for (unsigned int i = 0; i < num_certs; i++)
+                {
+                    if (cache.revoked.count(i == 0 ? fp : cert_fingerprint(certs[i])))
+                    {
+                        log::warning(log_cat, "Rejecting peer certificate chain with revoked certificate");
+                        return GNUTLS_E_CERTIFICATE_ERROR;
+                    }
+                }
+            }
+
+            if (auto it = cache.entries.find(fp); it != cache.entries.end())
+            {
+                if (it->second.generation == cache.generation && now < it->second.expiry)
+                {
+                    cache.hits++;
+                    log::trace(log_cat, "Peer certificate {} verified from cache", oxenc::to_hex(fp));
+                    return 0;
+                }
+                cache.entries.erase(it);
+            }
+            cache.misses++;
+            generation = cache.generation;
+        }
+
+        unsigned int status = 0;
+        if (auto rv = gnutls_certificate_verify_peers3(session, nullptr, &status); rv < 0)
+        {
+            log::warning(log_cat, "gnutls_certificate_verify_peers3 failed: {}", gnutls_strerror(rv));
+            return GNUTLS_E_CERTIFICATE_ERROR;
+        }
+        if (status != 0)
+        {
+            gnutls_datum_t out{};
+            if (gnutls_certificate_verification_status_print(status, gnutls_certificate_type_get(session), &out, 0) >= 0)
+            {
+                log::warning(log_cat, "Peer certificate verification failed: {}", reinterpret_cast<char*>(out.data));
+                gnutls_free(out.data);
+            }
+            return GNUTLS_E_CERTIFICATE_VERIFICATION_ERROR;
+        }
+
+        log::debug(log_cat, "Verified peer certificate {}", oxenc::to_hex(fp));
+
+        if (cache.ttl.count() <= 0 || cache.max_size == 0)
+            return 0;
+
+        // Don't cache beyond the certificate's own expiry
+        auto expiry = now + cache.ttl;
+        gnutls_x509_crt_t crt;
+        if (gnutls_x509_crt_init(&crt) >= 0)
+        {
+            if (gnutls_x509_crt_import(crt, &certs[0], GNUTLS_X509_FMT_DER) >= 0)
+            {
+                auto expires = gnutls_x509_crt_get_expiration_time(crt);
+                if (auto left = expires - std::time(nullptr); expires != -1 && left < cache.ttl.count())
+                    expiry = now + std::chrono::seconds{std::max<std::time_t>(left, 0)};
+            }
+            gnutls_x509_crt_deinit(crt);
+        }
+
+        std::lock_guard lock{cache.mutex};
+        // The trust store changed (or something was revoked) while we were verifying
+        if (generation != cache.generation)
+            return 0;
+        if (cache.entries.size() >= cache.max_size)
+            cache.evict(now);
+        cache.entries[std::move(fp)] = {expiry, generation};
+        return 0;
+    }
+
     GNUTLSSession::~GNUTLSSession()
     {
         log::warning(log_cat, "Entered {}", __PRETTY_FUNCTION__);
@@ -104,6 +357,30 @@ namespace oxen::quic
         gnutls_handshake_set_hook_function(session, GNUTLS_HANDSHAKE_FINISHED, GNUTLS_HOOK_POST, gnutls_callback_wrapper);
     }
 
+    void GNUTLSSession::set_alpns(const std::vector<std::string>& protocols)
+    {
+        std::vector<gnutls_datum_t> protos;
+        protos.reserve(protocols.size());
+        for (const auto& p : protocols)
+            protos.push_back(
+                    {reinterpret_cast<unsigned char*>(const_cast<char*>(p.data())), static_cast<unsigned>(p.size())});
+
+        // (GnuTLS copies the protocol names)
+        if (auto rv = gnutls_alpn_set_protocols(session, protos.data(), protos.size(), 0); rv < 0)
+        {
+            log::warning(log_cat, "gnutls_alpn_set_protocols failed: {}", gnutls_strerror(rv));
+            throw std::runtime_error("gnutls_alpn_set_protocols failed");
+        }
+    }
+
+    std::string_view GNUTLSSession::selected_alpn() const
+    {
+        gnutls_datum_t proto;
+        if (gnutls_alpn_get_selected_protocol(session, &proto) < 0)
+            return {};
+        return {reinterpret_cast<const char*>(proto.data), proto.size};
+    }
+
     GNUTLSSession::GNUTLSSession(GNUTLSCreds& creds, const ngtcp2_crypto_conn_ref& conn_ref_, bool is_client) :
             TLSSession{conn_ref_}, creds{creds}, is_client{is_client}
     {
@@ -115,7 +392,15 @@ namespace oxen::quic
             throw std::runtime_error("{} gnutls_init failed"_format(s));
         }
 
-        if (auto rv = gnutls_set_default_priority(session); rv < 0)
+        if (!creds.priority.empty())
+        {
+            if (auto rv = gnutls_priority_set_direct(session, creds.priority.c_str(), nullptr); rv < 0)
+            {
+                log::warning(log_cat, "gnutls_priority_set_direct({}) failed: {}", creds.priority, gnutls_strerror(rv));
+                throw std::runtime_error("gnutls_priority_set_direct failed");
+            }
+        }
+        else if (auto rv = gnutls_set_default_priority(session); rv < 0)
         {
             log::warning(log_cat, "gnutls_set_default_priority failed: {}", gnutls_strerror(rv));
             throw std::runtime_error("gnutls_set_default_priority failed");
@@ -146,6 +431,9 @@ namespace oxen::quic
             throw std::runtime_error("gnutls_credentials_set failed");
         }
 
+        if (!is_client && creds.verifying_peers())
+            gnutls_certificate_server_set_request(session, GNUTLS_CERT_REQUIRE);
+
         // NOTE: IPv4 or IPv6 addresses not allowed (cannot be "127.0.0.1")
         if (is_client)
         {
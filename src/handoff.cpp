@@ -0,0 +1,381 @@
+#include "handoff.hpp"
+
+extern "C"
+{
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+}
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include "internal.hpp"
+
+namespace oxen::quic
+{
+#ifndef _WIN32
+
+    // Payload of the message carrying the socket, identifying it as one of ours
+    static constexpr std::string_view HANDOFF_MAGIC = "libquic-handoff-1"sv;
+
+    // Largest packet we forward (the maximum UDP payload)
+    static constexpr size_t MAX_FORWARDED_SIZE = 65527;
+
+    // Header preceding each forwarded packet.  Both ends are the same libquic build on the same
+    // host, so we can simply send the raw struct.
+    struct forward_header
+    {
+        sockaddr_in6 local;  // (or a sockaddr_in, as given by local_len)
+        sockaddr_in6 remote;
+        uint8_t local_len;
+        uint8_t remote_len;
+        uint8_t ecn;
+    };
+
+    // Fills `sun` for `path`, which is a filesystem path or, if starting with `@`, a name in the
+    // Linux abstract socket namespace.  Returns the address length.
+    static socklen_t handoff_sockaddr(const std::string& path, sockaddr_un& sun)
+    {
+        sun = {};
+        sun.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(sun.sun_path))
+            throw std::invalid_argument{"Invalid socket handoff path '{}'"_format(path)};
+        std::memcpy(sun.sun_path, path.data(), path.size());
+        if (path.front() == '@')
+            sun.sun_path[0] = '\0';
+        return offsetof(sockaddr_un, sun_path) + path.size() + (path.front() == '@' ? 0 : 1);
+    }
+
+    static void set_nonblocking(int fd)
+    {
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1)
+            throw std::system_error{errno, std::system_category(), "Failed to make handoff socket non-blocking"};
+    }
+
+    handoff_channel::handoff_channel(
+            event_base* loop,
+            std::string path,
+            UDPSocket::socket_t udp_sock,
+            size_t max_payload,
+            std::function<void()> on_handoff,
+            UDPSocket::receive_callback_t on_packet,
+            UDPSocket::batch_done_callback_t on_batch_done) :
+            loop_{loop},
+            inherited_{false},
+            path_{std::move(path)},
+            max_payload_{std::min(max_payload, MAX_FORWARDED_SIZE)},
+            udp_sock_{udp_sock},
+            on_handoff_{std::move(on_handoff)},
+            on_packet_{std::move(on_packet)},
+            on_batch_done_{std::move(on_batch_done)}
+    {
+        sockaddr_un sun;
+        auto len = handoff_sockaddr(path_, sun);
+        if (path_.front() != '@')
+            ::unlink(path_.c_str());  // Stale socket from an earlier handoff
+
+        listener_ = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        if (listener_ == -1 || bind(listener_, reinterpret_cast<sockaddr*>(&sun), len) != 0 || listen(listener_, 1) != 0)
+        {
+            int err = errno;
+            close();
+            throw std::system_error{err, std::system_category(), "Failed to listen for socket handoff on " + path_};
+        }
+        set_nonblocking(listener_);
+
+        listen_ev_.reset(event_new(
+                loop_,
+                listener_,
+                EV_READ | EV_PERSIST,
+                [](evutil_socket_t, short, void* self) { static_cast<handoff_channel*>(self)->accept(); },
+                this));
+        event_add(listen_ev_.get(), nullptr);
+
+        log::info(log_cat, "Waiting for a replacement process to take over our socket on {}", path_);
+    }
+
+    handoff_channel::handoff_channel(event_base* loop, const std::string& path, std::chrono::milliseconds timeout) :
+            loop_{loop}, inherited_{true}
+    {
+        sockaddr_un sun;
+        auto len = handoff_sockaddr(path, sun);
+
+        conn_ = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        timeval tv;
+        tv.tv_sec = timeout / 1s;
+        tv.tv_usec = (timeout % 1s) / 1us;
+        if (conn_ == -1 || setsockopt(conn_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+            connect(conn_, reinterpret_cast<sockaddr*>(&sun), len) != 0)
+        {
+            int err = errno;
+            close();
+            throw std::system_error{err, std::system_category(), "Failed to connect for socket handoff to " + path};
+        }
+
+        std::array<char, HANDOFF_MAGIC.size()> magic;
+        iovec iov{magic.data(), magic.size()};
+        alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int))> control{};
+        msghdr hdr{};
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control.data();
+        hdr.msg_controllen = control.size();
+
+        ssize_t n;
+        do
+        {
+            n = recvmsg(conn_, &hdr, MSG_CMSG_CLOEXEC);
+        } while (n == -1 && errno == EINTR);
+        int err = errno;
+
+        auto* cmsg = CMSG_FIRSTHDR(&hdr);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+            std::memcpy(&udp_sock_, CMSG_DATA(cmsg), sizeof(int));
+
+        if (n != static_cast<ssize_t>(magic.size()) || std::string_view{magic.data(), magic.size()} != HANDOFF_MAGIC ||
+            udp_sock_ == -1)
+        {
+            close();
+            if (n == -1)
+                throw std::system_error{err, std::system_category(), "Failed to receive socket handoff from " + path};
+            throw std::runtime_error{"Invalid socket handoff received from " + path};
+        }
+
+        // Forwarding is best effort, but let a decent burst of packets queue up before we drop any
+        int sndbuf = 4_Mi;
+        setsockopt(conn_, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        set_nonblocking(conn_);
+
+        conn_ev_.reset(event_new(
+                loop_,
+                conn_,
+                EV_READ | EV_PERSIST,
+                [](evutil_socket_t, short, void* self) { static_cast<handoff_channel*>(self)->receive(); },
+                this));
+        event_add(conn_ev_.get(), nullptr);
+
+        log::info(log_cat, "Took over UDP socket from the previous process via {}", path);
+    }
+
+    handoff_channel::~handoff_channel()
+    {
+        close();
+        // A socket we received but that was never taken is ours to close
+        if (inherited_ && udp_sock_ != -1)
+            ::close(udp_sock_);
+    }
+
+    UDPSocket::socket_t handoff_channel::take_socket()
+    {
+        assert(inherited_);
+        return std::exchange(udp_sock_, -1);
+    }
+
+    void handoff_channel::close()
+    {
+        listen_ev_.reset();
+        conn_ev_.reset();
+        if (listener_ != -1)
+        {
+            ::close(listener_);
+            listener_ = -1;
+            if (!path_.empty() && path_.front() != '@')
+                ::unlink(path_.c_str());
+        }
+        if (conn_ != -1)
+        {
+            ::close(conn_);
+            conn_ = -1;
+        }
+    }
+
+    void handoff_channel::accept()
+    {
+        int fd = ::accept(listener_, nullptr, nullptr);
+        if (fd == -1)
+            return;  // (Spurious wakeup, or the connecting process already gave up)
+
+        std::array<char, HANDOFF_MAGIC.size()> magic;
+        std::memcpy(magic.data(), HANDOFF_MAGIC.data(), magic.size());
+        iovec iov{magic.data(), magic.size()};
+        alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int))> control{};
+        msghdr hdr{};
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control.data();
+        hdr.msg_controllen = control.size();
+        auto* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &udp_sock_, sizeof(int));
+
+        if (sendmsg(fd, &hdr, MSG_NOSIGNAL) != static_cast<ssize_t>(magic.size()))
+        {
+            log::warning(log_cat, "Failed to hand off socket to new process: {}", strerror(errno));
+            ::close(fd);
+            return;  // Keep listening for another attempt
+        }
+
+        // Only one process can take over from us, so stop listening
+        listen_ev_.reset();
+        ::close(listener_);
+        listener_ = -1;
+        if (path_.front() != '@')
+            ::unlink(path_.c_str());
+
+        conn_ = fd;
+        set_nonblocking(conn_);
+        recv_buf_.resize(DATAGRAM_BATCH_SIZE * max_payload_);
+        conn_ev_.reset(event_new(
+                loop_,
+                conn_,
+                EV_READ | EV_PERSIST,
+                [](evutil_socket_t, short, void* self) { static_cast<handoff_channel*>(self)->receive(); },
+                this));
+        event_add(conn_ev_.get(), nullptr);
+
+        handed_off_ = true;
+        log::info(log_cat, "Handed off UDP socket to new process");
+        if (on_handoff_)
+            on_handoff_();
+    }
+
+    void handoff_channel::forward(const Packet& pkt)
+    {
+        if (!forwarding())
+            return;
+
+        forward_header h{};
+        h.local_len = pkt.local.socklen();
+        h.remote_len = pkt.remote.socklen();
+        h.ecn = pkt.pkt_info.ecn;
+        std::memcpy(&h.local, static_cast<const sockaddr*>(pkt.local), h.local_len);
+        std::memcpy(&h.remote, static_cast<const sockaddr*>(pkt.remote), h.remote_len);
+
+        std::array<iovec, 2> iov{{{&h, sizeof(h)}, {const_cast<std::byte*>(pkt.data.data()), pkt.data.size()}}};
+        msghdr hdr{};
+        hdr.msg_iov = iov.data();
+        hdr.msg_iovlen = iov.size();
+
+        ssize_t n;
+        do
+        {
+            n = sendmsg(conn_, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (n == -1 && errno == EINTR);
+
+        if (n >= 0)
+            return;
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+            log::debug(log_cat, "Socket handoff channel full; dropping forwarded packet from {}", pkt.remote);
+        else
+        {
+            log::info(
+                    log_cat,
+                    "Previous process closed the socket handoff channel ({}); no longer forwarding",
+                    strerror(errno));
+            close();
+        }
+    }
+
+    void handoff_channel::receive()
+    {
+        if (inherited_)
+        {
+            // The old process never sends us anything, so this is EOF (or an error): either way it
+            // is done with the channel.
+            char c;
+            if (recv(conn_, &c, 1, MSG_DONTWAIT) == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return;
+            log::info(log_cat, "Previous process closed the socket handoff channel; no longer forwarding");
+            close();
+            return;
+        }
+
+        // `count` only advances for valid packets, but we make at most one batch worth of reads
+        // regardless so that a stream of invalid packets can't hold up the loop.
+        size_t count = 0;
+        for (size_t reads = 0; reads < DATAGRAM_BATCH_SIZE; reads++)
+        {
+            forward_header h;
+            auto* data = recv_buf_.data() + count * max_payload_;
+            std::array<iovec, 2> iov{{{&h, sizeof(h)}, {data, max_payload_}}};
+            msghdr hdr{};
+            hdr.msg_iov = iov.data();
+            hdr.msg_iovlen = iov.size();
+
+            ssize_t n;
+            do
+            {
+                n = recvmsg(conn_, &hdr, MSG_DONTWAIT);
+            } while (n == -1 && errno == EINTR);
+
+            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (n <= 0)
+            {
+                log::warning(log_cat, "New process closed the socket handoff channel; no more packets will be forwarded");
+                close();
+                break;
+            }
+            if (static_cast<size_t>(n) <= sizeof(h) || (hdr.msg_flags & MSG_TRUNC) || h.local_len > sizeof(h.local) ||
+                h.remote_len > sizeof(h.remote))
+            {
+                log::warning(log_cat, "Dropping invalid (or oversized) forwarded packet");
+                continue;
+            }
+
+            recv_local_[count] = Address{reinterpret_cast<const sockaddr*>(&h.local), h.local_len};
+            Address remote{reinterpret_cast<const sockaddr*>(&h.remote), h.remote_len};
+            on_packet_(Packet{recv_local_[count], std::move(remote), bstring_view{data, n - sizeof(h)}, h.ecn});
+            count++;
+        }
+
+        if (count > 0 && on_batch_done_)
+            on_batch_done_();
+    }
+
+#else
+
+    handoff_channel::handoff_channel(
+            event_base*,
+            std::string,
+            UDPSocket::socket_t,
+            size_t,
+            std::function<void()>,
+            UDPSocket::receive_callback_t,
+            UDPSocket::batch_done_callback_t) :
+            inherited_{false}
+    {
+        throw std::invalid_argument{"Socket handoff is not supported on Windows"};
+    }
+
+    handoff_channel::handoff_channel(event_base*, const std::string&, std::chrono::milliseconds) : inherited_{true}
+    {
+        throw std::invalid_argument{"Socket handoff is not supported on Windows"};
+    }
+
+    handoff_channel::~handoff_channel() = default;
+
+    UDPSocket::socket_t handoff_channel::take_socket()
+    {
+        return UDPSocket::socket_t(-1);
+    }
+
+    void handoff_channel::forward(const Packet&) {}
+
+    void handoff_channel::close() {}
+
+    void handoff_channel::accept() {}
+
+    void handoff_channel::receive() {}
+
+#endif
+}  // namespace oxen::quic
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "udp.hpp"
+#include "utils.hpp"
+
+namespace oxen::quic
+{
+    // Unix socket channel between the two processes of a zero-downtime restart (see
+    // opt::inherit_socket and Endpoint::hand_off).  The old process listens on a unix socket path;
+    // the new process connects to it and is sent the endpoint's UDP socket (via SCM_RIGHTS), after
+    // which the new process forwards packets for the old process's connections back over the same
+    // (SOCK_SEQPACKET) connection, each prefixed by its addresses and ECN bits.  The old process
+    // closes the channel once its connections are gone, which stops the forwarding.
+    //
+    // Only used from the event loop thread (except for the new-process constructor, which is
+    // called during Endpoint construction).  Not supported on Windows.
+    class handoff_channel
+    {
+      public:
+        // Old process: listens on `path` for the new process.  When it connects it is sent
+        // `udp_sock` and `on_handoff` is invoked; packets that it forwards to us are then fed into
+        // `on_packet`, with `on_batch_done` invoked after each batch (as for UDPSocket).  Forwarded
+        // packets larger than `max_payload` (our endpoint's maximum UDP payload, which our peers
+        // must not exceed) are dropped.  Throws if we can't listen on `path`.
+        handoff_channel(
+                event_base* loop,
+                std::string path,
+                UDPSocket::socket_t udp_sock,
+                size_t max_payload,
+                std::function<void()> on_handoff,
+                UDPSocket::receive_callback_t on_packet,
+                UDPSocket::batch_done_callback_t on_batch_done);
+
+        // New process: connects to `path` and waits (for up to `timeout`) to be sent the old
+        // process's UDP socket, which is then available from `take_socket()`.  Throws on failure.
+        handoff_channel(event_base* loop, const std::string& path, std::chrono::milliseconds timeout);
+
+        ~handoff_channel();
+
+        handoff_channel(const handoff_channel&) = delete;
+        handoff_channel& operator=(const handoff_channel&) = delete;
+
+        // New process: returns the UDP socket received from the old process, ownership of which
+        // passes to the caller.  Returns -1 if already taken.
+        UDPSocket::socket_t take_socket();
+
+        // New process: true while the old process is still there to forward packets to.
+        bool forwarding() const { return inherited_ && conn_ != -1; }
+
+        // New process: forwards a packet to the old process.  The packet is dropped if the channel
+        // is full (the connection recovers from that as from any other loss); if the old process
+        // has closed the channel (or gone away) the channel is closed and `forwarding()` becomes
+        // false.
+        void forward(const Packet& pkt);
+
+        // Old process: true once the new process has taken over the UDP socket.
+        bool handed_off() const { return handed_off_; }
+
+        // Closes the channel, which (from the old process) tells the new process to stop
+        // forwarding to us.
+        void close();
+
+      private:
+        event_base* loop_;
+        const bool inherited_;
+        std::string path_;
+        size_t max_payload_{0};
+        int listener_{-1};
+        int conn_{-1};
+        UDPSocket::socket_t udp_sock_{-1};
+        bool handed_off_{false};
+        event_ptr listen_ev_;
+        event_ptr conn_ev_;
+
+        std::function<void()> on_handoff_;
+        UDPSocket::receive_callback_t on_packet_;
+        UDPSocket::batch_done_callback_t on_batch_done_;
+
+        // Old process: buffers (of max_payload_ bytes each) for a batch of forwarded packets, and
+        // their local addresses (which the Packets we construct refer to).
+        std::vector<std::byte> recv_buf_;
+        std::array<Address, DATAGRAM_BATCH_SIZE> recv_local_;
+
+        // Old process: accepts the new process's connection and sends it the socket.
+        void accept();
+
+        // Reads from the connection: forwarded packets in the old process; in the new process
+        // there is nothing to read, but this is how we find out that the old process closed it.
+        void receive();
+    };
+}  // namespace oxen::quic
@@ -14,4 +14,8 @@ namespace oxen::quic
             1;
 #endif
 
+    // Maximum total UDP payload we put into a single GSO send: the resulting (pre-segmentation)
+    // datagram, including IPv6 and UDP headers, has to fit within the 16-bit IP length field.
+    inline constexpr size_t MAX_GSO_BYTES = 65535 - 40 - 8;
+
 }  // namespace oxen::quic
@@ -51,7 +51,9 @@ namespace oxen::quic
         running.store(true);
     }
 
-    Network::Network()
+    Network::Network() : Network{opt::busy_poll{}} {}
+
+    Network::Network(opt::busy_poll bp) : busy_poll{bp}
     {
         log::trace(log_cat, "Beginning network context creation with new ev loop thread");
 
@@ -100,7 +102,19 @@ namespace oxen::quic
 
         loop_thread.emplace([this]() mutable {
             log::debug(log_cat, "Starting event loop run");
-            event_base_loop(ev_loop.get(), EVLOOP_NO_EXIT_ON_EMPTY);
+            if (busy_poll)
+                run_busy_poll_loop();
+            else
+                event_base_loop(ev_loop.get(), EVLOOP_NO_EXIT_ON_EMPTY);
+
+            decltype(job_queue) dropped;
+            {
+                std::lock_guard lock{job_queue_mutex};
+                loop_done = true;
+                job_queue.swap(dropped);
+            }
+            if (!dropped.empty())
+                log::debug(log_cat, "Dropping {} job(s) queued after the event loop stopped", dropped.size());
             log::debug(log_cat, "Event loop run returned, thread finished");
         });
         loop_thread_id = loop_thread->get_id();
@@ -115,6 +129,9 @@ namespace oxen::quic
         close().get();
         if (loop_thread)
             loop_thread->join();
+        // close_final() already did this, but jobs that ran after it (in the same job queue batch)
+        // could have started more
+        join_async_workers();
         log::info(log_cat, "Network shutdown complete");
 
 #ifdef _WIN32
@@ -123,6 +140,48 @@ namespace oxen::quic
 #endif
     }
 
+    // Busy-poll replacement for `event_base_loop(..., EVLOOP_NO_EXIT_ON_EMPTY)`: we repeatedly run
+    // non-blocking passes of the event loop (which poll the sockets and fire the job waker, if
+    // active) for as long as we keep seeing activity, and for up to `busy_poll.budget` after the
+    // last activity.  Once the budget is exhausted we go back to a blocking epoll wait until the
+    // next event comes in.
+    void Network::run_busy_poll_loop()
+    {
+        log::info(
+                log_cat,
+                "Running event loop in busy-poll mode (spin budget: {}us)",
+                std::chrono::microseconds{busy_poll.budget}.count());
+
+        auto* base = ev_loop.get();
+        auto last_activity = loop_activity;
+        auto idle_since = get_time();
+
+        while (!loop_stop)
+        {
+            event_base_loop(base, EVLOOP_NONBLOCK);
+            if (loop_stop || event_base_got_exit(base) || event_base_got_break(base))
+                break;
+
+            if (loop_activity != last_activity)
+            {
+                last_activity = loop_activity;
+                idle_since = get_time();
+                continue;
+            }
+
+            if (get_time() - idle_since < busy_poll.budget)
+                continue;
+
+            // Nothing happened within our spin budget: block until something does.
+            event_base_loop(base, EVLOOP_ONCE | EVLOOP_NO_EXIT_ON_EMPTY);
+            if (loop_stop || event_base_got_exit(base) || event_base_got_break(base))
+                break;
+
+            last_activity = loop_activity;
+            idle_since = get_time();
+        }
+    }
+
     void Network::setup_job_waker()
     {
         job_waker.reset(event_new(
@@ -137,21 +196,7 @@ namespace oxen::quic
         assert(job_waker);
     }
 
-    std::shared_ptr<Endpoint> Network::endpoint(const Address& local_addr)
-    {
-        if (auto [it, added] = endpoint_map.emplace(local_addr, nullptr); !added)
-        {
-            log::info(log_cat, "Endpoint already exists for listening address {}", local_addr);
-            return it->second;
-        }
-        else
-        {
-            it->second = std::make_shared<Endpoint>(*this, local_addr);
-            return it->second;
-        }
-    }
-
-    std::future<void> Network::close(bool graceful)
+    std::future<void> Network::close(bool graceful, std::chrono::milliseconds timeout)
     {
         auto prom = std::make_shared<std::promise<void>>();
         auto fut = prom->get_future();
@@ -163,13 +208,13 @@ namespace oxen::quic
 
         log::info(log_cat, "Shutting down Network...");
 
-        call([this, prom, &graceful]() mutable {
+        call([this, prom, graceful, timeout]() mutable {
             // If we have no endpoints we can just shut down immediately
             if (endpoint_map.empty() || !graceful)
                 return close_final(std::move(prom));
 
             // Otherwise we need to initiate closing
-            close_all(std::move(prom));
+            close_all(std::move(prom), timeout);
         });
 
         return fut;
@@ -177,16 +222,67 @@ namespace oxen::quic
 
     void Network::close_final(std::shared_ptr<std::promise<void>> done)
     {
+        close_timer.reset();
 
         endpoint_map.clear();
 
+        // Destroying the endpoints stopped their streams' async chunk producers, but streams kept
+        // alive elsewhere can still have some running
+        join_async_workers();
+
         if (loop_thread)
+        {
+            loop_stop = true;
             event_base_loopexit(ev_loop.get(), nullptr);
+        }
 
         if (done)
             done->set_value();
     }
 
+    void Network::start_async_worker(std::function<void()> work, std::function<void()> stop)
+    {
+        // The new thread can't get to finish_async_worker before we've registered it, as that
+        // needs the lock we're holding.
+        std::lock_guard lock{async_workers_mutex};
+        auto id = ++next_async_worker;
+        std::thread t{[this, id, work = std::move(work)]() mutable {
+            work();
+            // Release whatever the work holds on to before we (possibly) detach
+            work = nullptr;
+            finish_async_worker(id);
+        }};
+        async_workers.emplace(id, async_worker{std::move(t), std::move(stop)});
+    }
+
+    void Network::finish_async_worker(uint64_t id)
+    {
+        std::lock_guard lock{async_workers_mutex};
+        auto it = async_workers.find(id);
+        if (it == async_workers.end())
+            return;
+        it->second.thread.detach();
+        async_workers.erase(it);
+    }
+
+    void Network::join_async_workers()
+    {
+        decltype(async_workers) workers;
+        {
+            std::lock_guard lock{async_workers_mutex};
+            workers.swap(async_workers);
+        }
+        if (workers.empty())
+            return;
+
+        log::debug(log_cat, "Stopping {} async chunk producer thread(s)", workers.size());
+        for (auto& [id, w] : workers)
+            if (w.stop)
+                w.stop();
+        for (auto& [id, w] : workers)
+            w.thread.join();
+    }
+
     bool Network::in_event_loop() const
     {
         return std::this_thread::get_id() == loop_thread_id;
@@ -198,6 +294,11 @@ namespace oxen::quic
         loop_trace_log(log_cat, src, "Event loop queueing `{}`", src.function_name());
         {
             std::lock_guard lock{job_queue_mutex};
+            if (loop_done)
+            {
+                log::debug(log_cat, "Event loop has stopped; dropping `{}`", src.function_name());
+                return;
+            }
             job_queue.emplace(std::move(f), std::move(src));
             log::trace(log_cat, "Event loop now has {} jobs queued", job_queue.size());
         }
@@ -216,6 +317,8 @@ namespace oxen::quic
             job_queue.swap(swapped_queue);
         }
 
+        loop_activity++;
+
         while (not swapped_queue.empty())
         {
             auto job = swapped_queue.front();
@@ -226,18 +329,55 @@ namespace oxen::quic
         }
     }
 
-    // TODO (Tom): for graceful shutdown, how best to wait until clients and servers have properly disconnected
-    void Network::close_all(std::shared_ptr<std::promise<void>> done)
+    void Network::close_all(std::shared_ptr<std::promise<void>> done, std::chrono::milliseconds timeout)
     {
-        call([this, done = std::move(done)]() mutable {
+        call([this, done = std::move(done), timeout]() mutable {
+            close_done = std::move(done);
+            close_pending = true;
+            closing_endpoints = endpoint_map.size();
+
+            // Each endpoint sends its close packets in batches, telling us when it has sent them
+            // all; until then its socket may be blocked, so we also set a deadline.
             for (const auto& ep : endpoint_map)
-                ep.second->close_conns();
-            // FIXME TODO
-            log::critical(
-                    log_cat,
-                    "FIXME: need to properly get a call to close_final() to happen here *after* shutdown is complete");
-            close_final(done);
+                ep.second->close_conns(std::nullopt, [this] { endpoint_close_flushed(); });
+
+            if (!close_pending)
+                return;  // Everything went out right away
+
+            close_timer.reset(event_new(
+                    ev_loop.get(),
+                    -1,
+                    0,
+                    [](evutil_socket_t, short, void* self) { static_cast<Network*>(self)->close_deadline(); },
+                    this));
+            timeval tv;
+            tv.tv_sec = timeout / 1s;
+            tv.tv_usec = (timeout % 1s) / 1us;
+            event_add(close_timer.get(), &tv);
         });
     }
 
+    void Network::endpoint_close_flushed()
+    {
+        if (!close_pending || --closing_endpoints > 0)
+            return;
+        close_pending = false;
+
+        log::debug(log_cat, "All close packets sent; finishing shutdown");
+        // We can be called from deep within an endpoint (e.g. from its socket's writeable callback)
+        // so defer the actual teardown (which destroys the endpoints) until we're out of it.
+        call_soon([this] { close_final(std::move(close_done)); });
+    }
+
+    void Network::close_deadline()
+    {
+        if (!close_pending)
+            return;
+        close_pending = false;
+
+        log::warning(
+                log_cat, "Shutdown deadline reached with {} endpoint(s) still sending close packets", closing_endpoints);
+        close_final(std::move(close_done));
+    }
+
 }  // namespace oxen::quic
@@ -5,9 +5,11 @@ extern "C"
 #include <ngtcp2/ngtcp2.h>
 }
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdio>
 
+#include "compress.hpp"
 #include "connection.hpp"
 #include "context.hpp"
 #include "endpoint.hpp"
@@ -40,8 +42,15 @@ namespace oxen::quic
         bool was_closing = is_closing;
         is_closing = is_shutdown = true;
 
-        if (!was_closing && close_callback)
-            close_callback(*this, STREAM_ERROR_CONNECTION_EXPIRED);
+        stop_async_senders();
+
+        if (!was_closing)
+        {
+            if (handler)
+                handler->on_close(*this, STREAM_ERROR_CONNECTION_EXPIRED);
+            if (close_callback)
+                close_callback(*this, STREAM_ERROR_CONNECTION_EXPIRED);
+        }
     }
 
     Connection& Stream::get_conn()
@@ -67,12 +76,58 @@ namespace oxen::quic
                 ngtcp2_conn_shutdown_stream(conn, 0, stream_id, error_code);
             }
             if (is_shutdown)
+            {
                 data_callback = nullptr;
+                stop_async_senders();
+            }
 
             conn.io_ready();
         });
     }
 
+    void Stream::send_fin()
+    {
+        endpoint.net.call([this]() {
+            if (is_closing || finishing)
+            {
+                log::debug(log_cat, "Stream {} is already closing or finishing", stream_id);
+                return;
+            }
+            log::debug(log_cat, "Finishing stream (ID: {})", stream_id);
+            finishing = true;
+            if (ready)
+                conn.io_ready();
+        });
+    }
+
+    void Stream::start_async_sender(std::shared_ptr<async_chunk_base> sender)
+    {
+        endpoint.net.call([this, sender = std::move(sender)]() mutable {
+            if (is_closing)
+            {
+                log::warning(log_cat, "Not starting async chunk sender on closing stream {}", stream_id);
+                return;
+            }
+
+            async_senders.erase(
+                    std::remove_if(
+                            async_senders.begin(), async_senders.end(), [](const auto& w) { return w.expired(); }),
+                    async_senders.end());
+            async_senders.push_back(sender);
+
+            sender->start([&net = endpoint.net](std::function<void()> f) { net.call_soon(std::move(f)); });
+            endpoint.net.start_async_worker([sender] { sender->produce(); }, [sender] { sender->stop(); });
+        });
+    }
+
+    void Stream::stop_async_senders()
+    {
+        for (auto& w : async_senders)
+            if (auto sender = w.lock())
+                sender->stop();
+        async_senders.clear();
+    }
+
     void Stream::append_buffer(bstring_view buffer, std::shared_ptr<void> keep_alive)
     {
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
@@ -90,6 +145,8 @@ namespace oxen::quic
 
         assert(bytes <= unacked_size);
         unacked_size -= bytes;
+        if (codec)
+            codec->acked(bytes);
 
         // drop all acked user_buffers, as they are unneeded
         while (bytes >= user_buffers.front().first.size() && bytes)
@@ -111,6 +168,7 @@ namespace oxen::quic
         log::trace(log_cat, "{} called", __PRETTY_FUNCTION__);
         log::trace(log_cat, "Increasing unacked_size by {}B", bytes);
         unacked_size += bytes;
+        sent_bytes.store(sent_bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
     }
 
     static auto get_buffer_it(std::deque<std::pair<bstring_view, std::shared_ptr<void>>>& bufs, size_t offset)
@@ -158,7 +216,80 @@ namespace oxen::quic
     {
         endpoint.net.call([this, data, keep_alive]() {
             log::trace(log_cat, "Stream (ID: {}) sending message: {}", stream_id, buffer_printer{data});
-            append_buffer(data, keep_alive);
+            // Until the stream opens we don't know whether the peer agreed to compression, so the
+            // data is held as-is and encoded by the connection once it does.
+            if (codec && ready)
+            {
+                codec->send(*this, data, keep_alive);
+                update_compression_state();
+            }
+            else
+                append_buffer(data, keep_alive);
         });
     }
+
+    void Stream::simulate_raw_send(bstring_view raw)
+    {
+        auto copy = std::make_shared<bstring>(raw);
+        bstring_view data{*copy};
+        endpoint.net.call([this, data, copy = std::move(copy)]() mutable { append_buffer(data, std::move(copy)); });
+    }
+
+    void Stream::set_compression(bool compress)
+    {
+        if (!compression_enabled)
+            throw std::logic_error{"Stream compression is not enabled on this connection"};
+        endpoint.net.call([this, compress]() {
+            if (!codec)
+                return;
+            if (!codec->set_compress(compress))
+                log::warning(log_cat, "Stream {} compression cannot be changed after data has been sent", stream_id);
+            update_compression_state();
+        });
+    }
+
+    void Stream::update_compression_state()
+    {
+        const bool on = codec && codec->compressing();
+        compressing = on;
+        compress_level = on ? codec->level() : 0;
+    }
+
+    void Stream::pause_receiving()
+    {
+        endpoint.net.call([this]() {
+            if (!recv_paused)
+                log::trace(log_cat, "Pausing flow control credit for stream {}", stream_id);
+            recv_paused = true;
+        });
+    }
+
+    void Stream::resume_receiving()
+    {
+        endpoint.net.call([this]() {
+            if (!recv_paused)
+                return;
+            recv_paused = false;
+            if (is_closing || !recv_withheld)
+                return;
+            log::trace(log_cat, "Resuming stream {}: granting {}B of withheld credit", stream_id, recv_withheld);
+            ngtcp2_conn_extend_max_stream_offset(conn, stream_id, std::exchange(recv_withheld, 0));
+            conn.io_ready();
+        });
+    }
+
+    bool Stream::compressed() const
+    {
+        return compressing;
+    }
+
+    int Stream::compression_level() const
+    {
+        return compress_level;
+    }
+
+    uint64_t Stream::bytes_sent() const
+    {
+        return sent_bytes;
+    }
 }  // namespace oxen::quic
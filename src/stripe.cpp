@@ -0,0 +1,536 @@
+#include "stripe.hpp"
+
+#include <oxenc/endian.h>
+
+#include <array>
+#include <cstring>
+#include <limits>
+
+#include "internal.hpp"
+
+namespace oxen::quic
+{
+    static std::array<std::byte, STRIPE_HEADER_SIZE> make_stripe_header(uint64_t offset, uint32_t size)
+    {
+        std::array<std::byte, STRIPE_HEADER_SIZE> h;
+        oxenc::write_host_as_little(offset, h.data());
+        oxenc::write_host_as_little(size, h.data() + 8);
+        return h;
+    }
+
+    // A chunk handed to a stripe stream: kept alive by the stream until acknowledged, at which
+    // point it lets the sender know so that it can send more.
+    struct StripedSender::sent_chunk
+    {
+        std::shared_ptr<StripedSender> sender;
+        size_t stripe;
+        uint64_t offset;
+        std::array<std::byte, STRIPE_HEADER_SIZE> header;
+        bstring data;
+
+        sent_chunk(StripedSender& s, size_t stripe, uint64_t offset, bstring d) :
+                sender{s.shared_from_this()},
+                stripe{stripe},
+                offset{offset},
+                header{make_stripe_header(offset, static_cast<uint32_t>(d.size()))},
+                data{std::move(d)}
+        {}
+
+        ~sent_chunk() { sender->chunk_acked(stripe, offset, data.size()); }
+    };
+
+    StripedSender::StripedSender(source_t source, done_callback_t done, size_t window, int simultaneous, uint64_t id) :
+            source{std::move(source)},
+            done{std::move(done)},
+            window{window},
+            simultaneous{static_cast<size_t>(simultaneous)},
+            id{id}
+    {
+        oxenc::write_host_as_little(id, id_bytes.data());
+    }
+
+    std::shared_ptr<StripedSender> StripedSender::make(
+            const std::vector<std::shared_ptr<connection_interface>>& conns,
+            source_t source,
+            done_callback_t done,
+            size_t window,
+            int simultaneous,
+            std::optional<uint64_t> transfer_id)
+    {
+        if (conns.empty())
+            throw std::invalid_argument{"StripedSender requires at least one connection"};
+        if (window == 0)
+            throw std::invalid_argument{"StripedSender window must be non-zero"};
+        if (simultaneous < 1)
+            throw std::invalid_argument{"StripedSender simultaneous must be >= 1"};
+
+        if (!transfer_id)
+        {
+            auto rng = make_mt19937();
+            transfer_id = uint64_t{rng()} << 32 | rng();
+        }
+
+        std::shared_ptr<StripedSender> sender{
+                new StripedSender{std::move(source), std::move(done), window, simultaneous, *transfer_id}};
+        std::weak_ptr<StripedSender> weak = sender;
+
+        // Open the streams before taking the lock: a stream's close callback takes it.
+        std::vector<std::weak_ptr<Stream>> streams;
+        for (const auto& conn : conns)
+        {
+            auto s = conn->get_new_stream(nullptr, [weak](Stream&, uint64_t error_code) {
+                if (auto s = weak.lock())
+                    s->stripe_closed(error_code);
+            });
+            s->send(bstring_view{sender->id_bytes.data(), sender->id_bytes.size()}, sender);
+            streams.push_back(std::move(s));
+        }
+
+        log::debug(log_cat, "Starting striped transfer {:016x} across {} stripes", *transfer_id, streams.size());
+
+        std::vector<std::shared_ptr<void>> keep;
+        std::vector<std::shared_ptr<Stream>> to_close;
+        done_callback_t failed;
+        {
+            std::lock_guard lock{sender->mutex};
+            sender->streams = std::move(streams);
+            sender->in_flight.resize(sender->streams.size(), 0);
+            if (!sender->finished && !sender->fill(keep))
+            {
+                to_close = sender->finish();
+                failed = sender->done;
+            }
+        }
+        for (auto& s : to_close)
+            s->close(ERROR_STRIPE_ABORTED);
+        if (failed)
+            failed(false);
+
+        return sender;
+    }
+
+    bool StripedSender::fill(std::vector<std::shared_ptr<void>>& keep, size_t first)
+    {
+        for (size_t n = 0; n < streams.size() && !exhausted; n++)
+        {
+            const size_t i = (first + n) % streams.size();
+            auto s = streams[i].lock();
+            if (!s)
+                continue;
+            // If this ends up as the last reference, the stream must not be destroyed under the lock
+            keep.push_back(s);
+
+            while (in_flight[i] < simultaneous && !exhausted)
+            {
+                if (!unacked.empty() && next_offset - unacked.begin()->first >= window)
+                    return true;
+
+                bstring data;
+                try
+                {
+                    data = source();
+                }
+                catch (const std::exception& e)
+                {
+                    log::warning(log_cat, "Striped transfer source raised exception: {}", e.what());
+                    return false;
+                }
+                if (data.size() > std::numeric_limits<uint32_t>::max())
+                {
+                    log::warning(log_cat, "Striped transfer source returned an oversized chunk ({}B)", data.size());
+                    return false;
+                }
+
+                // An empty chunk ends the transfer; we send it (with the total size as its offset) as
+                // a zero-length chunk.
+                if (data.empty())
+                {
+                    exhausted = true;
+                    log::debug(log_cat, "Striped transfer source exhausted after {}B", next_offset);
+                }
+
+                auto chunk = std::make_shared<sent_chunk>(*this, i, next_offset, std::move(data));
+                unacked.emplace(next_offset, chunk->data.size());
+                next_offset += chunk->data.size();
+                in_flight[i]++;
+
+                s->send(bstring_view{chunk->header.data(), chunk->header.size()}, chunk);
+                if (!chunk->data.empty())
+                    s->send(bstring_view{chunk->data}, chunk);
+                keep.push_back(std::move(chunk));
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::shared_ptr<Stream>> StripedSender::finish()
+    {
+        finished = true;
+        std::vector<std::shared_ptr<Stream>> to_close;
+        for (auto& w : streams)
+            if (auto s = w.lock())
+                to_close.push_back(std::move(s));
+        return to_close;
+    }
+
+    void StripedSender::chunk_acked(size_t stripe, uint64_t offset, size_t size)
+    {
+        // Declared before the lock so that what fill() holds onto is released after it
+        std::vector<std::shared_ptr<void>> keep;
+        std::vector<std::shared_ptr<Stream>> to_close;
+        done_callback_t cb;
+        bool success = false;
+        {
+            std::lock_guard lock{mutex};
+            if (finished)
+                return;
+
+            in_flight[stripe]--;
+            unacked.erase(offset);
+            acked_bytes += size;
+
+            if (!fill(keep, stripe))
+            {
+                to_close = finish();
+                cb = done;
+            }
+            else if (exhausted && unacked.empty())
+            {
+                log::debug(log_cat, "Striped transfer of {}B complete", acked_bytes);
+                to_close = finish();
+                success = true;
+                cb = done;
+            }
+        }
+        for (auto& s : to_close)
+        {
+            if (success)
+                s->send_fin();
+            else
+                s->close(ERROR_STRIPE_ABORTED);
+        }
+        if (cb)
+            cb(success);
+    }
+
+    void StripedSender::stripe_closed(uint64_t error_code)
+    {
+        std::vector<std::shared_ptr<Stream>> to_close;
+        done_callback_t cb;
+        bool success = false;
+        {
+            std::lock_guard lock{mutex};
+            if (finished)
+                return;
+
+            // The receiver closes the stripes with 0 once it has everything, which can arrive
+            // before we've seen the final acks.
+            if (error_code == 0 && exhausted)
+            {
+                log::debug(log_cat, "Striped transfer complete (closed by receiver)");
+                success = true;
+            }
+            else
+                log::warning(log_cat, "Striped transfer stripe closed with error code {}; aborting", error_code);
+            to_close = finish();
+            cb = done;
+        }
+        for (auto& s : to_close)
+        {
+            if (success)
+                s->send_fin();
+            else
+                s->close(ERROR_STRIPE_ABORTED);
+        }
+        if (cb)
+            cb(success);
+    }
+
+    void StripedSender::close()
+    {
+        std::vector<std::shared_ptr<Stream>> to_close;
+        {
+            std::lock_guard lock{mutex};
+            if (finished)
+                return;
+            to_close = finish();
+        }
+        for (auto& s : to_close)
+            s->close(ERROR_STRIPE_ABORTED);
+    }
+
+    uint64_t StripedSender::acked() const
+    {
+        std::lock_guard lock{mutex};
+        return acked_bytes;
+    }
+
+    // Reassembly state of one transfer
+    struct StripeReceiver::transfer
+    {
+        uint64_t id;
+        std::vector<std::weak_ptr<Stream>> streams;
+        // Out-of-order data, by offset
+        std::map<uint64_t, bstring> pending;
+        size_t pending_bytes{0};
+        uint64_t next_offset{0};
+        std::optional<uint64_t> total;  // set by the end chunk
+        bool finished{false};
+    };
+
+    // How many finished transfer IDs the receiver remembers
+    static constexpr size_t RECENT_TRANSFERS = 1024;
+
+    // Parser state of one stripe: its transfer (once the ID has arrived), the partially received
+    // ID or header of the next chunk, or the position within (and bytes remaining of) the current
+    // chunk.  `late` is set on a stripe whose transfer had already finished when its ID arrived.
+    struct StripeReceiver::stripe_state
+    {
+        std::shared_ptr<transfer> xfer;
+        bool late{false};
+        std::array<std::byte, STRIPE_HEADER_SIZE> header;
+        size_t header_size{0};
+        uint64_t offset{0};
+        size_t remaining{0};
+    };
+
+    StripeReceiver::StripeReceiver(data_callback_t on_data, done_callback_t done, size_t max_buffer) :
+            data_cb{std::move(on_data)}, done{std::move(done)}, max_buffer{max_buffer}
+    {}
+
+    std::shared_ptr<StripeReceiver> StripeReceiver::make(data_callback_t on_data, done_callback_t done, size_t max_buffer)
+    {
+        if (!on_data)
+            throw std::invalid_argument{"StripeReceiver requires a data callback"};
+        return std::shared_ptr<StripeReceiver>{new StripeReceiver{std::move(on_data), std::move(done), max_buffer}};
+    }
+
+    std::optional<uint64_t> StripeReceiver::accept(transfer& t, uint64_t offset, bstring_view data)
+    {
+        auto next = t.pending.lower_bound(offset);
+        if (offset < t.next_offset || (t.total && offset + data.size() > *t.total) ||
+            (next != t.pending.end() && next->first < offset + data.size()) ||
+            (next != t.pending.begin() && std::prev(next)->first + std::prev(next)->second.size() > offset))
+        {
+            log::warning(log_cat, "Striped transfer {:016x} chunk data at {} overlaps already received data", t.id, offset);
+            return ERROR_STRIPE_BAD_CHUNK;
+        }
+
+        if (offset > t.next_offset)
+        {
+            if (t.pending_bytes + data.size() > max_buffer)
+            {
+                log::warning(
+                        log_cat,
+                        "Striped transfer {:016x} buffer overflow: {}B buffered + {}B exceeds {}B",
+                        t.id,
+                        t.pending_bytes,
+                        data.size(),
+                        max_buffer);
+                return ERROR_STRIPE_OVERFLOW;
+            }
+            t.pending.emplace_hint(next, offset, bstring{data});
+            t.pending_bytes += data.size();
+            pending_bytes += data.size();
+            return std::nullopt;
+        }
+
+        data_cb(t.id, data);
+        t.next_offset += data.size();
+        delivered_bytes += data.size();
+
+        while (!t.pending.empty() && t.pending.begin()->first == t.next_offset)
+        {
+            auto& buffered = t.pending.begin()->second;
+            data_cb(t.id, buffered);
+            t.next_offset += buffered.size();
+            delivered_bytes += buffered.size();
+            t.pending_bytes -= buffered.size();
+            pending_bytes -= buffered.size();
+            t.pending.erase(t.pending.begin());
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::shared_ptr<Stream>> StripeReceiver::finish(transfer& t)
+    {
+        t.finished = true;
+        pending_bytes -= t.pending_bytes;
+        t.pending.clear();
+        t.pending_bytes = 0;
+        std::vector<std::shared_ptr<Stream>> to_close;
+        for (auto& w : t.streams)
+            if (auto s = w.lock())
+                to_close.push_back(std::move(s));
+        t.streams.clear();
+        // (The stripes' state keeps `t` itself alive)
+        if (auto it = active.find(t.id); it != active.end() && it->second.get() == &t)
+            active.erase(it);
+        if (recent.insert(t.id).second)
+        {
+            recent_order.push_back(t.id);
+            if (recent_order.size() > RECENT_TRANSFERS)
+            {
+                recent.erase(recent_order.front());
+                recent_order.pop_front();
+            }
+        }
+        return to_close;
+    }
+
+    void StripeReceiver::on_data(Stream& s, bstring_view data)
+    {
+        std::vector<std::shared_ptr<Stream>> to_close;
+        std::optional<uint64_t> error;
+        bool complete = false;
+        uint64_t id;
+        {
+            std::unique_lock lock{mutex};
+
+            auto* st = s.user_data<stripe_state>();
+            if (!st)
+                st = &s.emplace_user_data<stripe_state>();
+            if (st->late)
+                return;
+
+            if (!st->xfer)
+            {
+                auto n = std::min(data.size(), STRIPE_ID_SIZE - st->header_size);
+                std::memcpy(st->header.data() + st->header_size, data.data(), n);
+                st->header_size += n;
+                data.remove_prefix(n);
+                if (st->header_size < STRIPE_ID_SIZE)
+                    return;
+
+                st->header_size = 0;
+                auto tid = oxenc::load_little_to_host<uint64_t>(st->header.data());
+                if (recent.count(tid))
+                {
+                    // A stripe of a transfer we're already done with (e.g. one that carried no
+                    // chunks): there is nothing left for it to do.
+                    log::debug(log_cat, "Closing late stripe of finished striped transfer {:016x}", tid);
+                    st->late = true;
+                    lock.unlock();
+                    s.close(0);
+                    return;
+                }
+                auto& xfer = active[tid];
+                if (!xfer)
+                {
+                    log::debug(log_cat, "Receiving new striped transfer {:016x}", tid);
+                    xfer = std::make_shared<transfer>();
+                    xfer->id = tid;
+                }
+                st->xfer = xfer;
+                xfer->streams.push_back(s.weak_from_this());
+            }
+
+            auto& t = *st->xfer;
+            if (t.finished)
+                return;
+            id = t.id;
+
+            while (!data.empty() && !error)
+            {
+                if (st->remaining == 0)
+                {
+                    auto n = std::min(data.size(), st->header.size() - st->header_size);
+                    std::memcpy(st->header.data() + st->header_size, data.data(), n);
+                    st->header_size += n;
+                    data.remove_prefix(n);
+                    if (st->header_size < st->header.size())
+                        break;
+
+                    st->header_size = 0;
+                    st->offset = oxenc::load_little_to_host<uint64_t>(st->header.data());
+                    st->remaining = oxenc::load_little_to_host<uint32_t>(st->header.data() + 8);
+                    if (st->remaining == 0)
+                    {
+                        // The end can't come before data we already have
+                        auto last = t.pending.rbegin();
+                        if ((t.total && *t.total != st->offset) || st->offset < t.next_offset ||
+                            (last != t.pending.rend() && last->first + last->second.size() > st->offset))
+                            error = ERROR_STRIPE_BAD_CHUNK;
+                        t.total = st->offset;
+                    }
+                    continue;
+                }
+
+                auto n = std::min(data.size(), st->remaining);
+                error = accept(t, st->offset, data.substr(0, n));
+                st->offset += n;
+                st->remaining -= n;
+                data.remove_prefix(n);
+            }
+
+            if (error)
+            {
+                log::warning(log_cat, "Aborting striped transfer {:016x} on stripe error {}", id, *error);
+                to_close = finish(t);
+            }
+            else if (t.total && t.next_offset == *t.total)
+            {
+                log::debug(log_cat, "Striped transfer {:016x} of {}B received", id, t.next_offset);
+                to_close = finish(t);
+                complete = true;
+            }
+        }
+
+        for (auto& str : to_close)
+            str->close(complete ? 0 : str.get() == &s ? *error : ERROR_STRIPE_ABORTED);
+        if ((error || complete) && done)
+            done(id, complete);
+    }
+
+    void StripeReceiver::on_fin(Stream& s)
+    {
+        {
+            std::lock_guard lock{mutex};
+            // The sender FINs its stripes once the transfer is done, so we only have to close ones
+            // that aren't already (or about to be) closed as part of finishing their transfer.
+            auto* st = s.user_data<stripe_state>();
+            if (st && st->xfer && !st->xfer->finished)
+                return;
+        }
+        s.close(0);
+    }
+
+    void StripeReceiver::on_close(Stream& s, uint64_t error_code)
+    {
+        std::vector<std::shared_ptr<Stream>> to_close;
+        uint64_t id;
+        {
+            std::lock_guard lock{mutex};
+            // Nothing to do for a stripe that never got as far as its transfer ID
+            auto* st = s.user_data<stripe_state>();
+            if (!st || !st->xfer || st->xfer->finished)
+                return;
+            id = st->xfer->id;
+            log::warning(
+                    log_cat, "Striped transfer {:016x} stripe closed with error code {}; aborting", id, error_code);
+            to_close = finish(*st->xfer);
+        }
+        for (auto& str : to_close)
+            str->close(ERROR_STRIPE_ABORTED);
+        if (done)
+            done(id, false);
+    }
+
+    uint64_t StripeReceiver::delivered() const
+    {
+        std::lock_guard lock{mutex};
+        return delivered_bytes;
+    }
+
+    size_t StripeReceiver::buffered() const
+    {
+        std::lock_guard lock{mutex};
+        return pending_bytes;
+    }
+
+    size_t StripeReceiver::transfers() const
+    {
+        std::lock_guard lock{mutex};
+        return active.size();
+    }
+}  // namespace oxen::quic
@@ -0,0 +1,591 @@
+#include "tunnel.hpp"
+
+extern "C"
+{
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+}
+
+#include <event2/util.h>
+
+#include "internal.hpp"
+
+namespace oxen::quic
+{
+    // Pool of CHUNK_SIZE buffers for TCP reads.  Buffers are handed to streams as keep-alives and
+    // come back here once the stream no longer needs them (i.e. once acknowledged); the pool is
+    // shared by those keep-alives so that it outlives the tunnel if needed.
+    struct TCPTunnel::buffer_pool
+    {
+        // Maximum number of idle buffers we hold onto
+        static constexpr size_t MAX_FREE = 256;
+
+        std::vector<std::unique_ptr<std::byte[]>> free;
+
+        std::unique_ptr<std::byte[]> get()
+        {
+            if (free.empty())
+                return std::unique_ptr<std::byte[]>{new std::byte[CHUNK_SIZE]};
+            auto buf = std::move(free.back());
+            free.pop_back();
+            return buf;
+        }
+
+        void put(std::unique_ptr<std::byte[]> buf)
+        {
+            if (free.size() < MAX_FREE)
+                free.push_back(std::move(buf));
+        }
+    };
+
+    struct TCPTunnel::tcp_conn : std::enable_shared_from_this<tcp_conn>
+    {
+        TCPTunnel& tunnel;
+        evutil_socket_t fd;
+        std::weak_ptr<Stream> stream;
+
+        event_ptr read_ev;
+        event_ptr write_ev;
+        // Manually activated (from buffer keep-alive destruction) to re-check whether we can resume
+        // reading, or finish closing, once stream data has been acknowledged.
+        event_ptr check_ev;
+
+        bool connecting = false;     // Server side: TCP connect in progress
+        bool ready = false;          // CONNECT_INIT exchanged: we may read from TCP
+        bool reading = false;        // read_ev is active
+        bool read_eof = false;       // TCP reached EOF; our side of the stream is finished
+        bool remote_fin = false;     // Remote finished the stream; shut down TCP writes once written
+        bool write_shut = false;     // TCP writing side has been shut down
+        bool stream_closed = false;  // Stream is closed; close TCP once pending data is written
+        bool recv_paused = false;    // Stream receiving paused until `pending` is written out
+
+        // Received stream data that the TCP socket couldn't take immediately
+        std::vector<std::byte> pending;
+        size_t pending_offset = 0;
+
+        tcp_conn(TCPTunnel& t, evutil_socket_t fd) : tunnel{t}, fd{fd} {}
+
+        ~tcp_conn()
+        {
+            read_ev.reset();
+            write_ev.reset();
+            check_ev.reset();
+            evutil_closesocket(fd);
+        }
+
+        bool has_pending() const { return pending_offset < pending.size(); }
+
+        void pause_reading()
+        {
+            if (reading)
+                event_del(read_ev.get());
+            reading = false;
+        }
+
+        void resume_reading()
+        {
+            if (!reading)
+                event_add(read_ev.get(), nullptr);
+            reading = true;
+        }
+    };
+
+    static int socket_error()
+    {
+        return EVUTIL_SOCKET_ERROR();
+    }
+
+    static bool would_block(int err)
+    {
+#ifdef _WIN32
+        return err == WSAEWOULDBLOCK;
+#else
+        return err == EAGAIN || err == EWOULDBLOCK || err == EINTR;
+#endif
+    }
+
+    static bool connect_in_progress(int err)
+    {
+#ifdef _WIN32
+        return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS;
+#else
+        return err == EINPROGRESS || err == EINTR;
+#endif
+    }
+
+    static void set_nodelay(evutil_socket_t fd)
+    {
+        int on = 1;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on)) != 0)
+            log::debug(log_cat, "Failed to set TCP_NODELAY on tunnel socket");
+    }
+
+#ifdef _WIN32
+    static constexpr int shut_wr = SD_SEND;
+#else
+    static constexpr int shut_wr = SHUT_WR;
+#endif
+
+    static constexpr int send_flags =
+#ifdef MSG_NOSIGNAL
+            MSG_NOSIGNAL
+#else
+            0
+#endif
+            ;
+
+    TCPTunnel::TCPTunnel(Network& n, std::shared_ptr<connection_interface> c, std::optional<Address> t) :
+            net{n},
+            ev_loop{n.loop().get()},
+            conn{c},
+            target{std::move(t)},
+            pool{std::make_shared<buffer_pool>()}
+    {}
+
+    TCPTunnel::~TCPTunnel()
+    {
+        listener.reset();
+        tcp_conns.clear();
+    }
+
+    std::shared_ptr<TCPTunnel> TCPTunnel::client(
+            Network& net, std::shared_ptr<connection_interface> conn, const Address& tcp_listen)
+    {
+        if (!conn)
+            throw std::invalid_argument{"TCPTunnel::client requires a connection"};
+
+        std::shared_ptr<TCPTunnel> tunnel{new TCPTunnel{net, std::move(conn), std::nullopt}};
+
+        std::promise<void> p;
+        auto f = p.get_future();
+        net.call([&p, &tunnel, &tcp_listen] {
+            try
+            {
+                tunnel->listen_tcp(tcp_listen);
+                p.set_value();
+            }
+            catch (...)
+            {
+                p.set_exception(std::current_exception());
+            }
+        });
+        f.get();
+
+        return tunnel;
+    }
+
+    std::shared_ptr<TCPTunnel> TCPTunnel::server(Network& net, const Address& tcp_target)
+    {
+        return std::shared_ptr<TCPTunnel>{new TCPTunnel{net, nullptr, tcp_target}};
+    }
+
+    void TCPTunnel::listen_tcp(const Address& addr)
+    {
+        listener.reset(evconnlistener_new_bind(
+                ev_loop,
+                [](evconnlistener*, evutil_socket_t fd, sockaddr*, int, void* self) {
+                    static_cast<TCPTunnel*>(self)->accept_tcp(fd);
+                },
+                this,
+                LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE,
+                -1,
+                addr,
+                addr.socklen()));
+        if (!listener)
+            throw std::runtime_error{"Failed to listen for TCP tunnel connections on {}"_format(addr)};
+
+        getsockname(evconnlistener_get_fd(listener.get()), tcp_addr, tcp_addr.socklen_ptr());
+        log::info(log_cat, "TCP tunnel listening on {}", tcp_addr);
+    }
+
+    void TCPTunnel::close()
+    {
+        net.call([self = shared_from_this()] {
+            self->listener.reset();
+            std::vector<tcp_conn*> all;
+            all.reserve(self->tcp_conns.size());
+            for (auto& [ptr, tc] : self->tcp_conns)
+                all.push_back(ptr);
+            for (auto* tc : all)
+                self->drop(*tc, ERROR_TCP);
+        });
+    }
+
+    void TCPTunnel::accept_tcp(evutil_socket_t fd)
+    {
+        set_nodelay(fd);
+        auto tc = std::make_shared<tcp_conn>(*this, fd);
+
+        auto c = conn.lock();
+        if (!c)
+        {
+            log::warning(log_cat, "Tunnel connection is gone; refusing new TCP connection");
+            return;  // tc's destruction closes the socket
+        }
+
+        std::shared_ptr<Stream> s;
+        try
+        {
+            s = c->get_new_stream();
+        }
+        catch (const std::exception& e)
+        {
+            log::warning(log_cat, "Unable to open tunnel stream for new TCP connection: {}", e.what());
+            return;  // tc's destruction closes the socket
+        }
+
+        s->handler = shared_from_this();
+        s->set_user_data(tc.get());
+        tc->stream = s;
+        init_events(*tc);
+        tcp_conns.emplace(tc.get(), tc);
+
+        log::debug(log_cat, "Accepted TCP tunnel connection; requesting remote connection on stream {}", s->stream_id);
+        // We don't read from the TCP socket until we get the CONNECT_INIT reply
+        s->send(bstring_view{&CONNECT_INIT, 1});
+    }
+
+    void TCPTunnel::start_tcp_connect(Stream& s)
+    {
+        assert(target);
+        evutil_socket_t fd = socket(target->is_ipv6() ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+        if (fd == EVUTIL_INVALID_SOCKET)
+        {
+            log::warning(log_cat, "Failed to create TCP socket for tunnel stream {}", s.stream_id);
+            s.close(ERROR_CONNECT);
+            return;
+        }
+        evutil_make_socket_nonblocking(fd);
+        set_nodelay(fd);
+
+        auto tc = std::make_shared<tcp_conn>(*this, fd);
+
+        if (::connect(fd, *target, target->socklen()) != 0)
+        {
+            if (auto err = socket_error(); !connect_in_progress(err))
+            {
+                log::warning(
+                        log_cat,
+                        "TCP tunnel connection to {} failed: {}",
+                        *target,
+                        evutil_socket_error_to_string(err));
+                s.close(ERROR_CONNECT);
+                return;
+            }
+        }
+
+        tc->connecting = true;
+        tc->stream = s.shared_from_this();
+        s.set_user_data(tc.get());
+        init_events(*tc);
+        tcp_conns.emplace(tc.get(), tc);
+
+        // Writeability signals completion (or failure) of the connect
+        event_add(tc->write_ev.get(), nullptr);
+        log::debug(log_cat, "Connecting to {} for tunnel stream {}", *target, s.stream_id);
+    }
+
+    void TCPTunnel::init_events(tcp_conn& tc)
+    {
+        tc.read_ev.reset(event_new(
+                ev_loop,
+                tc.fd,
+                EV_READ | EV_PERSIST,
+                [](evutil_socket_t, short, void* arg) {
+                    auto& c = *static_cast<tcp_conn*>(arg);
+                    c.tunnel.on_tcp_readable(c);
+                },
+                &tc));
+        tc.write_ev.reset(event_new(
+                ev_loop,
+                tc.fd,
+                EV_WRITE | EV_PERSIST,
+                [](evutil_socket_t, short, void* arg) {
+                    auto& c = *static_cast<tcp_conn*>(arg);
+                    c.tunnel.on_tcp_writeable(c);
+                },
+                &tc));
+        tc.check_ev.reset(event_new(
+                ev_loop,
+                -1,
+                0,
+                [](evutil_socket_t, short, void* arg) {
+                    auto& c = *static_cast<tcp_conn*>(arg);
+                    c.tunnel.on_check(c);
+                },
+                &tc));
+    }
+
+    void TCPTunnel::drop(tcp_conn& tc, std::optional<uint64_t> stream_code)
+    {
+        if (auto s = tc.stream.lock())
+        {
+            s->set_user_data(nullptr);
+            if (stream_code)
+                s->close(*stream_code);
+        }
+        // Destroys tc, closing the socket:
+        tcp_conns.erase(&tc);
+    }
+
+    void TCPTunnel::on_tcp_connected(tcp_conn& tc)
+    {
+        tc.connecting = false;
+
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(tc.fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) != 0 || err != 0)
+        {
+            log::warning(log_cat, "TCP tunnel connection to {} failed: {}", *target, evutil_socket_error_to_string(err));
+            return drop(tc, ERROR_CONNECT);
+        }
+
+        auto s = tc.stream.lock();
+        if (!s)
+            return drop(tc);
+
+        log::debug(log_cat, "TCP tunnel connection to {} established for stream {}", *target, s->stream_id);
+        if (!tc.has_pending())
+            event_del(tc.write_ev.get());
+
+        tc.ready = true;
+        s->send(bstring_view{&CONNECT_INIT, 1});
+        tc.resume_reading();
+        maybe_shutdown_tcp(tc);
+    }
+
+    void TCPTunnel::on_tcp_readable(tcp_conn& tc)
+    {
+        auto s = tc.stream.lock();
+        if (!s)
+            return drop(tc);
+
+        auto buf = pool->get();
+        auto n = recv(tc.fd, reinterpret_cast<char*>(buf.get()), CHUNK_SIZE, 0);
+
+        if (n > 0)
+        {
+            bstring_view data{buf.get(), static_cast<size_t>(n)};
+            // The buffer goes back to the pool once the stream is done with it (i.e. once the data
+            // is acknowledged), at which point we re-check whether we can resume reading.
+            std::shared_ptr<void> keep_alive{
+                    buf.release(), [pool = pool, wtc = tc.weak_from_this()](std::byte* b) {
+                        pool->put(std::unique_ptr<std::byte[]>{b});
+                        if (auto t = wtc.lock(); t && t->check_ev)
+                            event_active(t->check_ev.get(), 0, 0);
+                    }};
+            s->send(data, std::move(keep_alive));
+
+            if (s->size() >= PAUSE_SIZE)
+            {
+                log::trace(log_cat, "Pausing TCP reads for tunnel stream {}: {}B unacked", s->stream_id, s->size());
+                tc.pause_reading();
+            }
+            return;
+        }
+
+        pool->put(std::move(buf));
+
+        if (n == 0)
+        {
+            log::debug(log_cat, "TCP connection for tunnel stream {} reached EOF; finishing stream", s->stream_id);
+            tc.pause_reading();
+            tc.read_eof = true;
+            s->send_fin();
+            return;
+        }
+
+        if (auto err = socket_error(); !would_block(err))
+        {
+            log::warning(
+                    log_cat,
+                    "TCP read error on tunnel stream {}: {}; closing",
+                    s->stream_id,
+                    evutil_socket_error_to_string(err));
+            drop(tc, ERROR_TCP);
+        }
+    }
+
+    void TCPTunnel::on_tcp_writeable(tcp_conn& tc)
+    {
+        if (tc.connecting)
+            return on_tcp_connected(tc);
+
+        while (tc.has_pending())
+        {
+            auto* data = tc.pending.data() + tc.pending_offset;
+            auto size = tc.pending.size() - tc.pending_offset;
+            auto n = ::send(tc.fd, reinterpret_cast<const char*>(data), size, send_flags);
+            if (n < 0)
+            {
+                if (auto err = socket_error(); !would_block(err))
+                {
+                    log::warning(log_cat, "TCP write error on tunnel: {}; closing", evutil_socket_error_to_string(err));
+                    return drop(tc, tc.stream_closed ? std::nullopt : std::optional<uint64_t>{ERROR_TCP});
+                }
+                return;  // Still blocked; wait for the next write event
+            }
+            tc.pending_offset += n;
+        }
+
+        tc.pending.clear();
+        tc.pending_offset = 0;
+        event_del(tc.write_ev.get());
+
+        if (tc.recv_paused)
+        {
+            tc.recv_paused = false;
+            if (auto s = tc.stream.lock())
+            {
+                log::trace(log_cat, "TCP socket drained; resuming tunnel stream {}", s->stream_id);
+                s->resume_receiving();
+            }
+        }
+
+        if (tc.stream_closed)
+            drop(tc);
+        else
+            maybe_shutdown_tcp(tc);
+    }
+
+    void TCPTunnel::maybe_shutdown_tcp(tcp_conn& tc)
+    {
+        if (!tc.remote_fin || tc.write_shut || tc.connecting || tc.has_pending())
+            return;
+
+        log::debug(log_cat, "Tunnel stream finished by remote; shutting down TCP writes");
+        tc.write_shut = true;
+        if (::shutdown(tc.fd, shut_wr) != 0)
+            log::debug(log_cat, "TCP shutdown failed: {}", evutil_socket_error_to_string(socket_error()));
+    }
+
+    void TCPTunnel::on_check(tcp_conn& tc)
+    {
+        auto s = tc.stream.lock();
+        if (!s)
+            return drop(tc);
+
+        if (tc.ready && !tc.reading && !tc.read_eof && !tc.stream_closed && s->size() < PAUSE_SIZE)
+        {
+            log::trace(log_cat, "Resuming TCP reads for tunnel stream {}", s->stream_id);
+            tc.resume_reading();
+        }
+    }
+
+    bool TCPTunnel::write_tcp(tcp_conn& tc, bstring_view data)
+    {
+        if (data.empty())
+            return true;
+
+        size_t written = 0;
+        if (!tc.connecting && !tc.has_pending())
+        {
+            // Fast path: write directly from the stream's receive buffer
+            auto n = ::send(tc.fd, reinterpret_cast<const char*>(data.data()), data.size(), send_flags);
+            if (n < 0)
+            {
+                if (auto err = socket_error(); !would_block(err))
+                {
+                    log::warning(log_cat, "TCP write error on tunnel: {}; closing", evutil_socket_error_to_string(err));
+                    drop(tc, ERROR_TCP);
+                    return false;
+                }
+            }
+            else
+                written = n;
+
+            if (written == data.size())
+                return true;
+
+            event_add(tc.write_ev.get(), nullptr);
+        }
+
+        // Whatever we couldn't write has to be copied until the socket becomes writeable
+        tc.pending.insert(tc.pending.end(), data.begin() + written, data.end());
+
+        if (!tc.recv_paused && tc.pending.size() - tc.pending_offset >= PENDING_HIGH_WATER)
+        {
+            if (auto s = tc.stream.lock())
+            {
+                log::trace(
+                        log_cat,
+                        "Pausing tunnel stream {}: {}B waiting for TCP",
+                        s->stream_id,
+                        tc.pending.size() - tc.pending_offset);
+                tc.recv_paused = true;
+                s->pause_receiving();
+            }
+        }
+        return true;
+    }
+
+    void TCPTunnel::on_data(Stream& s, bstring_view data)
+    {
+        auto* tc = s.user_data<tcp_conn>();
+
+        if (!tc)
+        {
+            // A new incoming stream, which must start with a CONNECT_INIT request
+            if (!target || data.empty() || data[0] != CONNECT_INIT)
+            {
+                log::warning(log_cat, "Invalid tunnel stream {} initial data; closing", s.stream_id);
+                s.close(ERROR_BAD_INIT);
+                return;
+            }
+            start_tcp_connect(s);
+            if (tc = s.user_data<tcp_conn>(); !tc)
+                return;  // Connect failed
+            data.remove_prefix(1);
+        }
+        else if (!target && !tc->ready)
+        {
+            if (data.empty())
+                return;
+            // Client side: the first byte from the server confirms the remote TCP connection
+            if (data[0] != CONNECT_INIT)
+            {
+                log::warning(log_cat, "Invalid tunnel stream {} initial response; closing", s.stream_id);
+                return drop(*tc, ERROR_BAD_INIT);
+            }
+            log::debug(log_cat, "Tunnel stream {} connected", s.stream_id);
+            data.remove_prefix(1);
+            tc->ready = true;
+            tc->resume_reading();
+        }
+
+        write_tcp(*tc, data);
+    }
+
+    void TCPTunnel::on_fin(Stream& s)
+    {
+        auto* tc = s.user_data<tcp_conn>();
+        if (!tc)
+            return;
+
+        tc->remote_fin = true;
+        maybe_shutdown_tcp(*tc);
+    }
+
+    void TCPTunnel::on_close(Stream& s, uint64_t error_code)
+    {
+        auto* tc = s.user_data<tcp_conn>();
+        if (!tc)
+            return;
+
+        log::debug(log_cat, "Tunnel stream {} closed (code {})", s.stream_id, error_code);
+        tc->stream_closed = true;
+        tc->pause_reading();
+        s.set_user_data(nullptr);
+
+        // On a clean close we finish writing out whatever we have already received
+        if (error_code != 0 || !tc->has_pending())
+            drop(*tc);
+    }
+
+}  // namespace oxen::quic
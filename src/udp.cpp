@@ -3,17 +3,26 @@ extern "C"
 {
 
 #ifdef __linux__
+#include <time.h>  // Must precede errqueue.h, which needs struct timespec
+//
+#include <linux/errqueue.h>
 #include <netinet/udp.h>
 #endif
 
 #include <fcntl.h>
+#ifndef _WIN32
+#include <sys/un.h>
+#endif
 #include <unistd.h>
 }
 
+#include <cstring>
+#include <limits>
 #include <system_error>
 
 #include "internal.hpp"
 #include "udp.hpp"
+#include "xdp.hpp"
 
 namespace oxen::quic
 {
@@ -22,6 +31,25 @@ namespace oxen::quic
     static_assert(std::is_same_v<UDPSocket::socket_t, SOCKET>);
 #endif
 
+    // Local address tracking for sockets bound to a wildcard address (see UDPSocket::UDPSocket)
+#if !defined(_WIN32) && defined(IP_PKTINFO) && defined(IPV6_RECVPKTINFO)
+#define OXEN_LIBQUIC_PKTINFO
+#endif
+
+#ifndef _WIN32
+    // Space for a pktinfo control message (the IPv6 one being the larger)
+#ifdef OXEN_LIBQUIC_PKTINFO
+    static constexpr size_t PKTINFO_CONTROL_SIZE = CMSG_SPACE(sizeof(in6_pktinfo));
+#else
+    static constexpr size_t PKTINFO_CONTROL_SIZE = 0;
+#endif
+
+    // Space for the control messages we request on received packets: the TOS/TCLASS byte (for ECN),
+    // the SO_RXQ_OVFL drop counter, and the packet's destination address (pktinfo).
+    static constexpr size_t RECV_CONTROL_SIZE =
+            CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint32_t)) + PKTINFO_CONTROL_SIZE;
+#endif
+
     /// Checks rv for being -1 and, if so, raises a system_error from errno.  Otherwise returns it.
     static int check_rv(int rv)
     {
@@ -36,22 +64,21 @@ namespace oxen::quic
     }
 
     Packet::Packet(const Address& local, bstring_view data, msghdr& hdr) :
-            path{local,
+            local{local},
 #ifdef _WIN32
-                 {static_cast<const sockaddr*>(hdr.name), hdr.namelen}
+            remote{static_cast<const sockaddr*>(hdr.name), hdr.namelen},
 #else
-                 {static_cast<const sockaddr*>(hdr.msg_name), hdr.msg_namelen}
+            remote{static_cast<const sockaddr*>(hdr.msg_name), hdr.msg_namelen},
 #endif
-            },
             data{data}
     {
         // ECN flag:
-        assert(path.remote.is_ipv4() || path.remote.is_ipv6());
+        assert(remote.is_ipv4() || remote.is_ipv6());
 #ifdef _WIN32
         for (auto cmsg = WSA_CMSG_FIRSTHDR(&hdr); cmsg; cmsg = WSA_CMSG_NXTHDR(&hdr, cmsg))
         {
-            if ((path.remote.is_ipv4() ? (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_ECN)
-                                       : (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_ECN)) &&
+            if ((remote.is_ipv4() ? (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_ECN)
+                                  : (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_ECN)) &&
                 cmsg->cmsg_len > 0)
             {
                 pkt_info.ecn = *reinterpret_cast<uint8_t*>(WSA_CMSG_DATA(cmsg));
@@ -59,13 +86,15 @@ namespace oxen::quic
             }
         }
 #else
+        // (A dual-stack socket reports IPv4 packets' TOS as IP_TOS, even though the remote address
+        // we were given was IPv4-mapped IPv6, so we accept either here).
         for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
         {
-            if ((path.remote.is_ipv4() ? (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
-                                       : (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_TCLASS)) &&
+            if (((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) ||
+                 (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_TCLASS)) &&
                 cmsg->cmsg_len > 0)
             {
-                pkt_info.ecn = *reinterpret_cast<uint8_t*>(CMSG_DATA(cmsg));
+                pkt_info.ecn = *reinterpret_cast<uint8_t*>(CMSG_DATA(cmsg)) & NGTCP2_ECN_MASK;
                 break;
             }
         }
@@ -122,8 +151,137 @@ namespace oxen::quic
     }
 #endif
 
-    UDPSocket::UDPSocket(event_base* ev_loop, const Address& addr, receive_callback_t on_receive) :
-            ev_{ev_loop}, receive_callback_{std::move(on_receive)}
+#ifndef _WIN32
+    // Unix transport mode: each (IP) Address maps to a Unix datagram socket name of the form
+    // `libquic-4-HEX-PORT` or `libquic-6-HEX-PORT`, where HEX is the raw address bytes, located in
+    // the transport directory (or in the Linux abstract socket namespace if the directory is empty).
+    static constexpr std::string_view UNIX_NAME_PREFIX = "libquic-"sv;
+
+    static socklen_t to_unix_sockaddr(const std::string& dir, const Address& addr, sockaddr_un& sun)
+    {
+        std::string name{UNIX_NAME_PREFIX};
+        if (addr.is_ipv4())
+        {
+            auto& a = addr.in4().sin_addr;
+            name += "4-" + oxenc::to_hex(reinterpret_cast<const char*>(&a), reinterpret_cast<const char*>(&a) + 4);
+        }
+        else
+        {
+            auto& a = addr.in6().sin6_addr;
+            name += "6-" + oxenc::to_hex(reinterpret_cast<const char*>(&a), reinterpret_cast<const char*>(&a) + 16);
+        }
+        name += "-" + std::to_string(addr.port());
+
+        sun = {};
+        sun.sun_family = AF_UNIX;
+        size_t offset = 0;
+        if (dir.empty())
+            offset = 1;  // Abstract namespace: sun_path starts with a null byte
+        else
+        {
+            name = dir + "/" + name;
+            if (name.size() >= sizeof(sun.sun_path))
+                throw std::invalid_argument{"Unix transport directory {} is too long"_format(dir)};
+        }
+        std::memcpy(sun.sun_path + offset, name.data(), name.size());
+        return offsetof(sockaddr_un, sun_path) + offset + name.size();
+    }
+
+    // Inverse of to_unix_sockaddr; returns nullopt if the name isn't a libquic unix transport name.
+    static std::optional<Address> from_unix_sockaddr(const sockaddr_un& sun, socklen_t len)
+    {
+        if (len <= offsetof(sockaddr_un, sun_path) + 1)
+            return std::nullopt;  // Unbound sender
+        std::string_view name{sun.sun_path, len - offsetof(sockaddr_un, sun_path)};
+        if (name.front() == '\0')
+            name.remove_prefix(1);
+        if (auto slash = name.rfind('/'); slash != std::string_view::npos)
+            name.remove_prefix(slash + 1);
+        if (auto nul = name.find('\0'); nul != std::string_view::npos)
+            name = name.substr(0, nul);
+        if (name.substr(0, UNIX_NAME_PREFIX.size()) != UNIX_NAME_PREFIX)
+            return std::nullopt;
+        name.remove_prefix(UNIX_NAME_PREFIX.size());
+
+        if (name.size() < 2 || (name[0] != '4' && name[0] != '6') || name[1] != '-')
+            return std::nullopt;
+        bool v4 = name[0] == '4';
+        name.remove_prefix(2);
+        size_t hexlen = v4 ? 8 : 32;
+        if (name.size() < hexlen + 2 || name[hexlen] != '-' || !oxenc::is_hex(name.substr(0, hexlen)))
+            return std::nullopt;
+        auto bytes = oxenc::from_hex(name.substr(0, hexlen));
+        uint16_t port = 0;
+        for (char c : name.substr(hexlen + 1))
+        {
+            if (c < '0' || c > '9')
+                return std::nullopt;
+            port = port * 10 + (c - '0');
+        }
+
+        if (v4)
+        {
+            sockaddr_in sin{};
+            sin.sin_family = AF_INET;
+            sin.sin_port = oxenc::host_to_big(port);
+            std::memcpy(&sin.sin_addr, bytes.data(), 4);
+            return Address{&sin};
+        }
+        sockaddr_in6 sin6{};
+        sin6.sin6_family = AF_INET6;
+        sin6.sin6_port = oxenc::host_to_big(port);
+        std::memcpy(&sin6.sin6_addr, bytes.data(), 16);
+        return Address{&sin6};
+    }
+
+    void UDPSocket::bind_unix(const Address& addr)
+    {
+        sock_ = check_rv(socket(AF_UNIX, SOCK_DGRAM, 0));
+
+        // With a port of 0 we pick a random port that isn't in use
+        const bool random_port = addr.port() == 0;
+        auto rng = make_mt19937();
+        for (int attempt = 0;; attempt++)
+        {
+            Address a = addr;
+            if (random_port)
+            {
+                auto port = oxenc::host_to_big(std::uniform_int_distribution<uint16_t>{1024, 65535}(rng));
+                if (a.is_ipv4())
+                    static_cast<sockaddr_in*>(a)->sin_port = port;
+                else
+                    static_cast<sockaddr_in6*>(a)->sin6_port = port;
+            }
+            sockaddr_un sun;
+            auto len = to_unix_sockaddr(*unix_dir_, a, sun);
+            if (!unix_dir_->empty())
+                // Remove a stale socket file from a previous instance
+                ::unlink(sun.sun_path);
+            if (::bind(sock_, reinterpret_cast<sockaddr*>(&sun), len) == 0)
+            {
+                bound_ = a;
+                unix_path_ = unix_dir_->empty() ? "" : sun.sun_path;
+                break;
+            }
+            if (!(random_port && errno == EADDRINUSE && attempt < 100))
+                throw std::system_error{errno, std::system_category()};
+        }
+        log::debug(log_cat, "Unix transport socket bound for {}", bound_);
+    }
+#endif
+
+    UDPSocket::UDPSocket(
+            event_base* ev_loop,
+            const Address& addr,
+            receive_callback_t on_receive,
+            batch_done_callback_t batch_done,
+            std::optional<std::string> unix_dir,
+            bool dual_stack) :
+            unix_dir_{std::move(unix_dir)},
+            dual_stack_{dual_stack},
+            ev_{ev_loop},
+            receive_callback_{std::move(on_receive)},
+            batch_done_callback_{std::move(batch_done)}
     {
         assert(ev_);
 
@@ -134,11 +292,71 @@ namespace oxen::quic
         init_wsa_bs();
 #endif
 
-        sock_ = check_rv(socket(addr.is_ipv6() ? AF_INET6 : AF_INET, SOCK_DGRAM, 0));
+        if (dual_stack_ && (unix_dir_ || !addr.is_ipv6() || !addr.is_any_addr()))
+            throw std::invalid_argument{"A dual-stack socket must be bound to the IPv6 any address ([::])"};
+
+        if (unix_dir_)
+        {
+#ifdef _WIN32
+            throw std::invalid_argument{"Unix datagram transport is not supported on this platform"};
+#else
+            bind_unix(addr);
+#endif
+        }
+        else
+        {
+            sock_ = check_rv(socket(addr.is_ipv6() ? AF_INET6 : AF_INET, SOCK_DGRAM, 0));
+
+#ifdef _WIN32
+            const DWORD v6only = dual_stack_ ? 0 : 1;
+            auto* v6only_val = reinterpret_cast<const char*>(&v6only);
+#else
+            const int v6only = dual_stack_ ? 0 : 1;
+            auto* v6only_val = &v6only;
+#endif
+            // Set explicitly either way, as the default depends on the system (on Linux, the
+            // net.ipv6.bindv6only sysctl) and Windows defaults to v6-only.
+            if (addr.is_ipv6())
+                check_rv(setsockopt(sock_, IPPROTO_IPV6, IPV6_V6ONLY, v6only_val, sizeof(v6only)));
+
+            check_rv(bind(sock_, addr, addr.socklen()));
+            check_rv(getsockname(sock_, bound_, bound_.socklen_ptr()));
+        }
+
+        init();
+    }
+
+    UDPSocket::UDPSocket(
+            event_base* ev_loop, socket_t sock, receive_callback_t on_receive, batch_done_callback_t batch_done) :
+            sock_{sock}, ev_{ev_loop}, receive_callback_{std::move(on_receive)}, batch_done_callback_{std::move(batch_done)}
+    {
+        assert(ev_);
+
+        if (!receive_callback_)
+            throw std::logic_error{"UDPSocket construction requires a non-empty receive callback"};
 
-        check_rv(bind(sock_, addr, addr.socklen()));
         check_rv(getsockname(sock_, bound_, bound_.socklen_ptr()));
+        if (!bound_.is_ipv4() && !bound_.is_ipv6())
+            throw std::invalid_argument{"Cannot adopt socket: not a bound IPv4/IPv6 socket"};
+
+        if (bound_.is_ipv6() && bound_.is_any_addr())
+        {
+#ifdef _WIN32
+            DWORD v6only = 1;
+#else
+            int v6only = 1;
+#endif
+            socklen_t len = sizeof(v6only);
+            if (getsockopt(sock_, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<char*>(&v6only), &len) == 0)
+                dual_stack_ = !v6only;
+        }
+
+        log::debug(log_cat, "Adopted existing UDP socket bound to {}{}", bound_, dual_stack_ ? " (dual-stack)" : "");
+        init();
+    }
 
+    void UDPSocket::init()
+    {
         // Make the socket non-blocking:
 #ifdef _WIN32
         u_long mode = 1;
@@ -153,18 +371,54 @@ namespace oxen::quic
 #else
         const unsigned int on = 1;
 #endif
-        if (addr.is_ipv6())
-            check_rv(setsockopt(sock_, IPPROTO_IPV6, IPV6_RECVTCLASS, &on, sizeof(on)));
-        else
-            check_rv(setsockopt(sock_, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)));
+        if (!unix_dir_)  // (The unix transport has no IP header, so no ECN)
+        {
+            if (bound_.is_ipv6())
+                check_rv(setsockopt(sock_, IPPROTO_IPV6, IPV6_RECVTCLASS, &on, sizeof(on)));
+            // A dual-stack socket reports the TOS of IPv4 packets only if asked for it separately
+            if (bound_.is_ipv4() || dual_stack_)
+                check_rv(setsockopt(sock_, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)));
+        }
 
-        set_ecn();
+#ifdef OXEN_LIBQUIC_PKTINFO
+        // When bound to a wildcard address we need the destination address of each packet to know
+        // which of our addresses it arrived on (and so which to reply from).  (IPV6_RECVPKTINFO also
+        // covers the IPv4 packets of a dual-stack socket, as IPv4-mapped addresses).
+        if (!unix_dir_ && bound_.is_any_addr())
+        {
+            if (bound_.is_ipv6())
+                check_rv(setsockopt(sock_, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on)));
+            else
+                check_rv(setsockopt(sock_, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)));
+            pktinfo_ = true;
+        }
+#endif
+
+#ifdef SO_RXQ_OVFL
+        // Have the kernel report (via a control message on received packets) how many packets it has
+        // dropped because our receive buffer was full.  Not fatal: we just lose the drop counts.
+        if (setsockopt(sock_, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == -1)
+            log::warning(log_cat, "Failed to enable SO_RXQ_OVFL on socket: {}", strerror(errno));
+#endif
+
+        if (!unix_dir_)
+        {
+            set_ecn();
+            set_dont_fragment();
+        }
+        set_max_payload_size(max_payload_);
 
         rev_.reset(event_new(
                 ev_,
                 sock_,
                 EV_READ | EV_PERSIST,
-                [](evutil_socket_t, short, void* self) { static_cast<UDPSocket*>(self)->receive(); },
+                [](evutil_socket_t, short, void* self_) {
+                    auto* self = static_cast<UDPSocket*>(self_);
+                    // Zero-copy completions arrive on the error queue, which also wakes us up here
+                    if (self->zerocopy())
+                        self->process_zerocopy_completions();
+                    self->receive();
+                },
                 this));
         event_add(rev_.get(), nullptr);
 
@@ -172,29 +426,108 @@ namespace oxen::quic
                 ev_,
                 sock_,
                 EV_WRITE,
-                [](evutil_socket_t, short, void* self_) {
-                    auto* self = static_cast<UDPSocket*>(self_);
-                    auto callbacks = std::move(self->writeable_callbacks_);
-                    for (const auto& f : callbacks)
-                        f();
-                },
+                [](evutil_socket_t, short, void* self) { static_cast<UDPSocket*>(self)->on_writeable(); },
                 this));
         // Don't event_add wev_ now: we only activate wev_ when something asks to be tied to writeability
     }
 
+    void UDPSocket::on_writeable()
+    {
+        auto callbacks = std::move(writeable_callbacks_);
+        for (const auto& f : callbacks)
+            f();
+    }
+
+    void UDPSocket::stop_receiving()
+    {
+        event_del(rev_.get());
+#ifdef OXEN_LIBQUIC_XDP
+        if (xdp_ev_)
+            event_del(xdp_ev_.get());
+#endif
+    }
+
     UDPSocket::~UDPSocket()
     {
 #ifdef _WIN32
         ::closesocket(sock_);
 #else
         ::close(sock_);
+        if (!unix_path_.empty())
+            ::unlink(unix_path_.c_str());
+#endif
+    }
+
+    void UDPSocket::enable_xdp([[maybe_unused]] const opt::xdp& conf)
+    {
+#ifdef OXEN_LIBQUIC_XDP
+        if (unix_dir_)
+            throw std::invalid_argument{"opt::xdp cannot be combined with the unix transport"};
+        xdp_ = std::make_unique<xdp_socket>(conf, bound_);
+        if (xdp_->max_payload() < max_payload_)
+        {
+            log::warning(
+                    log_cat,
+                    "AF_XDP frames limit packets to {}B; lowering the configured max payload of {}B to match",
+                    xdp_->max_payload(),
+                    max_payload_);
+            set_max_payload_size(xdp_->max_payload());
+        }
+
+        xdp_ev_.reset(event_new(
+                ev_,
+                xdp_->fd(),
+                EV_READ | EV_PERSIST,
+                [](evutil_socket_t, short, void* self) { static_cast<UDPSocket*>(self)->receive_xdp(); },
+                this));
+        event_add(xdp_ev_.get(), nullptr);
+
+        xdp_wev_.reset(event_new(
+                ev_,
+                xdp_->fd(),
+                EV_WRITE,
+                [](evutil_socket_t, short, void* self) { static_cast<UDPSocket*>(self)->on_writeable(); },
+                this));
+#else
+        throw std::invalid_argument{"opt::xdp requires libquic to be built with LIBQUIC_XDP"};
+#endif
+    }
+
+    void UDPSocket::confirm_path([[maybe_unused]] const Packet& pkt)
+    {
+#ifdef OXEN_LIBQUIC_XDP
+        if (xdp_)
+            xdp_->confirm_route(pkt.remote, pkt.data);
+#endif
+    }
+
+    void UDPSocket::receive_xdp()
+    {
+#ifdef OXEN_LIBQUIC_XDP
+        size_t count = 0;
+        for (;;)
+        {
+            auto n = xdp_->receive([this](const Address& remote, bstring_view data, uint8_t ecn) {
+                receive_callback_(Packet{bound_, remote, data, ecn});
+            });
+            if (n == 0)
+                break;
+            if (batch_done_callback_)
+                batch_done_callback_();
+            // The batch's packet data lives in the UMEM frames, so they can only go back now
+            xdp_->release_received();
+
+            count += n;
+            if (n < DATAGRAM_BATCH_SIZE || count >= MAX_RECEIVE_PER_LOOP)
+                break;
+        }
 #endif
     }
 
     // Updates the socket's ECN value to `ecn_`.
     void UDPSocket::set_ecn()
     {
-        int rv;
+        int rv = 0;
         auto& ecn =
 #ifdef _WIN32
                 reinterpret_cast<char&>(ecn_);
@@ -203,7 +536,8 @@ namespace oxen::quic
 #endif
         if (bound_.is_ipv6())
             rv = setsockopt(sock_, IPPROTO_IPV6, IPV6_TCLASS, &ecn, sizeof(ecn_));
-        else
+        // (IPv4 packets sent from a dual-stack socket take their TOS from the IPv4 option)
+        if (rv != -1 && (bound_.is_ipv4() || dual_stack_))
             rv = setsockopt(sock_, IPPROTO_IP, IP_TOS, &ecn, sizeof(ecn_));
         if (rv == -1)  // Just warn; this isn't fatal
             log::warning(
@@ -217,8 +551,234 @@ namespace oxen::quic
             );
     }
 
-    void UDPSocket::process_packet(bstring_view payload, msghdr& hdr)
+    // Turns on the DF bit so that DPLPMTUD probes (and regular packets) are never fragmented; we use
+    // the PROBE variants on Linux so that the kernel doesn't clamp our sends to its cached path MTU
+    // (which would prevent probing above it).
+    void UDPSocket::set_dont_fragment()
+    {
+        int rv = 0;
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+        int val = IP_PMTUDISC_PROBE;
+        if (bound_.is_ipv6())
+        {
+            int val6 = IPV6_PMTUDISC_PROBE;
+            rv = setsockopt(sock_, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &val6, sizeof(val6));
+        }
+        if (rv != -1 && (bound_.is_ipv4() || dual_stack_))
+            rv = setsockopt(sock_, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val));
+#elif defined(IP_DONTFRAG) || defined(IP_DONTFRAGMENT)
+#ifdef _WIN32
+        DWORD on = 1;
+        auto* val = reinterpret_cast<const char*>(&on);
+#else
+        int on = 1;
+        auto* val = &on;
+#endif
+        if (bound_.is_ipv6())
+            rv = setsockopt(sock_, IPPROTO_IPV6, IPV6_DONTFRAG, val, sizeof(on));
+        else
+#ifdef IP_DONTFRAG
+            rv = setsockopt(sock_, IPPROTO_IP, IP_DONTFRAG, val, sizeof(on));
+#else
+            rv = setsockopt(sock_, IPPROTO_IP, IP_DONTFRAGMENT, val, sizeof(on));
+#endif
+#else
+        log::debug(log_cat, "Don't-fragment socket options are not supported on this platform");
+#endif
+        if (rv == -1)  // Not fatal: we just lose the ability to probe for larger MTUs
+            log::warning(log_cat, "Failed to set don't-fragment on socket");
+    }
+
+    void UDPSocket::set_max_payload_size(size_t size)
+    {
+        max_payload_ = size;
+#ifdef OXEN_LIBQUIC_RECVMMSG
+        recv_buf_.resize(max_payload_ * DATAGRAM_BATCH_SIZE);
+#else
+        recv_buf_.resize(max_payload_);
+#endif
+    }
+
+    void UDPSocket::connect(const Address& remote)
+    {
+        if (unix_dir_)
+        {
+            log::debug(log_cat, "Not connecting unix transport socket to {}", remote);
+            return;
+        }
+
+        const auto to = dual_stack_ ? remote.mapped() : remote;
+        if (::connect(sock_, to, to.socklen()) != 0)
+        {
+#ifdef _WIN32
+            auto err = WSAGetLastError();
+#else
+            auto err = errno;
+#endif
+            log::warning(
+                    log_cat,
+                    "Failed to connect UDP socket to {}: {}; continuing unconnected",
+                    remote,
+                    std::system_category().message(err));
+            connected_.reset();
+            return;
+        }
+        connected_ = remote;
+        log::debug(log_cat, "UDP socket bound to {} connected to {}", bound_, remote);
+    }
+
+    void UDPSocket::disconnect()
+    {
+        if (!connected_)
+            return;
+
+        sockaddr sa{};
+        sa.sa_family = AF_UNSPEC;
+        if (::connect(sock_, &sa, sizeof(sa)) != 0)
+        {
+            log::warning(log_cat, "Failed to disconnect UDP socket from {}", *connected_);
+            connected_.reset();
+            return;
+        }
+        log::debug(log_cat, "UDP socket bound to {} disconnected from {}", bound_, *connected_);
+        connected_.reset();
+
+        // Disconnecting a socket whose port was chosen by the kernel (i.e. bound to port 0) gives
+        // the port back, and the next send would pick a new one out from under our connections;
+        // bind to the port we had explicitly, which also keeps it through future disconnects.
+        Address now;
+        if (getsockname(sock_, now, now.socklen_ptr()) == 0 && now.port() == bound_.port())
+            return;
+        if (bind(sock_, bound_, bound_.socklen()) != 0)
+        {
+#ifdef _WIN32
+            auto err = WSAGetLastError();
+#else
+            auto err = errno;
+#endif
+            log::error(
+                    log_cat,
+                    "Failed to rebind disconnected UDP socket to {}: {}",
+                    bound_,
+                    std::system_category().message(err));
+        }
+        else
+            log::debug(log_cat, "Rebound disconnected UDP socket to {}", bound_);
+    }
+
+    void UDPSocket::set_busy_poll([[maybe_unused]] std::chrono::microseconds usec, [[maybe_unused]] bool prefer)
+    {
+#ifdef SO_BUSY_POLL
+        int val = usec.count();
+        if (setsockopt(sock_, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)) == -1)
+            log::warning(log_cat, "Failed to set SO_BUSY_POLL={} on socket: {}", val, strerror(errno));
+        else
+            log::debug(log_cat, "Set SO_BUSY_POLL={} on socket bound to {}", val, bound_);
+#ifdef SO_PREFER_BUSY_POLL
+        if (prefer)
+        {
+            int on = 1;
+            if (setsockopt(sock_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof(on)) == -1)
+                log::warning(log_cat, "Failed to set SO_PREFER_BUSY_POLL on socket: {}", strerror(errno));
+        }
+#endif
+#else
+        log::warning(log_cat, "SO_BUSY_POLL is not supported on this platform");
+#endif
+    }
+
+    size_t UDPSocket::set_buffer_size(int opt, [[maybe_unused]] int force_opt, size_t size)
+    {
+        int val = static_cast<int>(std::min<size_t>(size, std::numeric_limits<int>::max()));
+        auto* valp = reinterpret_cast<const char*>(&val);
+        int rv = -1;
+#if defined(SO_RCVBUFFORCE) && defined(SO_SNDBUFFORCE)
+        // The FORCE variants ignore the rmem_max/wmem_max limits, but require CAP_NET_ADMIN:
+        rv = setsockopt(sock_, SOL_SOCKET, force_opt, valp, sizeof(val));
+#endif
+        if (rv == -1)
+            rv = setsockopt(sock_, SOL_SOCKET, opt, valp, sizeof(val));
+        if (rv == -1)
+            log::warning(
+                    log_cat,
+                    "Failed to set socket {} buffer size to {}: {}",
+                    opt == SO_RCVBUF ? "receive" : "send",
+                    size,
+#ifdef _WIN32
+                    WSAGetLastError()
+#else
+                    strerror(errno)
+#endif
+            );
+
+        auto actual = get_buffer_size(opt);
+        log::debug(
+                log_cat,
+                "Socket {} buffer size on {} is now {} (requested {})",
+                opt == SO_RCVBUF ? "receive" : "send",
+                bound_,
+                actual,
+                size);
+        return actual;
+    }
+
+    size_t UDPSocket::get_buffer_size(int opt) const
+    {
+        int val = 0;
+        socklen_t len = sizeof(val);
+        if (getsockopt(sock_, SOL_SOCKET, opt, reinterpret_cast<char*>(&val), &len) == -1)
+            return 0;
+        return static_cast<size_t>(val);
+    }
+
+    size_t UDPSocket::set_receive_buffer_size(size_t size)
+    {
+        return set_buffer_size(
+                SO_RCVBUF,
+#ifdef SO_RCVBUFFORCE
+                SO_RCVBUFFORCE,
+#else
+                SO_RCVBUF,
+#endif
+                size);
+    }
+
+    size_t UDPSocket::set_send_buffer_size(size_t size)
+    {
+        return set_buffer_size(
+                SO_SNDBUF,
+#ifdef SO_SNDBUFFORCE
+                SO_SNDBUFFORCE,
+#else
+                SO_SNDBUF,
+#endif
+                size);
+    }
+
+    size_t UDPSocket::receive_buffer_size() const
+    {
+        return get_buffer_size(SO_RCVBUF);
+    }
+
+    size_t UDPSocket::send_buffer_size() const
+    {
+        return get_buffer_size(SO_SNDBUF);
+    }
+
+    void UDPSocket::process_packet(bstring_view payload, msghdr& hdr, [[maybe_unused]] Address& local)
     {
+#ifdef SO_RXQ_OVFL
+        for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL &&
+                cmsg->cmsg_len >= CMSG_LEN(sizeof(uint32_t)))
+            {
+                std::memcpy(&rx_drops_, CMSG_DATA(cmsg), sizeof(uint32_t));
+                break;
+            }
+        }
+#endif
+
         if (payload.empty())
         {
             // This is unexpected, and not something a proper libquic client would ever send so
@@ -227,8 +787,9 @@ namespace oxen::quic
             return;
         }
 
-        // This flag means the packet payload couldn't fit in max_payload_size, but that should
-        // never happen (at least as long as the other end is a proper libquic client).
+        // This flag means the packet payload couldn't fit in max_payload_, but that should never
+        // happen (at least as long as the other end is a proper libquic client and respects our
+        // max_udp_payload_size transport parameter).
         if (MSG_TRUNC &
 #ifdef _WIN32
             hdr.dwFlags
@@ -241,32 +802,96 @@ namespace oxen::quic
             return;
         }
 
-        receive_callback_(Packet{bound_, payload, hdr});
+#ifndef _WIN32
+        if (unix_dir_)
+        {
+            // Translate the sender's unix socket name back into the address it stands for
+            auto remote = from_unix_sockaddr(*static_cast<const sockaddr_un*>(hdr.msg_name), hdr.msg_namelen);
+            if (!remote)
+            {
+                log::warning(log_cat, "Dropping packet from unrecognized unix socket peer");
+                return;
+            }
+            sockaddr_in6 remote_sa;
+            std::memcpy(&remote_sa, static_cast<const sockaddr*>(*remote), remote->socklen());
+            hdr.msg_name = &remote_sa;
+            hdr.msg_namelen = remote->socklen();
+            receive_callback_(Packet{bound_, payload, hdr});
+            return;
+        }
+#endif
+
+        const Address* local_addr = &bound_;
+#ifdef OXEN_LIBQUIC_PKTINFO
+        for (auto cmsg = CMSG_FIRSTHDR(&hdr); pktinfo_ && cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO &&
+                cmsg->cmsg_len >= CMSG_LEN(sizeof(in_pktinfo)))
+            {
+                in_pktinfo info;
+                std::memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+                sockaddr_in sin{};
+                sin.sin_family = AF_INET;
+                sin.sin_port = oxenc::host_to_big(bound_.port());
+                sin.sin_addr = info.ipi_addr;
+                local = Address{&sin};
+                local_addr = &local;
+                break;
+            }
+            if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO &&
+                cmsg->cmsg_len >= CMSG_LEN(sizeof(in6_pktinfo)))
+            {
+                in6_pktinfo info;
+                std::memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+                sockaddr_in6 sin6{};
+                sin6.sin6_family = AF_INET6;
+                sin6.sin6_port = oxenc::host_to_big(bound_.port());
+                sin6.sin6_addr = info.ipi6_addr;
+                local = Address{&sin6}.unmapped();
+                local_addr = &local;
+                break;
+            }
+        }
+#endif
+
+        Packet pkt{*local_addr, payload, hdr};
+        // A dual-stack socket gives us IPv4 remotes as IPv4-mapped addresses, but we want to deal
+        // with (and report) them as the plain IPv4 addresses they are.
+        if (dual_stack_)
+            pkt.remote = pkt.remote.unmapped();
+        receive_callback_(pkt);
     }
 
     io_result UDPSocket::receive()
     {
 #ifdef OXEN_LIBQUIC_RECVMMSG
-        std::array<sockaddr_in6, DATAGRAM_BATCH_SIZE> peers;
+        // (sockaddr_storage rather than sockaddr_in6 so that unix transport socket names fit)
+        std::array<sockaddr_storage, DATAGRAM_BATCH_SIZE> peers;
         std::array<iovec, DATAGRAM_BATCH_SIZE> iovs;
         std::array<mmsghdr, DATAGRAM_BATCH_SIZE> msgs = {};
-
-        std::array<std::array<std::byte, max_payload_size>, DATAGRAM_BATCH_SIZE> data;
+        std::array<std::array<char, RECV_CONTROL_SIZE>, DATAGRAM_BATCH_SIZE> controls;
 
         for (size_t i = 0; i < DATAGRAM_BATCH_SIZE; i++)
         {
-            iovs[i].iov_base = data[i].data();
-            iovs[i].iov_len = data[i].size();
+            iovs[i].iov_base = recv_buf_.data() + i * max_payload_;
+            iovs[i].iov_len = max_payload_;
             auto& h = msgs[i].msg_hdr;
             h.msg_iov = &iovs[i];
             h.msg_iovlen = 1;
             h.msg_name = &peers[i];
-            h.msg_namelen = sizeof(peers[i]);
+            h.msg_control = controls[i].data();
         }
 
         size_t count = 0;
         do
         {
+            // The kernel overwrites these with the actual lengths, so need resetting for each call:
+            for (size_t i = 0; i < DATAGRAM_BATCH_SIZE; i++)
+            {
+                msgs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+                msgs[i].msg_hdr.msg_controllen = controls[i].size();
+            }
+
             int nread;
             do
             {
@@ -284,7 +909,13 @@ namespace oxen::quic
             }
 
             for (int i = 0; i < nread; i++)
-                process_packet(bstring_view{data[i].data(), msgs[i].msg_len}, msgs[i].msg_hdr);
+                process_packet(
+                        bstring_view{recv_buf_.data() + i * max_payload_, msgs[i].msg_len},
+                        msgs[i].msg_hdr,
+                        recv_local_[i]);
+
+            if (batch_done_callback_)
+                batch_done_callback_();
 
             count += nread;
 
@@ -299,7 +930,7 @@ namespace oxen::quic
 #else  // no recvmmsg
 
         sockaddr_storage peer{};
-        std::array<std::byte, max_payload_size> data;
+        auto& data = recv_buf_;
 #ifdef _WIN32
         // Microsoft renames everything but uses the same structure just to be obtuse:
         WSABUF iov;
@@ -314,11 +945,12 @@ namespace oxen::quic
         iovec iov;
         iov.iov_base = data.data();
         iov.iov_len = data.size();
+        std::array<char, RECV_CONTROL_SIZE> control;
         msghdr hdr{};
         hdr.msg_iov = &iov;
         hdr.msg_iovlen = 1;
         hdr.msg_name = &peer;
-        hdr.msg_namelen = sizeof(peer);
+        hdr.msg_control = control.data();
 #endif
 
         size_t count = 0;
@@ -336,6 +968,8 @@ namespace oxen::quic
             }
 #else
             int nbytes;
+            hdr.msg_namelen = sizeof(peer);
+            hdr.msg_controllen = control.size();
             do
             {
                 nbytes = recvmsg(sock_, &hdr, 0);
@@ -349,7 +983,10 @@ namespace oxen::quic
             }
 #endif
 
-            process_packet(bstring_view{data.data(), static_cast<size_t>(nbytes)}, hdr);
+            process_packet(bstring_view{data.data(), static_cast<size_t>(nbytes)}, hdr, recv_local_[0]);
+
+            if (batch_done_callback_)
+                batch_done_callback_();
 
             count++;
 
@@ -383,21 +1020,234 @@ namespace oxen::quic
 #define OXEN_LIBQUIC_UDP_SENDMMSG
 #endif
 
+    // Zero-copy sending (opt::zerocopy_send) is only implemented for the GSO send path.
+#if defined(OXEN_LIBQUIC_UDP_GSO) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define OXEN_LIBQUIC_ZEROCOPY
+#endif
+
+    bool UDPSocket::enable_zerocopy([[maybe_unused]] size_t min_bytes)
+    {
+#ifdef OXEN_LIBQUIC_ZEROCOPY
+        if (unix_dir_)
+        {
+            log::warning(log_cat, "Zero-copy sends are not supported with the unix transport");
+            return false;
+        }
+        const int on = 1;
+        if (setsockopt(sock_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == -1)
+        {
+            log::warning(log_cat, "Failed to enable SO_ZEROCOPY on socket: {}", strerror(errno));
+            return false;
+        }
+        zerocopy_min_ = std::max<size_t>(min_bytes, 1);
+        log::debug(log_cat, "Enabled zero-copy sends of batches of {}B or more", zerocopy_min_);
+        return true;
+#else
+        log::warning(log_cat, "Zero-copy sends are not supported by this platform or build");
+        return false;
+#endif
+    }
+
+    void UDPSocket::process_zerocopy_completions()
+    {
+#ifdef OXEN_LIBQUIC_ZEROCOPY
+        bool completed = false;
+        for (;;)
+        {
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+            msghdr hdr{};
+            hdr.msg_control = control;
+            hdr.msg_controllen = sizeof(control);
+            if (recvmsg(sock_, &hdr, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;  // EAGAIN: no more notifications
+            }
+
+            for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+            {
+                if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                      || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+                    continue;
+                sock_extended_err err;
+                std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0)
+                    continue;
+
+                // The notification covers the (inclusive, possibly wrapping) id range [lo, hi]; the
+                // kernel coalesces consecutive completions, but they may span several of our sends.
+                const uint32_t lo = err.ee_info, n = err.ee_data - lo + 1;
+                if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                    zc_copied_ += n;
+                for (auto& p : zc_pending_)
+                    for (uint32_t i = 0; i < p.count && p.remaining > 0; i++)
+                        if (static_cast<uint32_t>(p.first_id + i - lo) < n)
+                        {
+                            p.remaining--;
+                            completed = true;
+                        }
+            }
+        }
+
+        if (completed)
+            zc_pending_.erase(
+                    std::remove_if(
+                            zc_pending_.begin(), zc_pending_.end(), [](const auto& p) { return p.remaining == 0; }),
+                    zc_pending_.end());
+#endif
+    }
+
+#ifndef _WIN32
+    // Appends a control message to `hdr`'s control buffer (which must have room for it), updating
+    // msg_controllen.
+    template <typename T>
+    static void append_cmsg(msghdr& hdr, int level, int type, T value)
+    {
+        auto* cm = reinterpret_cast<cmsghdr*>(static_cast<char*>(hdr.msg_control) + hdr.msg_controllen);
+        cm->cmsg_level = level;
+        cm->cmsg_type = type;
+        cm->cmsg_len = CMSG_LEN(sizeof(T));
+        std::memcpy(CMSG_DATA(cm), &value, sizeof(T));
+        hdr.msg_controllen += CMSG_SPACE(sizeof(T));
+    }
+
+    // Space needed for per-message traffic class (see opt::dscp) and source address control messages
+    static constexpr size_t SEND_CONTROL_SIZE = CMSG_SPACE(sizeof(int)) + PKTINFO_CONTROL_SIZE;
+
+    // On a wildcard-bound socket we send from the path's local address (when known) so that replies
+    // come from the address the peer sent to; otherwise the kernel would pick the source address
+    // from the routing table, which on a multihomed host may not be it.
+    bool UDPSocket::need_source_cmsg(const Path& path) const
+    {
+        return pktinfo_ && !path.local.is_any_addr() && (bound_.is_ipv6() || path.local.is_ipv4());
+    }
+
+    bool UDPSocket::need_send_cmsgs(const Path& path, uint8_t tos) const
+    {
+        return tos > NGTCP2_ECN_MASK || need_source_cmsg(path);
+    }
+
+    void UDPSocket::append_send_cmsgs(msghdr& hdr, const Path& path, uint8_t tos) const
+    {
+        // A DSCP marking is specific to the sending connection, so rather than changing the shared
+        // socket we attach the full traffic class byte (DSCP + ECN) to each message.  (The kernel
+        // sends to IPv4 destinations of a dual-stack socket as IPv4, and so only looks at IP_TOS for
+        // them).
+        if (tos > NGTCP2_ECN_MASK)
+        {
+            if (path.remote.is_ipv4())
+                append_cmsg<int>(hdr, IPPROTO_IP, IP_TOS, tos);
+            else
+                append_cmsg<int>(hdr, IPPROTO_IPV6, IPV6_TCLASS, tos);
+        }
+
+#ifdef OXEN_LIBQUIC_PKTINFO
+        if (!need_source_cmsg(path))
+            return;
+        if (bound_.is_ipv6())
+        {
+            in6_pktinfo src{};
+            src.ipi6_addr = path.local.mapped().in6().sin6_addr;
+            append_cmsg(hdr, IPPROTO_IPV6, IPV6_PKTINFO, src);
+        }
+        else
+        {
+            in_pktinfo src{};
+            src.ipi_spec_dst = path.local.in4().sin_addr;
+            append_cmsg(hdr, IPPROTO_IP, IP_PKTINFO, src);
+        }
+#endif
+    }
+#endif
+
+#ifdef OXEN_LIBQUIC_TEST_HOOKS
+    bool UDPSocket::simulated_block(const std::byte* buf, const size_t* bufsize, size_t n_pkts)
+    {
+        if (!sim_refused_.empty())
+        {
+            // A retry must resend exactly the packets that were refused (though it may be followed
+            // by new ones, or have fewer if some were dropped).
+            bool same = true;
+            const std::byte* pos = buf;
+            for (size_t i = 0; i < std::min(n_pkts, sim_refused_.size()) && same; pos += bufsize[i++])
+                same = sim_refused_[i] == bstring_view{pos, bufsize[i]};
+            if (same)
+                sim_resends_++;
+            else
+                sim_resend_mismatches_++;
+            sim_refused_.clear();
+        }
+
+        for (size_t n = sim_block_sends_; n > 0;)
+        {
+            if (!sim_block_sends_.compare_exchange_weak(n, n - 1))
+                continue;
+            for (size_t i = 0; i < n_pkts; buf += bufsize[i++])
+                sim_refused_.emplace_back(buf, bufsize[i]);
+            send_blocks_++;
+            return true;
+        }
+        return false;
+    }
+#endif
+
     std::pair<io_result, size_t> UDPSocket::send(
-            const Address& dest, const std::byte* buf, const size_t* bufsize, uint8_t ecn, size_t n_pkts)
+            const Path& path,
+            const std::byte* buf,
+            const size_t* bufsize,
+            uint8_t tos,
+            size_t n_pkts,
+            [[maybe_unused]] const std::shared_ptr<void>& pin)
     {
+#ifdef OXEN_LIBQUIC_TEST_HOOKS
+        if ((sim_block_sends_ || !sim_refused_.empty()) && simulated_block(buf, bufsize, n_pkts))
+            return {io_result{EAGAIN}, 0};
+#endif
 
+        const Address& dest = path.remote;
         auto* next_buf = const_cast<char*>(reinterpret_cast<const char*>(buf));
         int rv = 0;
         size_t sent = 0;
-        sockaddr* dest_sa = const_cast<Address&>(dest);
 
-        if (ecn != ecn_)
+        // A dual-stack socket has to be given IPv4 destinations in their IPv4-mapped form
+        std::optional<Address> mapped_dest;
+        if (dual_stack_ && dest.is_ipv4())
+            mapped_dest = dest.mapped();
+        const Address& to = mapped_dest ? *mapped_dest : dest;
+
+        // If the socket is connected to the destination then we omit the address entirely and let
+        // the kernel use the connected route.
+        const bool omit_dest = connected_ && *connected_ == dest;
+        sockaddr* dest_sa = omit_dest ? nullptr : static_cast<sockaddr*>(const_cast<Address&>(to));
+        socklen_t dest_len = omit_dest ? 0 : to.socklen();
+
+#ifndef _WIN32
+        if (unix_dir_)
+            return send_unix(dest, buf, bufsize, n_pkts);
+#endif
+
+#ifdef OXEN_LIBQUIC_XDP
+        // (Anything too big for an AF_XDP frame goes through the kernel socket instead)
+        xdp_blocked_ = false;
+        if (xdp_ && xdp_->has_route(dest) && xdp_->fits(bufsize, n_pkts))
+        {
+            auto result = xdp_->send(dest, buf, bufsize, tos, n_pkts);
+            xdp_blocked_ = result.first.blocked();
+            return result;
+        }
+#endif
+
+        if (uint8_t ecn = tos & NGTCP2_ECN_MASK; ecn != ecn_)
         {
             ecn_ = ecn;
             set_ecn();
         }
 
+#ifndef _WIN32
+        [[maybe_unused]] const bool with_cmsgs = need_send_cmsgs(path, tos);
+#endif
+
 #ifdef OXEN_LIBQUIC_UDP_GSO
 
         // With GSO, we use *one* sendmmsg call which can contain multiple batches of packets; each
@@ -405,7 +1255,11 @@ namespace oxen::quic
         //
         // We could have up to the full MAX_BATCH, with the worst case being every packet being a
         // different size than the one before it.
-        std::array<std::array<char, CMSG_SPACE(sizeof(uint16_t))>, DATAGRAM_BATCH_SIZE> controls{};
+        struct alignas(cmsghdr) control_buf
+        {
+            char data[CMSG_SPACE(sizeof(uint16_t)) + SEND_CONTROL_SIZE];
+        };
+        std::array<control_buf, MAX_BATCH> controls{};
         std::array<uint16_t, MAX_BATCH> gso_sizes{};   // Size of each of the packets
         std::array<uint16_t, MAX_BATCH> gso_counts{};  // Number of packets
 
@@ -421,11 +1275,15 @@ namespace oxen::quic
             if (gso_size == 0)
                 gso_size = bufsize[i];  // new batch
 
-            if (i < n_pkts - 1 && bufsize[i + 1] == gso_size)
-                continue;  // The next one can be batched with us
+            // The next one can be batched with us if it's the same size, as long as the total
+            // stays within the maximum size of a single (GSO) UDP send; the latter matters when
+            // sending large (e.g. jumbo frame) packets.
+            if (i < n_pkts - 1 && bufsize[i + 1] == gso_size && (gso_count + size_t{1}) * gso_size <= MAX_GSO_BYTES)
+                continue;
 
             auto& iov = iovs[msg_count];
             auto& msg = msgs[msg_count];
+            auto& control = controls[msg_count];
             iov.iov_base = next_buf;
             iov.iov_len = gso_count * gso_size;
             next_buf += iov.iov_len;
@@ -434,25 +1292,54 @@ namespace oxen::quic
             hdr.msg_iov = &iov;
             hdr.msg_iovlen = 1;
             hdr.msg_name = dest_sa;
-            hdr.msg_namelen = dest.socklen();
-            if (gso_count > 1)
+            hdr.msg_namelen = dest_len;
+            if (gso_count > 1 || with_cmsgs)
             {
-                auto& control = controls[msg_count];
-                hdr.msg_control = control.data();
-                hdr.msg_controllen = control.size();
-                auto* cm = CMSG_FIRSTHDR(&hdr);
-                cm->cmsg_level = SOL_UDP;
-                cm->cmsg_type = UDP_SEGMENT;
-                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
-                *reinterpret_cast<uint16_t*>(CMSG_DATA(cm)) = gso_size;
+                hdr.msg_control = control.data;
+                hdr.msg_controllen = 0;
+                if (gso_count > 1)
+                    append_cmsg<uint16_t>(hdr, SOL_UDP, UDP_SEGMENT, gso_size);
+                if (with_cmsgs)
+                    append_send_cmsgs(hdr, path, tos);
             }
         }
 
+        int flags = 0;
+#ifdef OXEN_LIBQUIC_ZEROCOPY
+        if (!zc_pending_.empty())
+            process_zerocopy_completions();
+        const bool zerocopy = pin && zerocopy_min_ > 0
+                           && static_cast<size_t>(next_buf - reinterpret_cast<const char*>(buf)) >= zerocopy_min_;
+        if (zerocopy)
+            flags |= MSG_ZEROCOPY;
+#endif
+
         do
         {
-            rv = sendmmsg(sock_, msgs.data(), msg_count, 0);
+            rv = sendmmsg(sock_, msgs.data(), msg_count, flags);
+#ifdef OXEN_LIBQUIC_ZEROCOPY
+            // ENOBUFS with MSG_ZEROCOPY means we have hit the limit on pinned memory or outstanding
+            // notifications (optmem_max), in which case we just copy this one.
+            if (rv == -1 && errno == ENOBUFS && (flags & MSG_ZEROCOPY))
+            {
+                flags &= ~MSG_ZEROCOPY;
+                errno = EINTR;
+            }
+#endif
         } while (rv == -1 && errno == EINTR);
 
+#ifdef OXEN_LIBQUIC_ZEROCOPY
+        // Each message sent zero-copy is assigned the next notification id; hold on to the buffer
+        // until the kernel has reported all of them complete.
+        if (rv > 0 && (flags & MSG_ZEROCOPY))
+        {
+            auto count = static_cast<uint32_t>(rv);
+            zc_pending_.push_back({zc_next_id_, count, count, pin});
+            zc_next_id_ += count;
+            zc_sends_ += count;
+        }
+#endif
+
         // Figure out number of packets we actually sent:
         // rv is the number of `msgs` elements that were updated; within each, the `.msg_len` field
         // has been updated to the number of bytes that were sent (which we need to use to figure
@@ -491,6 +1378,9 @@ namespace oxen::quic
 
         std::array<mmsghdr, MAX_BATCH> msgs{};
         std::array<iovec, MAX_BATCH> iovs{};
+        // Every message carries the same traffic class and source, so they can share one control
+        // buffer
+        alignas(cmsghdr) std::array<char, SEND_CONTROL_SIZE> control{};
 
         for (size_t i = 0; i < n_pkts; i++)
         {
@@ -504,7 +1394,13 @@ namespace oxen::quic
             hdr.msg_iov = &iovs[i];
             hdr.msg_iovlen = 1;
             hdr.msg_name = dest_sa;
-            hdr.msg_namelen = dest.socklen();
+            hdr.msg_namelen = dest_len;
+            if (with_cmsgs)
+            {
+                hdr.msg_control = control.data();
+                hdr.msg_controllen = 0;
+                append_send_cmsgs(hdr, path, tos);
+            }
         }
 
         do
@@ -523,14 +1419,20 @@ namespace oxen::quic
         hdr.lpBuffers = &iov;
         hdr.dwBufferCount = 1;
         hdr.name = dest_sa;
-        hdr.namelen = dest.socklen();
+        hdr.namelen = dest_len;
 #else
         msghdr hdr{};
         iovec iov;
         hdr.msg_iov = &iov;
         hdr.msg_iovlen = 1;
         hdr.msg_name = dest_sa;
-        hdr.msg_namelen = dest.socklen();
+        hdr.msg_namelen = dest_len;
+        alignas(cmsghdr) std::array<char, SEND_CONTROL_SIZE> control{};
+        if (with_cmsgs)
+        {
+            hdr.msg_control = control.data();
+            append_send_cmsgs(hdr, path, tos);
+        }
 #endif
 
         for (size_t i = 0; i < n_pkts; ++i)
@@ -562,12 +1464,148 @@ namespace oxen::quic
         }
 #endif
 
-        return {io_result{rv < 0 ? errno : 0}, sent};
+        io_result res{rv < 0 ? errno : 0};
+        // (A partial batch isn't a block: the caller retries the rest, which reports EAGAIN if the
+        // socket really is full.)
+        if (res.blocked())
+            send_blocks_++;
+
+        return {res, sent};
+    }
+
+    std::pair<io_result, size_t> UDPSocket::send_multi(
+            const Path* paths, const std::byte* buf, const size_t* bufsize, const uint8_t* tos, size_t n_pkts)
+    {
+#if defined(OXEN_LIBQUIC_UDP_GSO) || defined(OXEN_LIBQUIC_UDP_SENDMMSG)
+        if (!unix_dir_ && !xdp_)
+        {
+            n_pkts = std::min(n_pkts, MAX_BATCH);
+
+            struct alignas(cmsghdr) control_buf
+            {
+                char data[SEND_CONTROL_SIZE];
+            };
+            std::array<control_buf, MAX_BATCH> controls;
+            std::array<Address, MAX_BATCH> dests;
+            std::array<mmsghdr, MAX_BATCH> msgs{};
+            std::array<iovec, MAX_BATCH> iovs{};
+
+            auto* next_buf = const_cast<char*>(reinterpret_cast<const char*>(buf));
+            for (size_t i = 0; i < n_pkts; i++)
+            {
+                assert(bufsize[i] > 0);
+                // (A dual-stack socket has to be given IPv4 destinations in their IPv4-mapped form)
+                dests[i] = dual_stack_ ? paths[i].remote.mapped() : paths[i].remote;
+
+                iovs[i].iov_base = next_buf;
+                iovs[i].iov_len = bufsize[i];
+                next_buf += bufsize[i];
+
+                auto& hdr = msgs[i].msg_hdr;
+                hdr.msg_iov = &iovs[i];
+                hdr.msg_iovlen = 1;
+                hdr.msg_name = static_cast<sockaddr*>(dests[i]);
+                hdr.msg_namelen = dests[i].socklen();
+                if (need_send_cmsgs(paths[i], tos[i]))
+                {
+                    hdr.msg_control = controls[i].data;
+                    hdr.msg_controllen = 0;
+                    append_send_cmsgs(hdr, paths[i], tos[i]);
+                }
+            }
+
+            int rv;
+            do
+            {
+                rv = sendmmsg(sock_, msgs.data(), n_pkts, MSG_DONTWAIT);
+            } while (rv == -1 && errno == EINTR);
+
+            size_t sent = rv >= 0 ? rv : 0;
+            io_result res{rv < 0 ? errno : 0};
+            if (res.blocked())
+                send_blocks_++;
+            return {res, sent};
+        }
+#endif
+
+        // Without sendmmsg (or with the unix or AF_XDP transports) we send them one at a time
+        size_t sent = 0;
+        for (; sent < n_pkts; buf += bufsize[sent], sent++)
+            if (auto [res, n] = send(paths[sent], buf, &bufsize[sent], tos[sent], 1); n == 0)
+                return {res, sent};
+        return {io_result{}, sent};
+    }
+
+#ifndef _WIN32
+    std::pair<io_result, size_t> UDPSocket::send_unix(
+            const Address& dest, const std::byte* buf, const size_t* bufsize, size_t n_pkts)
+    {
+        sockaddr_un sun;
+        auto sun_len = to_unix_sockaddr(*unix_dir_, dest, sun);
+
+        auto* next_buf = const_cast<char*>(reinterpret_cast<const char*>(buf));
+        int rv = 0;
+        size_t sent = 0;
+
+#if defined(OXEN_LIBQUIC_UDP_GSO) || defined(OXEN_LIBQUIC_UDP_SENDMMSG)
+        // No GSO on unix sockets, but we can still send the whole batch in one sendmmsg call
+        std::array<mmsghdr, MAX_BATCH> msgs{};
+        std::array<iovec, MAX_BATCH> iovs{};
+        for (size_t i = 0; i < n_pkts; i++)
+        {
+            iovs[i].iov_base = next_buf;
+            iovs[i].iov_len = bufsize[i];
+            next_buf += bufsize[i];
+            auto& hdr = msgs[i].msg_hdr;
+            hdr.msg_iov = &iovs[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_name = &sun;
+            hdr.msg_namelen = sun_len;
+        }
+        do
+        {
+            rv = sendmmsg(sock_, msgs.data(), n_pkts, MSG_DONTWAIT);
+        } while (rv == -1 && errno == EINTR);
+        sent = rv >= 0 ? rv : 0;
+#else
+        for (; sent < n_pkts; sent++)
+        {
+            do
+            {
+                rv = sendto(sock_, next_buf, bufsize[sent], 0, reinterpret_cast<sockaddr*>(&sun), sun_len);
+            } while (rv == -1 && errno == EINTR);
+            if (rv < 0)
+                break;
+            next_buf += bufsize[sent];
+        }
+#endif
+
+        // A peer that isn't there (yet, or any more) is reported as ECONNREFUSED/ENOENT; treat that
+        // like packet loss on a regular UDP socket rather than as a send failure.
+        if (rv < 0 && (errno == ECONNREFUSED || errno == ENOENT))
+        {
+            log::debug(log_cat, "No unix transport peer listening for {}; dropping packet(s)", dest);
+            return {io_result{}, n_pkts};
+        }
+
+        io_result res{rv < 0 ? errno : 0};
+        if (res.blocked())
+            send_blocks_++;
+
+        return {res, sent};
     }
+#endif
 
     void UDPSocket::when_writeable(std::function<void()> cb)
     {
         writeable_callbacks_.push_back(std::move(cb));
+#ifdef OXEN_LIBQUIC_XDP
+        if (xdp_blocked_)
+        {
+            event_add(xdp_wev_.get(), nullptr);
+            return;
+        }
+#endif
         event_add(wev_.get(), nullptr);
     }
 
@@ -31,6 +31,63 @@ namespace oxen::quic
         return std::chrono::steady_clock::now().time_since_epoch();
     }
 
+    token_bucket::token_bucket(uint64_t rate, uint64_t burst, std::chrono::steady_clock::time_point now) :
+            rate_per_ns{rate / 1e9},
+            burst{static_cast<int64_t>(burst)},
+            tokens{static_cast<int64_t>(burst)},
+            last_refill{now}
+    {
+        assert(rate > 0 && burst > 0);
+    }
+
+    void token_bucket::refill(std::chrono::steady_clock::time_point now)
+    {
+        auto elapsed = now - last_refill;
+        if (elapsed <= 0ns)
+            return;
+        // Only advance last_refill by the time corresponding to the whole tokens we added, so that
+        // frequent refills don't lose fractional tokens.
+        auto add = static_cast<int64_t>(elapsed.count() * rate_per_ns);
+        if (add <= 0)
+            return;
+        if (tokens + add >= burst)
+        {
+            tokens = burst;
+            last_refill = now;
+        }
+        else
+        {
+            tokens += add;
+            last_refill += std::chrono::nanoseconds{static_cast<int64_t>(add / rate_per_ns)};
+        }
+    }
+
+    std::chrono::steady_clock::time_point token_bucket::ready_at(std::chrono::steady_clock::time_point now) const
+    {
+        if (tokens > 0)
+            return now;
+        return last_refill + std::chrono::nanoseconds{static_cast<int64_t>((1 - tokens) / rate_per_ns) + 1};
+    }
+
+    void throttle_timer::set(bool throttled, std::chrono::steady_clock::time_point now)
+    {
+        if (throttled)
+        {
+            if (!since)
+                since = now;
+        }
+        else if (since)
+        {
+            total += now - *since;
+            since.reset();
+        }
+    }
+
+    std::chrono::nanoseconds throttle_timer::elapsed(std::chrono::steady_clock::time_point now) const
+    {
+        return total + (since ? now - *since : 0ns);
+    }
+
     std::string str_tolower(std::string s)
     {
         std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
@@ -68,21 +125,21 @@ namespace oxen::quic
         if (addr.empty())
         {
             // Default to all-0 IPv6 address, which is good (it's `::`, the IPv6 any addr)
-            reinterpret_cast<sockaddr_in6&>(_sock_addr).sin6_port = oxenc::host_to_big(port);
+            _sin6.sin6_port = oxenc::host_to_big(port);
         }
         int rv;
         if (addr.find(':') != std::string_view::npos)
         {
-            _sock_addr.ss_family = AF_INET6;
-            auto& sin6 = reinterpret_cast<sockaddr_in6&>(_sock_addr);
+            _sin6.sin6_family = AF_INET6;
+            auto& sin6 = _sin6;
             sin6.sin6_port = oxenc::host_to_big(port);
             _addr.addrlen = sizeof(sockaddr_in6);
             rv = inet_pton(AF_INET6, addr.c_str(), &sin6.sin6_addr);
         }
         else
         {
-            _sock_addr.ss_family = AF_INET;
-            auto& sin4 = reinterpret_cast<sockaddr_in&>(_sock_addr);
+            _sin.sin_family = AF_INET;
+            auto& sin4 = _sin;
             sin4.sin_port = oxenc::host_to_big(port);
             _addr.addrlen = sizeof(sockaddr_in);
             rv = inet_pton(AF_INET, addr.c_str(), &sin4.sin_addr);
@@ -93,15 +150,51 @@ namespace oxen::quic
             std::system_error{errno, std::system_category()};
     }
 
+    bool Address::is_any_addr() const
+    {
+        if (is_ipv4())
+            return _sin.sin_addr.s_addr == INADDR_ANY;
+        return is_ipv6() && IN6_IS_ADDR_UNSPECIFIED(&_sin6.sin6_addr);
+    }
+
+    bool Address::is_ipv4_mapped() const
+    {
+        return is_ipv6() && IN6_IS_ADDR_V4MAPPED(&_sin6.sin6_addr);
+    }
+
+    Address Address::unmapped() const
+    {
+        if (!is_ipv4_mapped())
+            return *this;
+        sockaddr_in sin{};
+        sin.sin_family = AF_INET;
+        sin.sin_port = _sin6.sin6_port;
+        std::memcpy(&sin.sin_addr, &_sin6.sin6_addr.s6_addr[12], sizeof(sin.sin_addr));
+        return Address{&sin};
+    }
+
+    Address Address::mapped() const
+    {
+        if (!is_ipv4())
+            return *this;
+        sockaddr_in6 sin6{};
+        sin6.sin6_family = AF_INET6;
+        sin6.sin6_port = _sin.sin_port;
+        sin6.sin6_addr.s6_addr[10] = 0xff;
+        sin6.sin6_addr.s6_addr[11] = 0xff;
+        std::memcpy(&sin6.sin6_addr.s6_addr[12], &_sin.sin_addr, sizeof(_sin.sin_addr));
+        return Address{&sin6};
+    }
+
     std::string Address::to_string() const
     {
         char buf[INET6_ADDRSTRLEN] = {};
         if (is_ipv6())
         {
-            inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6&>(_sock_addr).sin6_addr, buf, sizeof(buf));
+            inet_ntop(AF_INET6, &_sin6.sin6_addr, buf, sizeof(buf));
             return "[{}]:{}"_format(buf, port());
         }
-        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in&>(_sock_addr).sin_addr, buf, sizeof(buf));
+        inet_ntop(AF_INET, &_sin.sin_addr, buf, sizeof(buf));
         return "{}:{}"_format(buf, port());
     }
 
@@ -0,0 +1,623 @@
+#include "xdp.hpp"
+
+extern "C"
+{
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+#include <cstring>
+
+#include "internal.hpp"
+
+namespace oxen::quic
+{
+    static constexpr size_t FRAME_SIZE = XSK_UMEM__DEFAULT_FRAME_SIZE;
+
+    static constexpr size_t IPV4_HLEN = sizeof(iphdr);
+    static constexpr size_t IPV6_HLEN = sizeof(ip6_hdr);
+    static constexpr size_t UDP_HLEN = sizeof(udphdr);
+
+    // Minimum number of entries in the XSK map (which is indexed by receive queue)
+    static constexpr uint32_t MIN_XSK_MAP_SIZE = 64;
+
+    namespace
+    {
+        // Minimal BPF assembler for our XDP program: emits instructions, and resolves jumps to
+        // labels once the program is complete.
+        struct bpf_assembler
+        {
+            enum label : size_t
+            {
+                PASS,
+                REDIRECT,
+                LABEL_COUNT
+            };
+
+            std::vector<bpf_insn> insns;
+            std::vector<std::pair<size_t, label>> jumps;
+            std::array<size_t, LABEL_COUNT> labels{};
+
+            void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+            {
+                auto& i = insns.emplace_back();
+                i.code = code;
+                i.dst_reg = dst;
+                i.src_reg = src;
+                i.off = off;
+                i.imm = imm;
+            }
+
+            // dst = *(size *)(src + off)
+            void load(uint8_t size, uint8_t dst, uint8_t src, int16_t off)
+            {
+                emit(BPF_LDX | size | BPF_MEM, dst, src, off, 0);
+            }
+            void mov(uint8_t dst, uint8_t src) { emit(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0); }
+            void mov_imm(uint8_t dst, int32_t imm) { emit(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm); }
+            void add_imm(uint8_t dst, int32_t imm) { emit(BPF_ALU64 | BPF_ADD | BPF_K, dst, 0, 0, imm); }
+            void and_imm(uint8_t dst, int32_t imm) { emit(BPF_ALU64 | BPF_AND | BPF_K, dst, 0, 0, imm); }
+
+            // Conditional jumps comparing a register with an immediate (BPF_K) or register (BPF_X)
+            void jump(uint8_t op, uint8_t dst, int32_t imm, label to)
+            {
+                jumps.emplace_back(insns.size(), to);
+                emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+            }
+            void jump_reg(uint8_t op, uint8_t dst, uint8_t src, label to)
+            {
+                jumps.emplace_back(insns.size(), to);
+                emit(BPF_JMP | op | BPF_X, dst, src, 0, 0);
+            }
+            void jump(label to) { jump(BPF_JA, 0, 0, to); }
+            // As jump(), but comparing only the low 32 bits of the register, and without sign
+            // extending the immediate (which a 64-bit comparison does)
+            void jump32(uint8_t op, uint8_t dst, int32_t imm, label to)
+            {
+                jumps.emplace_back(insns.size(), to);
+                emit(BPF_JMP32 | op | BPF_K, dst, 0, 0, imm);
+            }
+
+            // 64-bit load of a map fd (which the kernel replaces with the map address)
+            void load_map_fd(uint8_t dst, int fd)
+            {
+                emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+                emit(0, 0, 0, 0, 0);
+            }
+
+            void call(int32_t func) { emit(BPF_JMP | BPF_CALL, 0, 0, 0, func); }
+            void exit() { emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+
+            void mark(label l) { labels[l] = insns.size(); }
+
+            std::vector<bpf_insn>& finish()
+            {
+                for (auto [i, to] : jumps)
+                    insns[i].off = static_cast<int16_t>(labels[to] - (i + 1));
+                return insns;
+            }
+        };
+
+        // Internet checksum helpers: accumulates 16-bit big-endian words, then folds and inverts the
+        // sum into a value to store as-is into a header.
+        uint32_t csum_add(uint32_t sum, const void* data, size_t len)
+        {
+            auto* p = static_cast<const uint8_t*>(data);
+            for (; len > 1; p += 2, len -= 2)
+                sum += (uint32_t{p[0]} << 8) | p[1];
+            if (len)
+                sum += uint32_t{p[0]} << 8;
+            return sum;
+        }
+
+        uint16_t csum_finish(uint32_t sum)
+        {
+            while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+            return htons(static_cast<uint16_t>(~sum));
+        }
+    }  // namespace
+
+    xdp_socket::xdp_socket(const opt::xdp& conf, const Address& bound) : frame_count{conf.frames}
+    {
+        ifindex = if_nametoindex(conf.ifname.c_str());
+        if (!ifindex)
+            throw std::runtime_error{"Unknown network interface '{}'"_format(conf.ifname)};
+        xdp_flags = (conf.native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE) | XDP_FLAGS_UPDATE_IF_NOEXIST;
+
+        try
+        {
+            const size_t size = frame_count * FRAME_SIZE;
+            umem_area = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (umem_area == MAP_FAILED)
+            {
+                umem_area = nullptr;
+                throw std::runtime_error{"Failed to allocate XDP UMEM: {}"_format(strerror(errno))};
+            }
+
+            // Half of the frames are for receiving (and live in the fill/RX rings), the other half
+            // for sending (in the TX/completion rings, or our free list).
+            const uint32_t half = frame_count / 2;
+
+            xsk_umem_config umem_conf{};
+            umem_conf.fill_size = half;
+            umem_conf.comp_size = half;
+            umem_conf.frame_size = FRAME_SIZE;
+            umem_conf.frame_headroom = 0;
+            if (int rv = xsk_umem__create(&umem, umem_area, size, &fill, &comp, &umem_conf))
+                throw std::runtime_error{"Failed to create XDP UMEM: {}"_format(strerror(-rv))};
+
+            load_program(bound, conf.queue);
+
+            // We load our own program (rather than libxdp's default, which redirects everything
+            // arriving on the queue), so only need the socket added to our map.
+            xsk_socket_config sock_conf{};
+            sock_conf.rx_size = half;
+            sock_conf.tx_size = half;
+            sock_conf.libxdp_flags = XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD;
+            sock_conf.xdp_flags = xdp_flags;
+            sock_conf.bind_flags = (conf.native ? 0 : XDP_COPY) | XDP_USE_NEED_WAKEUP;
+            if (int rv = xsk_socket__create(&xsk, conf.ifname.c_str(), conf.queue, umem, &rx, &tx, &sock_conf))
+                throw std::runtime_error{"Failed to create AF_XDP socket on {} queue {}: {}"_format(
+                        conf.ifname, conf.queue, strerror(-rv))};
+            if (int rv = xsk_socket__update_xskmap(xsk, map_fd))
+                throw std::runtime_error{"Failed to add AF_XDP socket to XDP map: {}"_format(strerror(-rv))};
+
+            uint32_t idx;
+            if (xsk_ring_prod__reserve(&fill, half, &idx) != half)
+                throw std::runtime_error{"Failed to populate AF_XDP fill ring"};
+            for (uint32_t i = 0; i < half; i++)
+                *xsk_ring_prod__fill_addr(&fill, idx + i) = uint64_t{i} * FRAME_SIZE;
+            xsk_ring_prod__submit(&fill, half);
+
+            free_tx.reserve(half);
+            for (uint32_t i = half; i < frame_count; i++)
+                free_tx.push_back(uint64_t{i} * FRAME_SIZE);
+            received.reserve(DATAGRAM_BATCH_SIZE);
+            rx_sources.resize(half);
+        }
+        catch (...)
+        {
+            cleanup();
+            throw;
+        }
+
+        log::info(
+                log_cat,
+                "AF_XDP socket ready on {} queue {} ({} mode) for UDP {}",
+                conf.ifname,
+                conf.queue,
+                conf.native ? "native" : "generic",
+                bound);
+    }
+
+    xdp_socket::~xdp_socket()
+    {
+        cleanup();
+    }
+
+    void xdp_socket::cleanup()
+    {
+        if (attached)
+        {
+            bpf_xdp_detach(ifindex, xdp_flags & ~XDP_FLAGS_UPDATE_IF_NOEXIST, nullptr);
+            attached = false;
+        }
+        if (xsk)
+        {
+            xsk_socket__delete(xsk);
+            xsk = nullptr;
+        }
+        if (umem)
+        {
+            xsk_umem__delete(umem);
+            umem = nullptr;
+        }
+        if (prog_fd >= 0)
+        {
+            ::close(prog_fd);
+            prog_fd = -1;
+        }
+        if (map_fd >= 0)
+        {
+            ::close(map_fd);
+            map_fd = -1;
+        }
+        if (umem_area)
+        {
+            munmap(umem_area, frame_count * FRAME_SIZE);
+            umem_area = nullptr;
+        }
+    }
+
+    void xdp_socket::load_program(const Address& bound, uint32_t queue)
+    {
+        map_fd = bpf_map_create(
+                BPF_MAP_TYPE_XSKMAP,
+                "libquic_xsks",
+                sizeof(uint32_t),
+                sizeof(uint32_t),
+                std::max(MIN_XSK_MAP_SIZE, queue + 1),
+                nullptr);
+        if (map_fd < 0)
+            throw std::runtime_error{"Failed to create XSK map: {}"_format(strerror(errno))};
+
+        // The equivalent of (for an IPv4 bound address):
+        //
+        //     if (eth->h_proto == ETH_P_IP && ip->ihl == 5 && ip->protocol == IPPROTO_UDP
+        //             && !(ip->frag_off & (IP_MF | IP_OFFMASK)) && ip->daddr == addr && udp->dest == port)
+        //         return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+        //     return XDP_PASS;
+        //
+        // or (for IPv6):
+        //
+        //     if (eth->h_proto == ETH_P_IPV6 && ip6->nexthdr == IPPROTO_UDP && ip6->daddr == addr
+        //             && udp->dest == port)
+        //         return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+        //     return XDP_PASS;
+        //
+        // (with the bounds checks the verifier requires, and without the address check when bound
+        // to the any address).  Fragments go to the kernel to be reassembled, as do IPv6 packets
+        // with extension headers (including the fragment header), as the UDP header isn't where we
+        // look for it.  Packets arriving on a queue without a socket in the map fall back to
+        // XDP_PASS, and so still reach the kernel socket.
+        bpf_assembler a;
+        using A = bpf_assembler;
+        const int32_t nport = htons(bound.port());
+        const bool ipv6 = bound.is_ipv6();
+        const bool any = bound.is_any_addr();
+
+        a.load(BPF_W, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, data));
+        a.load(BPF_W, BPF_REG_3, BPF_REG_1, offsetof(xdp_md, data_end));
+        a.load(BPF_W, BPF_REG_4, BPF_REG_1, offsetof(xdp_md, rx_queue_index));
+
+        a.mov(BPF_REG_5, BPF_REG_2);
+        a.add_imm(BPF_REG_5, ETH_HLEN);
+        a.jump_reg(BPF_JGT, BPF_REG_5, BPF_REG_3, A::PASS);
+        a.load(BPF_H, BPF_REG_0, BPF_REG_2, offsetof(ethhdr, h_proto));
+        a.jump(BPF_JNE, BPF_REG_0, htons(ipv6 ? ETH_P_IPV6 : ETH_P_IP), A::PASS);
+
+        if (!ipv6)
+        {
+            a.mov(BPF_REG_5, BPF_REG_2);
+            a.add_imm(BPF_REG_5, ETH_HLEN + IPV4_HLEN + UDP_HLEN);
+            a.jump_reg(BPF_JGT, BPF_REG_5, BPF_REG_3, A::PASS);
+            a.load(BPF_B, BPF_REG_0, BPF_REG_2, ETH_HLEN);  // version/ihl
+            a.and_imm(BPF_REG_0, 0x0f);
+            a.jump(BPF_JNE, BPF_REG_0, IPV4_HLEN / 4, A::PASS);
+            a.load(BPF_B, BPF_REG_0, BPF_REG_2, ETH_HLEN + offsetof(iphdr, protocol));
+            a.jump(BPF_JNE, BPF_REG_0, IPPROTO_UDP, A::PASS);
+            a.load(BPF_H, BPF_REG_0, BPF_REG_2, ETH_HLEN + offsetof(iphdr, frag_off));
+            a.and_imm(BPF_REG_0, htons(IP_MF | IP_OFFMASK));
+            a.jump(BPF_JNE, BPF_REG_0, 0, A::PASS);
+            if (!any)
+            {
+                // Loads are in memory order, so this compares against the address as stored
+                a.load(BPF_W, BPF_REG_0, BPF_REG_2, ETH_HLEN + offsetof(iphdr, daddr));
+                a.jump32(BPF_JNE, BPF_REG_0, static_cast<int32_t>(bound.in4().sin_addr.s_addr), A::PASS);
+            }
+            a.load(BPF_H, BPF_REG_0, BPF_REG_2, ETH_HLEN + IPV4_HLEN + offsetof(udphdr, dest));
+            a.jump(BPF_JNE, BPF_REG_0, nport, A::PASS);
+        }
+        else
+        {
+            a.mov(BPF_REG_5, BPF_REG_2);
+            a.add_imm(BPF_REG_5, ETH_HLEN + IPV6_HLEN + UDP_HLEN);
+            a.jump_reg(BPF_JGT, BPF_REG_5, BPF_REG_3, A::PASS);
+            a.load(BPF_B, BPF_REG_0, BPF_REG_2, ETH_HLEN + offsetof(ip6_hdr, ip6_nxt));
+            a.jump(BPF_JNE, BPF_REG_0, IPPROTO_UDP, A::PASS);
+            if (!any)
+            {
+                std::array<uint32_t, 4> words;
+                std::memcpy(words.data(), &bound.in6().sin6_addr, sizeof(words));
+                for (size_t i = 0; i < words.size(); i++)
+                {
+                    a.load(BPF_W, BPF_REG_0, BPF_REG_2, ETH_HLEN + offsetof(ip6_hdr, ip6_dst) + 4 * i);
+                    a.jump32(BPF_JNE, BPF_REG_0, static_cast<int32_t>(words[i]), A::PASS);
+                }
+            }
+            a.load(BPF_H, BPF_REG_0, BPF_REG_2, ETH_HLEN + IPV6_HLEN + offsetof(udphdr, dest));
+            a.jump(BPF_JNE, BPF_REG_0, nport, A::PASS);
+        }
+
+        a.mark(A::REDIRECT);
+        a.load_map_fd(BPF_REG_1, map_fd);
+        a.mov(BPF_REG_2, BPF_REG_4);
+        a.mov_imm(BPF_REG_3, XDP_PASS);
+        a.call(BPF_FUNC_redirect_map);
+        a.exit();
+
+        a.mark(A::PASS);
+        a.mov_imm(BPF_REG_0, XDP_PASS);
+        a.exit();
+
+        auto& insns = a.finish();
+        prog_fd = bpf_prog_load(BPF_PROG_TYPE_XDP, "libquic_xsk", "GPL", insns.data(), insns.size(), nullptr);
+        if (prog_fd < 0)
+            throw std::runtime_error{"Failed to load XDP program: {}"_format(strerror(errno))};
+
+        if (int rv = bpf_xdp_attach(ifindex, prog_fd, xdp_flags, nullptr); rv < 0)
+            throw std::runtime_error{
+                    "Failed to attach XDP program: {} (is another XDP program already attached?)"_format(strerror(-rv))};
+        attached = true;
+    }
+
+    int xdp_socket::fd() const
+    {
+        return xsk_socket__fd(xsk);
+    }
+
+    size_t xdp_socket::max_payload() const
+    {
+        return FRAME_SIZE - ETH_HLEN - IPV6_HLEN - UDP_HLEN;
+    }
+
+    std::optional<std::tuple<Address, bstring_view, uint8_t>> xdp_socket::parse(
+            uint8_t* frame, size_t len, rx_source& src)
+    {
+        if (len < ETH_HLEN)
+            return std::nullopt;
+        ethhdr eth;
+        std::memcpy(&eth, frame, ETH_HLEN);
+        uint8_t* p = frame + ETH_HLEN;
+        size_t left = len - ETH_HLEN;
+
+        neighbour nb;
+        std::memcpy(nb.local_mac.data(), eth.h_dest, ETH_ALEN);
+        std::memcpy(nb.remote_mac.data(), eth.h_source, ETH_ALEN);
+
+        // Headers are copied out rather than accessed in place, as the IP header is only 2-byte
+        // aligned behind the Ethernet header.
+        Address remote;
+        uint8_t tos;
+        udphdr udp;
+        if (ntohs(eth.h_proto) == ETH_P_IP)
+        {
+            iphdr ip;
+            if (left < IPV4_HLEN + UDP_HLEN)
+                return std::nullopt;
+            std::memcpy(&ip, p, IPV4_HLEN);
+            if (ip.ihl != IPV4_HLEN / 4 || ip.protocol != IPPROTO_UDP || ntohs(ip.tot_len) > left
+                || (ip.frag_off & htons(IP_MF | IP_OFFMASK)))
+                return std::nullopt;
+            left = ntohs(ip.tot_len) - IPV4_HLEN;  // Drops any Ethernet padding
+            p += IPV4_HLEN;
+            std::memcpy(&udp, p, UDP_HLEN);
+
+            sockaddr_in sin{};
+            sin.sin_family = AF_INET;
+            sin.sin_addr.s_addr = ip.saddr;
+            sin.sin_port = udp.source;
+            remote = Address{&sin};
+            sin.sin_addr.s_addr = ip.daddr;
+            sin.sin_port = udp.dest;
+            nb.local = Address{&sin};
+            tos = ip.tos;
+        }
+        else if (ntohs(eth.h_proto) == ETH_P_IPV6)
+        {
+            ip6_hdr ip;
+            if (left < IPV6_HLEN + UDP_HLEN)
+                return std::nullopt;
+            std::memcpy(&ip, p, IPV6_HLEN);
+            if (ip.ip6_nxt != IPPROTO_UDP || ntohs(ip.ip6_plen) > left - IPV6_HLEN)
+                return std::nullopt;
+            left = ntohs(ip.ip6_plen);
+            p += IPV6_HLEN;
+            std::memcpy(&udp, p, UDP_HLEN);
+
+            sockaddr_in6 sin6{};
+            sin6.sin6_family = AF_INET6;
+            sin6.sin6_addr = ip.ip6_src;
+            sin6.sin6_port = udp.source;
+            remote = Address{&sin6};
+            sin6.sin6_addr = ip.ip6_dst;
+            sin6.sin6_port = udp.dest;
+            nb.local = Address{&sin6};
+            tos = static_cast<uint8_t>(ntohl(ip.ip6_flow) >> 20);
+        }
+        else
+            return std::nullopt;
+
+        // We don't verify the UDP checksum (nothing has, when using XDP): a corrupted QUIC packet
+        // fails authentication anyway.
+        size_t udp_len = ntohs(udp.len);
+        if (udp_len < UDP_HLEN || udp_len > left)
+            return std::nullopt;
+
+        // Not a route yet: that waits until the endpoint has authenticated the packet
+        src.remote = remote;
+        src.nb = std::move(nb);
+        src.valid = true;
+
+        return std::make_tuple(
+                std::move(remote),
+                bstring_view{reinterpret_cast<const std::byte*>(p + UDP_HLEN), udp_len - UDP_HLEN},
+                static_cast<uint8_t>(tos & NGTCP2_ECN_MASK));
+    }
+
+    size_t xdp_socket::receive(const receive_callback_t& cb)
+    {
+        assert(received.empty());
+
+        uint32_t idx;
+        auto n = xsk_ring_cons__peek(&rx, DATAGRAM_BATCH_SIZE, &idx);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const auto* desc = xsk_ring_cons__rx_desc(&rx, idx + i);
+            received.push_back(desc->addr);
+            auto& src = rx_sources[desc->addr / FRAME_SIZE];
+            if (auto pkt = parse(static_cast<uint8_t*>(xsk_umem__get_data(umem_area, desc->addr)), desc->len, src))
+            {
+                auto& [remote, data, ecn] = *pkt;
+                cb(remote, data, ecn);
+            }
+        }
+        // The descriptors can go, but the frames only return to the kernel in release_received()
+        xsk_ring_cons__release(&rx, n);
+        return n;
+    }
+
+    void xdp_socket::confirm_route(const Address& remote, bstring_view data)
+    {
+        // Packet data from elsewhere (e.g. the kernel socket) isn't in our receive frames
+        auto offset = reinterpret_cast<uintptr_t>(data.data()) - reinterpret_cast<uintptr_t>(umem_area);
+        if (reinterpret_cast<uintptr_t>(data.data()) < reinterpret_cast<uintptr_t>(umem_area)
+            || offset >= rx_sources.size() * FRAME_SIZE)
+            return;
+        auto& src = rx_sources[offset / FRAME_SIZE];
+        if (!src.valid || !(src.remote == remote))
+            return;
+
+        if (auto it = neighbours.find(remote); it != neighbours.end())
+            it->second = src.nb;
+        else if (neighbours.size() < MAX_NEIGHBOURS)
+            neighbours.emplace(remote, src.nb);
+    }
+
+    void xdp_socket::release_received()
+    {
+        if (received.empty())
+            return;
+
+        for (auto addr : received)
+            rx_sources[addr / FRAME_SIZE].valid = false;
+
+        // The fill ring has room for all of the receive frames, so this always succeeds
+        uint32_t idx;
+        [[maybe_unused]] auto reserved = xsk_ring_prod__reserve(&fill, received.size(), &idx);
+        assert(reserved == received.size());
+        for (size_t i = 0; i < received.size(); i++)
+            *xsk_ring_prod__fill_addr(&fill, idx + i) = received[i];
+        xsk_ring_prod__submit(&fill, received.size());
+        received.clear();
+
+        if (xsk_ring_prod__needs_wakeup(&fill))
+            recvfrom(fd(), nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+
+    void xdp_socket::reclaim_tx()
+    {
+        uint32_t idx;
+        auto n = xsk_ring_cons__peek(&comp, frame_count / 2, &idx);
+        for (uint32_t i = 0; i < n; i++)
+            free_tx.push_back(*xsk_ring_cons__comp_addr(&comp, idx + i));
+        xsk_ring_cons__release(&comp, n);
+    }
+
+    size_t xdp_socket::build(uint8_t* frame, const neighbour& nb, const Address& dest, bstring_view payload, uint8_t tos)
+    {
+        ethhdr eth;
+        std::memcpy(eth.h_dest, nb.remote_mac.data(), ETH_ALEN);
+        std::memcpy(eth.h_source, nb.local_mac.data(), ETH_ALEN);
+        eth.h_proto = htons(dest.is_ipv6() ? ETH_P_IPV6 : ETH_P_IP);
+        std::memcpy(frame, &eth, ETH_HLEN);
+        uint8_t* p = frame + ETH_HLEN;
+
+        udphdr udp{};
+        udp.len = htons(static_cast<uint16_t>(UDP_HLEN + payload.size()));
+
+        if (dest.is_ipv6())
+        {
+            udp.source = nb.local.in6().sin6_port;
+            udp.dest = dest.in6().sin6_port;
+
+            ip6_hdr ip{};
+            ip.ip6_flow = htonl((uint32_t{6} << 28) | (uint32_t{tos} << 20));
+            ip.ip6_plen = udp.len;
+            ip.ip6_nxt = IPPROTO_UDP;
+            ip.ip6_hops = 64;
+            ip.ip6_src = nb.local.in6().sin6_addr;
+            ip.ip6_dst = dest.in6().sin6_addr;
+
+            // The UDP checksum is mandatory over IPv6; it covers a pseudo-header of the addresses,
+            // length, and protocol, plus the UDP header and payload.
+            uint32_t sum = csum_add(0, &ip.ip6_src, sizeof(ip.ip6_src));
+            sum = csum_add(sum, &ip.ip6_dst, sizeof(ip.ip6_dst));
+            sum += UDP_HLEN + payload.size();
+            sum += IPPROTO_UDP;
+            sum = csum_add(sum, &udp, UDP_HLEN);
+            sum = csum_add(sum, payload.data(), payload.size());
+            udp.check = csum_finish(sum);
+            if (udp.check == 0)
+                udp.check = 0xffff;
+
+            std::memcpy(p, &ip, IPV6_HLEN);
+            p += IPV6_HLEN;
+        }
+        else
+        {
+            udp.source = nb.local.in4().sin_port;
+            udp.dest = dest.in4().sin_port;
+
+            iphdr ip{};
+            ip.version = 4;
+            ip.ihl = IPV4_HLEN / 4;
+            ip.tos = tos;
+            ip.tot_len = htons(static_cast<uint16_t>(IPV4_HLEN + UDP_HLEN + payload.size()));
+            ip.frag_off = htons(IP_DF);
+            ip.ttl = 64;
+            ip.protocol = IPPROTO_UDP;
+            ip.saddr = nb.local.in4().sin_addr.s_addr;
+            ip.daddr = dest.in4().sin_addr.s_addr;
+            ip.check = csum_finish(csum_add(0, &ip, IPV4_HLEN));
+            // (The UDP checksum is optional over IPv4, so we leave it as 0)
+
+            std::memcpy(p, &ip, IPV4_HLEN);
+            p += IPV4_HLEN;
+        }
+
+        std::memcpy(p, &udp, UDP_HLEN);
+        std::memcpy(p + UDP_HLEN, payload.data(), payload.size());
+        return p + UDP_HLEN + payload.size() - frame;
+    }
+
+    std::pair<io_result, size_t> xdp_socket::send(
+            const Address& dest, const std::byte* bufs, const size_t* bufsize, uint8_t tos, size_t n_pkts)
+    {
+        auto it = neighbours.find(dest);
+        assert(it != neighbours.end());
+        const auto& nb = it->second;
+
+        // An oversized packet would overrun its UMEM frame into the next one (or past the end)
+        if (!fits(bufsize, n_pkts))
+        {
+            log::warning(log_cat, "Refusing to send packet(s) larger than the {}B AF_XDP frame payload", max_payload());
+            return {io_result{EMSGSIZE}, 0};
+        }
+
+        if (free_tx.size() < n_pkts)
+            reclaim_tx();
+        const auto n = std::min(n_pkts, free_tx.size());
+
+        uint32_t idx;
+        if (n == 0 || xsk_ring_prod__reserve(&tx, n, &idx) != n)
+            return {io_result{EAGAIN}, 0};
+
+        for (size_t i = 0; i < n; i++)
+        {
+            auto addr = free_tx.back();
+            free_tx.pop_back();
+            auto* desc = xsk_ring_prod__tx_desc(&tx, idx + i);
+            desc->addr = addr;
+            desc->len = build(
+                    static_cast<uint8_t*>(xsk_umem__get_data(umem_area, addr)), nb, dest, {bufs, bufsize[i]}, tos);
+            bufs += bufsize[i];
+        }
+        xsk_ring_prod__submit(&tx, n);
+
+        // Kick the kernel into sending (always required in generic mode)
+        if (xsk_ring_prod__needs_wakeup(&tx))
+            sendto(fd(), nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+
+        return {n < n_pkts ? io_result{EAGAIN} : io_result{}, n};
+    }
+}  // namespace oxen::quic
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "opt.hpp"
+#include "utils.hpp"
+
+#ifdef OXEN_LIBQUIC_XDP
+#include <xdp/xsk.h>
+#endif
+
+namespace oxen::quic
+{
+#ifdef OXEN_LIBQUIC_XDP
+
+    // AF_XDP packet I/O backend used by UDPSocket when given opt::xdp.  This owns the UMEM (the
+    // packet memory shared with the kernel), the XSK (AF_XDP socket) bound to one queue of the
+    // interface, and the XDP program that redirects UDP packets for our port to the XSK while
+    // passing everything else on to the kernel stack.
+    //
+    // Received packets are handed out as views directly into UMEM frames (there is no copy into a
+    // separate receive buffer), which remain valid until `release_received()` is called; outgoing
+    // packets are written into UMEM frames behind Ethernet/IP/UDP headers we construct ourselves.
+    // Building those headers requires the peer's (or gateway's) MAC address and our own address,
+    // which we learn from received packets, but only once the endpoint has authenticated one (see
+    // `confirm_route`): anyone can send us a packet with a forged source, and learning from that
+    // would let them redirect our traffic to another remote.  Sending to a remote without a
+    // confirmed route is left to the regular kernel socket (see `has_route`).
+    //
+    // Only packets the kernel socket would otherwise have received are redirected: UDP to the bound
+    // port (and address, unless bound to the any address) of the bound address family, with no
+    // IPv4 options, fragmentation, or IPv6 extension headers.  (Thus IPv4 packets for a
+    // dual-stack socket also stay with the kernel socket).
+    //
+    // Only used from the event loop thread.
+    class xdp_socket
+    {
+      public:
+        // Sets up the UMEM, XSK, and XDP program for `conf`, redirecting UDP packets addressed to
+        // `bound` (our kernel socket's bound address).  Throws std::runtime_error on failure.
+        xdp_socket(const opt::xdp& conf, const Address& bound);
+        ~xdp_socket();
+
+        xdp_socket(const xdp_socket&) = delete;
+        xdp_socket& operator=(const xdp_socket&) = delete;
+
+        // The XSK file descriptor, which becomes readable when packets arrive in the RX ring.
+        int fd() const;
+
+        using receive_callback_t = std::function<void(const Address& remote, bstring_view data, uint8_t ecn)>;
+
+        // Reads up to DATAGRAM_BATCH_SIZE packets from the RX ring, passing each to `cb`.  The data
+        // remains valid until `release_received()` is called.  Returns the number of packets read.
+        size_t receive(const receive_callback_t& cb);
+
+        // Returns the frames of the packets from the last `receive()` to the kernel's fill ring.
+        void release_received();
+
+        // Records the addressing of the packet from the last `receive()` with payload `data` from
+        // `remote` as the route for sending to `remote`.  To be called only once the packet has
+        // been authenticated (i.e. successfully decrypted); does nothing if `data` isn't the
+        // payload of such a packet.
+        void confirm_route(const Address& remote, bstring_view data);
+
+        // True if we know how to address packets to `dest` (i.e. we have received an authenticated
+        // packet from it).
+        bool has_route(const Address& dest) const { return neighbours.count(dest); }
+
+        // Sends packets as UDPSocket::send (which see); `dest` must satisfy `has_route`, and the
+        // packets must all satisfy `fits` (otherwise nothing is sent and EMSGSIZE returned).  This
+        // blocks (returning EAGAIN) when no TX frames are free, i.e. when the kernel hasn't yet
+        // completed enough of our earlier sends; the socket's fd polls writeable once it has.
+        std::pair<io_result, size_t> send(
+                const Address& dest, const std::byte* bufs, const size_t* bufsize, uint8_t tos, size_t n_pkts);
+
+        // Maximum UDP payload we can send or receive: a frame less the headers.
+        size_t max_payload() const;
+
+        // True if all `n_pkts` packets (of sizes `bufsize`) fit in a frame.
+        bool fits(const size_t* bufsize, size_t n_pkts) const
+        {
+            return std::all_of(bufsize, bufsize + n_pkts, [max = max_payload()](size_t s) { return s <= max; });
+        }
+
+      private:
+        // What we learned about a remote from packets received from it: the MAC addresses and our
+        // local IP address to use for replies.
+        struct neighbour
+        {
+            std::array<uint8_t, 6> local_mac;
+            std::array<uint8_t, 6> remote_mac;
+            Address local;
+        };
+
+        // Upper bound on the number of neighbours we keep track of; beyond this, packets to new
+        // remotes go via the kernel socket.
+        static constexpr size_t MAX_NEIGHBOURS = 65536;
+
+        int ifindex{0};
+        uint32_t xdp_flags{0};
+        int map_fd{-1};
+        int prog_fd{-1};
+        bool attached{false};
+
+        size_t frame_count;
+        void* umem_area{nullptr};
+        xsk_umem* umem{nullptr};
+        xsk_socket* xsk{nullptr};
+        xsk_ring_prod fill;
+        xsk_ring_cons comp;
+        xsk_ring_cons rx;
+        xsk_ring_prod tx;
+
+        // UMEM addresses of free TX frames, and the RX frames handed out by the last receive().
+        std::vector<uint64_t> free_tx;
+        std::vector<uint64_t> received;
+
+        std::unordered_map<Address, neighbour> neighbours;
+
+        // Where each receive frame's current packet came from (indexed by frame; the receive frames
+        // are the first half of the UMEM), pending `confirm_route`.  Valid until the frame is
+        // released.
+        struct rx_source
+        {
+            Address remote;
+            neighbour nb;
+            bool valid{false};
+        };
+        std::vector<rx_source> rx_sources;
+
+        // Creates the XSK map and loads the XDP program redirecting packets for `bound` to the map
+        // entry for the receiving queue, then attaches it to the interface.
+        void load_program(const Address& bound, uint32_t queue);
+
+        // Releases everything we have set up so far; used by the destructor and on failure during
+        // construction.
+        void cleanup();
+
+        // Moves frames of completed sends from the completion ring back to `free_tx`.
+        void reclaim_tx();
+
+        // Parses an Ethernet frame, returning the remote address, UDP payload, and ECN bits of a
+        // UDP packet (and recording its source in `src`); returns nullopt for anything else.
+        std::optional<std::tuple<Address, bstring_view, uint8_t>> parse(uint8_t* frame, size_t len, rx_source& src);
+
+        // Writes the headers and payload for a packet to `dest` into `frame`, returning the frame
+        // length.
+        size_t build(uint8_t* frame, const neighbour& n, const Address& dest, bstring_view payload, uint8_t tos);
+    };
+
+#else
+
+    // Placeholder so that UDPSocket's (always empty) xdp_socket pointer is destructible in builds
+    // without AF_XDP support.
+    class xdp_socket
+    {};
+
+#endif
+}  // namespace oxen::quic
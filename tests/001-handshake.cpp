@@ -1,4 +1,5 @@
 #include <catch2/catch_test_macros.hpp>
+#include <future>
 #include <quic.hpp>
 #include <quic/gnutls_crypto.hpp>
 #include <thread>
@@ -57,4 +58,55 @@ namespace oxen::quic::test
         REQUIRE(good);
         test_net.close();
     };
+
+    TEST_CASE("001: Stateless reset after server restart", "[001][handshake][reset]")
+    {
+        logger_config();
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+        // The restarted server derives the same reset tokens from the same secret
+        opt::static_secret secret{bstring(32, std::byte{0x42})};
+
+        std::promise<void> received_prom;
+        auto received = received_prom.get_future();
+        stream_data_callback_t server_data_cb = [&](Stream&, bstring_view) { received_prom.set_value(); };
+
+        auto server_net = std::make_unique<Network>();
+        auto server = server_net->endpoint(server_local, secret);
+        REQUIRE(server->listen(server_tls, server_data_cb));
+
+        Network client_net{};
+        auto client = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 4400});
+        auto conn = client->connect(client_remote, client_tls);
+        auto stream = conn->get_new_stream();
+        stream->send("hello"_bsv);
+        REQUIRE(received.wait_for(1s) == std::future_status::ready);
+
+        // "Restart" the server without closing its connection
+        server.reset();
+        server_net->close(false).get();
+        server_net = std::make_unique<Network>();
+        server = server_net->endpoint(server_local, secret);
+        stream_data_callback_t ignore_data_cb = [](Stream&, bstring_view) {};
+        REQUIRE(server->listen(server_tls, ignore_data_cb));
+
+        // The next packet from the client gets a stateless reset, which the client recognizes (by
+        // the token from the old server's transport parameters) and so drops the connection right
+        // away rather than after an idle timeout.
+        stream->send("anyone there?"_bsv);
+        bool dropped = false;
+        for (auto until = std::chrono::steady_clock::now() + 3s; !dropped && std::chrono::steady_clock::now() < until;)
+        {
+            std::this_thread::sleep_for(25ms);
+            dropped = client->get_all_conns().empty();
+        }
+        CHECK(dropped);
+
+        client_net.close();
+        server_net->close();
+    };
 }  // namespace oxen::quic::test
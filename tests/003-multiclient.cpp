@@ -1,4 +1,5 @@
 #include <catch2/catch_test_macros.hpp>
+#include <future>
 #include <quic.hpp>
 #include <quic/gnutls_crypto.hpp>
 #include <thread>
@@ -88,4 +89,41 @@ namespace oxen::quic::test
         REQUIRE(data_check == 4);
         test_net.close();
     };
+
+    TEST_CASE("003: Batched close of many connections", "[003][multi-client][close]")
+    {
+        logger_config();
+
+        Network server_net{};
+        Network client_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        auto server_endpoint = server_net.endpoint(opt::local_addr{"127.0.0.1"s, 5500});
+        REQUIRE(server_endpoint->listen(server_tls));
+
+        constexpr size_t num_conns = 50;
+        auto client_endpoint = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 4400});
+        for (size_t i = 0; i < num_conns; i++)
+            client_endpoint->connect(opt::remote_addr{"127.0.0.1"s, 5500}, client_tls);
+
+        std::this_thread::sleep_for(600ms);
+        REQUIRE(server_endpoint->snapshot()->connections.size() == num_conns);
+
+        // Closing the client network completes once all of its close packets are sent, which then
+        // puts every connection on the server side into draining (or gets them removed already)
+        // long before any idle timeout would.  That has to happen well within the 1s deadline
+        // after which close() gives up on unsent close packets, or we've only tested the deadline.
+        auto close_start = std::chrono::steady_clock::now();
+        auto closed = client_net.close();
+        REQUIRE(closed.wait_for(2s) == std::future_status::ready);
+        CHECK(std::chrono::steady_clock::now() - close_start < 500ms);
+
+        std::this_thread::sleep_for(600ms);
+        for (const auto& c : server_endpoint->snapshot()->connections)
+            CHECK(c.draining);
+
+        server_net.close();
+    };
 }  // namespace oxen::quic::test
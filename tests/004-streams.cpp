@@ -69,7 +69,7 @@ namespace oxen::quic::test
 
         std::this_thread::sleep_for(100ms);
 
-        auto* conn = client_endpoint->get_conn(conn_interface->scid());
+        auto conn = client_endpoint->get_conn(conn_interface->scid());
 
         REQUIRE(conn);
         CHECK(conn->num_pending() == 1);
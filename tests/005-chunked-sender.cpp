@@ -1,8 +1,10 @@
 #include <catch2/catch_test_macros.hpp>
+#include <future>
 #include <iterator>
 #include <quic.hpp>
 #include <quic/gnutls_crypto.hpp>
 #include <thread>
+#include <utility>
 
 namespace oxen::quic::test
 {
@@ -98,4 +100,125 @@ namespace oxen::quic::test
 
         test_net.close();
     };
+
+    TEST_CASE("005: Chunked stream sending from a worker thread", "[005][chunked][async]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        std::mutex recv_mut;
+        std::string received;
+        std::promise<void> got_all_prom;
+        auto got_all = got_all_prom.get_future();
+        stream_data_callback_t stream_data_cb = [&](Stream&, bstring_view data) {
+            std::lock_guard lock{recv_mut};
+            received.append(reinterpret_cast<const char*>(data.data()), data.size());
+            if (received.size() >= 8 && received.compare(received.size() - 8, 8, "Goodbye.") == 0)
+                got_all_prom.set_value();
+        };
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        server_endpoint->listen(server_tls, stream_data_cb);
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls);
+
+        auto stream = conn_interface->get_new_stream();
+        stream->send("HELLO!"s);
+
+        REQUIRE_THROWS_AS(stream->send_chunks_async([] { return ""s; }, nullptr, 0), std::logic_error);
+        REQUIRE_THROWS_AS(stream->send_chunks_async([] { return ""s; }, nullptr, 2, 0), std::logic_error);
+
+        // The chunk callback must run on the worker, while `done` runs on the event loop thread
+        std::thread::id producer_thread, loop_thread;
+
+        int i = 0;
+        constexpr int parallel_chunks = 2, prefetch = 3;
+        std::array<std::vector<char>, parallel_chunks + prefetch + 1> bufs;
+
+        stream->send_chunks_async(
+                [&]() -> std::vector<char>* {
+                    producer_thread = std::this_thread::get_id();
+                    if (i++ >= 20)
+                        return nullptr;
+                    auto& vec = bufs[i % bufs.size()];
+                    vec.clear();
+                    // Pretend this is expensive, so that the stream has to wait on us some of the time
+                    std::this_thread::sleep_for(1ms);
+                    fmt::format_to(std::back_inserter(vec), "[chunk-{}]", i);
+                    return &vec;
+                },
+                [&](Stream& s) {
+                    loop_thread = std::this_thread::get_id();
+                    s.send("Goodbye."s);
+                },
+                parallel_chunks,
+                prefetch);
+
+        REQUIRE(got_all.wait_for(2s) == std::future_status::ready);
+
+        std::string expected = "HELLO!";
+        for (int j = 1; j <= 20; j++)
+            expected += fmt::format("[chunk-{}]", j);
+        expected += "Goodbye.";
+        {
+            std::lock_guard lock{recv_mut};
+            CHECK(received == expected);
+        }
+        CHECK(producer_thread != loop_thread);
+
+        test_net.close();
+    };
+
+    TEST_CASE("005: Chunk producer threads are joined on shutdown", "[005][chunked][async]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        auto server_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        REQUIRE(server_endpoint->listen(server_tls));
+        opt::remote_addr client_remote{"127.0.0.1"s, server_endpoint->get_socket()->address().port()};
+
+        auto client_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls);
+
+        // One producer is in the middle of (slowly) producing a chunk at shutdown, the other
+        // (endless) one is waiting for room in its full prefetch queue.
+        std::promise<void> entered_prom;
+        auto entered = entered_prom.get_future();
+        std::atomic<bool> returned{false};
+        bool first = true;
+        auto slow = conn_interface->get_new_stream();
+        slow->send_chunks_async([&] {
+            if (std::exchange(first, false))
+            {
+                entered_prom.set_value();
+                std::this_thread::sleep_for(300ms);
+                returned = true;
+            }
+            return "slow"s;
+        });
+
+        auto endless = conn_interface->get_new_stream();
+        endless->send_chunks_async([] { return "endless"s; });
+
+        REQUIRE(entered.wait_for(1s) == std::future_status::ready);
+
+        // The streams are still alive (we hold them), so the Network has to stop and join their
+        // producers itself: once shutdown completes, nothing may still be running in them.
+        test_net.close().get();
+        CHECK(returned);
+    };
 }  // namespace oxen::quic::test
@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("008: Batched stream data delivery", "[008][streams][batch]")
+    {
+        logger_config();
+
+        log::debug(log_cat, "Beginning test of batched stream data delivery...");
+
+        Network test_net{};
+
+        constexpr size_t num_sends = 200, send_size = 1000;
+
+        std::atomic<size_t> received{0}, callbacks{0};
+        std::atomic<bool> in_order{true};
+
+        stream_data_callback_t server_data_cb = [&](Stream&, bstring_view dat) {
+            // Each send is filled with the byte value (send# % 256), so we can verify that data
+            // arrives in order across the aggregated deliveries.
+            size_t offset = received;
+            for (size_t i = 0; i < dat.size(); i++)
+                if (dat[i] != static_cast<std::byte>(((offset + i) / send_size) % 256))
+                    in_order = false;
+            received += dat.size();
+            callbacks++;
+        };
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, server_data_cb, opt::batch_stream_data{}));
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls);
+
+        std::this_thread::sleep_for(100ms);
+
+        auto client_stream = conn_interface->get_new_stream();
+        for (size_t i = 0; i < num_sends; i++)
+            client_stream->send(std::basic_string<std::byte>(send_size, static_cast<std::byte>(i % 256)));
+
+        std::this_thread::sleep_for(250ms);
+
+        CHECK(received == num_sends * send_size);
+        CHECK(in_order);
+#ifdef OXEN_LIBQUIC_RECVMMSG
+        // The data cannot fit in fewer than one STREAM frame per (1500B MTU) packet, so if we got
+        // fewer callbacks than that then at least some of the frames were aggregated.
+        CHECK(callbacks < num_sends * send_size / 1500);
+#endif
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
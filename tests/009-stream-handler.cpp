@@ -0,0 +1,89 @@
+#include <catch2/catch_test_macros.hpp>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("009: Stream handler and user data slots", "[009][streams][handler]")
+    {
+        logger_config();
+
+        log::debug(log_cat, "Beginning test of stream handler and user data...");
+
+        Network test_net{};
+
+        struct stream_state
+        {
+            size_t received = 0;
+            std::atomic<size_t>* total_closed;
+            explicit stream_state(std::atomic<size_t>* closed) : total_closed{closed} {}
+            ~stream_state() { (*total_closed)++; }
+        };
+
+        std::atomic<size_t> states_destroyed{0};
+
+        struct test_handler final : stream_handler
+        {
+            std::atomic<size_t> data_calls{0}, bytes{0}, closes{0};
+            std::atomic<size_t>* destroyed;
+            explicit test_handler(std::atomic<size_t>* d) : destroyed{d} {}
+
+            void on_data(Stream& s, bstring_view data) override
+            {
+                auto* st = s.user_data<stream_state>();
+                if (!st)
+                    st = &s.emplace_user_data<stream_state>(destroyed);
+                st->received += data.size();
+                data_calls++;
+                bytes += data.size();
+            }
+
+            void on_close(Stream&, uint64_t) override { closes++; }
+        };
+
+        auto handler = std::make_shared<test_handler>(&states_destroyed);
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, handler));
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls);
+
+        int conn_tag = 42;
+        conn_interface->set_user_data(&conn_tag);
+        CHECK(conn_interface->user_data<int>() == &conn_tag);
+
+        std::this_thread::sleep_for(100ms);
+
+        auto s1 = conn_interface->get_new_stream();
+        auto s2 = conn_interface->get_new_stream();
+        s1->send("hello"sv);
+        s2->send("world!"sv);
+
+        std::this_thread::sleep_for(100ms);
+
+        CHECK(handler->data_calls >= 2);
+        CHECK(handler->bytes == 11);
+
+        s1->close();
+        s2->close();
+
+        std::this_thread::sleep_for(100ms);
+
+        // Closing the streams should have notified the handler and destroyed the owned stream state
+        CHECK(handler->closes == 2);
+        CHECK(states_destroyed == 2);
+
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
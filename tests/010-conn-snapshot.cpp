@@ -0,0 +1,165 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("010: Connection registry snapshots", "[010][snapshot]")
+    {
+        logger_config();
+
+        log::debug(log_cat, "Beginning test of connection snapshots...");
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls));
+
+        auto initial = server_endpoint->snapshot();
+        REQUIRE(initial);
+        CHECK(initial->connections.empty());
+
+        // Nothing changes on an idle endpoint, so once its first snapshot is out no more get built
+        std::this_thread::sleep_for(300ms);
+        auto idle = server_endpoint->snapshot();
+        std::this_thread::sleep_for(600ms);
+        CHECK(server_endpoint->snapshot() == idle);
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls);
+
+        auto stream = conn_interface->get_new_stream();
+        stream->send("hello"sv);
+
+        // Snapshots are published every 250ms
+        std::this_thread::sleep_for(600ms);
+
+        auto snap = server_endpoint->snapshot();
+        REQUIRE(snap);
+        CHECK(snap->epoch > initial->epoch);
+        REQUIRE(snap->connections.size() == 1);
+        const auto& cs = snap->connections.front();
+        CHECK(cs.direction == Direction::INBOUND);
+        CHECK(cs.path.remote == Address{"127.0.0.1"s, 4400});
+        CHECK(cs.streams == 1);
+        CHECK(cs.smoothed_rtt > 0ns);
+
+        auto client_snap = client_endpoint->snapshot();
+        REQUIRE(client_snap->connections.size() == 1);
+        CHECK(client_snap->connections.front().scid == conn_interface->scid());
+        CHECK(client_snap->connections.front().direction == Direction::OUTBOUND);
+
+        // The snapshot we hold is unaffected by later changes
+        test_net.close();
+        CHECK(snap->connections.size() == 1);
+    };
+
+    TEST_CASE("010: Rate limited connection snapshots", "[010][snapshot][rate_limit]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        REQUIRE_THROWS_AS(opt::rate_limit{0}, std::invalid_argument);
+
+        std::atomic<size_t> received{0};
+        stream_data_callback_t server_data_cb = [&](Stream&, bstring_view data) { received += data.size(); };
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, server_data_cb));
+
+        // 1MB/s with the minimum 16kB burst: sending 400kB has to be spread over ~400ms
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls, opt::rate_limit{1'000'000});
+
+        auto stream = conn_interface->get_new_stream();
+        auto started = std::chrono::steady_clock::now();
+        stream->send(std::string(400'000, 'x'));
+
+        while (received < 400'000 && std::chrono::steady_clock::now() - started < 5s)
+            std::this_thread::sleep_for(10ms);
+        auto elapsed = std::chrono::steady_clock::now() - started;
+
+        REQUIRE(received == 400'000);
+        CHECK(elapsed >= 350ms);
+
+        // Wait for the next snapshot
+        std::this_thread::sleep_for(300ms);
+
+        auto snap = client_endpoint->snapshot();
+        REQUIRE(snap->connections.size() == 1);
+        CHECK(snap->connections.front().throttled > 100ms);
+        // No endpoint-wide limit was set
+        CHECK(snap->throttled == 0ns);
+
+        test_net.close();
+    };
+
+    TEST_CASE("010: Endpoint-wide rate limit", "[010][snapshot][rate_limit]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        std::atomic<size_t> received{0};
+        stream_data_callback_t server_data_cb = [&](Stream&, bstring_view data) { received += data.size(); };
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, server_data_cb));
+
+        // 1MB/s (16kB burst) shared by two unlimited connections: their combined 400kB has to be
+        // spread over ~400ms, however the bucket gets split between them.
+        auto client_endpoint = test_net.endpoint(client_local, opt::rate_limit{1'000'000});
+        auto conn_a = client_endpoint->connect(client_remote, client_tls);
+        auto conn_b = client_endpoint->connect(client_remote, client_tls);
+
+        auto stream_a = conn_a->get_new_stream();
+        auto stream_b = conn_b->get_new_stream();
+        auto started = std::chrono::steady_clock::now();
+        stream_a->send(std::string(200'000, 'a'));
+        stream_b->send(std::string(200'000, 'b'));
+
+        while (received < 400'000 && std::chrono::steady_clock::now() - started < 5s)
+            std::this_thread::sleep_for(10ms);
+        auto elapsed = std::chrono::steady_clock::now() - started;
+
+        REQUIRE(received == 400'000);
+        CHECK(elapsed >= 350ms);
+
+        // Wait for the next snapshot
+        std::this_thread::sleep_for(300ms);
+
+        auto snap = client_endpoint->snapshot();
+        REQUIRE(snap->connections.size() == 2);
+        CHECK(snap->throttled > 100ms);
+        for (const auto& cs : snap->connections)
+            CHECK(cs.throttled > 0ns);
+
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
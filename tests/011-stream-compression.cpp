@@ -0,0 +1,214 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <map>
+#include <mutex>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <random>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("011: Per-stream compression", "[011][streams][compression]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        auto server_endpoint = test_net.endpoint(server_local);
+
+#ifndef OXEN_LIBQUIC_ZSTD
+        // Without zstd support the option must be refused rather than silently ignored
+        REQUIRE_THROWS_AS(server_endpoint->listen(server_tls, opt::stream_compression{}), std::invalid_argument);
+#else
+        std::mutex mut;
+        std::map<int64_t, std::string> server_received;
+        std::string client_received;
+
+        // The server echoes everything back, so the reply goes through the server's compressor
+        stream_data_callback_t server_data_cb = [&](Stream& s, bstring_view data) {
+            {
+                std::lock_guard lock{mut};
+                server_received[s.stream_id].append(reinterpret_cast<const char*>(data.data()), data.size());
+            }
+            s.send(std::basic_string<std::byte>{data});
+        };
+        stream_data_callback_t client_data_cb = [&](Stream&, bstring_view data) {
+            std::lock_guard lock{mut};
+            client_received.append(reinterpret_cast<const char*>(data.data()), data.size());
+        };
+
+        REQUIRE(server_endpoint->listen(server_tls, server_data_cb, opt::stream_compression{}));
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls, opt::stream_compression{});
+
+        std::this_thread::sleep_for(100ms);
+
+        // Something compressible, sent in several pieces so that it spans multiple flushes
+        std::string msg;
+        for (int i = 0; msg.size() < 200'000; i++)
+            msg += "{\"id\":" + std::to_string(i) + ",\"name\":\"item\",\"tags\":[\"a\",\"b\",\"c\"]}\n";
+
+        auto compressed = conn_interface->get_new_stream(client_data_cb);
+        auto plain = conn_interface->get_new_stream();
+        plain->set_compression(false);
+
+        for (size_t pos = 0; pos < msg.size(); pos += 50'000)
+            compressed->send(std::string{msg.substr(pos, 50'000)});
+        plain->send("uncompressed"sv);
+
+        std::this_thread::sleep_for(500ms);
+
+        CHECK(compressed->compressed());
+        CHECK_FALSE(plain->compressed());
+
+        // Fewer bytes must actually go on the wire; the uncompressed stream sends the data plus the
+        // one byte stream-open header.
+        CHECK(compressed->bytes_sent() < msg.size() / 4);
+        CHECK(plain->bytes_sent() == 13);
+
+        {
+            std::lock_guard lock{mut};
+            CHECK(server_received[compressed->stream_id] == msg);
+            CHECK(server_received[plain->stream_id] == "uncompressed");
+            CHECK(client_received == msg);
+        }
+#endif
+
+        test_net.close();
+    };
+
+#ifdef OXEN_LIBQUIC_ZSTD
+    TEST_CASE("011: Adaptive compression level", "[011][streams][compression][adaptive]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, [](Stream&, bstring_view) {}, opt::stream_compression{}));
+
+        // A slow link with plenty of CPU to spare: data piles up behind the rate limit, so the
+        // adaptive level should be raised from its starting point.
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface =
+                client_endpoint->connect(client_remote, client_tls, opt::stream_compression{}, opt::rate_limit{200'000});
+
+        auto stream = conn_interface->get_new_stream();
+
+        // Only moderately compressible, so that the compressed data alone outruns the link
+        std::mt19937 rng{42};
+        auto make_chunk = [&] {
+            std::string chunk;
+            while (chunk.size() < 100'000)
+                chunk += "{\"id\":" + std::to_string(rng()) + ",\"value\":" + std::to_string(rng() % 100'000) + "}\n";
+            return chunk;
+        };
+
+        const int start_level = stream->compression_level();
+        CHECK(start_level > 0);
+
+        for (int i = 0; i < 50 && stream->compression_level() <= start_level; i++)
+        {
+            stream->send(make_chunk());
+            std::this_thread::sleep_for(25ms);
+        }
+
+        CHECK(stream->compressed());
+        CHECK(stream->compression_level() > start_level);
+
+        test_net.close();
+    };
+
+    TEST_CASE("011: Undecodable stream data", "[011][streams][compression][bad-encoding]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        std::atomic<bool> server_got_data{false};
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(
+                server_tls, [&](Stream&, bstring_view) { server_got_data = true; }, opt::stream_compression{}));
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls, opt::stream_compression{});
+
+        std::promise<uint64_t> closed_prom;
+        auto closed = closed_prom.get_future();
+        auto stream = conn_interface->get_new_stream(
+                nullptr, [&](Stream&, uint64_t error_code) { closed_prom.set_value(error_code); });
+
+        // Not a valid stream-open header, so the server can't decode anything on this stream
+        stream->simulate_raw_send("\x07not a stream header"_bsv);
+
+        REQUIRE(closed.wait_for(1s) == std::future_status::ready);
+        CHECK(closed.get() == STREAM_ERROR_BAD_ENCODING);
+        CHECK_FALSE(server_got_data);
+
+        test_net.close();
+    };
+
+    TEST_CASE("011: Stream compression enabled on one side only", "[011][streams][compression][negotiation]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        std::promise<bstring> received_prom;
+        auto received = received_prom.get_future();
+
+        // Only the client asks for compression: the handshake doesn't agree on it, so both sides
+        // must fall back to the plain framing.
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, [&](Stream&, bstring_view data) {
+            received_prom.set_value(bstring{data});
+        }));
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls, opt::stream_compression{});
+
+        auto stream = conn_interface->get_new_stream();
+        auto msg = "hello uncompressed"_bsv;
+        stream->send(msg);
+
+        REQUIRE(received.wait_for(1s) == std::future_status::ready);
+        CHECK(received.get() == msg);
+        CHECK_FALSE(stream->compressed());
+        CHECK(stream->bytes_sent() == msg.size());
+
+        test_net.close();
+    };
+#endif
+}  // namespace oxen::quic::test
@@ -0,0 +1,67 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("012: AF_XDP endpoint", "[012][xdp]")
+    {
+        logger_config();
+
+        REQUIRE_THROWS_AS(opt::xdp{""}, std::invalid_argument);
+        REQUIRE_THROWS_AS(opt::xdp("lo", 0, false, 1000), std::invalid_argument);
+
+        Network test_net{};
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+#ifndef OXEN_LIBQUIC_XDP
+        REQUIRE_THROWS_AS(test_net.endpoint(server_local, opt::xdp{"lo"}), std::invalid_argument);
+#else
+        // Generic-mode XDP works on the loopback interface, but needs CAP_NET_ADMIN/CAP_BPF; without
+        // them there is nothing more we can test here.
+        std::shared_ptr<Endpoint> server_endpoint;
+        try
+        {
+            server_endpoint = test_net.endpoint(server_local, opt::xdp{"lo"});
+        }
+        catch (const std::runtime_error& e)
+        {
+            test_net.close();
+            SKIP("Unable to set up AF_XDP on lo (" << e.what() << ")");
+        }
+        REQUIRE(server_endpoint->get_socket()->is_xdp());
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        // The server echoes back what it receives: requests arrive via the XDP program redirect,
+        // and replies go out through the AF_XDP TX ring.
+        stream_data_callback_t server_data_cb = [](Stream& s, bstring_view data) {
+            s.send(std::basic_string<std::byte>{data});
+        };
+        REQUIRE(server_endpoint->listen(server_tls, server_data_cb));
+
+        std::promise<bstring> reply_prom;
+        auto reply = reply_prom.get_future();
+        stream_data_callback_t client_data_cb = [&](Stream&, bstring_view data) { reply_prom.set_value(bstring{data}); };
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls);
+        auto stream = conn_interface->get_new_stream(client_data_cb);
+        auto msg = "hello over xdp"_bsv;
+        stream->send(msg);
+
+        REQUIRE(reply.wait_for(2s) == std::future_status::ready);
+        CHECK(reply.get() == msg);
+#endif
+
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
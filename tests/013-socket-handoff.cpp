@@ -0,0 +1,105 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+#ifndef _WIN32
+    TEST_CASE("013: Zero-downtime socket handoff", "[013][handoff]")
+    {
+        logger_config();
+
+        // Separate Networks stand in for the old and new server processes (and the clients)
+        Network old_net{}, new_net{}, client_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+        const std::string path = "/tmp/libquic-test-013-handoff.sock";
+
+        std::promise<void> old_before_prom, old_after_prom, new_prom, drained_prom;
+        auto old_before = old_before_prom.get_future();
+        auto old_after = old_after_prom.get_future();
+        auto new_received = new_prom.get_future();
+        auto drained = drained_prom.get_future();
+
+        stream_data_callback_t old_data_cb = [&](Stream&, bstring_view data) {
+            if (data == "before"_bsv)
+                old_before_prom.set_value();
+            else if (data == "after"_bsv)
+                old_after_prom.set_value();
+        };
+        stream_data_callback_t new_data_cb = [&](Stream&, bstring_view data) {
+            if (data == "new"_bsv)
+                new_prom.set_value();
+        };
+
+        auto old_server = old_net.endpoint(server_local);
+        REQUIRE(old_server->listen(server_tls, old_data_cb));
+
+        auto client_a = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 4400});
+        auto conn_a = client_a->connect(client_remote, client_tls);
+        auto stream_a = conn_a->get_new_stream();
+        stream_a->send("before"_bsv);
+        REQUIRE(old_before.wait_for(1s) == std::future_status::ready);
+
+        // Nobody is listening on the handoff path yet
+        REQUIRE_THROWS(new_net.endpoint(server_local, opt::inherit_socket{path, 100ms}));
+
+        old_server->hand_off(path, [&] { drained_prom.set_value(); });
+        auto new_server = new_net.endpoint(server_local, opt::inherit_socket{path});
+        REQUIRE(new_server->listen(server_tls, new_data_cb));
+        CHECK(new_server->get_socket()->address() == old_server->get_socket()->address());
+
+        // The existing connection carries on with the old server, via forwarding...
+        stream_a->send("after"_bsv);
+        REQUIRE(old_after.wait_for(1s) == std::future_status::ready);
+
+        // ...while new connections go to the new one
+        auto client_b = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 4401});
+        auto conn_b = client_b->connect(client_remote, client_tls);
+        conn_b->get_new_stream()->send("new"_bsv);
+        REQUIRE(new_received.wait_for(1s) == std::future_status::ready);
+
+        CHECK(drained.wait_for(0s) == std::future_status::timeout);
+
+        // Once the old server's last connection has closed (and finished draining) it is done
+        client_net.close();
+        REQUIRE(drained.wait_for(5s) == std::future_status::ready);
+
+        new_net.close();
+        old_net.close();
+    };
+
+    TEST_CASE("013: Socket handoff refuses incompatible socket options", "[013][handoff]")
+    {
+        logger_config();
+
+        Network test_net{};
+        const std::string path = "/tmp/libquic-test-013-refuse.sock";
+
+        // Zero-copy sends and connected sockets don't survive the socket changing hands, so both
+        // sides must refuse them (without touching the handoff path).
+        auto zc_server = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 5500}, opt::zerocopy_send{});
+        CHECK_THROWS_AS(zc_server->hand_off(path), std::invalid_argument);
+
+        auto connected = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 4400}, opt::connected_socket{});
+        CHECK_THROWS_AS(connected->hand_off(path), std::invalid_argument);
+
+        opt::local_addr new_local{"127.0.0.1"s, 5501};
+        CHECK_THROWS_AS(
+                test_net.endpoint(new_local, opt::inherit_socket{path, 100ms}, opt::zerocopy_send{}), std::invalid_argument);
+        CHECK_THROWS_AS(
+                test_net.endpoint(new_local, opt::inherit_socket{path, 100ms}, opt::connected_socket{}),
+                std::invalid_argument);
+
+        test_net.close();
+    };
+#endif
+}  // namespace oxen::quic::test
@@ -0,0 +1,171 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <map>
+#include <mutex>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("014: Datagrams", "[014][datagrams]")
+    {
+        logger_config();
+
+        REQUIRE_THROWS_AS(opt::enable_datagrams(true, 1), std::invalid_argument);
+        REQUIRE_THROWS_AS(opt::enable_datagrams(true, 33), std::invalid_argument);
+
+        for (bool fec : {false, true})
+        {
+            opt::enable_datagrams dgrams{fec, fec ? 4 : 0};
+
+            Network test_net{};
+
+            auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+            auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+            opt::local_addr server_local{"127.0.0.1"s, 5500};
+            opt::local_addr client_local{"127.0.0.1"s, 4400};
+            opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+            // The server echoes datagrams back
+            datagram_data_callback_t server_dgram_cb = [](connection_interface& conn, bstring_view data) {
+                conn.send_datagram(data);
+            };
+
+            constexpr int count = 10;
+            std::atomic<int> received{0};
+            std::promise<void> all_prom;
+            auto all = all_prom.get_future();
+            datagram_data_callback_t client_dgram_cb = [&](connection_interface&, bstring_view data) {
+                if (data.size() == 100 && ++received == count)
+                    all_prom.set_value();
+            };
+
+            auto server_endpoint = test_net.endpoint(server_local);
+            REQUIRE(server_endpoint->listen(server_tls, dgrams, server_dgram_cb));
+
+            auto client_endpoint = test_net.endpoint(client_local);
+            auto conn = client_endpoint->connect(client_remote, client_tls, dgrams, client_dgram_cb);
+
+            // Datagrams queued before the handshake completes go out once it has
+            bstring payload(100, std::byte{'x'});
+            for (int i = 0; i < count; i++)
+                conn->send_datagram(payload);
+
+            REQUIRE(all.wait_for(2s) == std::future_status::ready);
+            CHECK(received == count);
+
+            // Datagrams need to be enabled on the connection
+            auto plain_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 4401});
+            auto plain_conn = plain_endpoint->connect(client_remote, client_tls);
+            REQUIRE_THROWS_AS(plain_conn->send_datagram(payload), std::logic_error);
+
+            test_net.close();
+        }
+    };
+
+    TEST_CASE("014: Datagram FEC recovery", "[014][datagrams][fec]")
+    {
+        logger_config();
+
+        opt::enable_datagrams dgrams{true, 4};
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        // Each datagram's first byte is its tag; the rest is filled with the tag as well
+        constexpr int count = 40;
+        constexpr auto HELLO = std::byte{0xfd};
+        constexpr auto LAST = std::byte{0xfe};
+        constexpr auto OVERSIZED = std::byte{0xff};
+        std::mutex mutex;
+        std::map<std::byte, bstring> received;
+        std::promise<void> hello_prom, all_prom, last_prom;
+        auto hello = hello_prom.get_future();
+        auto all = all_prom.get_future();
+        auto last = last_prom.get_future();
+        datagram_data_callback_t server_dgram_cb = [&](connection_interface&, bstring_view data) {
+            if (data.empty())
+                return;
+            std::lock_guard lock{mutex};
+            if (!received.emplace(data[0], data).second)
+                return;
+            if (data[0] == HELLO)
+                hello_prom.set_value();
+            else if (data[0] == LAST)
+                last_prom.set_value();
+            else if (received.size() == count + 1)  // (+1 for the HELLO)
+                all_prom.set_value();
+        };
+
+        auto server_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        REQUIRE(server_endpoint->listen(server_tls, dgrams, server_dgram_cb));
+        opt::remote_addr client_remote{"127.0.0.1"s, server_endpoint->get_socket()->address().port()};
+
+        auto client_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto conn = client_endpoint->connect(client_remote, client_tls, dgrams);
+
+        // Wait for the handshake (i.e. for a datagram to make it through) so that the max size is
+        // that of the established path
+        conn->send_datagram(bstring(10, HELLO));
+        REQUIRE(hello.wait_for(2s) == std::future_status::ready);
+
+        const size_t max_size = conn->max_datagram_size();
+        REQUIRE(max_size > 100);
+
+        // Drop the data datagram (kind 0x01 in the 4-byte FEC header) of every fourth tag.  Any
+        // four consecutive datagrams contain just one of those, so no group (of at most 4, wherever
+        // the group boundaries fall) loses more than the one datagram its parity can rebuild.  The
+        // dropped ones are also max size, so recovering them needs the largest parity datagrams we
+        // can produce.
+        auto drop_tag = [](std::byte tag) { return static_cast<int>(tag) % 4 == 1; };
+        auto cptr = client_endpoint->get_conn(conn->scid());
+        REQUIRE(cptr);
+        std::atomic<int> dropped{0};
+        cptr->simulate_datagram_loss([&](bstring_view dgram) {
+            if (dgram.size() > 4 && dgram[0] == std::byte{0x01} && drop_tag(dgram[4]))
+            {
+                dropped++;
+                return true;
+            }
+            return false;
+        });
+
+        for (int i = 0; i < count; i++)
+        {
+            auto tag = static_cast<std::byte>(i);
+            conn->send_datagram(bstring(drop_tag(tag) ? max_size : 100 + i, tag));
+        }
+
+        REQUIRE(all.wait_for(2s) == std::future_status::ready);
+        CHECK(dropped == count / 4);
+        {
+            std::lock_guard lock{mutex};
+            for (int i = 0; i < count; i++)
+            {
+                auto tag = static_cast<std::byte>(i);
+                auto it = received.find(tag);
+                REQUIRE(it != received.end());
+                CHECK(it->second == bstring(drop_tag(tag) ? max_size : 100 + i, tag));
+            }
+        }
+
+        // Anything bigger than max_datagram_size() is dropped rather than sent (and doesn't disturb
+        // the group it would have been part of)
+        cptr->simulate_datagram_loss(nullptr);
+        conn->send_datagram(bstring(max_size + 1, OVERSIZED));
+        conn->send_datagram(bstring(10, LAST));
+        REQUIRE(last.wait_for(2s) == std::future_status::ready);
+        {
+            std::lock_guard lock{mutex};
+            CHECK(received.count(OVERSIZED) == 0);
+        }
+
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
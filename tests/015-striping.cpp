@@ -0,0 +1,217 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <quic/stripe.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("015: Striped transfer", "[015][stripe]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        constexpr size_t chunk_size = 10'000, total_size = 1'000'000;
+        bstring data;
+        for (size_t i = 0; i < total_size; i++)
+            data.push_back(static_cast<std::byte>(i % 251));
+
+        std::mutex recv_mut;
+        bstring received;
+        std::promise<bool> recv_done_prom;
+        auto recv_done = recv_done_prom.get_future();
+        std::optional<uint64_t> recv_id;
+        auto receiver = StripeReceiver::make(
+                [&](uint64_t id, bstring_view piece) {
+                    std::lock_guard lock{recv_mut};
+                    recv_id = id;
+                    received += piece;
+                },
+                [&](uint64_t, bool success) { recv_done_prom.set_value(success); },
+                // Small enough to need the sender to respect its window
+                64 * 1024 + chunk_size);
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, receiver));
+
+        // Each stripe's connection comes from a different local endpoint
+        std::vector<std::shared_ptr<connection_interface>> conns;
+        for (uint16_t port : {4400, 4401, 4402})
+            conns.push_back(test_net.endpoint(opt::local_addr{"127.0.0.1"s, port})->connect(client_remote, client_tls));
+
+        REQUIRE_THROWS_AS(StripedSender::make({}, [] { return bstring{}; }), std::invalid_argument);
+
+        size_t pos = 0;
+        std::promise<bool> send_done_prom;
+        auto send_done = send_done_prom.get_future();
+        auto sender = StripedSender::make(
+                conns,
+                [&] {
+                    auto chunk = data.substr(pos, chunk_size);
+                    pos += chunk.size();
+                    return chunk;
+                },
+                [&](bool success) { send_done_prom.set_value(success); },
+                64 * 1024);
+        CHECK(sender->stripes() == 3);
+
+        REQUIRE(recv_done.wait_for(5s) == std::future_status::ready);
+        CHECK(recv_done.get());
+        REQUIRE(send_done.wait_for(1s) == std::future_status::ready);
+        CHECK(send_done.get());
+
+        {
+            std::lock_guard lock{recv_mut};
+            CHECK(received.size() == total_size);
+            CHECK(received == data);
+            CHECK(recv_id == sender->transfer_id());
+        }
+        CHECK(receiver->delivered() == total_size);
+        CHECK(receiver->buffered() == 0);
+        CHECK(receiver->transfers() == 0);
+
+        test_net.close();
+    };
+
+    TEST_CASE("015: Concurrent striped transfers", "[015][stripe]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        static constexpr size_t chunk_size = 10'000, total_size = 300'000;
+        constexpr uint64_t id_a = 0xa, id_b = 0xb;
+
+        std::mutex recv_mut;
+        std::map<uint64_t, bstring> received;
+        std::map<uint64_t, std::promise<bool>> done_proms;
+        auto done_a = done_proms[id_a].get_future();
+        auto done_b = done_proms[id_b].get_future();
+        auto receiver = StripeReceiver::make(
+                [&](uint64_t id, bstring_view piece) {
+                    std::lock_guard lock{recv_mut};
+                    received[id] += piece;
+                },
+                [&](uint64_t id, bool success) {
+                    std::lock_guard lock{recv_mut};
+                    // (Anything else is the bogus transfer of the unrelated stream)
+                    if (auto it = done_proms.find(id); it != done_proms.end())
+                        it->second.set_value(success);
+                });
+
+        auto server_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        REQUIRE(server_endpoint->listen(server_tls, receiver));
+        opt::remote_addr client_remote{"127.0.0.1"s, server_endpoint->get_socket()->address().port()};
+
+        std::vector<std::shared_ptr<connection_interface>> conns;
+        for (int i = 0; i < 2; i++)
+            conns.push_back(test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0})->connect(client_remote, client_tls));
+
+        // A stream that isn't a stripe at all only upsets its own (bogus) transfer
+        conns[0]->get_new_stream()->send("This is not a stripe, just some unrelated data!"s);
+
+        auto make_source = [](std::byte fill) {
+            return [fill, sent = size_t{0}]() mutable {
+                auto n = std::min(chunk_size, total_size - sent);
+                sent += n;
+                return bstring(n, fill);
+            };
+        };
+        auto sender_a = StripedSender::make(conns, make_source(std::byte{'a'}), nullptr, 64 * 1024, 2, id_a);
+        auto sender_b = StripedSender::make(conns, make_source(std::byte{'b'}), nullptr, 64 * 1024, 2, id_b);
+        CHECK(sender_a->transfer_id() == id_a);
+
+        REQUIRE(done_a.wait_for(5s) == std::future_status::ready);
+        CHECK(done_a.get());
+        REQUIRE(done_b.wait_for(5s) == std::future_status::ready);
+        CHECK(done_b.get());
+        {
+            std::lock_guard lock{recv_mut};
+            CHECK(received[id_a] == bstring(total_size, std::byte{'a'}));
+            CHECK(received[id_b] == bstring(total_size, std::byte{'b'}));
+        }
+
+        test_net.close();
+    };
+
+    TEST_CASE("015: Striped transfer with idle stripes", "[015][stripe]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        std::promise<bool> recv_done_prom;
+        auto recv_done = recv_done_prom.get_future();
+        auto receiver = StripeReceiver::make(
+                [](uint64_t, bstring_view) {}, [&](uint64_t, bool success) { recv_done_prom.set_value(success); });
+
+        auto server_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        REQUIRE(server_endpoint->listen(server_tls, receiver));
+        opt::remote_addr client_remote{"127.0.0.1"s, server_endpoint->get_socket()->address().port()};
+
+        std::vector<std::shared_ptr<Endpoint>> client_endpoints;
+        std::vector<std::shared_ptr<connection_interface>> conns;
+        for (int i = 0; i < 3; i++)
+        {
+            client_endpoints.push_back(test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0}));
+            conns.push_back(client_endpoints.back()->connect(client_remote, client_tls));
+        }
+
+        // A single chunk: two of the three stripes never carry anything but the transfer ID, which
+        // can reach the receiver after the transfer is already complete.
+        bool sent = false;
+        std::promise<bool> send_done_prom;
+        auto send_done = send_done_prom.get_future();
+        auto sender = StripedSender::make(
+                conns,
+                [&] { return std::exchange(sent, true) ? bstring{} : bstring(1000, std::byte{'x'}); },
+                [&](bool success) { send_done_prom.set_value(success); });
+
+        REQUIRE(recv_done.wait_for(1s) == std::future_status::ready);
+        CHECK(recv_done.get());
+        REQUIRE(send_done.wait_for(1s) == std::future_status::ready);
+        CHECK(send_done.get());
+
+        // Every stripe gets closed on both sides, without leaving a (bogus) transfer behind
+        auto open_streams = [](const std::shared_ptr<Endpoint>& ep) {
+            size_t n = 0;
+            if (auto snap = ep->snapshot())
+                for (const auto& cs : snap->connections)
+                    n += cs.streams + cs.pending_streams;
+            return n;
+        };
+        auto all_closed = [&] {
+            size_t n = open_streams(server_endpoint);
+            for (const auto& ep : client_endpoints)
+                n += open_streams(ep);
+            return n == 0;
+        };
+        // (Snapshots are published every 250ms)
+        for (int i = 0; i < 20 && !all_closed(); i++)
+            std::this_thread::sleep_for(100ms);
+        CHECK(all_closed());
+        CHECK(receiver->transfers() == 0);
+        CHECK(receiver->delivered() == 1000);
+
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
@@ -0,0 +1,112 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+
+extern "C"
+{
+#include <gnutls/x509.h>
+}
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    // Returns the hex SHA-256 fingerprint of a PEM certificate file
+    static std::string pem_fingerprint(const std::string& path)
+    {
+        gnutls_datum_t pem{};
+        REQUIRE(gnutls_load_file(path.c_str(), &pem) >= 0);
+        gnutls_x509_crt_t crt;
+        REQUIRE(gnutls_x509_crt_init(&crt) >= 0);
+        REQUIRE(gnutls_x509_crt_import(crt, &pem, GNUTLS_X509_FMT_PEM) >= 0);
+        std::string fp(32, '\0');
+        size_t size = fp.size();
+        REQUIRE(gnutls_x509_crt_get_fingerprint(crt, GNUTLS_DIG_SHA256, fp.data(), &size) >= 0);
+        gnutls_x509_crt_deinit(crt);
+        gnutls_free(pem.data);
+        return oxenc::to_hex(fp);
+    }
+
+    TEST_CASE("016: Verified certificate cache", "[016][tls][verify]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        // The client trusts the server's (self-signed) certificate
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+        client_tls->enable_peer_verification();
+        client_tls->add_trust("./servercert.pem"s);
+
+        std::atomic<int> handshakes{0};
+        gnutls_callback count_handshakes =
+                [&](gnutls_session_t, unsigned int, unsigned int, unsigned int, const gnutls_datum_t*) {
+                    handshakes++;
+                    return 0;
+                };
+        client_tls->client_tls_policy = count_handshakes;
+
+        // The server echoes, so that a reply tells us the handshake is complete
+        stream_data_callback_t echo = [](Stream& s, bstring_view data) { s.send(bstring{data}); };
+        auto server_endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 5500});
+        REQUIRE(server_endpoint->listen(server_tls, echo));
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        // Connects from a new local endpoint and sends a ping; returns true once the echo comes
+        // back, or false if the connection fails instead (which destroys, and so closes, the
+        // stream: we don't keep hold of the connection or the stream).
+        uint16_t next_port = 4400;
+        auto connect = [&](std::shared_ptr<GNUTLSCreds> tls) {
+            auto result = std::make_shared<std::promise<bool>>();
+            auto finished = std::make_shared<std::atomic<bool>>(false);
+            auto done = [result, finished](bool ok) {
+                if (!finished->exchange(true))
+                    result->set_value(ok);
+            };
+            auto f = result->get_future();
+            test_net.endpoint(opt::local_addr{"127.0.0.1"s, next_port++})
+                    ->connect(client_remote, tls)
+                    ->get_new_stream(
+                            [done](Stream&, bstring_view) { done(true); }, [done](Stream&, uint64_t) { done(false); })
+                    ->send("ping"sv);
+            REQUIRE(f.wait_for(5s) == std::future_status::ready);
+            return f.get();
+        };
+
+        // The first handshake verifies the chain; reconnects are answered from the cache
+        for (int i = 0; i < 3; i++)
+            CHECK(connect(client_tls));
+        REQUIRE(handshakes == 3);
+        auto stats = client_tls->verify_stats();
+        CHECK(stats.misses == 1);
+        CHECK(stats.hits == 2);
+        CHECK(stats.cached == 1);
+        CHECK(stats.hit_rate() > 0.66);
+
+        // Changing the trust store invalidates the cache
+        client_tls->add_trust("./servercert.pem"s);
+        CHECK(connect(client_tls));
+        CHECK(handshakes == 4);
+        CHECK(client_tls->verify_stats().misses == 2);
+
+        // A revoked certificate fails the handshake, even though it was cached
+        REQUIRE_THROWS_AS(client_tls->revoke("abcd"), std::invalid_argument);
+        client_tls->revoke(pem_fingerprint("./servercert.pem"));
+        CHECK_FALSE(connect(client_tls));
+        CHECK(handshakes == 4);
+
+        // A server certificate we don't trust fails verification
+        auto untrusting_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+        untrusting_tls->enable_peer_verification();
+        untrusting_tls->add_trust("./clientcert.pem"s);
+        untrusting_tls->client_tls_policy = count_handshakes;
+        CHECK_FALSE(connect(untrusting_tls));
+        CHECK(handshakes == 4);
+        CHECK(untrusting_tls->verify_stats().misses == 1);
+        CHECK(untrusting_tls->verify_stats().cached == 0);
+
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
@@ -0,0 +1,211 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <quic/tunnel.hpp>
+#include <thread>
+
+#ifndef _WIN32
+extern "C"
+{
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+}
+#endif
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+#ifndef _WIN32
+    TEST_CASE("017: TCP tunnel echo with half-close", "[017][tunnel]")
+    {
+        logger_config();
+
+        // Blocking TCP echo server for a single connection: echoes everything back until it sees
+        // EOF, then (still able to send, as the connection is only half-closed) sends a trailer and
+        // closes.
+        const std::string trailer = "goodbye";
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(listen_fd >= 0);
+        Address echo_addr{"127.0.0.1"s, 0};
+        REQUIRE(bind(listen_fd, echo_addr, echo_addr.socklen()) == 0);
+        REQUIRE(listen(listen_fd, 1) == 0);
+        getsockname(listen_fd, echo_addr, echo_addr.socklen_ptr());
+
+        std::promise<void> echo_eof_prom;
+        auto echo_eof = echo_eof_prom.get_future();
+        std::thread echo{[&] {
+            int c = accept(listen_fd, nullptr, nullptr);
+            if (c < 0)
+                return;
+            std::vector<char> buf(64 * 1024);
+            ssize_t n;
+            while ((n = recv(c, buf.data(), buf.size(), 0)) > 0)
+                send(c, buf.data(), n, MSG_NOSIGNAL);
+            if (n == 0)
+            {
+                echo_eof_prom.set_value();
+                send(c, trailer.data(), trailer.size(), MSG_NOSIGNAL);
+            }
+            ::close(c);
+        }};
+
+        Network server_net{}, client_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        auto server_tunnel = TCPTunnel::server(server_net, echo_addr);
+        auto server = server_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        REQUIRE(server->listen(server_tls, server_tunnel));
+        opt::remote_addr server_remote{"127.0.0.1"s, server->get_socket()->address().port()};
+
+        auto client = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto conn = client->connect(server_remote, client_tls);
+        auto client_tunnel = TCPTunnel::client(client_net, conn, Address{"127.0.0.1"s, 0});
+
+        // Enough data to need several pooled read buffers (and so several stream sends) each way
+        std::string msg;
+        for (int i = 0; msg.size() < 200'000; i++)
+            msg += "tunnelled line " + std::to_string(i) + "\n";
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(fd >= 0);
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        const auto& tunnel_addr = client_tunnel->tcp_address();
+        REQUIRE(connect(fd, tunnel_addr, tunnel_addr.socklen()) == 0);
+
+        // Read the echo concurrently, as the sockets can't buffer all of it
+        std::string received;
+        bool got_eof = false;
+        std::thread reader{[&] {
+            std::vector<char> buf(64 * 1024);
+            ssize_t n;
+            while ((n = recv(fd, buf.data(), buf.size(), 0)) > 0)
+                received.append(buf.data(), n);
+            got_eof = n == 0;
+        }};
+
+        for (size_t pos = 0; pos < msg.size();)
+        {
+            auto n = send(fd, msg.data() + pos, msg.size() - pos, MSG_NOSIGNAL);
+            REQUIRE(n > 0);
+            pos += n;
+        }
+        // Half-close: the echo server must see EOF while we can still read the echo
+        REQUIRE(shutdown(fd, SHUT_WR) == 0);
+        CHECK(echo_eof.wait_for(5s) == std::future_status::ready);
+
+        // Once the echo server closes its end the close comes back through the tunnel as EOF, after
+        // everything it sent
+        reader.join();
+        CHECK(got_eof);
+        CHECK(received.size() == msg.size() + trailer.size());
+        CHECK(received == msg + trailer);
+        ::close(fd);
+
+        // Both tunnel ends drop the connection once the stream has closed
+        auto started = std::chrono::steady_clock::now();
+        while ((client_tunnel->active() || server_tunnel->active()) && std::chrono::steady_clock::now() - started < 2s)
+            std::this_thread::sleep_for(10ms);
+        CHECK(client_tunnel->active() == 0);
+        CHECK(server_tunnel->active() == 0);
+
+        shutdown(listen_fd, SHUT_RDWR);
+        echo.join();
+        ::close(listen_fd);
+
+        client_tunnel->close();
+        server_tunnel->close();
+        client_net.close();
+        server_net.close();
+    };
+
+    TEST_CASE("017: TCP tunnel closes TCP connections when the QUIC connection goes away", "[017][tunnel]")
+    {
+        logger_config();
+
+        // TCP echo server for a single connection, echoing until EOF
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(listen_fd >= 0);
+        Address echo_addr{"127.0.0.1"s, 0};
+        REQUIRE(bind(listen_fd, echo_addr, echo_addr.socklen()) == 0);
+        REQUIRE(listen(listen_fd, 1) == 0);
+        getsockname(listen_fd, echo_addr, echo_addr.socklen_ptr());
+
+        std::thread echo{[&] {
+            int c = accept(listen_fd, nullptr, nullptr);
+            if (c < 0)
+                return;
+            char buf[4096];
+            ssize_t n;
+            while ((n = recv(c, buf, sizeof(buf), 0)) > 0)
+                send(c, buf, n, MSG_NOSIGNAL);
+            ::close(c);
+        }};
+
+        Network server_net{}, client_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        auto server_tunnel = TCPTunnel::server(server_net, echo_addr);
+        auto server = server_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        REQUIRE(server->listen(server_tls, server_tunnel));
+        opt::remote_addr server_remote{"127.0.0.1"s, server->get_socket()->address().port()};
+
+        auto client = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto conn = client->connect(server_remote, client_tls);
+        auto client_tunnel = TCPTunnel::client(client_net, conn, Address{"127.0.0.1"s, 0});
+
+        // Only the endpoint keeps the connection alive, not the tunnel (or its streams)
+        std::weak_ptr<connection_interface> weak_conn = conn;
+        conn.reset();
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(fd >= 0);
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        const auto& tunnel_addr = client_tunnel->tcp_address();
+        REQUIRE(connect(fd, tunnel_addr, tunnel_addr.socklen()) == 0);
+
+        // Make sure the whole path is up before tearing it down
+        const std::string ping = "ping";
+        REQUIRE(send(fd, ping.data(), ping.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(ping.size()));
+        std::string pong(ping.size(), '\0');
+        for (size_t got = 0; got < pong.size();)
+        {
+            auto n = recv(fd, pong.data() + got, pong.size() - got, 0);
+            REQUIRE(n > 0);
+            got += n;
+        }
+        CHECK(pong == ping);
+        CHECK(client_tunnel->active() == 1);
+
+        // Closing the far side closes its connections; once the client's connection has drained
+        // and been dropped, its tunnelled TCP connection must be closed too.
+        server_net.close();
+
+        char buf[64];
+        CHECK(recv(fd, buf, sizeof(buf), 0) == 0);
+        ::close(fd);
+
+        CHECK(weak_conn.expired());
+        auto started = std::chrono::steady_clock::now();
+        while (client_tunnel->active() && std::chrono::steady_clock::now() - started < 2s)
+            std::this_thread::sleep_for(10ms);
+        CHECK(client_tunnel->active() == 0);
+
+        shutdown(listen_fd, SHUT_RDWR);
+        echo.join();
+        ::close(listen_fd);
+
+        client_tunnel->close();
+        client_net.close();
+    };
+#endif
+}  // namespace oxen::quic::test
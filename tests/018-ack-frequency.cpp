@@ -0,0 +1,62 @@
+#include <catch2/catch_test_macros.hpp>
+#include <future>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    TEST_CASE("018: ACK frequency", "[018][ack_frequency]")
+    {
+        logger_config();
+
+        // 2^14ms and up can't be expressed in the max_ack_delay transport parameter
+        REQUIRE_THROWS_AS(opt::ack_frequency(2, 16384ms), std::invalid_argument);
+        REQUIRE_THROWS_AS(opt::ack_frequency(0), std::invalid_argument);
+        REQUIRE_NOTHROW(opt::ack_frequency(2, 16383ms));
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        // Each side reports the max_ack_delay its peer advertised (in the data callbacks, so that
+        // we read the transport parameters from the event loop).
+        auto remote_max_ack_delay = [](Stream& s) {
+            auto* params = ngtcp2_conn_get_remote_transport_params(s.get_conn());
+            return std::chrono::nanoseconds{params ? params->max_ack_delay : 0};
+        };
+
+        std::promise<std::chrono::nanoseconds> server_saw_prom, client_saw_prom;
+        auto server_saw = server_saw_prom.get_future();
+        auto client_saw = client_saw_prom.get_future();
+
+        stream_data_callback_t server_data_cb = [&](Stream& s, bstring_view data) {
+            server_saw_prom.set_value(remote_max_ack_delay(s));
+            s.send(bstring{data});
+        };
+        stream_data_callback_t client_data_cb = [&](Stream& s, bstring_view) {
+            client_saw_prom.set_value(remote_max_ack_delay(s));
+        };
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, server_data_cb, opt::ack_frequency{4, 40ms}));
+
+        auto client_endpoint = test_net.endpoint(client_local);
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls, opt::ack_frequency{8, 60ms});
+
+        conn_interface->get_new_stream(client_data_cb)->send("hi"sv);
+
+        REQUIRE(server_saw.wait_for(1s) == std::future_status::ready);
+        CHECK(server_saw.get() == 60ms);
+        REQUIRE(client_saw.wait_for(1s) == std::future_status::ready);
+        CHECK(client_saw.get() == 40ms);
+
+        test_net.close();
+    };
+}  // namespace oxen::quic::test
@@ -0,0 +1,95 @@
+#include <catch2/catch_test_macros.hpp>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+namespace oxen::quic::test
+{
+    using namespace std::literals;
+
+    // The sizes used here are below the usual net.core.rmem_max/wmem_max defaults (~208kB), so are
+    // applied as given even without CAP_NET_ADMIN.  Linux reports double the requested size (the
+    // extra being kernel bookkeeping), so we accept anything from the requested size to twice that.
+
+    TEST_CASE("019: Socket buffer sizes", "[019][socket_buffers]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        REQUIRE_THROWS_AS(
+                test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0}, opt::socket_buffer_autotune{1_Mi, 1_Mi, 0}),
+                std::invalid_argument);
+
+        auto endpoint = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0}, opt::socket_buffers{96_ki, 80_ki});
+        auto& sock = endpoint->get_socket();
+
+        CHECK(sock->receive_buffer_size() >= 96_ki);
+        CHECK(sock->receive_buffer_size() <= 2 * 96_ki);
+        CHECK(sock->send_buffer_size() >= 80_ki);
+        CHECK(sock->send_buffer_size() <= 2 * 80_ki);
+
+        // A size of 0 leaves that buffer at the system default
+        auto defaults = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto send_only = test_net.endpoint(opt::local_addr{"127.0.0.1"s, 0}, opt::socket_buffers{0, 80_ki});
+        CHECK(send_only->get_socket()->receive_buffer_size() == defaults->get_socket()->receive_buffer_size());
+        CHECK(send_only->get_socket()->send_buffer_size() == sock->send_buffer_size());
+
+        test_net.close();
+    };
+
+#ifdef OXEN_LIBQUIC_TEST_HOOKS
+    TEST_CASE("019: Send buffer autotuning", "[019][socket_buffers][autotune]")
+    {
+        logger_config();
+
+        Network test_net{};
+
+        auto server_tls = GNUTLSCreds::make("./serverkey.pem"s, "./servercert.pem"s, "./clientcert.pem"s);
+        auto client_tls = GNUTLSCreds::make("./clientkey.pem"s, "./clientcert.pem"s, "./servercert.pem"s);
+
+        opt::local_addr server_local{"127.0.0.1"s, 5500};
+        opt::local_addr client_local{"127.0.0.1"s, 4400};
+        opt::remote_addr client_remote{"127.0.0.1"s, 5500};
+
+        auto server_endpoint = test_net.endpoint(server_local);
+        REQUIRE(server_endpoint->listen(server_tls, [](Stream&, bstring_view) {}));
+
+        // Starts at 48kiB and may grow (48 -> 96 -> 128) to at most 128kiB
+        auto client_endpoint = test_net.endpoint(
+                client_local, opt::socket_buffers{0, 48_ki}, opt::socket_buffer_autotune{1_Mi, 128_ki, 4});
+        auto conn_interface = client_endpoint->connect(client_remote, client_tls);
+        auto client_stream = conn_interface->get_new_stream();
+        auto& sock = client_endpoint->get_socket();
+
+        const auto initial = sock->send_buffer_size();
+        REQUIRE(initial <= 2 * 48_ki);
+
+        // Refuses a burst of sends (well above the threshold) and waits out one autotune interval
+        std::string chunk(50'000, 'x');
+        auto block_for_a_tick = [&] {
+            sock->simulate_send_blocks(8);
+            client_stream->send(std::string{chunk});
+            std::this_thread::sleep_for(300ms);
+        };
+
+        for (int i = 0; i < 8 && sock->send_buffer_size() == initial; i++)
+            block_for_a_tick();
+        CHECK(sock->send_blocks() >= 8);
+        CHECK(sock->send_buffer_size() > initial);
+
+        // Continued blocking grows the buffer up to the maximum, but no further
+        for (int i = 0; i < 4; i++)
+            block_for_a_tick();
+        const auto capped = sock->send_buffer_size();
+        CHECK(capped >= 128_ki);
+        CHECK(capped <= 2 * 128_ki);
+
+        for (int i = 0; i < 2; i++)
+            block_for_a_tick();
+        CHECK(sock->send_buffer_size() == capped);
+
+        test_net.close();
+    };
+#endif
+}  // namespace oxen::quic::test
@@ -0,0 +1,283 @@
+/*
+    Stream compression benchmark: sends compressible, JSON-like data from a client to a server
+    through an in-process UDP relay that emulates a bandwidth-limited link (token-bucket rate
+    limiting with a bounded queue, dropping packets that would exceed it), and reports the
+    effective (uncompressed) throughput with and without opt::stream_compression.
+*/
+
+extern "C"
+{
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <CLI/Validators.hpp>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <random>
+#include <thread>
+
+#include "utils.hpp"
+
+using namespace oxen::quic;
+using namespace std::literals;
+
+namespace
+{
+    // UDP relay between a client and a fixed server address: packets from the server are relayed
+    // to whichever address most recently sent to us from elsewhere.  Each direction is limited to
+    // `rate` bits per second with at most `max_queue` of queueing delay.
+    struct link_emulator
+    {
+        int fd;
+        Address addr;
+        Address server;
+        std::optional<Address> client;
+        double rate;
+        std::chrono::nanoseconds max_queue;
+        std::atomic<bool> running{true};
+        std::atomic<uint64_t> dropped{0};
+        std::thread thread;
+
+        struct queued
+        {
+            std::chrono::steady_clock::time_point depart;
+            Address to;
+            std::vector<char> data;
+        };
+        // Per direction: [0] = towards the server, [1] = towards the client
+        std::array<std::deque<queued>, 2> queues;
+        std::array<std::chrono::steady_clock::time_point, 2> next_free{};
+
+        link_emulator(Address server_addr, double rate_bps, std::chrono::nanoseconds max_queue_delay) :
+                server{std::move(server_addr)}, rate{rate_bps}, max_queue{max_queue_delay}
+        {
+            fd = socket(AF_INET, SOCK_DGRAM, 0);
+            Address bind_addr{"127.0.0.1", 0};
+            if (fd < 0 || bind(fd, bind_addr, bind_addr.socklen()) != 0)
+                throw std::runtime_error{"Failed to set up link emulator socket"};
+            getsockname(fd, addr, addr.socklen_ptr());
+            thread = std::thread{[this] { run(); }};
+        }
+
+        ~link_emulator()
+        {
+            running = false;
+            thread.join();
+            ::close(fd);
+        }
+
+        void run()
+        {
+            std::vector<char> buf(65536);
+            while (running)
+            {
+                auto now = std::chrono::steady_clock::now();
+
+                // Send whatever is due
+                int timeout_ms = 10;
+                for (auto& q : queues)
+                {
+                    while (!q.empty() && q.front().depart <= now)
+                    {
+                        auto& p = q.front();
+                        sendto(fd, p.data.data(), p.data.size(), 0, p.to, p.to.socklen());
+                        q.pop_front();
+                    }
+                    if (!q.empty())
+                        timeout_ms = std::min<int>(
+                                timeout_ms,
+                                std::chrono::ceil<std::chrono::milliseconds>(q.front().depart - now).count());
+                }
+
+                pollfd pfd{fd, POLLIN, 0};
+                if (poll(&pfd, 1, timeout_ms) <= 0)
+                    continue;
+
+                Address from;
+                auto n = recvfrom(fd, buf.data(), buf.size(), 0, from, from.socklen_ptr());
+                if (n <= 0)
+                    continue;
+
+                int dir = from == server ? 1 : 0;
+                if (dir == 0)
+                    client = from;
+                else if (!client)
+                    continue;
+
+                // Token bucket: each packet occupies the link for its serialization time
+                now = std::chrono::steady_clock::now();
+                auto start = std::max(now, next_free[dir]);
+                if (start - now > max_queue)
+                {
+                    dropped++;
+                    continue;
+                }
+                auto tx_time = std::chrono::nanoseconds{static_cast<int64_t>(n * 8 / rate * 1e9)};
+                next_free[dir] = start + tx_time;
+                queues[dir].push_back(queued{start + tx_time, dir == 0 ? server : *client, {buf.data(), buf.data() + n}});
+            }
+        }
+    };
+
+    // Generates `size` bytes of newline-separated JSON records, similar to typical API traffic.
+    std::string make_json(size_t size)
+    {
+        std::mt19937_64 rng{12345};
+        std::uniform_int_distribution<int> price{100, 99999}, qty{1, 500};
+        static constexpr std::array names = {"widget", "gadget", "sprocket", "doohickey", "gizmo"};
+        std::string out;
+        out.reserve(size + 200);
+        for (uint64_t i = 0; out.size() < size; i++)
+            out += fmt::format(
+                    "{{\"id\":{},\"type\":\"order\",\"item\":\"{}\",\"price\":{}.{:02},\"quantity\":{},"
+                    "\"status\":\"pending\",\"tags\":[\"retail\",\"online\"]}}\n",
+                    i,
+                    names[rng() % names.size()],
+                    price(rng) / 100,
+                    price(rng) % 100,
+                    qty(rng));
+        out.resize(size);
+        return out;
+    }
+
+    void run(std::string_view name,
+             std::optional<opt::stream_compression> compression,
+             const std::string& data,
+             size_t chunk_size,
+             double rate_bps,
+             std::chrono::milliseconds max_queue,
+             std::shared_ptr<GNUTLSCreds> server_tls,
+             std::shared_ptr<GNUTLSCreds> client_tls)
+    {
+        Network server_net{};
+        Network client_net{};
+
+        std::atomic<uint64_t> received{0};
+        std::promise<void> done_prom;
+        auto done = done_prom.get_future();
+
+        stream_data_callback_t on_data = [&](Stream&, bstring_view d) {
+            if ((received += d.size()) == data.size())
+                done_prom.set_value();
+        };
+
+        auto server = server_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        if (compression)
+            server->listen(server_tls, on_data, *compression);
+        else
+            server->listen(server_tls, on_data);
+
+        link_emulator link{server->get_socket()->address(), rate_bps, max_queue};
+        opt::remote_addr remote{"127.0.0.1"s, link.addr.port()};
+
+        auto client = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto conn = compression ? client->connect(remote, client_tls, *compression) : client->connect(remote, client_tls);
+        auto stream = conn->get_new_stream();
+
+        auto started = get_time();
+        size_t pos = 0;
+        stream->send_chunks(
+                [&](const Stream&) -> std::string_view {
+                    if (pos >= data.size())
+                        return {};
+                    auto chunk = std::string_view{data}.substr(pos, chunk_size);
+                    pos += chunk.size();
+                    return chunk;
+                },
+                nullptr,
+                4);
+
+        if (done.wait_for(300s) != std::future_status::ready)
+            fmt::print("{:>10}: timed out after receiving {} of {} bytes\n", name, received.load(), data.size());
+        else
+        {
+            auto secs = (get_time() - started).count() / 1e9;
+            fmt::print(
+                    "{:>10}: {:.1f} MB in {:.3f}s = {:.2f} MB/s effective ({:.1f}x link rate); {} packets dropped\n",
+                    name,
+                    data.size() / 1e6,
+                    secs,
+                    data.size() / 1e6 / secs,
+                    data.size() * 8 / secs / rate_bps,
+                    link.dropped.load());
+        }
+
+        client_net.close();
+        server_net.close();
+    }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App cli{"libQUIC stream compression benchmark over an emulated bandwidth-limited link"};
+
+    std::string log_file, log_level;
+    add_log_opts(cli, log_file, log_level);
+
+    std::string server_key{"./serverkey.pem"}, server_cert{"./servercert.pem"};
+    std::string client_key{"./clientkey.pem"}, client_cert{"./clientcert.pem"};
+    cli.add_option("--server-key", server_key, "Path to server key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--server-cert", server_cert, "Path to server certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+    cli.add_option("--client-key", client_key, "Path to client key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--client-cert", client_cert, "Path to client certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+
+    size_t size = 20'000'000, chunk_size = 64'000;
+    cli.add_option("-S,--size", size, "Bytes of data to send")->capture_default_str();
+    cli.add_option("--chunk-size", chunk_size, "Size of each Stream send")->capture_default_str();
+
+    double rate_mbps = 20;
+    cli.add_option("-r,--rate", rate_mbps, "Emulated link rate, in Mbps")->capture_default_str()->check(CLI::PositiveNumber);
+    uint64_t queue_ms = 50;
+    cli.add_option("--queue", queue_ms, "Maximum link queueing delay (ms) before packets are dropped")
+            ->capture_default_str();
+
+    std::vector<int> levels{0};
+    cli.add_option(
+               "--levels",
+               levels,
+               "Compression levels to test (0 = adaptive); an uncompressed run is always done first")
+            ->capture_default_str();
+
+    try
+    {
+        cli.parse(argc, argv);
+    }
+    catch (const CLI::ParseError& e)
+    {
+        return cli.exit(e);
+    }
+
+    setup_logging(log_file, log_level);
+
+    auto server_tls = GNUTLSCreds::make(server_key, server_cert, client_cert);
+    auto client_tls = GNUTLSCreds::make(client_key, client_cert, server_cert);
+
+    auto data = make_json(size);
+    std::chrono::milliseconds max_queue{queue_ms};
+    double rate_bps = rate_mbps * 1e6;
+
+    run("plain", std::nullopt, data, chunk_size, rate_bps, max_queue, server_tls, client_tls);
+
+#ifdef OXEN_LIBQUIC_ZSTD
+    for (int level : levels)
+        run(level ? "zstd-{}"_format(level) : "adaptive"s,
+            opt::stream_compression{level},
+            data,
+            chunk_size,
+            rate_bps,
+            max_queue,
+            server_tls,
+            client_tls);
+#else
+    fmt::print("libquic was built without LIBQUIC_ZSTD; skipping compressed runs\n");
+#endif
+}
@@ -0,0 +1,274 @@
+/*
+    Datagram FEC benchmark: sends a stream of fixed-rate datagrams (as a real-time audio/video
+    flow would) from a client to a server through an in-process UDP relay that drops packets at
+    random and adds a fixed one-way delay, and reports how many datagrams arrived, the effective
+    goodput, and the delivery latency with and without opt::enable_datagrams FEC.
+*/
+
+extern "C"
+{
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <CLI/Validators.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <random>
+#include <thread>
+
+#include "utils.hpp"
+
+using namespace oxen::quic;
+using namespace std::literals;
+
+namespace
+{
+    // UDP relay between a client and a fixed server address: packets from the server are relayed
+    // to whichever address most recently sent to us from elsewhere.  Packets in either direction
+    // are dropped with probability `loss`, and otherwise delivered after `delay`.
+    struct lossy_link
+    {
+        int fd;
+        Address addr;
+        Address server;
+        std::optional<Address> client;
+        double loss;
+        std::chrono::nanoseconds delay;
+        std::atomic<bool> running{true};
+        std::atomic<uint64_t> dropped{0};
+        std::mt19937_64 rng{42};
+        std::thread thread;
+
+        struct queued
+        {
+            std::chrono::steady_clock::time_point depart;
+            Address to;
+            std::vector<char> data;
+        };
+        std::deque<queued> queue;
+
+        lossy_link(Address server_addr, double loss, std::chrono::nanoseconds delay) :
+                server{std::move(server_addr)}, loss{loss}, delay{delay}
+        {
+            fd = socket(AF_INET, SOCK_DGRAM, 0);
+            Address bind_addr{"127.0.0.1", 0};
+            if (fd < 0 || bind(fd, bind_addr, bind_addr.socklen()) != 0)
+                throw std::runtime_error{"Failed to set up link emulator socket"};
+            getsockname(fd, addr, addr.socklen_ptr());
+            thread = std::thread{[this] { run(); }};
+        }
+
+        ~lossy_link()
+        {
+            running = false;
+            thread.join();
+            ::close(fd);
+        }
+
+        void run()
+        {
+            std::vector<char> buf(65536);
+            std::uniform_real_distribution<double> coin{0.0, 1.0};
+            while (running)
+            {
+                auto now = std::chrono::steady_clock::now();
+
+                // Send whatever is due (the delay is fixed, so the queue is in departure order)
+                int timeout_ms = 10;
+                while (!queue.empty() && queue.front().depart <= now)
+                {
+                    auto& p = queue.front();
+                    sendto(fd, p.data.data(), p.data.size(), 0, p.to, p.to.socklen());
+                    queue.pop_front();
+                }
+                if (!queue.empty())
+                    timeout_ms = std::min<int>(
+                            timeout_ms,
+                            std::chrono::ceil<std::chrono::milliseconds>(queue.front().depart - now).count());
+
+                pollfd pfd{fd, POLLIN, 0};
+                if (poll(&pfd, 1, timeout_ms) <= 0)
+                    continue;
+
+                Address from;
+                auto n = recvfrom(fd, buf.data(), buf.size(), 0, from, from.socklen_ptr());
+                if (n <= 0)
+                    continue;
+
+                bool to_client = from == server;
+                if (!to_client)
+                    client = from;
+                else if (!client)
+                    continue;
+
+                if (coin(rng) < loss)
+                {
+                    dropped++;
+                    continue;
+                }
+                queue.push_back(queued{
+                        std::chrono::steady_clock::now() + delay,
+                        to_client ? *client : server,
+                        {buf.data(), buf.data() + n}});
+            }
+        }
+    };
+
+    // Each datagram starts with its sequence number and send time, followed by filler
+    struct dgram_header
+    {
+        uint64_t seq;
+        int64_t sent_ns;
+    };
+
+    void run(std::string_view name,
+             const opt::enable_datagrams& dgrams,
+             size_t count,
+             size_t size,
+             std::chrono::microseconds interval,
+             double loss,
+             std::chrono::milliseconds delay,
+             std::shared_ptr<GNUTLSCreds> server_tls,
+             std::shared_ptr<GNUTLSCreds> client_tls)
+    {
+        Network server_net{};
+        Network client_net{};
+
+        // Receive time (relative to send time) of each datagram, or -1 if not (yet) received
+        std::mutex latency_mutex;
+        std::vector<int64_t> latency_ns(count, -1);
+
+        datagram_data_callback_t on_dgram = [&](connection_interface&, bstring_view data) {
+            if (data.size() < sizeof(dgram_header))
+                return;
+            dgram_header h;
+            std::memcpy(&h, data.data(), sizeof(h));
+            auto now = get_time().time_since_epoch().count();
+            std::lock_guard lock{latency_mutex};
+            if (h.seq < count && latency_ns[h.seq] < 0)
+                latency_ns[h.seq] = now - h.sent_ns;
+        };
+
+        auto server = server_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        server->listen(server_tls, dgrams, on_dgram);
+
+        lossy_link link{server->get_socket()->address(), loss, delay};
+        opt::remote_addr remote{"127.0.0.1"s, link.addr.port()};
+
+        auto client = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto conn = client->connect(remote, client_tls, dgrams);
+
+        // Let the handshake finish (through the lossy link) before the clock starts
+        std::this_thread::sleep_for(500ms + 4 * delay);
+
+        bstring payload(std::max(size, sizeof(dgram_header)), std::byte{0x55});
+        auto started = get_time();
+        auto next = std::chrono::steady_clock::now();
+        for (uint64_t seq = 0; seq < count; seq++)
+        {
+            std::this_thread::sleep_until(next);
+            next += interval;
+            dgram_header h{seq, get_time().time_since_epoch().count()};
+            std::memcpy(payload.data(), &h, sizeof(h));
+            conn->send_datagram(payload);
+        }
+        auto elapsed = get_time() - started;
+
+        // Give the stragglers (and parity) time to arrive
+        std::this_thread::sleep_for(100ms + 2 * delay);
+
+        std::vector<int64_t> lat;
+        {
+            std::lock_guard lock{latency_mutex};
+            for (auto l : latency_ns)
+                if (l >= 0)
+                    lat.push_back(l);
+        }
+        std::sort(lat.begin(), lat.end());
+        auto pct = [&](double p) { return lat.empty() ? 0.0 : lat[std::min(lat.size() - 1, size_t(p * lat.size()))] / 1e6; };
+        auto secs = elapsed.count() / 1e9;
+
+        fmt::print(
+                "{:>10}: {}/{} datagrams ({:.2f}%) delivered; goodput {:.2f} Mbps; latency p50 {:.2f}ms, "
+                "p99 {:.2f}ms, max {:.2f}ms; {} packets dropped by link\n",
+                name,
+                lat.size(),
+                count,
+                lat.size() * 100.0 / count,
+                lat.size() * payload.size() * 8 / secs / 1e6,
+                pct(0.5),
+                pct(0.99),
+                lat.empty() ? 0.0 : lat.back() / 1e6,
+                link.dropped.load());
+
+        client_net.close();
+        server_net.close();
+    }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App cli{"libQUIC datagram FEC benchmark over an emulated lossy link"};
+
+    std::string log_file, log_level;
+    add_log_opts(cli, log_file, log_level);
+
+    std::string server_key{"./serverkey.pem"}, server_cert{"./servercert.pem"};
+    std::string client_key{"./clientkey.pem"}, client_cert{"./clientcert.pem"};
+    cli.add_option("--server-key", server_key, "Path to server key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--server-cert", server_cert, "Path to server certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+    cli.add_option("--client-key", client_key, "Path to client key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--client-cert", client_cert, "Path to client certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+
+    size_t count = 5000, size = 1000;
+    cli.add_option("-n,--count", count, "Number of datagrams to send")->capture_default_str();
+    cli.add_option("-s,--size", size, "Size of each datagram")->capture_default_str();
+    uint64_t interval_us = 1000;
+    cli.add_option("-i,--interval", interval_us, "Interval between datagrams, in microseconds")->capture_default_str();
+
+    double loss_pct = 5;
+    cli.add_option("-l,--loss", loss_pct, "Emulated random packet loss, in percent")
+            ->capture_default_str()
+            ->check(CLI::Range(0.0, 100.0));
+    uint64_t delay_ms = 20;
+    cli.add_option("-d,--delay", delay_ms, "Emulated one-way link delay (ms)")->capture_default_str();
+
+    std::vector<int> groups{4, 8};
+    cli.add_option("--groups", groups, "Fixed FEC group sizes to test (2-32) in addition to adaptive")
+            ->capture_default_str();
+
+    try
+    {
+        cli.parse(argc, argv);
+    }
+    catch (const CLI::ParseError& e)
+    {
+        return cli.exit(e);
+    }
+
+    setup_logging(log_file, log_level);
+
+    auto server_tls = GNUTLSCreds::make(server_key, server_cert, client_cert);
+    auto client_tls = GNUTLSCreds::make(client_key, client_cert, server_cert);
+
+    std::chrono::microseconds interval{interval_us};
+    std::chrono::milliseconds delay{delay_ms};
+    double loss = loss_pct / 100;
+
+    run("plain", opt::enable_datagrams{}, count, size, interval, loss, delay, server_tls, client_tls);
+    run("adaptive", opt::enable_datagrams{true}, count, size, interval, loss, delay, server_tls, client_tls);
+    for (int g : groups)
+        run("fec-{}"_format(g), opt::enable_datagrams{true, g}, count, size, interval, loss, delay, server_tls, client_tls);
+}
@@ -0,0 +1,242 @@
+/*
+    Request/response latency benchmark: measures small-message round trip latency (and the CPU
+    used to achieve it) between an in-process client and server, optionally comparing the default
+    event loop against busy-poll mode, and UDP over loopback against the same-host Unix datagram
+    transport.
+*/
+
+#include <sys/resource.h>
+
+#include <CLI/Validators.hpp>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <thread>
+
+#include "utils.hpp"
+
+using namespace oxen::quic;
+
+namespace
+{
+    std::chrono::microseconds cpu_time()
+    {
+        rusage ru{};
+        getrusage(RUSAGE_SELF, &ru);
+        auto tv = [](const timeval& t) { return std::chrono::seconds{t.tv_sec} + std::chrono::microseconds{t.tv_usec}; };
+        return tv(ru.ru_utime) + tv(ru.ru_stime);
+    }
+
+    struct run_result
+    {
+        std::vector<std::chrono::nanoseconds> rtts;
+        std::chrono::nanoseconds wall;
+        std::chrono::microseconds cpu;
+    };
+
+    run_result run_pingpong(
+            opt::busy_poll bp,
+            std::optional<opt::unix_transport> unix,
+            const std::string& listen,
+            std::shared_ptr<GNUTLSCreds> server_tls,
+            std::shared_ptr<GNUTLSCreds> client_tls,
+            size_t rounds,
+            size_t warmup,
+            size_t msg_size)
+    {
+        Network server_net{bp};
+        Network client_net{bp};
+
+        auto [listen_addr, listen_port] = parse_addr(listen, 5500);
+        opt::local_addr server_local{listen_addr, listen_port};
+        opt::remote_addr server_remote{listen_addr, listen_port};
+
+        stream_data_callback_t echo = [](Stream& s, bstring_view data) {
+            s.send(std::basic_string<std::byte>{data});
+        };
+
+        auto server = unix ? server_net.endpoint(server_local, *unix) : server_net.endpoint(server_local);
+        server->listen(server_tls, echo);
+
+        run_result result;
+        result.rtts.reserve(rounds);
+
+        std::basic_string<std::byte> msg(msg_size, std::byte{'x'});
+        size_t received = 0, completed = 0;
+        auto sent_at = get_time();
+        std::promise<void> done_prom;
+        auto done = done_prom.get_future();
+
+        // This runs in the client's event loop thread, so we can immediately send the next ping from
+        // within the data callback.
+        stream_data_callback_t on_pong = [&](Stream& s, bstring_view data) {
+            received += data.size();
+            if (received < msg_size)
+                return;
+            received -= msg_size;
+
+            auto now = get_time();
+            if (completed++ >= warmup)
+                result.rtts.push_back(now - sent_at);
+
+            if (completed == warmup + rounds)
+            {
+                done_prom.set_value();
+                return;
+            }
+
+            sent_at = get_time();
+            s.send(bstring_view{msg});
+        };
+
+        // Unix transport addresses only name sockets, so the client needs a concrete IP to name its own
+        auto client = unix ? client_net.endpoint(opt::local_addr{listen_addr, 0}, *unix)
+                           : client_net.endpoint(opt::local_addr{});
+        auto conn = client->connect(server_remote, client_tls, on_pong);
+        auto stream = conn->get_new_stream();
+
+        auto wall_start = get_time();
+        auto cpu_start = cpu_time();
+
+        sent_at = get_time();
+        stream->send(bstring_view{msg});
+
+        done.wait();
+
+        result.wall = get_time() - wall_start;
+        result.cpu = cpu_time() - cpu_start;
+
+        return result;
+    }
+
+    void report(std::string_view name, run_result& r)
+    {
+        using namespace std::literals;
+        auto& v = r.rtts;
+        if (v.empty())
+        {
+            fmt::print("{:>10}: no round trips completed\n", name);
+            return;
+        }
+        std::sort(v.begin(), v.end());
+        auto pct = [&v](double p) {
+            auto i = std::min<size_t>(v.size() - 1, static_cast<size_t>(p * v.size()));
+            return v[i].count() / 1000.0;
+        };
+        auto mean = std::accumulate(v.begin(), v.end(), 0ns).count() / 1000.0 / v.size();
+        auto wall_s = r.wall.count() / 1e9;
+
+        fmt::print(
+                "{:>10}: {} round trips; RTT (µs): mean {:.1f}, p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, max {:.1f}; "
+                "CPU {:.2f}s over {:.2f}s wall ({:.0f}% of a core)\n",
+                name,
+                v.size(),
+                mean,
+                pct(0.5),
+                pct(0.9),
+                pct(0.99),
+                v.back().count() / 1000.0,
+                r.cpu.count() / 1e6,
+                wall_s,
+                100.0 * r.cpu.count() / 1e6 / wall_s);
+    }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App cli{"libQUIC request/response latency benchmark"};
+
+    std::string listen = "127.0.0.1:5500";
+    cli.add_option("--listen", listen, "Address for the in-process server to listen on")
+            ->type_name("IP:PORT")
+            ->capture_default_str();
+
+    std::string log_file, log_level;
+    add_log_opts(cli, log_file, log_level);
+
+    std::string server_key{"./serverkey.pem"}, server_cert{"./servercert.pem"};
+    std::string client_key{"./clientkey.pem"}, client_cert{"./clientcert.pem"};
+    cli.add_option("--server-key", server_key, "Path to server key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--server-cert", server_cert, "Path to server certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+    cli.add_option("--client-key", client_key, "Path to client key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--client-cert", client_cert, "Path to client certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+
+    size_t rounds = 10'000, warmup = 100, msg_size = 64;
+    cli.add_option("-n,--rounds", rounds, "Number of measured round trips")
+            ->capture_default_str()
+            ->check(CLI::Range(size_t{1}, std::numeric_limits<size_t>::max()));
+    cli.add_option("--warmup", warmup, "Number of unmeasured round trips to run first")->capture_default_str();
+    cli.add_option("-s,--size", msg_size, "Message size in bytes")->capture_default_str()->check(CLI::Range(1, 65536));
+
+    uint64_t budget_us = 0, socket_poll_us = 50;
+    cli.add_option(
+               "-b,--busy-poll",
+               budget_us,
+               "Busy-poll spin budget in microseconds.  If non-zero then a default-mode run is followed by a "
+               "busy-poll run for comparison.")
+            ->capture_default_str();
+    cli.add_option("--socket-busy-poll", socket_poll_us, "SO_BUSY_POLL value (in µs) to apply when busy polling")
+            ->capture_default_str();
+
+    bool busy_only = false;
+    cli.add_flag("--busy-only", busy_only, "Skip the default-mode comparison run");
+
+    bool unix_sock = false;
+    std::string unix_dir;
+    cli.add_flag(
+            "--unix",
+            unix_sock,
+            "Also run over the same-host Unix datagram transport for comparison with UDP over loopback");
+    cli.add_option(
+               "--unix-dir", unix_dir, "Directory for unix transport sockets; empty uses the abstract namespace")
+            ->capture_default_str();
+    bool fast_cipher = false;
+    cli.add_flag("--fast-cipher", fast_cipher, "Restrict both sides to the AES-128-GCM cipher suite");
+
+    try
+    {
+        cli.parse(argc, argv);
+    }
+    catch (const CLI::ParseError& e)
+    {
+        return cli.exit(e);
+    }
+
+    setup_logging(log_file, log_level);
+
+    auto server_tls = GNUTLSCreds::make(server_key, server_cert, client_cert);
+    auto client_tls = GNUTLSCreds::make(client_key, client_cert, server_cert);
+    if (fast_cipher)
+        server_tls->priority = client_tls->priority = GNUTLSCreds::FAST_CIPHER_PRIORITY;
+
+    if (!(busy_only && budget_us))
+    {
+        auto r = run_pingpong(opt::busy_poll{}, std::nullopt, listen, server_tls, client_tls, rounds, warmup, msg_size);
+        report("default", r);
+    }
+
+    if (unix_sock)
+    {
+        opt::unix_transport ut{unix_dir};
+        auto r = run_pingpong(opt::busy_poll{}, ut, listen, server_tls, client_tls, rounds, warmup, msg_size);
+        report("unix", r);
+    }
+
+    if (budget_us)
+    {
+        opt::busy_poll bp{std::chrono::microseconds{budget_us}, std::chrono::microseconds{socket_poll_us}};
+        std::optional<opt::unix_transport> ut;
+        if (unix_sock)
+            ut.emplace(unix_dir);
+        auto r = run_pingpong(bp, ut, listen, server_tls, client_tls, rounds, warmup, msg_size);
+        report(unix_sock ? "unix+busy" : "busy-poll", r);
+    }
+}
@@ -2,6 +2,11 @@
     Test client binary
 */
 
+extern "C"
+{
+#include <sys/resource.h>
+}
+
 #include <oxenc/endian.h>
 #include <oxenc/hex.h>
 
@@ -76,6 +81,14 @@ int main(int argc, char* argv[])
     cli.add_option("--stream-chunk-size", chunk_size, "How much data to queue at once, per chunk");
     cli.add_option("--stream-chunks", chunk_num, "How much chunks to queue at once per stream")->check(CLI::Range(1, 100));
 
+    size_t async_prefetch = 0;
+    cli.add_option(
+               "--async-chunks",
+               async_prefetch,
+               "Generate stream chunks on a worker thread (via send_chunks_async) rather than the event loop thread, "
+               "keeping up to this many chunks ready ahead of the stream.  0 generates on the event loop.")
+            ->check(CLI::Range(0, 100));
+
     size_t rng_seed = 0;
     cli.add_option(
             "--rng-seed",
@@ -93,6 +106,32 @@ int main(int argc, char* argv[])
             ->capture_default_str()
             ->check(CLI::ExistingFile);
 
+    bool connected = false;
+    cli.add_flag(
+            "--connected",
+            connected,
+            "Use a connected UDP socket for the client endpoint (so that sends need not specify the destination)");
+
+    size_t zerocopy_min = 0;
+    cli.add_option(
+            "--zerocopy",
+            zerocopy_min,
+            "Send GSO batches of at least this many bytes zero-copy (MSG_ZEROCOPY); 0 to disable.  Compare the "
+            "reported CPU per GB with and without this.");
+
+    size_t ack_thresh = 2;
+    cli.add_option(
+            "--ack-thresh",
+            ack_thresh,
+            "Number of received ack-eliciting packets that trigger an immediate ACK.  Should typically be specified on "
+            "the server as well.")
+            ->capture_default_str()
+            ->check(CLI::Range(1, 1000));
+    uint64_t max_ack_delay_ms = 25;
+    cli.add_option("--max-ack-delay", max_ack_delay_ms, "Maximum ACK delay, in milliseconds (used with --ack-thresh)")
+            ->capture_default_str()
+            ->check(CLI::Range(0, 16383));
+
     try
     {
         cli.parse(argc, argv);
@@ -220,8 +259,18 @@ int main(int argc, char* argv[])
     opt::remote_addr server_addr{server_a, server_p};
 
     log::debug(test_cat, "Calling 'client_connect'...");
-    auto client = client_net.endpoint(client_local);
-    auto client_ci = client->connect(server_addr, client_tls, on_stream_data, stream_closed);
+    std::shared_ptr<Endpoint> client;
+    if (zerocopy_min)
+        client = connected ? client_net.endpoint(client_local, opt::connected_socket{}, opt::zerocopy_send{zerocopy_min})
+                           : client_net.endpoint(client_local, opt::zerocopy_send{zerocopy_min});
+    else
+        client = connected ? client_net.endpoint(client_local, opt::connected_socket{}) : client_net.endpoint(client_local);
+    auto client_ci = client->connect(
+            server_addr,
+            client_tls,
+            on_stream_data,
+            stream_closed,
+            opt::ack_frequency{ack_thresh, std::chrono::milliseconds{max_ack_delay_ms}});
 
     auto per_stream = size / parallel;
 
@@ -273,8 +322,10 @@ int main(int argc, char* argv[])
     for (size_t i = 0; i < parallel; i++)
     {
         uint64_t my_data = per_stream + (i == 0 ? size % parallel : 0);
+        // With async chunks, up to chunk_num + async_prefetch + 1 buffers can be in use at once
+        size_t num_bufs = pregenerate ? 1 : async_prefetch ? chunk_num + async_prefetch + 1 : chunk_num;
         auto& s = *streams.emplace_back(std::make_unique<stream_data>(
-                my_data, rng_seed + i, pregenerate ? my_data : chunk_size, pregenerate ? 1 : chunk_num));
+                my_data, rng_seed + i, pregenerate ? my_data : chunk_size, num_bufs));
 
         if (pregenerate)
         {
@@ -288,7 +339,14 @@ int main(int argc, char* argv[])
         log::warning(test_cat, "Data pregeneration done");
     }
 
+    auto cpu_time = [] {
+        rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        auto tv = [](const timeval& t) { return std::chrono::seconds{t.tv_sec} + std::chrono::microseconds{t.tv_usec}; };
+        return std::chrono::duration<double>{tv(ru.ru_utime) + tv(ru.ru_stime)}.count();
+    };
     auto started_at = std::chrono::steady_clock::now();
+    auto cpu_started = cpu_time();
 
     for (size_t i = 0; i < parallel; i++)
     {
@@ -306,31 +364,33 @@ int main(int argc, char* argv[])
         }
         else
         {
-            s.stream->send_chunks(
-                    [&, i](const Stream&) -> std::vector<std::byte>* {
-                        auto& sd = *streams[i];
-                        auto& data = sd.bufs[sd.next_buf++];
-                        sd.next_buf %= sd.bufs.size();
-
-                        const auto size = std::min(sd.remaining, chunk_size);
-                        if (size == 0)
-                            return nullptr;
-
-                        gen_data(sd.rng, size, data, sd.sent_hasher, sd.checksum);
-
-                        sd.remaining -= size;
-
-                        if (sd.remaining == 0)
-                        {
-                            sd.hash.resize(32);
-                            gnutls_hash_output(sd.sent_hasher, reinterpret_cast<unsigned char*>(sd.hash.data()));
-                            sd.done_sending = true;
-                        }
-
-                        return &data;
-                    },
-                    nullptr,
-                    chunk_num);
+            auto next_chunk = [&, i]() -> std::vector<std::byte>* {
+                auto& sd = *streams[i];
+                auto& data = sd.bufs[sd.next_buf++];
+                sd.next_buf %= sd.bufs.size();
+
+                const auto size = std::min(sd.remaining, chunk_size);
+                if (size == 0)
+                    return nullptr;
+
+                gen_data(sd.rng, size, data, sd.sent_hasher, sd.checksum);
+
+                sd.remaining -= size;
+
+                if (sd.remaining == 0)
+                {
+                    sd.hash.resize(32);
+                    gnutls_hash_output(sd.sent_hasher, reinterpret_cast<unsigned char*>(sd.hash.data()));
+                    sd.done_sending = true;
+                }
+
+                return &data;
+            };
+            if (async_prefetch)
+                s.stream->send_chunks_async(std::move(next_chunk), nullptr, chunk_num, async_prefetch);
+            else
+                s.stream->send_chunks(
+                        [next_chunk = std::move(next_chunk)](const Stream&) { return next_chunk(); }, nullptr, chunk_num);
         }
     }
 
@@ -366,6 +426,17 @@ int main(int argc, char* argv[])
     auto elapsed = std::chrono::duration<double>{std::chrono::steady_clock::now() - started_at}.count();
     fmt::print("Elapsed time: {:.3f}s\n", elapsed);
     fmt::print("Speed: {:.3f}MB/s\n", size / 1'000'000.0 / elapsed);
+    // Note that this includes data generation (unless pregenerating), so use -g to compare send costs
+    auto cpu = cpu_time() - cpu_started;
+    fmt::print("CPU time: {:.3f}s ({:.3f}s per GB)\n", cpu, cpu / (size / 1e9));
+    if (zerocopy_min)
+    {
+        auto& sock = client->get_socket();
+        fmt::print(
+                "Zero-copy: {} messages sent zero-copy, {} of them copied by the kernel anyway\n",
+                sock->zerocopy_sends(),
+                sock->zerocopy_copied());
+    }
 
     client_net.close();
 
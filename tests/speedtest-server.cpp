@@ -58,6 +58,25 @@ int main(int argc, char* argv[])
             "Disable even the simple xor byte checksum (typically used together with -H).  Should be specified on the "
             "client as well.");
 
+    bool batch_recv = false;
+    cli.add_flag(
+            "-b,--batch-recv",
+            batch_recv,
+            "Enable batched stream data delivery, so that data is hashed/checksummed in larger chunks");
+
+    size_t ack_thresh = 2;
+    cli.add_option(
+            "--ack-thresh",
+            ack_thresh,
+            "Number of received ack-eliciting packets that trigger an immediate ACK.  Should typically be specified on "
+            "the client as well.")
+            ->capture_default_str()
+            ->check(CLI::Range(1, 1000));
+    uint64_t max_ack_delay_ms = 25;
+    cli.add_option("--max-ack-delay", max_ack_delay_ms, "Maximum ACK delay, in milliseconds (used with --ack-thresh)")
+            ->capture_default_str()
+            ->check(CLI::Range(0, 16383));
+
     try
     {
         cli.parse(argc, argv);
@@ -93,72 +112,82 @@ int main(int argc, char* argv[])
         ~stream_info() { gnutls_hash_deinit(hasher, nullptr); }
     };
 
-    std::unordered_map<ConnectionID, std::map<int64_t, stream_info>> csd;
+    // Per-stream state lives in the stream's user data slot, so there is no lookup per chunk.
+    struct speed_handler final : stream_handler
+    {
+        bool no_hash, no_checksum;
+        speed_handler(bool no_hash, bool no_checksum) : no_hash{no_hash}, no_checksum{no_checksum} {}
 
-    stream_data_callback_t stream_data = [&](Stream& s, bstring_view data) {
-        auto& sd = csd[s.conn.scid()];
-        auto it = sd.find(s.stream_id);
-        if (it == sd.end())
+        void on_data(Stream& s, bstring_view data) override
         {
-            if (data.size() < sizeof(uint64_t))
+            auto* info_ptr = s.user_data<stream_info>();
+            if (!info_ptr)
             {
-                log::critical(test_cat, "Well this was unexpected: I got {} < 8 bytes", data.size());
-                return;
+                if (data.size() < sizeof(uint64_t))
+                {
+                    log::critical(test_cat, "Well this was unexpected: I got {} < 8 bytes", data.size());
+                    return;
+                }
+                auto size = oxenc::load_little_to_host<uint64_t>(data.data());
+                data.remove_prefix(sizeof(uint64_t));
+                info_ptr = &s.emplace_user_data<stream_info>(size);
+                log::warning(test_cat, "First data from new stream {}, expecting {}B!", s.stream_id, size);
             }
-            auto size = oxenc::load_little_to_host<uint64_t>(data.data());
-            data.remove_prefix(sizeof(uint64_t));
-            it = sd.emplace(s.stream_id, size).first;
-            log::warning(test_cat, "First data from new stream {}, expecting {}B!", s.stream_id, size);
-        }
 
-        auto& [ignore, info] = *it;
+            auto& info = *info_ptr;
 
-        bool need_more = info.received < info.expected;
-        info.received += data.size();
-        if (info.received > info.expected)
-        {
-            log::critical(test_cat, "Received too much data ({}B > {}B)!");
-            if (!need_more)
-                return;
-            data.remove_suffix(info.received - info.expected);
-        }
+            bool need_more = info.received < info.expected;
+            info.received += data.size();
+            if (info.received > info.expected)
+            {
+                log::critical(test_cat, "Received too much data ({}B > {}B)!");
+                if (!need_more)
+                    return;
+                data.remove_suffix(info.received - info.expected);
+            }
 
-        if (!no_checksum)
-        {
-            uint64_t csum = 0;
-            const uint64_t* stuff = reinterpret_cast<const uint64_t*>(data.data());
-            for (size_t i = 0; i < data.size() / 8; i++)
-                csum ^= stuff[i];
-            for (int i = 0; i < 8; i++)
-                info.checksum ^= reinterpret_cast<const uint8_t*>(&csum)[i];
-            for (size_t i = (data.size() / 8) * 8; i < data.size(); i++)
-                info.checksum ^= static_cast<uint8_t>(data[i]);
-        }
+            if (!no_checksum)
+            {
+                uint64_t csum = 0;
+                const uint64_t* stuff = reinterpret_cast<const uint64_t*>(data.data());
+                for (size_t i = 0; i < data.size() / 8; i++)
+                    csum ^= stuff[i];
+                for (int i = 0; i < 8; i++)
+                    info.checksum ^= reinterpret_cast<const uint8_t*>(&csum)[i];
+                for (size_t i = (data.size() / 8) * 8; i < data.size(); i++)
+                    info.checksum ^= static_cast<uint8_t>(data[i]);
+            }
 
-        if (!no_hash)
-            gnutls_hash(info.hasher, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+            if (!no_hash)
+                gnutls_hash(info.hasher, reinterpret_cast<const unsigned char*>(data.data()), data.size());
 
-        if (info.received >= info.expected)
-        {
-            std::basic_string<unsigned char> final_hash;
-            final_hash.resize(33);
-            gnutls_hash_output(info.hasher, final_hash.data());
-            final_hash[32] = info.checksum;
-
-            log::warning(
-                    test_cat,
-                    "Data from stream {} complete ({} B).  Final hash: {}",
-                    s.stream_id,
-                    info.received,
-                    oxenc::to_hex(final_hash.begin(), final_hash.end()));
-
-            s.send(std::move(final_hash));
+            if (info.received >= info.expected)
+            {
+                std::basic_string<unsigned char> final_hash;
+                final_hash.resize(33);
+                gnutls_hash_output(info.hasher, final_hash.data());
+                final_hash[32] = info.checksum;
+
+                log::warning(
+                        test_cat,
+                        "Data from stream {} complete ({} B).  Final hash: {}",
+                        s.stream_id,
+                        info.received,
+                        oxenc::to_hex(final_hash.begin(), final_hash.end()));
+
+                s.send(std::move(final_hash));
+            }
         }
     };
 
     log::debug(test_cat, "Calling 'server_listen'...");
     auto _server = server_net.endpoint(server_local);
-    _server->listen(server_tls, stream_opened, stream_data);
+    _server->listen(
+            server_tls,
+            stream_opened,
+            std::make_shared<speed_handler>(no_hash, no_checksum),
+            opt::batch_stream_data{batch_recv ? opt::batch_stream_data{}.max_size : 0},
+            opt::ack_frequency{ack_thresh, std::chrono::milliseconds{max_ack_delay_ms}});
 
     for (;;)
         std::this_thread::sleep_for(10min);
@@ -0,0 +1,200 @@
+/*
+    Striped transfer benchmark: compares the time to move one logical byte stream across several
+    connections with StripedSender/StripeReceiver (each connection on its own client and server
+    Network, and so on its own pair of event loop threads) against moving the same amount of data
+    over a single connection split across --parallel streams.
+*/
+
+#include <CLI/Validators.hpp>
+#include <atomic>
+#include <future>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <quic/stripe.hpp>
+#include <thread>
+
+#include "utils.hpp"
+
+using namespace oxen::quic;
+using namespace std::literals;
+
+namespace
+{
+    void report(std::string_view name, uint64_t bytes, std::chrono::nanoseconds elapsed)
+    {
+        auto secs = elapsed.count() / 1e9;
+        fmt::print(
+                "{:>10}: {:.1f} MB in {:.3f}s = {:.1f} MB/s ({:.2f} Gbps)\n",
+                name,
+                bytes / 1e6,
+                secs,
+                bytes / 1e6 / secs,
+                bytes * 8 / 1e9 / secs);
+    }
+
+    // Returns chunks (copies of `pattern`) of a `size`-byte stream
+    struct chunk_source
+    {
+        const bstring& pattern;
+        uint64_t remaining;
+
+        bstring operator()()
+        {
+            auto n = std::min<uint64_t>(remaining, pattern.size());
+            remaining -= n;
+            return pattern.substr(0, n);
+        }
+    };
+
+    // Single connection with `parallel` streams, each sending its share of `size` bytes
+    std::chrono::nanoseconds run_parallel(
+            uint64_t size,
+            int parallel,
+            const bstring& pattern,
+            std::shared_ptr<GNUTLSCreds> server_tls,
+            std::shared_ptr<GNUTLSCreds> client_tls)
+    {
+        Network server_net{};
+        Network client_net{};
+
+        std::atomic<uint64_t> received{0};
+        std::promise<void> done_prom;
+        auto done = done_prom.get_future();
+        stream_data_callback_t on_data = [&](Stream&, bstring_view data) {
+            if ((received += data.size()) == size)
+                done_prom.set_value();
+        };
+
+        auto server = server_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        server->listen(server_tls, on_data);
+        opt::remote_addr remote{"127.0.0.1"s, server->get_socket()->address().port()};
+
+        auto client = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+        auto conn = client->connect(remote, client_tls);
+
+        std::vector<std::shared_ptr<Stream>> streams;
+        auto started = get_time();
+        for (int i = 0; i < parallel; i++)
+        {
+            auto& s = streams.emplace_back(conn->get_new_stream());
+            s->send_chunks(
+                    [src = chunk_source{pattern, size / parallel + (i == 0 ? size % parallel : 0)}](
+                            const Stream&) mutable { return src(); },
+                    nullptr,
+                    2);
+        }
+
+        if (done.wait_for(300s) != std::future_status::ready)
+            fmt::print("Timed out: only received {} of {} bytes\n", received.load(), size);
+        auto elapsed = get_time() - started;
+
+        client_net.close();
+        server_net.close();
+        return elapsed;
+    }
+
+    // `stripes` connections, each on its own client and server Network, carrying one striped stream
+    std::chrono::nanoseconds run_striped(
+            uint64_t size,
+            int stripes,
+            size_t window,
+            const bstring& pattern,
+            std::shared_ptr<GNUTLSCreds> server_tls,
+            std::shared_ptr<GNUTLSCreds> client_tls)
+    {
+        std::vector<std::unique_ptr<Network>> server_nets, client_nets;
+
+        std::promise<bool> done_prom;
+        auto done = done_prom.get_future();
+        auto receiver = StripeReceiver::make(
+                [](uint64_t, bstring_view) {},
+                [&](uint64_t, bool success) { done_prom.set_value(success); },
+                window + pattern.size());
+
+        std::vector<std::shared_ptr<connection_interface>> conns;
+        for (int i = 0; i < stripes; i++)
+        {
+            auto& snet = *server_nets.emplace_back(std::make_unique<Network>());
+            auto server = snet.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+            server->listen(server_tls, receiver);
+            opt::remote_addr remote{"127.0.0.1"s, server->get_socket()->address().port()};
+
+            auto& cnet = *client_nets.emplace_back(std::make_unique<Network>());
+            auto client = cnet.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+            conns.push_back(client->connect(remote, client_tls));
+        }
+
+        auto started = get_time();
+        auto sender = StripedSender::make(conns, chunk_source{pattern, size}, nullptr, window);
+
+        if (done.wait_for(300s) != std::future_status::ready)
+            fmt::print("Timed out: only received {} of {} bytes\n", receiver->delivered(), size);
+        else if (!done.get())
+            fmt::print("Striped transfer failed after {} of {} bytes\n", receiver->delivered(), size);
+        auto elapsed = get_time() - started;
+
+        for (auto& net : client_nets)
+            net->close();
+        for (auto& net : server_nets)
+            net->close();
+        return elapsed;
+    }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App cli{"libQUIC striped transfer benchmark"};
+
+    std::string log_file, log_level;
+    add_log_opts(cli, log_file, log_level);
+
+    std::string server_key{"./serverkey.pem"}, server_cert{"./servercert.pem"};
+    std::string client_key{"./clientkey.pem"}, client_cert{"./clientcert.pem"};
+    cli.add_option("--server-key", server_key, "Path to server key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--server-cert", server_cert, "Path to server certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+    cli.add_option("--client-key", client_key, "Path to client key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--client-cert", client_cert, "Path to client certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+
+    uint64_t size = 1'000'000'000;
+    cli.add_option("-S,--size", size, "Bytes to transfer")->capture_default_str();
+    int stripes = 4;
+    cli.add_option("-n,--stripes", stripes, "Number of connections to stripe across")
+            ->capture_default_str()
+            ->check(CLI::Range(1, 64));
+    int parallel = 4;
+    cli.add_option("-P,--parallel", parallel, "Number of streams for the single connection comparison run")
+            ->capture_default_str()
+            ->check(CLI::Range(1, 32));
+    size_t chunk_size = 256 * 1024;
+    cli.add_option("--chunk-size", chunk_size, "Size of each chunk sent")->capture_default_str();
+    size_t window = STRIPE_DEFAULT_WINDOW;
+    cli.add_option("--window", window, "Striped sender window (bytes)")->capture_default_str();
+    bool striped_only = false;
+    cli.add_flag("--striped-only", striped_only, "Skip the single connection comparison run");
+
+    try
+    {
+        cli.parse(argc, argv);
+    }
+    catch (const CLI::ParseError& e)
+    {
+        return cli.exit(e);
+    }
+
+    setup_logging(log_file, log_level);
+
+    auto server_tls = GNUTLSCreds::make(server_key, server_cert, client_cert);
+    auto client_tls = GNUTLSCreds::make(client_key, client_cert, server_cert);
+
+    bstring pattern(chunk_size, std::byte{0});
+    for (size_t i = 0; i < pattern.size(); i++)
+        pattern[i] = static_cast<std::byte>(i * 7 + 3);
+
+    if (!striped_only)
+        report("parallel-{}"_format(parallel), size, run_parallel(size, parallel, pattern, server_tls, client_tls));
+    report("striped-{}"_format(stripes), size, run_striped(size, stripes, window, pattern, server_tls, client_tls));
+}
@@ -0,0 +1,203 @@
+/*
+    TCP tunnel throughput benchmark: pushes data from a local TCP source through a TCPTunnel
+    (client tunnel -> QUIC -> server tunnel) into a local iperf-style TCP sink that discards
+    everything it receives, and compares against a direct TCP source -> sink transfer.
+*/
+
+extern "C"
+{
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <CLI/Validators.hpp>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <quic.hpp>
+#include <quic/gnutls_crypto.hpp>
+#include <quic/tunnel.hpp>
+#include <thread>
+
+#include "utils.hpp"
+
+using namespace oxen::quic;
+using namespace std::literals;
+
+namespace
+{
+    // Blocking TCP sink: accepts connections and discards data, counting received bytes.
+    struct tcp_sink
+    {
+        int fd;
+        Address addr;
+        std::atomic<uint64_t> received{0};
+        std::thread acceptor;
+        std::mutex threads_mutex;
+        std::vector<std::thread> threads;
+
+        tcp_sink()
+        {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            Address bind_addr{"127.0.0.1", 0};
+            if (fd < 0 || bind(fd, bind_addr, bind_addr.socklen()) != 0 || listen(fd, 64) != 0)
+                throw std::runtime_error{"Failed to set up TCP sink"};
+            getsockname(fd, addr, addr.socklen_ptr());
+
+            acceptor = std::thread{[this] {
+                for (;;)
+                {
+                    int c = accept(fd, nullptr, nullptr);
+                    if (c < 0)
+                        break;
+                    std::lock_guard lock{threads_mutex};
+                    threads.emplace_back([this, c] {
+                        std::vector<char> buf(256 * 1024);
+                        ssize_t n;
+                        while ((n = recv(c, buf.data(), buf.size(), 0)) > 0)
+                            received += n;
+                        ::close(c);
+                    });
+                }
+            }};
+        }
+
+        ~tcp_sink()
+        {
+            // The acceptor exits once the listening socket is shut down; the others exit once their
+            // connections close.
+            shutdown(fd, SHUT_RDWR);
+            acceptor.join();
+            ::close(fd);
+            std::lock_guard lock{threads_mutex};
+            for (auto& t : threads)
+                t.join();
+        }
+    };
+
+    // Connects to `to` and writes `size` bytes as fast as possible, then closes.
+    void tcp_source(const Address& to, uint64_t size)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, to, to.socklen()) != 0)
+            throw std::runtime_error{"TCP source failed to connect to {}"_format(to)};
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        std::vector<char> buf(256 * 1024, 'x');
+        while (size > 0)
+        {
+            auto n = send(fd, buf.data(), std::min<uint64_t>(size, buf.size()), MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            size -= n;
+        }
+        ::close(fd);
+    }
+
+    // Runs `conns` parallel sources of `size` bytes each towards `to`, returning how long it took
+    // for the sink to receive everything.
+    std::chrono::nanoseconds run(const Address& to, tcp_sink& sink, uint64_t size, int conns)
+    {
+        auto start_bytes = sink.received.load();
+        auto target = start_bytes + size * conns;
+        auto started = get_time();
+
+        std::vector<std::thread> sources;
+        for (int i = 0; i < conns; i++)
+            sources.emplace_back(tcp_source, to, size);
+
+        while (sink.received < target && get_time() - started < 120s)
+            std::this_thread::sleep_for(1ms);
+        auto elapsed = get_time() - started;
+
+        for (auto& t : sources)
+            t.join();
+
+        if (sink.received < target)
+            fmt::print("Timed out: only received {} of {} bytes\n", sink.received - start_bytes, target - start_bytes);
+        return elapsed;
+    }
+
+    void report(std::string_view name, uint64_t bytes, std::chrono::nanoseconds elapsed)
+    {
+        auto secs = elapsed.count() / 1e9;
+        fmt::print(
+                "{:>8}: {:.1f} MB in {:.3f}s = {:.1f} MB/s ({:.2f} Gbps)\n",
+                name,
+                bytes / 1e6,
+                secs,
+                bytes / 1e6 / secs,
+                bytes * 8 / 1e9 / secs);
+    }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    CLI::App cli{"libQUIC TCP tunnel throughput benchmark"};
+
+    std::string log_file, log_level;
+    add_log_opts(cli, log_file, log_level);
+
+    std::string server_key{"./serverkey.pem"}, server_cert{"./servercert.pem"};
+    std::string client_key{"./clientkey.pem"}, client_cert{"./clientcert.pem"};
+    cli.add_option("--server-key", server_key, "Path to server key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--server-cert", server_cert, "Path to server certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+    cli.add_option("--client-key", client_key, "Path to client key")->capture_default_str()->check(CLI::ExistingFile);
+    cli.add_option("--client-cert", client_cert, "Path to client certificate")
+            ->capture_default_str()
+            ->check(CLI::ExistingFile);
+
+    uint64_t size = 100'000'000;
+    cli.add_option("-S,--size", size, "Bytes to send over each TCP connection")->capture_default_str();
+    int conns = 1;
+    cli.add_option("-n,--connections", conns, "Number of parallel TCP connections")
+            ->capture_default_str()
+            ->check(CLI::Range(1, 64));
+    bool tunnel_only = false;
+    cli.add_flag("--tunnel-only", tunnel_only, "Skip the direct (untunnelled) TCP comparison run");
+
+    try
+    {
+        cli.parse(argc, argv);
+    }
+    catch (const CLI::ParseError& e)
+    {
+        return cli.exit(e);
+    }
+
+    setup_logging(log_file, log_level);
+
+    tcp_sink sink;
+
+    if (!tunnel_only)
+        report("direct", size * conns, run(sink.addr, sink, size, conns));
+
+    Network server_net{};
+    Network client_net{};
+
+    auto server_tls = GNUTLSCreds::make(server_key, server_cert, client_cert);
+    auto client_tls = GNUTLSCreds::make(client_key, client_cert, server_cert);
+
+    auto server_tunnel = TCPTunnel::server(server_net, sink.addr);
+    auto server = server_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+    server->listen(server_tls, server_tunnel);
+    opt::remote_addr server_remote{"127.0.0.1"s, server->get_socket()->address().port()};
+
+    auto client = client_net.endpoint(opt::local_addr{"127.0.0.1"s, 0});
+    auto conn = client->connect(server_remote, client_tls);
+    auto client_tunnel = TCPTunnel::client(client_net, conn, Address{"127.0.0.1"s, 0});
+
+    report("tunnel", size * conns, run(client_tunnel->tcp_address(), sink, size, conns));
+
+    client_tunnel->close();
+    server_tunnel->close();
+    client_net.close();
+    server_net.close();
+}